@@ -23,6 +23,7 @@ Possible options are:
     Relative paths are relative to the current directory.
 -o followed by a directory: optionally clean directory and build all artefacts there.
     Relative paths are relative to the destination'"'"'s top metamath-exe directory.
+-p compile a metamath_bench executable for microbenchmarks
 -t compile a metamath_test executable for regression tests
 -v extract the version from metamath sources, print it and exit'
 
@@ -33,6 +34,7 @@ do_clean=0
 do_doc=0
 debug=0
 do_make_test=0
+do_make_bench=0
 print_help=0
 version_only=0
 version_for_autoconf=0
@@ -40,7 +42,7 @@ unset dest_dir
 unset doc_dir
 top_dir="$(pwd)"
 
-while getopts abcdghm:o:tv flag
+while getopts abcdghm:o:ptv flag
 do
   case "${flag}" in
     a) version_for_autoconf=1;;
@@ -51,6 +53,7 @@ do
     h) print_help=1;;
     m) cd "${OPTARG}" && top_dir=$(pwd);;
     o) dest_dir=${OPTARG};;
+    p) do_make_bench=1;;
     t) do_make_test=1;;
     v) version_only=1;;
     *) echo "unknown parameter" >&2
@@ -142,6 +145,11 @@ then
   # create an executable running regression tests
   make "CFLAGS=-DTEST_ENABLE"
   mv src/metamath "$top_dir"/metamath_test
+elif [ $do_make_bench -eq 1 ]
+then
+  # create an executable running microbenchmarks
+  make "CFLAGS=-O2 -DBENCH_ENABLE"
+  mv src/metamath "$top_dir"/metamath_bench
 else
   # normal executable
   make
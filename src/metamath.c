@@ -712,6 +712,7 @@
 #include "mmwtex.h"
 #include "mmfatl.h"
 #include "mmtest.h"
+#include "mmbench.h"
 
 void command(int argc, char *argv[]);
 
@@ -738,6 +739,11 @@ int main(int argc, char *argv[]) {
   // you never get here
 #endif
 
+#ifdef BENCH_ENABLE // enable this via './build.sh -p'
+  RUN_BENCHMARKS(MVERSION, argc, argv);
+  // you never get here
+#endif
+
   // ******** If g_listMode is set to 1 here, the startup will be Text
   //          Tools utilities, and Metamath will be disabled *********
 
@@ -923,6 +929,9 @@ void command(int argc, char *argv[]) {
   double timeTotal = 0;
   double timeIncr = 0;
   flag printTime; // Set by "/ TIME" in SAVE PROOF and others
+  // For SET PROFILE:  the command being profiled and its start
+  vstring_def(profileCommand);
+  struct profileMark_struct profileCommandMark;
 
   flag defaultScrollMode = 1; // Default to prompted mode
 
@@ -989,6 +998,28 @@ void command(int argc, char *argv[]) {
 
     g_midiFlag = 0; // Initialize here in case SHOW PROOF exits early
 
+    if (profileCommand[0]) { // The previous command is complete
+      if (g_profileFlag) {
+        profileRecord('c', profileCommand, &profileCommandMark);
+        // Where the Proof Assistant's search effort went
+        if (g_unifCandidates || g_quickMatchRejects || g_unifBacktracks) {
+          print2("Search:  %ld candidates tried, %ld quick filter rejects,"
+              " %ld timeouts,\n", g_unifCandidates, g_quickMatchRejects,
+              g_unifTimeouts);
+          print2("    %ld unification backtracks, %ld Henty filter rejects.\n",
+              g_unifBacktracks, g_hentyRejects);
+        }
+      }
+      free_vstring(profileCommand);
+    }
+    g_pfasDeadline = 0; // A / BUDGET applies only to its command
+    // The search statistics are per command
+    g_unifCandidates = 0;
+    g_quickMatchRejects = 0;
+    g_unifBacktracks = 0;
+    g_hentyRejects = 0;
+    g_unifTimeouts = 0;
+
     if (g_memoryStatus) {
       // ??? Change to user-friendly message
       print2("Memory:  string %ld xxxString %ld\n",db,db3);
@@ -1141,6 +1172,29 @@ void command(int argc, char *argv[]) {
       }
     }
 
+    if (g_profileFlag && !cmdMatches("SET PROFILE")
+        && !cmdMatches("SHOW PROFILE")) {
+      // Profile the command until we are back at the prompt
+      k = pntrLen(g_fullArg);
+      for (i = 0; i < k; i++) {
+        let(&profileCommand, cat(profileCommand, i ? " " : "", g_fullArg[i],
+            NULL));
+      }
+      profileMark(&profileCommandMark);
+    }
+
+    if (g_serveMode && g_commandFileNestingLevel == 0 && !g_toolsMode
+        && !g_logFileOpenFlag && !g_texFileOpenFlag
+        && (cmdMatches("SHOW") || cmdMatches("SEARCH")
+            || cmdMatches("VERIFY") || cmdMatches("HELP"))) {
+      // These commands don't change the database, so a worker process can
+      // answer the request while other SERVE / SOCKET clients are served.
+      // (Not while a LOG or TeX file is open, since the worker's output to
+      // it would be lost, nor for a command from a SUBMIT file, since the
+      // server and the worker would both go on reading the rest of the file.)
+      if (serveFork()) continue;
+    }
+
     if (cmdMatches("BEEP") || cmdMatches("B")) {
       // Print a bell (if user types ahead "B", the bell lets him know when
       // his command is finished - useful for long-running commands.
@@ -1268,6 +1322,8 @@ void command(int argc, char *argv[]) {
           g_logFileOpenFlag = 0;
         }
 
+        serveStop(); // Reply to a SERVE client's EXIT
+
         // Free remaining allocations before exiting
         freeCommandLine();
         freeInOu();
@@ -1278,11 +1334,22 @@ void command(int argc, char *argv[]) {
         free_vstring(g_commandLine);
         free_vstring(g_input_fn);
         free_vstring(g_contributorName);
+        free_vstring(profileCommand);
 
         return; // Exit from program
       }
     }
 
+    if (cmdMatches("SERVE")) {
+      if (g_serveMode) {
+        print2("?SERVE is already in effect.\n");
+        continue;
+      }
+      i = switchPos("SOCKET");
+      serveStart(i ? g_fullArg[i + 1] : "");
+      continue;
+    }
+
     if (cmdMatches("SUBMIT")) {
       if (g_commandFileNestingLevel == MAX_COMMAND_FILE_NESTING) {
         printf("?The SUBMIT nesting level has been exceeded.\n");
@@ -2043,6 +2110,19 @@ void command(int argc, char *argv[]) {
       // We can't use 'statements > 0' for the test since the source
       // could be just a comment.
       if (g_sourceHasBeenRead == 1) {
+        if (switchPos("INCREMENTAL") && !strcmp(g_input_fn, g_fullArg[1])) {
+          if (g_sourceChanged) {
+            print2("?You have not saved changes to the source.  %s\n",
+                "Use WRITE SOURCE to save them or ERASE to discard them.");
+            continue;
+          }
+          if (rereadInput()) {
+            // Statement numbers may have changed
+            g_showStatement = 0;
+            g_proveStatement = 0;
+          }
+          continue;
+        }
         printLongLine(cat(
             "?Sorry, reading of more than one source file is not allowed.  ",
             "The file \"", g_input_fn, "\" has already been READ in.  ",
@@ -2063,9 +2143,10 @@ void command(int argc, char *argv[]) {
       readInput();
 
       if (switchPos("VERIFY")) {
-        verifyProofs("*",1); // Parse and verify
+        verifyProofs("*", 1, 0, ""); // Parse and verify
       } else {
-        // verifyProofs("*",0); // Parse only (for gross error checking)
+        // Parse only (for gross error checking)
+        // verifyProofs("*", 0, 0, "");
       }
 
       if (g_sourceHasBeenRead == 1) {
@@ -3146,6 +3227,14 @@ void command(int argc, char *argv[]) {
       print2(
     "(SET UNIFICATION_TIMEOUT...) The unification timeout parameter is %ld.\n",
           g_userMaxUnifTrials);
+      if (g_userMaxUnifSeconds) {
+        print2(
+"(SET UNIFICATION_TIMEOUT... / SECONDS) A unification may take %ld s.\n",
+            g_userMaxUnifSeconds);
+      } else {
+        print2(
+"(SET UNIFICATION_TIMEOUT... / SECONDS) A unification has no time limit.\n");
+      }
       print2(
     "(SET SEARCH_LIMIT...) The SEARCH_LIMIT for the IMPROVE command is %ld.\n",
           g_userMaxProveFloat);
@@ -3163,6 +3252,26 @@ void command(int argc, char *argv[]) {
         print2(
              "(SET JEREMY_HENTY_FILTER...) The Henty filter is turned OFF.\n");
       }
+      if (g_mathCacheMax > 0) {
+        print2(
+          "(SET MATH_CACHE...) The math cache size is %ld (%ld hits, %ld misses).\n",
+            g_mathCacheMax, g_mathCacheHits, g_mathCacheMisses);
+      } else {
+        print2("(SET MATH_CACHE...) The math typesetting cache is OFF.\n");
+      }
+      if (g_stepSharing) {
+        print2(
+          "(SET STEP_SHARING...) Step sharing is ON (%ld strings, %ld steps reused).\n",
+            stepSharingStrings(), g_stepShareHits);
+      } else {
+        print2("(SET STEP_SHARING...) Step sharing is OFF.\n");
+      }
+      if (g_profileFlag) {
+        print2("(SET PROFILE...) Profiling is %s; see SHOW PROFILE.\n",
+            g_profileFlag == 2 ? "ON with STATEMENTS" : "ON");
+      } else {
+        print2("(SET PROFILE...) Profiling is OFF.\n");
+      }
       if (g_showStatement) {
         print2("(SHOW...) The default statement for SHOW commands is \"%s\".\n",
             g_Statement[g_showStatement].labelName);
@@ -3187,6 +3296,13 @@ void command(int argc, char *argv[]) {
  "sizeof(short)=%ld, sizeof(int)=%ld, sizeof(long)=%ld, sizeof(size_t)=%ld.\n",
         (long)(sizeof(short)),
         (long)(sizeof(int)), (long)(sizeof(long)), (long)(sizeof(size_t)));
+#ifdef NMBRSTRING_INT32
+      print2("Math strings and proofs use %ld-bit numbers.\n",
+          (long)(8 * sizeof(nmbrString)));
+#endif
+#ifdef VSTRING_HEADER
+      print2("Text strings keep their length and capacity in a header.\n");
+#endif
       continue;
     }
 
@@ -3198,6 +3314,12 @@ void command(int argc, char *argv[]) {
       } else {
         print2("%ld bytes of memory are free.\n",i);
       }
+      showPoolStats();
+      continue;
+    }
+
+    if (cmdMatches("SHOW PROFILE")) {
+      showProfile(switchPos("JSON") != 0);
       continue;
     }
 
@@ -3635,6 +3757,16 @@ void command(int argc, char *argv[]) {
           }
           print2("The proof source for \"%s\" has %ld characters.\n",
               g_Statement[g_showStatement].labelName, n);
+          g_outputToString = 1; // Suppress error messages
+          parseProof(g_showStatement);
+          g_outputToString = 0; // Restore to normal output
+          free_vstring(g_printString); // Clear out the stored error messages
+          if (g_WrkProof.errorSeverity <= 1) {
+            // Get the uncompressed length without uncompressing it
+            print2("Its %ld steps would be %.15g steps uncompressed.\n",
+                nmbrLen(g_WrkProof.proofString),
+                nmbrGetUnsquishedLen(g_WrkProof.proofString));
+          }
           continue;
         }
 
@@ -3671,6 +3803,10 @@ void command(int argc, char *argv[]) {
             if (fastFlag) {
               // Use the proof as is
               nmbrLet(&nmbrSaveProof, g_WrkProof.proofString);
+            } else if (switchPos("PACKED") || switchPos("COMPRESSED")) {
+              // It will be repacked below; nmbrSquishProof() doesn't need
+              // it uncompressed first (which may be exponentially longer)
+              nmbrLet(&nmbrSaveProof, g_WrkProof.proofString);
             } else {
               // Make sure the proof is uncompressed
               nmbrLet(&nmbrSaveProof, nmbrUnsquishProof(g_WrkProof.proofString));
@@ -3776,6 +3912,7 @@ void command(int argc, char *argv[]) {
                 }
                 // Set flag that this is not the original source
                 g_Statement[outStatement].labelSectionChanged = 1;
+                eraseSectionOutline(); // Rebuild on next use
                 g_Statement[outStatement].labelSectionLen = (long)strlen(str3);
                 // We do a direct assignment instead of let(&...) because
                 // labelSectionPtr may point to the middle of the giant input
@@ -3802,7 +3939,7 @@ void command(int argc, char *argv[]) {
 
             // Add an initial \n which will go after the "$=" and the
             // beginning of the proof.
-            let(&g_printString, cat("\n", g_printString, NULL));
+            setPrintString(cat("\n", g_printString, NULL));
             if (g_Statement[outStatement].proofSectionChanged == 1) {
               // Deallocate old proof if not original source
               free_vstring(str1); // Deallocate any previous str1 content
@@ -4010,6 +4147,14 @@ void command(int argc, char *argv[]) {
     if (cmdMatches("DBG")) {
       print2("DEBUGGING MODE IS FOR DEVELOPER'S USE ONLY!\n");
       print2("Argument:  %s\n", g_fullArg[1]);
+      if (!strcmp(edit(g_fullArg[1], 32), "PARSE_BENCH")) {
+        if (!g_sourceHasBeenRead) {
+          print2("?No source file has been read in.  Use READ first.\n");
+        } else {
+          benchCompressedProofs();
+        }
+        continue;
+      }
       nmbrLet(&nmbrTmp, parseMathTokens(g_fullArg[1], g_proveStatement));
       for (j = 0; j < 3; j++) {
         print2("Trying depth %ld\n", j);
@@ -4608,7 +4753,7 @@ void command(int argc, char *argv[]) {
       }
 
       // Get the subproof at step s
-      q = subproofLen(g_ProofInProgress.proof, step - 1);
+      q = pipSubproofLen(step - 1);
       deleteSubProof(step - 1);
       addSubProof(nmbrTmpPtr, step - q);
 
@@ -4700,6 +4845,10 @@ void command(int argc, char *argv[]) {
       if (switchPos("3")) searchAlg = 3;
       searchUnkSubproofs = 0;
       if (switchPos("SUBPROOFS")) searchUnkSubproofs = 1;
+      i = switchPos("BUDGET");
+      if (i && val(g_fullArg[i + 1]) > 0) {
+        g_pfasDeadline = getWallTime() + val(g_fullArg[i + 1]);
+      }
 
       mathboxFlag = (switchPos("INCLUDE_MATHBOXES") != 0);
       assignMathboxInfo(); // In case it hasn't been assigned yet
@@ -4724,7 +4873,7 @@ void command(int argc, char *argv[]) {
         m = nmbrLen(g_ProofInProgress.proof); // Original proof length
 
         // Get the subproof at step s
-        q = subproofLen(g_ProofInProgress.proof, s - 1);
+        q = pipSubproofLen(s - 1);
         nmbrLet(&nmbrTmp, nmbrSeg(g_ProofInProgress.proof, s - q + 1, s));
 
         // ???Shouldn't this be just known?
@@ -4770,6 +4919,9 @@ void command(int argc, char *argv[]) {
           }
           if (!nmbrLen(nmbrTmpPtr)) {
             print2("A proof for step %ld was not found.\n", s);
+            if (pfasTimeUp()) {
+              print2("The search was stopped when the / BUDGET ran out.\n");
+            }
             // REPLACE algorithm also failed
             continue;
           }
@@ -4851,6 +5003,7 @@ void command(int argc, char *argv[]) {
           m = nmbrLen(g_ProofInProgress.proof); // Original proof length
 
           for (s = m; s > 0; s--) {
+            if (pfasTimeUp()) break;
 
             proofStepUnk = ((g_ProofInProgress.proof)[s - 1] == -(long)'?')
                 ? 1 : 0;
@@ -4867,7 +5020,7 @@ void command(int argc, char *argv[]) {
             }
 
             // Get the subproof at step s
-            q = subproofLen(g_ProofInProgress.proof, s - 1);
+            q = pipSubproofLen(s - 1);
             if (proofStepUnk && q != 1) bug(1120); // Consistency check
             nmbrLet(&nmbrTmp, nmbrSeg(g_ProofInProgress.proof, s - q + 1, s));
 
@@ -4950,6 +5103,11 @@ void command(int argc, char *argv[]) {
             break; // Proof is complete
           }
 
+          if (pfasTimeUp()) {
+            print2("The search was stopped when the / BUDGET ran out.\n");
+            break;
+          }
+
           if (searchAlg == 1) break; // Old algorithm does just 1st pass
         } // Next improveAllIter
 
@@ -4997,6 +5155,10 @@ void command(int argc, char *argv[]) {
       if (switchPos("TIME") != 0) {
         printTime = 1;
       }
+      i = switchPos("BUDGET");
+      if (i && val(g_fullArg[i + 1]) > 0) {
+        g_pfasDeadline = getWallTime() + val(g_fullArg[i + 1]);
+      }
       if (printTime == 1) {
         getRunTime(&timeIncr); // This call just resets the time
       }
@@ -5105,6 +5267,8 @@ void command(int argc, char *argv[]) {
           if (!g_proofChangedFlag) break;
           // If only one statement was specified, don't bother with rev pass
           if (!hasWildCard) break;
+          // If the time is up, keep the forward pass
+          if (pfasTimeUp()) break;
           print2("Scanning backward through statements...\n");
           forwFlag = 0;
           // Save proof and length from 1st pass; re-initialize
@@ -5124,6 +5288,7 @@ void command(int argc, char *argv[]) {
         for (k = forwFlag ? 1 : (g_proveStatement - 1);
              k * (forwFlag ? 1 : -1) < (forwFlag ? g_proveStatement : 0);
              k = k + (forwFlag ? 1 : -1)) {
+          if (pfasTimeUp()) break;
           if (!mathboxFlag && k >= g_mathboxStmt && k < thisMathboxStartStmt) {
             continue;
           }
@@ -5481,6 +5646,9 @@ void command(int argc, char *argv[]) {
         }
       } // next forwRevPass
 
+      if (pfasTimeUp()) {
+        print2("The scan was stopped when the / BUDGET ran out.\n");
+      }
       if (prntStatus == 1 && !mayGrowFlag)
         print2("No shorter proof was found.\n");
       if (prntStatus == 1 && mayGrowFlag)
@@ -5654,7 +5822,7 @@ void command(int argc, char *argv[]) {
         if ((g_ProofInProgress.proof)[s - 1] == -(long)'?') continue; // Unknown
 
         // Get the subproof length at step s
-        q = subproofLen(g_ProofInProgress.proof, s - 1);
+        q = pipSubproofLen(s - 1);
 
         deleteSubProof(s - 1);
 
@@ -6003,6 +6171,47 @@ void command(int argc, char *argv[]) {
       continue;
     }
 
+    if (cmdMatches("SET STEP_SHARING")) {
+      if (cmdMatches("SET STEP_SHARING ON")) {
+        print2("Proof verification will share equal step results.\n");
+        g_stepSharing = 1;
+      } else {
+        print2("Proof verification will no longer share step results.\n");
+        g_stepSharing = 0;
+        eraseStepSharing();
+      }
+      g_stepShareHits = 0;
+      continue;
+    }
+
+    if (cmdMatches("SET PROFILE")) {
+      profileClear();
+      if (cmdMatches("SET PROFILE OFF")) {
+        g_profileFlag = 0;
+        print2("Profiling has been turned off.\n");
+      } else if (cmdMatches("SET PROFILE STATEMENTS")) {
+        g_profileFlag = 2;
+        print2(
+"Commands, READ phases, and statements of VERIFY PROOF will be profiled.\n");
+      } else {
+        g_profileFlag = 1;
+        print2("Commands and READ phases will be profiled.\n");
+      }
+      continue;
+    }
+
+    if (cmdMatches("SET MATH_CACHE")) {
+      s = (long)val(g_fullArg[2]); // Number of entries
+      if (s < 0) s = 0;
+      print2("Math typesetting cache size has been changed from %ld to %ld.\n",
+          g_mathCacheMax, s);
+      eraseMathCache(); // The hash table depends on the size
+      g_mathCacheMax = s;
+      g_mathCacheHits = 0;
+      g_mathCacheMisses = 0;
+      continue;
+    }
+
     if (cmdMatches("SET WIDTH")) {
       s = (long)val(g_fullArg[2]); // Screen width value
 
@@ -6103,6 +6312,12 @@ void command(int argc, char *argv[]) {
 
     if (cmdMatches("SET UNIFICATION_TIMEOUT")) {
       s = (long)val(g_fullArg[2]); // Timeout value
+      if (switchPos("SECONDS")) {
+        print2("Unification time limit has been changed from %ld to %ld s%s\n",
+            g_userMaxUnifSeconds, s, s ? "" : " (no limit)");
+        g_userMaxUnifSeconds = s;
+        continue;
+      }
       print2("Unification timeout has been changed from %ld to %ld\n",
           g_userMaxUnifTrials,s);
       g_userMaxUnifTrials = s;
@@ -6317,11 +6532,12 @@ void command(int argc, char *argv[]) {
     }
 
     if (cmdMatches("VERIFY PROOF")) {
-      if (switchPos("SYNTAX_ONLY")) {
-        verifyProofs(g_fullArg[2],0); // Parse only
-      } else {
-        verifyProofs(g_fullArg[2],1); // Parse and verify
-      }
+      i = switchPos("STATS");
+      j = i ? (long)val(g_fullArg[i + 1]) : 0; // Slowest statements to show
+      k = switchPos("CSV");
+      verifyProofs(g_fullArg[2],
+          switchPos("SYNTAX_ONLY") == 0, // 0 = parse only
+          j, k ? g_fullArg[k + 1] : "");
       continue;
     }
 
@@ -6332,13 +6548,20 @@ void command(int argc, char *argv[]) {
       l = switchPos("UNDERSCORE_SKIP") == 0;
       m = switchPos("MATHBOX_SKIP") == 0;
       n = switchPos("VERBOSE") != 0;
+      p = switchPos("THREADS");
+      if (p != 0) {
+        p = (long)val(g_fullArg[p + 1]); // Number of worker processes
+      } else {
+        p = 1;
+      }
       verifyMarkup(g_fullArg[2],
           (flag)i, // 1 = check date consistency
           (flag)j, // 1 = check top date
           (flag)k, // 1 = check external files (gifs and bib)
           (flag)l, // 1 = check labels for underscores
           (flag)m, // 1 = check mathbox cross-references
-          (flag)n); // 1 = verbose mode
+          (flag)n, // 1 = verbose mode
+          p); // Number of worker processes
       continue;
     }
 
@@ -0,0 +1,538 @@
+/*****************************************************************************/
+/*        Copyright (C) 2026  metamath-exe contributors                      */
+/*            License terms:  GNU General Public License                     */
+/*****************************************************************************/
+/*34567890123456 (79-character line to adjust editor window) 2345678901234567*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mmbench.h"
+
+/*!
+ * \file mmbench.c microbenchmarks of the core primitives (see mmbench.h)
+ */
+
+#ifdef BENCH_ENABLE
+
+#include "mmvstr.h"
+#include "mmdata.h"
+#include "mminou.h"
+#include "mmcmdl.h"
+#include "mmcmds.h"
+#include "mmpars.h"
+#include "mmpfas.h"
+#include "mmunif.h"
+#include "mmveri.h"
+
+/*! Minimum CPU time in seconds each benchmark is repeated for */
+#define BENCH_MIN_TIME 0.25
+
+/*! Seed of the pseudo-random inputs, fixed so that runs are comparable */
+#define BENCH_SEED 20260101UL
+
+/*! The synthetic database, written to the current directory and deleted
+    after it has been read */
+#define BENCH_DB_FILE "metamath_bench.mm"
+
+/*! Number of ordinary theorems in the synthetic database */
+#define BENCH_THEOREMS 300
+
+#define BENCH_VARS 8
+#define BENCH_MAX_NODES 100000
+
+static unsigned long benchState = BENCH_SEED;
+
+// Pseudo-random number in 0..n-1.  This is a linear congruential generator
+// of its own, so the inputs do not depend on the C library.
+static long benchRandom(long n) {
+  benchState = (benchState * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+  return (long)((benchState >> 8) % (unsigned long)n);
+}
+
+//***** Synthetic formulas *****
+
+// Formulas of the synthetic database are kept as a DAG, so that larger
+// formulas share subformulas the way real proofs do.  Nodes 0 to
+// BENCH_VARS - 1 are the variables.
+static const char *benchVarName[BENCH_VARS] =
+    {"ph", "ps", "ch", "th", "ta", "et", "ze", "si"};
+static struct benchNode_struct {
+  char type; // 'v' variable, 'n' negation, 'i' implication
+  long left, right; // Subformulas, or the variable number
+  long size; // Number of math tokens
+  long varMask; // Variables occurring
+  flag hasNeg, hasImp; // Connectives occurring
+} benchNode[BENCH_MAX_NODES];
+static long benchNodes = 0;
+
+static long benchNewNode(char type, long left, long right) {
+  struct benchNode_struct *node = &benchNode[benchNodes];
+  if (benchNodes >= BENCH_MAX_NODES) bug(2701);
+  node->type = type;
+  node->left = left;
+  node->right = right;
+  if (type == 'v') {
+    node->size = 1;
+    node->varMask = 1L << left;
+    node->hasNeg = 0;
+    node->hasImp = 0;
+  } else if (type == 'n') {
+    node->size = 1 + benchNode[left].size;
+    node->varMask = benchNode[left].varMask;
+    node->hasNeg = 1;
+    node->hasImp = benchNode[left].hasImp;
+  } else {
+    node->size = 3 + benchNode[left].size + benchNode[right].size;
+    node->varMask = benchNode[left].varMask | benchNode[right].varMask;
+    node->hasNeg = benchNode[left].hasNeg || benchNode[right].hasNeg;
+    node->hasImp = 1;
+  }
+  return benchNodes++;
+}
+
+// Build a random formula of at most size tokens
+static long benchFormula(long size) {
+  long node, left;
+  if (size >= 4 && benchNodes > BENCH_VARS && !benchRandom(3)) {
+    // Reuse an earlier subformula of about the requested size
+    node = BENCH_VARS + benchRandom(benchNodes - BENCH_VARS);
+    if (benchNode[node].size <= size && 2 * benchNode[node].size > size) {
+      return node;
+    }
+  }
+  if (size < 2) return benchRandom(BENCH_VARS);
+  if (size < 5 || !benchRandom(5)) {
+    return benchNewNode('n', benchFormula(size - 1), 0);
+  }
+  left = 1 + benchRandom(size - 4);
+  return benchNewNode('i', benchFormula(left), benchFormula(size - 3 - left));
+}
+
+static void benchWriteMath(FILE *f, long node) {
+  switch (benchNode[node].type) {
+    case 'v':
+      fprintf(f, "%s ", benchVarName[benchNode[node].left]);
+      break;
+    case 'n':
+      fprintf(f, "-. ");
+      benchWriteMath(f, benchNode[node].left);
+      break;
+    default:
+      fprintf(f, "( ");
+      benchWriteMath(f, benchNode[node].left);
+      fprintf(f, "-> ");
+      benchWriteMath(f, benchNode[node].right);
+      fprintf(f, ") ");
+  }
+}
+
+// Numbers of the mandatory hypotheses and labels of the compressed proof
+// being written, and its output column
+static long benchHypNumber[BENCH_VARS];
+static long benchWnNumber, benchWiNumber;
+static long benchColumn;
+
+// Write step number n in compressed proof notation
+static void benchWriteNumber(FILE *f, long n) {
+  char letters[20];
+  int i = 19;
+  letters[i] = 0;
+  letters[--i] = (char)('A' + (n - 1) % 20);
+  n = (n - 1) / 20;
+  while (n > 0) {
+    letters[--i] = (char)('U' + (n - 1) % 5);
+    n = (n - 1) / 5;
+  }
+  if (benchColumn + 19 - i > 79) {
+    fprintf(f, "\n     ");
+    benchColumn = 5;
+  }
+  fprintf(f, "%s", letters + i);
+  benchColumn += 19 - i;
+}
+
+static void benchWriteProof(FILE *f, long node) {
+  switch (benchNode[node].type) {
+    case 'v':
+      benchWriteNumber(f, benchHypNumber[benchNode[node].left]);
+      break;
+    case 'n':
+      benchWriteProof(f, benchNode[node].left);
+      benchWriteNumber(f, benchWnNumber);
+      break;
+    default:
+      benchWriteProof(f, benchNode[node].left);
+      benchWriteProof(f, benchNode[node].right);
+      benchWriteNumber(f, benchWiNumber);
+  }
+}
+
+// Write theorem label:  |- ( x -> ( y -> x ) ), with a compressed proof by
+// ax-1
+static void benchWriteTheorem(FILE *f, const char *label, long x, long y) {
+  long var, n = 0;
+  long varMask = benchNode[x].varMask | benchNode[y].varMask;
+  // The mandatory hypotheses are the variables in declaration order
+  for (var = 0; var < BENCH_VARS; var++) {
+    if (varMask & (1L << var)) benchHypNumber[var] = ++n;
+  }
+  fprintf(f, "%s $p |- ( ", label);
+  benchWriteMath(f, x);
+  fprintf(f, "-> ( ");
+  benchWriteMath(f, y);
+  fprintf(f, "-> ");
+  benchWriteMath(f, x);
+  fprintf(f, ") ) $=\n    ( ");
+  if (benchNode[x].hasNeg || benchNode[y].hasNeg) {
+    benchWnNumber = ++n;
+    fprintf(f, "wn ");
+  }
+  if (benchNode[x].hasImp || benchNode[y].hasImp) {
+    benchWiNumber = ++n;
+    fprintf(f, "wi ");
+  }
+  fprintf(f, "ax-1 ) ");
+  benchColumn = 14;
+  benchWriteProof(f, x);
+  benchWriteProof(f, y);
+  benchWriteNumber(f, n + 1);
+  fprintf(f, " $.\n");
+}
+
+//***** The database *****
+
+// Statements and strings of the synthetic database used by the benchmarks
+static long benchAx1, benchAxMp, benchBig;
+static long benchBigX, benchBigY; // Subformulas of benchBig
+static nmbrString_def(benchUnifyScheme); // ax-1 with unknown variables
+static nmbrString_def(benchMpScheme); // ax-mp hypotheses for assignVar()
+static nmbrString_def(benchMpInstance);
+static nmbrString_def(benchBigProof); // Normal proof of benchBig
+
+// Write and read the synthetic database
+static void benchReadDatabase(void) {
+  FILE *f;
+  long i, var;
+  vstring_def(label);
+
+  f = fopen(BENCH_DB_FILE, "w");
+  if (!f) {
+    fprintf(stderr, "?Could not write \"%s\".\n", BENCH_DB_FILE);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f, "$( Synthetic database of metamath_bench $)\n");
+  fprintf(f, "$c ( ) -> -. wff |- $.\n$v");
+  for (var = 0; var < BENCH_VARS; var++) {
+    fprintf(f, " %s", benchVarName[var]);
+  }
+  fprintf(f, " $.\n");
+  for (var = 0; var < BENCH_VARS; var++) {
+    fprintf(f, "w%s $f wff %s $.\n", benchVarName[var], benchVarName[var]);
+    benchNewNode('v', var, 0);
+  }
+  fprintf(f, "wn $a wff -. ph $.\n");
+  fprintf(f, "wi $a wff ( ph -> ps ) $.\n");
+  fprintf(f, "${\n  min $e |- ph $.\n  maj $e |- ( ph -> ps ) $.\n"
+      "  ax-mp $a |- ps $.\n$}\n");
+  fprintf(f, "ax-1 $a |- ( ph -> ( ps -> ph ) ) $.\n");
+  for (i = 1; i <= BENCH_THEOREMS; i++) {
+    let(&label, cat("bench", str((double)i), NULL));
+    benchWriteTheorem(f, label, benchFormula(5 + benchRandom(200)),
+        benchFormula(5 + benchRandom(100)));
+  }
+  benchBigX = benchFormula(4000);
+  benchBigY = benchFormula(2000);
+  benchWriteTheorem(f, "benchbig", benchBigX, benchBigY);
+  fclose(f);
+
+  let(&g_input_fn, BENCH_DB_FILE);
+  g_outputToString = 1; // Keep the messages of READ off stdout
+  readInput();
+  g_outputToString = 0;
+  remove(BENCH_DB_FILE);
+  if (!g_sourceHasBeenRead || g_errorCount) {
+    fprintf(stderr, "%s?The synthetic database has errors.\n", g_printString);
+    exit(EXIT_FAILURE);
+  }
+  free_vstring(g_printString);
+  free_vstring(label);
+
+  benchAx1 = lookupLabel("ax-1");
+  benchAxMp = lookupLabel("ax-mp");
+  benchBig = lookupLabel("benchbig");
+  if (benchAx1 < 0 || benchAxMp < 0 || benchBig < 0) bug(2702);
+} // benchReadDatabase
+
+// Prepare the inputs of unify(), assignVar() and compressProof()
+static void benchPrepare(void) {
+  long i, j, hyp;
+  nmbrString *math; // Pointer only
+  nmbrString_def(x);
+  nmbrString_def(y);
+
+  // ax-1 with its variables replaced by unknown ones, as the Proof
+  // Assistant does, to be unified with benchbig
+  if (g_dummyVars < 2) declareDummyVars(2 - g_dummyVars);
+  nmbrLet(&benchUnifyScheme, g_Statement[benchAx1].mathString);
+  for (i = 0; i < nmbrLen(benchUnifyScheme); i++) {
+    for (j = 0; j < nmbrLen(g_Statement[benchAx1].reqVarList); j++) {
+      if (benchUnifyScheme[i] == g_Statement[benchAx1].reqVarList[j]) {
+        benchUnifyScheme[i] = g_mathTokens + 1 + j;
+      }
+    }
+  }
+
+  // The hypotheses of ax-mp and their instances with ph := x and ps := y,
+  // separated by "$|$" as verifyProof() assembles them
+  math = g_Statement[benchBig].mathString; // |- ( x -> ( y -> x ) )
+  nmbrLet(&x, nmbrMid(math, 3, benchNode[benchBigX].size));
+  nmbrLet(&y, nmbrMid(math, 3 + benchNode[benchBigX].size + 2,
+      benchNode[benchBigY].size));
+  nmbrLet(&benchMpScheme, nmbrAddElement(NULL_NMBRSTRING, g_mathTokens));
+  nmbrLet(&benchMpInstance, benchMpScheme);
+  for (i = 0; i < nmbrLen(g_Statement[benchAxMp].reqHypList); i++) {
+    hyp = g_Statement[benchAxMp].reqHypList[i];
+    math = g_Statement[hyp].mathString;
+    nmbrLet(&benchMpScheme, nmbrCat(benchMpScheme, math,
+        nmbrAddElement(NULL_NMBRSTRING, g_mathTokens), NULL));
+    for (j = 0; j < nmbrLen(math); j++) {
+      if (math[j] == g_Statement[benchAxMp].reqVarList[0]) {
+        nmbrLet(&benchMpInstance, nmbrCat(benchMpInstance, x, NULL));
+      } else if (math[j] == g_Statement[benchAxMp].reqVarList[1]) {
+        nmbrLet(&benchMpInstance, nmbrCat(benchMpInstance, y, NULL));
+      } else {
+        nmbrLet(&benchMpInstance, nmbrAddElement(benchMpInstance, math[j]));
+      }
+    }
+    nmbrLet(&benchMpInstance, nmbrAddElement(benchMpInstance, g_mathTokens));
+  }
+
+  if (parseCompressedProof(benchBig) > 1) bug(2703);
+  nmbrLet(&benchBigProof, g_WrkProof.proofString);
+
+  free_nmbrString(x);
+  free_nmbrString(y);
+} // benchPrepare
+
+//***** The benchmarks *****
+
+// Each benchmark performs its operation n times and returns a value of the
+// last one that does not depend on n.
+
+static long benchNmbrLet(long n) {
+  nmbrString_def(a);
+  nmbrString_def(b);
+  nmbrString_def(target);
+  long i;
+  nmbrLet(&a, nmbrSpace(1000));
+  nmbrLet(&b, nmbrSpace(100));
+  for (i = 0; i < n; i++) {
+    nmbrLet(&target, a); // Grow
+    nmbrLet(&target, b); // and shrink
+  }
+  i = nmbrLen(target);
+  free_nmbrString(a);
+  free_nmbrString(b);
+  free_nmbrString(target);
+  return i;
+}
+
+static long benchNmbrCat(long n) {
+  nmbrString_def(a);
+  nmbrString_def(b);
+  nmbrString_def(target);
+  long i;
+  nmbrLet(&a, nmbrSpace(200));
+  nmbrLet(&b, nmbrSpace(50));
+  for (i = 0; i < n; i++) {
+    nmbrLet(&target, nmbrCat(a, b, a, NULL));
+  }
+  i = nmbrLen(target);
+  free_nmbrString(a);
+  free_nmbrString(b);
+  free_nmbrString(target);
+  return i;
+}
+
+// One iteration builds a list of 1000 numbers element by element
+static long benchNmbrPush(long n) {
+  nmbrString_def(target);
+  long i, j;
+  for (i = 0; i < n; i++) {
+    free_nmbrString(target);
+    for (j = 0; j < 1000; j++) nmbrPush(&target, j);
+  }
+  i = nmbrLen(target);
+  free_nmbrString(target);
+  return i;
+}
+
+// One iteration allocates 64 blocks of assorted sizes and frees them in a
+// scrambled order
+#define BENCH_POOL_BLOCKS 64
+static long benchPool(long n) {
+  void *block[BENCH_POOL_BLOCKS];
+  long size[BENCH_POOL_BLOCKS], order[BENCH_POOL_BLOCKS];
+  long i, j, total = 0;
+  benchState = BENCH_SEED; // The same sizes on every call
+  for (j = 0; j < BENCH_POOL_BLOCKS; j++) {
+    size[j] = 8 * (1 + benchRandom(j < 56 ? 32 : 512));
+    order[j] = (j * 37) % BENCH_POOL_BLOCKS; // 37 is coprime to 64
+  }
+  for (i = 0; i < n; i++) {
+    total = 0;
+    for (j = 0; j < BENCH_POOL_BLOCKS; j++) {
+      block[j] = poolMalloc(size[j]);
+      total += size[j];
+    }
+    for (j = 0; j < BENCH_POOL_BLOCKS; j++) poolFree(block[order[j]]);
+  }
+  return total;
+}
+
+static long benchLet(long n) {
+  vstring_def(a);
+  vstring_def(b);
+  vstring_def(target);
+  long i;
+  let(&a, string(400, 'a'));
+  let(&b, string(60, 'b'));
+  for (i = 0; i < n; i++) {
+    let(&target, a); // Grow
+    let(&target, b); // and shrink
+  }
+  i = (long)strlen(target);
+  free_vstring(a);
+  free_vstring(b);
+  free_vstring(target);
+  return i;
+}
+
+static long benchCat(long n) {
+  vstring_def(a);
+  vstring_def(b);
+  vstring_def(target);
+  long i;
+  let(&a, string(200, 'a'));
+  let(&b, string(50, 'b'));
+  for (i = 0; i < n; i++) {
+    let(&target, cat(a, " ", b, " ", a, NULL));
+  }
+  i = (long)strlen(target);
+  free_vstring(a);
+  free_vstring(b);
+  free_vstring(target);
+  return i;
+}
+
+// One iteration matches every label of the database against each pattern
+static long benchMatches(long n) {
+  static const char *pattern[] = {"bench1*", "*big", "ax-?", "w*h", "*2?1"};
+  long i, stmt, p, hits = 0;
+  for (i = 0; i < n; i++) {
+    hits = 0;
+    for (stmt = 1; stmt <= g_statements; stmt++) {
+      for (p = 0; p < 5; p++) {
+        hits += matches(g_Statement[stmt].labelName, pattern[p], '*', '?');
+      }
+    }
+  }
+  return hits;
+}
+
+static long benchUnify(long n) {
+  struct unifState_struct *stateVector = NULL;
+  long i;
+  char result = 0;
+  for (i = 0; i < n; i++) {
+    g_unifTrialCount = 1; // Reset unification timeout
+    result = unify(benchUnifyScheme, g_Statement[benchBig].mathString,
+        &stateVector, 0);
+    purgeStateVector(&stateVector);
+  }
+  return result;
+}
+
+static long benchAssignVar(long n) {
+  nmbrString *result; // Pointer only
+  long i, length = 0;
+  for (i = 0; i < n; i++) {
+    result = assignVar(benchMpScheme, benchMpInstance, benchAxMp, benchBig,
+        0, 0);
+    length = nmbrLen(result);
+    free_nmbrString(result);
+    nmbrTempAlloc(0); // As verifyProof() does after each step
+  }
+  return length;
+}
+
+static long benchCompressProof(long n) {
+  vstring_def(proof);
+  long i;
+  for (i = 0; i < n; i++) {
+    let(&proof, compressProof(benchBigProof, benchBig,
+        0 /* oldCompressionAlgorithm */));
+  }
+  i = (long)strlen(proof);
+  free_vstring(proof);
+  return i;
+}
+
+static long benchParseCompressedProof(long n) {
+  long i;
+  for (i = 0; i < n; i++) {
+    parseCompressedProof(benchBig);
+  }
+  return g_WrkProof.numSteps;
+}
+
+// Time the benchmark f:  repeat it with more iterations until it runs for
+// BENCH_MIN_TIME, then report the last run
+static void benchRun(const char *name, long (*f)(long), const char *filter) {
+  long n = 1, result;
+  double seconds;
+  clock_t start;
+  if (filter && !matches(name, filter, '*', '?')) return;
+  while (1) {
+    start = clock();
+    result = f(n);
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    if (seconds >= BENCH_MIN_TIME) break;
+    // Aim a little beyond the minimum time
+    if (seconds < 0.01) {
+      n *= 10;
+    } else {
+      n = (long)((double)n * 1.2 * BENCH_MIN_TIME / seconds) + 1;
+    }
+  }
+  printf("%s\t%ld\t%.4f\t%.1f\t%ld\n", name, n, seconds,
+      seconds * 1e9 / (double)n, result);
+  fflush(stdout);
+}
+
+void runBenchmarks(const char *version, int argc, char *argv[]) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+
+  initBigArrays();
+  benchReadDatabase();
+  benchPrepare();
+
+  printf("# metamath_bench %s\n", version);
+  printf("# benchmark\titerations\tseconds\tns_per_iteration\tresult\n");
+  benchRun("nmbrLet", benchNmbrLet, filter);
+  benchRun("nmbrCat", benchNmbrCat, filter);
+  benchRun("nmbrPush", benchNmbrPush, filter);
+  benchRun("poolMalloc", benchPool, filter);
+  benchRun("let", benchLet, filter);
+  benchRun("cat", benchCat, filter);
+  benchRun("matches", benchMatches, filter);
+  benchRun("unify", benchUnify, filter);
+  benchRun("assignVar", benchAssignVar, filter);
+  benchRun("compressProof", benchCompressProof, filter);
+  benchRun("parseCompressedProof", benchParseCompressedProof, filter);
+  exit(EXIT_SUCCESS);
+} // runBenchmarks
+
+#endif // BENCH_ENABLE
@@ -0,0 +1,67 @@
+/*****************************************************************************/
+/*        Copyright (C) 2026  metamath-exe contributors                      */
+/*            License terms:  GNU General Public License                     */
+/*****************************************************************************/
+/*34567890123456 (79-character line to adjust editor window) 2345678901234567*/
+
+#ifndef METAMATH_MMBENCH_H_
+#define METAMATH_MMBENCH_H_
+
+/*!
+ * \file mmbench.h
+ * \brief runs the microbenchmarks
+ *
+ * part of the application's infrastructure
+ *
+ * Microbenchmarks
+ * ===============
+ *
+ * If the macro **BENCH_ENABLE** is defined (option -p of build.sh), the
+ * executable does not start the command interpreter.  It times the core
+ * primitives instead: nmbrString and vstring assignment and concatenation,
+ * building a nmbrString in place, the memory pool, matches(), unify(),
+ * assignVar(), compressProof() and parseCompressedProof(), and exits.
+ *
+ * The inputs are synthetic and built from a fixed seed, so that runs of
+ * different releases measure the same work.  The primitives that need a
+ * database use a generated one, written to metamath_bench.mm in the current
+ * directory, read, and deleted again.
+ *
+ * An optional command line argument restricts the run to the benchmarks
+ * whose names match it; it may contain the wildcards * and ?, e.g.
+ *
+ *     ./metamath_bench 'nmbr*'
+ *
+ * The results go to stdout, one tab-separated line per benchmark:  name,
+ * number of iterations, CPU seconds, nanoseconds per iteration, and a result
+ * value of the last iteration that does not depend on the timing (to check
+ * that the same work was done).  Lines starting with # are comments.
+ *
+ * As with the regression tests (\ref TEST_ENABLE), invoke option -c (clean)
+ * on build.sh when switching between a normal and a benchmark build without
+ * intermediate source file change.
+ */
+
+/*!
+ * \def BENCH_ENABLE
+ * macro, no value, just defined or not.
+ *
+ * Controls whether the microbenchmarks replace the command interpreter.
+ */
+
+#ifdef BENCH_ENABLE
+
+  /*!
+   * Run the benchmarks selected by the optional wildcard pattern argv[1] and
+   * exit the program.
+   * \param[in] version of the program, reported in the output header.
+   */
+  extern void runBenchmarks(const char *version, int argc, char *argv[]);
+  #define RUN_BENCHMARKS(version, argc, argv) \
+      runBenchmarks(version, argc, argv)
+
+#else // BENCH_ENABLE
+  #define RUN_BENCHMARKS(version, argc, argv)
+#endif // BENCH_ENABLE
+
+#endif // METAMATH_MMBENCH_H_
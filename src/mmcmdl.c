@@ -13,6 +13,7 @@
 #include "mminou.h"
 #include "mmpfas.h"
 #include "mmunif.h" // For g_hentyFilter, g_userMaxUnifTrials, g_minSubstLen
+#include "mmveri.h" // For g_stepSharing
 #include "mmwtex.h"
 #include "mmword.h"
 
@@ -55,7 +56,7 @@ flag processCommandLine(void) {
       let(&tmpStr, cat("DBG|",
           "HELP|READ|WRITE|PROVE|SHOW|SEARCH|SAVE|SUBMIT|OPEN|CLOSE|",
           "SET|FILE|BEEP|EXIT|QUIT|ERASE|VERIFY|MARKUP|MORE|TOOLS|",
-          "MIDI|<HELP>",
+          "MIDI|SERVE|<HELP>",
           NULL));
     } else {
       // Proof assistant mode
@@ -77,7 +78,7 @@ flag processCommandLine(void) {
           "MARKUP|ASSIGN|REPLACE|MATCH|UNIFY|LET|INITIALIZE|DELETE|IMPROVE|",
           "MINIMIZE_WITH|EXPAND|UNDO|REDO|SAVE|DEMO|INVOKE|CLI|EXPLORE|TEX|",
           "LATEX|HTML|COMMENTS|BIBLIOGRAPHY|MORE|",
-          "TOOLS|MIDI|$|<$>", NULL))) goto pclbad;
+          "TOOLS|MIDI|SERVE|$|<$>", NULL))) goto pclbad;
       if (cmdMatches("HELP OPEN")) {
         if (!getFullArg(2, "LOG|TEX|<LOG>")) goto pclbad;
         goto pclgood;
@@ -89,7 +90,7 @@ flag processCommandLine(void) {
       if (cmdMatches("HELP SHOW")) {
         if (!getFullArg(2, cat("MEMORY|SETTINGS|LABELS|SOURCE|STATEMENT|",
             "PROOF|NEW_PROOF|USAGE|TRACE_BACK|ELAPSED_TIME|",
-            "DISCOURAGED|<MEMORY>",
+            "DISCOURAGED|PROFILE|<MEMORY>",
             NULL)))
             goto pclbad;
         goto pclgood;
@@ -100,7 +101,8 @@ flag processCommandLine(void) {
             "DISCOURAGEMENT|",
             "CONTRIBUTOR|",
             "ROOT_DIRECTORY|",
-            "EMPTY_SUBSTITUTION|SEARCH_LIMIT|JEREMY_HENTY_FILTER|<ECHO>",
+            "EMPTY_SUBSTITUTION|SEARCH_LIMIT|JEREMY_HENTY_FILTER|",
+            "MATH_CACHE|STEP_SHARING|PROFILE|<ECHO>",
             NULL)))
             goto pclbad;
         goto pclgood;
@@ -140,11 +142,10 @@ flag processCommandLine(void) {
         if (!getFullArg(i, "/|$|<$>")) goto pclbad;
         if (lastArgMatches("/")) {
           i++;
-          if (!getFullArg(i, "VERIFY|<VERIFY>")) goto pclbad;
+          if (!getFullArg(i, "VERIFY|INCREMENTAL|<VERIFY>")) goto pclbad;
         } else {
           break;
         }
-        break; // Break if only 1 switch is allowed
       } // End while for switch loop
       goto pclgood;
     }
@@ -377,12 +378,12 @@ flag processCommandLine(void) {
       if (!g_PFASmode) {
         if (!getFullArg(1, cat(
      "SETTINGS|LABELS|STATEMENT|SOURCE|PROOF|MEMORY|TRACE_BACK|",
-     "USAGE|ELAPSED_TIME|DISCOURAGED|<SETTINGS>", NULL)))
+     "USAGE|ELAPSED_TIME|DISCOURAGED|PROFILE|<SETTINGS>", NULL)))
             goto pclbad;
       } else {
         if (!getFullArg(1, cat("NEW_PROOF|",
      "SETTINGS|LABELS|STATEMENT|SOURCE|PROOF|MEMORY|TRACE_BACK|",
-     "USAGE|ELAPSED_TIME|DISCOURAGED|<SETTINGS>",
+     "USAGE|ELAPSED_TIME|DISCOURAGED|PROFILE|<SETTINGS>",
             NULL)))
             goto pclbad;
       }
@@ -438,6 +439,23 @@ flag processCommandLine(void) {
         goto pclgood;
       } // End if (cmdMatches("SHOW TRACE_BACK"))
 
+      if (cmdMatches("SHOW PROFILE")) {
+        // Get any switches
+        i = 1;
+        while (1) {
+          i++;
+          if (!getFullArg(i, "/|$|<$>")) goto pclbad;
+          if (lastArgMatches("/")) {
+            i++;
+            if (!getFullArg(i, "JSON|<JSON>")) goto pclbad;
+          } else {
+            break;
+          }
+          break; // Break if only 1 switch is allowed
+        }
+        goto pclgood;
+      } // End if (cmdMatches("SHOW PROFILE"))
+
       if (cmdMatches("SHOW USAGE")) {
         if (g_sourceHasBeenRead == 0) {
           print2("?No source file has been read in.  Use READ first.\n");
@@ -855,12 +873,18 @@ flag processCommandLine(void) {
         if (lastArgMatches("/")) {
           i++;
           if (!getFullArg(i, "DEPTH|NO_DISTINCT|1|2|3"
-            "|SUBPROOFS|OVERRIDE|INCLUDE_MATHBOXES|<DEPTH>")) goto pclbad;
+            "|SUBPROOFS|OVERRIDE|INCLUDE_MATHBOXES|BUDGET|<DEPTH>"))
+            goto pclbad;
           if (lastArgMatches("DEPTH")) {
             i++;
             if (!getFullArg(i, "# What is maximum depth for "
               "searching statements with $e hypotheses <0>? ")) goto pclbad;
           }
+          if (lastArgMatches("BUDGET")) {
+            i++;
+            if (!getFullArg(i, "# How many seconds may the search take <60>? "))
+              goto pclbad;
+          }
         } else {
           break;
         }
@@ -880,10 +904,16 @@ flag processCommandLine(void) {
           i++;
           if (!getFullArg(i, cat(
               "VERBOSE|MAY_GROW|EXCEPT|OVERRIDE|INCLUDE_MATHBOXES|",
-              "ALLOW_NEW_AXIOMS|NO_NEW_AXIOMS_FROM|FORBID|TIME|<VERBOSE>",
-              NULL)))
+              "ALLOW_NEW_AXIOMS|NO_NEW_AXIOMS_FROM|FORBID|TIME|BUDGET|",
+              "<VERBOSE>", NULL)))
             goto pclbad;
 
+          if (lastArgMatches("BUDGET")) {
+            i++;
+            if (!getFullArg(i, "# How many seconds may the search take <60>? "))
+              goto pclbad;
+          }
+
           if (lastArgMatches("EXCEPT")) {
             i++;
             if (!getFullArg(i, "* What statement label match pattern? "))
@@ -1034,7 +1064,8 @@ flag processCommandLine(void) {
           "DISCOURAGEMENT|",
           "CONTRIBUTOR|",
           "ROOT_DIRECTORY|",
-          "EMPTY_SUBSTITUTION|JEREMY_HENTY_FILTER|<WIDTH>", NULL));
+          "EMPTY_SUBSTITUTION|JEREMY_HENTY_FILTER|MATH_CACHE|STEP_SHARING|",
+          "PROFILE|<WIDTH>", NULL));
       if (!getFullArg(1,tmpStr)) goto pclbad;
       if (cmdMatches("SET DEBUG")) {
         if (!getFullArg(2, "FLAG|OFF|<OFF>")) goto pclbad;
@@ -1089,6 +1120,24 @@ flag processCommandLine(void) {
         goto pclgood;
       }
 
+      if (cmdMatches("SET STEP_SHARING")) {
+        if (g_stepSharing) {
+          if (!getFullArg(2, "ON|OFF|<OFF>")) goto pclbad;
+        } else {
+          if (!getFullArg(2, "ON|OFF|<ON>")) goto pclbad;
+        }
+        goto pclgood;
+      }
+
+      if (cmdMatches("SET PROFILE")) {
+        if (g_profileFlag) {
+          if (!getFullArg(2, "ON|OFF|STATEMENTS|<OFF>")) goto pclbad;
+        } else {
+          if (!getFullArg(2, "ON|OFF|STATEMENTS|<ON>")) goto pclbad;
+        }
+        goto pclgood;
+      }
+
       if (cmdMatches("SET CONTRIBUTOR")) {
         if (!getFullArg(2, cat(
             "* What is the contributor name for SAVE (NEW_)PROOF <",
@@ -1113,11 +1162,35 @@ flag processCommandLine(void) {
         goto pclgood;
       }
 
+      if (cmdMatches("SET MATH_CACHE")) {
+        if (!getFullArg(2, cat(
+            "# How many typeset math strings should be cached <",
+            str((double)g_mathCacheMax), ">? ", NULL)))
+          goto pclbad;
+        goto pclgood;
+      }
+
       if (cmdMatches("SET UNIFICATION_TIMEOUT")) {
         if (!getFullArg(2, cat(
            "# What is maximum number of unification trials <",
             str((double)g_userMaxUnifTrials), ">? ", NULL)))
           goto pclbad;
+        // Get any switches
+        i = 2;
+        while (1) {
+          i++;
+          if (!getFullArg(i, "/|$|<$>")) goto pclbad;
+          if (lastArgMatches("/")) {
+            i++;
+            if (!getFullArg(i, cat(
+                "SECONDS",
+                "|<SECONDS>", NULL)))
+              goto pclbad;
+          } else {
+            break;
+          }
+          break; // Break if only 1 switch is allowed
+        }
         goto pclgood;
       }
 
@@ -1171,6 +1244,31 @@ flag processCommandLine(void) {
       goto pclgood;
     }
 
+    if (cmdMatches("SERVE")) {
+      // Get any switches
+      i = 0;
+      while (1) {
+        i++;
+        if (!getFullArg(i, "/|$|<$>")) goto pclbad;
+        if (lastArgMatches("/")) {
+          i++;
+          if (!getFullArg(i, cat(
+              "SOCKET",
+              "|<SOCKET>", NULL)))
+            goto pclbad;
+          if (lastArgMatches("SOCKET")) {
+            i++;
+            if (!getFullArg(i, "* What is the name of the socket? "))
+              goto pclbad;
+          }
+        } else {
+          break;
+        }
+        break; // Break if only 1 switch is allowed
+      } // End while for switch loop
+      goto pclgood;
+    }
+
     if (cmdMatches("VERIFY")) {
       if (!getFullArg(1,
           "PROOF|MARKUP|<PROOF>"))
@@ -1192,13 +1290,23 @@ flag processCommandLine(void) {
           if (lastArgMatches("/")) {
             i++;
             if (!getFullArg(i, cat(
-                "SYNTAX_ONLY",
+                "SYNTAX_ONLY|STATS|CSV",
                 "|<SYNTAX_ONLY>", NULL)))
               goto pclbad;
+            if (lastArgMatches("STATS")) {
+              i++;
+              if (!getFullArg(i, "# How many of the slowest statements <10>? "))
+                goto pclbad;
+            }
+            if (lastArgMatches("CSV")) {
+              i++;
+              if (!getFullArg(i,
+                  "* What is the name of the CSV file <verify_stats.csv>? "))
+                goto pclbad;
+            }
           } else {
             break;
           }
-          break; // Break if only 1 switch is allowed
         }
 
         goto pclgood;
@@ -1223,8 +1331,13 @@ flag processCommandLine(void) {
             if (!getFullArg(i, cat(
                 "DATE_SKIP|FILE_SKIP|TOP_DATE_SKIP|VERBOSE",
                 "|FILE_CHECK|TOP_DATE_CHECK",
-                "|UNDERSCORE_SKIP|MATHBOX_SKIP|<DATE_SKIP>", NULL)))
+                "|UNDERSCORE_SKIP|MATHBOX_SKIP|THREADS|<DATE_SKIP>", NULL)))
               goto pclbad;
+            if (lastArgMatches("THREADS")) {
+              i++;
+              if (!getFullArg(i, "# How many worker processes <1>? "))
+                goto pclbad;
+            }
           } else {
             break;
           }
@@ -9,6 +9,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#if defined(__unix__) || defined(__APPLE__)
+// Worker processes for VERIFY MARKUP ... / THREADS
+#define VERIFY_MARKUP_FORK
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 #include "mmvstr.h"
 #include "mmdata.h"
 #include "mmcmdl.h" // For g_texFileName
@@ -497,6 +504,8 @@ void typeStatement(long showStmt,
   switch (type) {
     case a_:
     case p_:
+      buildOptHypList(showStmt);
+      buildOptVarLists(showStmt);
       // This is not really needed but keeps output consistent
       // with previous version.  It puts a blank line before the HTML
       // "distinct variable" list.
@@ -912,7 +921,7 @@ void typeStatement(long showStmt,
       if (g_printString[0]) {
         bug(256);
       }
-      let(&g_printString, str2);
+      setPrintString(str2);
     } // if (subType != SYNTAX)
     if (subType == THEOREM) {
       // The "referenced by" does not show up after the proof
@@ -1005,6 +1014,8 @@ vstring htmlDummyVars(long showStmt)
     goto RETURN_POINT;
   }
 
+  buildOptHypList(showStmt);
+  buildOptVarLists(showStmt);
   optDVA = g_Statement[showStmt].optDisjVarsA;
   optDVB = g_Statement[showStmt].optDisjVarsB;
   numDVs = nmbrLen(optDVA);
@@ -1471,6 +1482,10 @@ void typeProof(long statemNum,
   nmbrString_def(indentationLevel);
   nmbrLet(&indentationLevel, nmbrGetIndentation(proof, 0));
 
+  // Index the proof structure, to find the hypotheses of each step
+  struct proofIndex_struct proofIndex = {NULL, NULL, NULL, NULL, NULL, 0, 0};
+  buildProofIndex(&proofIndex, proof);
+
   // Get the target hypotheses
   nmbrString_def(targetHyps);
   nmbrLet(&targetHyps, nmbrGetTargetHyp(proof, statemNum));
@@ -1728,7 +1743,7 @@ void typeProof(long statemNum,
           }
           if (hyp < g_Statement[stmt].numReqHyp) {
             // Move down to previous hypothesis
-            hypStep = hypStep - subproofLen(proof, hypStep);
+            hypStep = proofIndex.subproofStart[hypStep] - 1;
           }
         } // Next hyp
 
@@ -2251,6 +2266,7 @@ void typeProof(long statemNum,
   free_nmbrString(localLabels);
   free_nmbrString(localLabelNames);
   free_nmbrString(indentationLevel);
+  freeProofIndex(&proofIndex);
   free_nmbrString(targetHyps);
   free_nmbrString(essentialFlags);
 } // typeProof()
@@ -3580,7 +3596,7 @@ vstring traceUsage(long statemNum,
     notEFRec = 1;
   }
 
-  nmbrLet(&statementList, nmbrAddElement(statementList, statemNum));
+  nmbrPush(&statementList, statemNum);
   lastPos = 1;
 
   // For speedup (in traceProofWork), scan only up to cutoffStmt if it
@@ -3642,7 +3658,7 @@ vstring traceUsage(long statemNum,
     if (!tmpFlag) continue;
     // The traced statement is used in this proof
     // Add this statement to the statement list
-    nmbrLet(&statementList, nmbrAddElement(statementList, stmt));
+    nmbrPush(&statementList, stmt);
     if (recursiveFlag) lastPos++;
   } // Next stmt
 
@@ -3666,30 +3682,307 @@ vstring traceUsage(long statemNum,
 
 // This implements the READ command (although the / VERIFY qualifier is
 // processed separately in metamath.c).
+// For SET PROFILE:  record the phase of readInput() that started at *mark,
+// and start the next one
+static void profilePhase(const char *name, struct profileMark_struct *mark) {
+  if (!g_profileFlag) return;
+  profileRecord('p', name, mark);
+  profileMark(mark);
+}
+
 void readInput(void)
 {
   vstring_def(fullInput_fn);
+  struct profileMark_struct mark;
 
   let(&fullInput_fn, cat(g_rootDirectory, g_input_fn, NULL));
 
+  if (g_profileFlag) profileMark(&mark);
   g_sourcePtr = readSourceAndIncludes(g_input_fn, &g_sourceLen);
   if (g_sourcePtr == NULL) {
     print2(
 "?Source was not read due to error(s).  Please correct and try again.\n");
     goto RETURN_POINT;
   }
+  profilePhase("readSourceAndIncludes", &mark);
 
   g_sourcePtr = readRawSource(g_sourcePtr, &g_sourceLen);
+  profilePhase("readRawSource", &mark);
   parseKeywords();
+  profilePhase("parseKeywords", &mark);
   parseLabels();
+  profilePhase("parseLabels", &mark);
   parseMathDecl();
+  profilePhase("parseMathDecl", &mark);
   parseStatements();
+  profilePhase("parseStatements", &mark);
+  buildVerifyView(); // Packed statement data for verifyProof()
+  profilePhase("buildVerifyView", &mark);
+  buildSectionOutline(); // Section headers for getSectionHeadings()
+  profilePhase("buildSectionOutline", &mark);
   g_sourceHasBeenRead = 1;
 
  RETURN_POINT:
   free_vstring(fullInput_fn);
 } // readInput
 
+// For READ / INCREMENTAL:  what verifying a statement depends on, so that
+// the statements of the database read before can be compared with the new
+// ones
+struct stmtSignature_struct {
+  char *label;
+  unsigned long frame; // Hash of the assertion or hypothesis
+  unsigned long proof; // Hash of the proof text and optional $d's
+};
+
+// Continue hash with the names and types of the math tokens of s
+static unsigned long mathSignature(unsigned long hash, const nmbrString *s)
+{
+  long i;
+  for (i = 0; s[i] != -1; i++) {
+    // Include the terminating null as separator
+    hash = textHash(hash, g_MathToken[s[i]].tokenName,
+        (long)strlen(g_MathToken[s[i]].tokenName) + 1);
+    hash = textHash(hash, &g_MathToken[s[i]].tokenType, 1);
+  }
+  return hash;
+} // mathSignature
+
+// The hash of what users of the statement rely on:  its type and math
+// string, and for an assertion its mandatory hypotheses and $d's
+static unsigned long frameSignature(long stmt)
+{
+  long i, hyp;
+  unsigned long hash = TEXT_HASH_INIT;
+  hash = textHash(hash, &g_Statement[stmt].type, 1);
+  hash = mathSignature(hash, g_Statement[stmt].mathString);
+  for (i = 0; i < g_Statement[stmt].numReqHyp; i++) {
+    hyp = g_Statement[stmt].reqHypList[i];
+    hash = textHash(hash, g_Statement[hyp].labelName,
+        (long)strlen(g_Statement[hyp].labelName) + 1);
+    hash = textHash(hash, &g_Statement[hyp].type, 1);
+    hash = mathSignature(hash, g_Statement[hyp].mathString);
+  }
+  hash = mathSignature(hash, g_Statement[stmt].reqDisjVarsA);
+  hash = mathSignature(hash, g_Statement[stmt].reqDisjVarsB);
+  return hash;
+} // frameSignature
+
+// The hash of what else the proof of a $p statement relies on:  the proof
+// text and the optional $d's
+static unsigned long proofSignature(long stmt)
+{
+  unsigned long hash = TEXT_HASH_INIT;
+  if (g_Statement[stmt].type != p_) return hash;
+  hash = textHash(hash, g_Statement[stmt].proofSectionPtr,
+      g_Statement[stmt].proofSectionLen);
+  buildOptVarLists(stmt); // The optional $d's aren't built when it is read
+  hash = mathSignature(hash, g_Statement[stmt].optDisjVarsA);
+  hash = mathSignature(hash, g_Statement[stmt].optDisjVarsB);
+  return hash;
+} // proofSignature
+
+// qsort and bsearch comparison of struct stmtSignature_struct by label
+static int stmtSignatureCmp(const void *p1, const void *p2)
+{
+  return strcmp(((const struct stmtSignature_struct *)p1)->label,
+      ((const struct stmtSignature_struct *)p2)->label);
+} // stmtSignatureCmp
+
+// The offset in the source buffer of the keyword of statement stmt
+static long stmtOffset(long stmt)
+{
+  return (long)(g_Statement[stmt].statementPtr - g_sourcePtr);
+} // stmtOffset
+
+// The first statement whose keyword is at or after the offset in the source
+// buffer (g_statements + 1 if there is none)
+static long stmtAtOrAfter(long offset)
+{
+  long low = 1, high = g_statements + 1, mid;
+  while (low < high) { // Binary search; statement offsets increase
+    mid = (low + high) / 2;
+    if (stmtOffset(mid) >= offset) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+} // stmtAtOrAfter
+
+// The end of the part of the source buffer that begins with
+// g_IncludeCall[inclCall]:  the offset of the next entry
+static long inclCallEnd(long inclCall)
+{
+  if (inclCall == 0) {
+    // Entry 1 is the end of the buffer; the entries after it follow entry 0
+    return g_includeCalls >= 2 ? g_IncludeCall[2].current_offset
+        : g_IncludeCall[1].current_offset;
+  }
+  if (inclCall == g_includeCalls) return g_IncludeCall[1].current_offset;
+  return g_IncludeCall[inclCall + 1].current_offset;
+} // inclCallEnd
+
+// Does the proof text of $p statement stmt refer to a label that is not in
+// the database or whose statement changed, according to changed[]?
+static flag proofUsesChanged(long stmt, const char *changed)
+{
+  char *ptr = g_Statement[stmt].proofSectionPtr;
+  char *end = ptr + g_Statement[stmt].proofSectionLen;
+  long len, ref;
+  while (1) {
+    ptr = ptr + whiteSpaceLen(ptr);
+    if (ptr >= end) return 0;
+    len = proofTokenLen(ptr);
+    if (len == 0) return 0; // The $. keyword
+    if (ptr[0] == ')') return 0; // The end of the labels of a compressed proof
+    if (len > 1 || !strchr("?():=", ptr[0])) {
+      ref = lookupLabelHash(ptr, len);
+      // Local labels of / EXPLICIT proofs are not in the database either, so
+      // such proofs are always verified
+      if (ref <= 0 || changed[ref] == 'F') return 1;
+    }
+    ptr = ptr + len;
+  }
+} // proofUsesChanged
+
+// READ / INCREMENTAL of the database that has already been read.  Only if
+// some of its source files changed, all of it is read and parsed again, and
+// then only the proofs that may be affected by the changes are verified:
+// the proofs of new or changed statements, including changed optional $d's,
+// and the proofs that refer to a statement whose assertion or hypothesis
+// changed.
+// The statements before the first changed file keep their numbers.
+// Returns 1 if the database was read again.
+flag rereadInput(void)
+{
+  long i, j, stmt, first, last, files, firstChanged, oldCount, changedCount;
+  long verifyCount;
+  struct stmtSignature_struct *old;
+  struct stmtSignature_struct key;
+  struct stmtSignature_struct *found;
+  char *changed;
+  char parseResult;
+  vstring_def(emptyProofList);
+
+  // Find the files that changed, and the first statement they contain
+  files = 0;
+  firstChanged = g_statements + 1;
+  for (i = 0; i <= g_includeCalls; i++) {
+    if (!g_IncludeCall[i].fileRead) continue;
+    if (!sourceFileChanged(i)) continue;
+    files++;
+    // The statements in the parts of the source buffer from this file:  the
+    // file itself and the continuations after the files it includes
+    first = g_statements + 1;
+    last = 0;
+    for (j = 0; j <= g_includeCalls; j++) {
+      if (j != i && (g_IncludeCall[j].pushOrPop != 1 || j == 1
+          || strcmp(g_IncludeCall[j].included_fn,
+              g_IncludeCall[i].included_fn))) continue;
+      if (inclCallEnd(j) <= g_IncludeCall[j].current_offset) continue;
+      stmt = stmtAtOrAfter(g_IncludeCall[j].current_offset);
+      if (stmt < first) first = stmt;
+      stmt = stmtAtOrAfter(inclCallEnd(j)) - 1;
+      if (stmt > last) last = stmt;
+    }
+    if (first <= last) {
+      print2("The file \"%s\" has changed (statements %ld through %ld).\n",
+          g_IncludeCall[i].included_fn, first, last);
+    } else {
+      print2("The file \"%s\" has changed.\n", g_IncludeCall[i].included_fn);
+    }
+    if (first < firstChanged) firstChanged = first;
+  }
+  if (!files) {
+    print2("No source file has changed since it was read.\n");
+    return 0;
+  }
+
+  // Save the signatures of the statements that may change
+  oldCount = 0;
+  old = malloc((size_t)(g_statements - firstChanged + 2)
+      * sizeof(struct stmtSignature_struct));
+  if (!old) outOfMemory("#153 (stmtSignature)");
+  for (stmt = firstChanged; stmt <= g_statements; stmt++) {
+    if (!g_Statement[stmt].labelName[0]) continue; // Not labeled
+    old[oldCount].label = malloc(strlen(g_Statement[stmt].labelName) + 1);
+    if (!old[oldCount].label) outOfMemory("#154 (stmtSignature label)");
+    strcpy(old[oldCount].label, g_Statement[stmt].labelName);
+    old[oldCount].frame = frameSignature(stmt);
+    old[oldCount].proof = proofSignature(stmt);
+    oldCount++;
+  }
+  qsort(old, (size_t)oldCount, sizeof(struct stmtSignature_struct),
+      stmtSignatureCmp);
+
+  // Read and parse the database again.  (Its parse passes build tables of
+  // the whole database, so they are not run on a part of it.)
+  eraseSource();
+  g_sourceHasBeenRead = 0;
+  readInput();
+
+  if (g_sourceHasBeenRead) {
+    // Compare the statements:  changed[stmt] is 'F' if the assertion or
+    // hypothesis stmt is new or changed, 'P' if only its proof changed
+    changed = malloc((size_t)(g_statements + 1));
+    if (!changed) outOfMemory("#155 (changed)");
+    changedCount = 0;
+    for (stmt = 1; stmt <= g_statements; stmt++) {
+      changed[stmt] = 0;
+      if (stmt < firstChanged || !g_Statement[stmt].labelName[0]) continue;
+      key.label = g_Statement[stmt].labelName;
+      found = bsearch(&key, old, (size_t)oldCount,
+          sizeof(struct stmtSignature_struct), stmtSignatureCmp);
+      if (!found || found->frame != frameSignature(stmt)) {
+        changed[stmt] = 'F';
+      } else if (found->proof != proofSignature(stmt)) {
+        changed[stmt] = 'P';
+      }
+      if (changed[stmt]) changedCount++;
+    }
+
+    // Verify the proofs that may be affected
+    verifyCount = 0;
+    for (stmt = firstChanged; stmt <= g_statements; stmt++) {
+      if (g_Statement[stmt].type != p_) continue;
+      if (!changed[stmt] && !proofUsesChanged(stmt, changed)) continue;
+      verifyCount++;
+      parseResult = parseProof(stmt);
+      if (parseResult < 2) { // $p with no error
+        verifyProof(stmt);
+        cleanWrkProof(); // Deallocate verifyProof storage
+      }
+      if (parseResult == 1) {
+        let(&emptyProofList, cat(emptyProofList, ", ",
+            g_Statement[stmt].labelName, NULL));
+      }
+    }
+    if (emptyProofList[0]) {
+      printLongLine(cat(
+          "Warning: The following $p statement(s) were not proved:  ",
+          right(emptyProofList, 3), NULL), " ", "  ");
+    }
+    print2(
+"%ld labeled statement(s) are new or changed; %ld proof(s) were verified.\n",
+        changedCount, verifyCount);
+    if (!g_errorCount) {
+      print2("No errors were found.\n");
+    } else if (g_errorCount == 1) {
+      print2("One error was found.\n");
+    } else {
+      print2("%ld errors were found.\n", (long)g_errorCount);
+    }
+    free(changed);
+  }
+
+  for (i = 0; i < oldCount; i++) free(old[i].label);
+  free(old);
+  free_vstring(emptyProofList);
+  return 1;
+} // rereadInput
+
 // This function implements the WRITE SOURCE command.
 // Note that the labelSection, mathSection, and proofSection do not
 // contain keywords ($a, $p,...; $=; $.).  The keywords are added
@@ -3895,6 +4188,8 @@ void writeExtractedSource(
         // All flagged statements so far will be $a or $p.
         // Skip the ${'s and $}'s that earlier loop populates (is it necessary?)
         && (g_Statement[stmt].type == a_ || g_Statement[stmt].type == p_)) {
+      buildOptHypList(stmt);
+      buildOptVarLists(stmt);
       hyps = g_Statement[stmt].numReqHyp;
       for (hyp = 0; hyp < hyps; hyp++) {
         extractNeeded[g_Statement[stmt].reqHypList[hyp]] = 'Y';
@@ -4469,6 +4764,8 @@ void eraseSource(void) // ERASE command
     free(g_WrkProof.compressedPfLabelMap);
     g_wrkProofMaxSize = 0;
   }
+  eraseStepSharing(); // Its statement numbers are no longer valid
+  eraseVerifyView();
 
   if (g_statements == 0) {
     // Already called
@@ -4486,7 +4783,7 @@ void eraseSource(void) // ERASE command
   // Deallocate the g_Statement[] array.
   // g_statements + 1 is a dummy statement to hold source after last statement.
   for (i = 1; i <= g_statements + 1; i++) {
-    if (g_Statement[i].fileName[0]) free(g_Statement[i].fileName);
+    free_vstring(g_Statement[i].fileName);
     if (g_Statement[i].labelName[0]) free(g_Statement[i].labelName);
     if (g_Statement[i].mathString != NULL_NMBRSTRING)
         poolFree(g_Statement[i].mathString);
@@ -4541,13 +4838,17 @@ void eraseSource(void) // ERASE command
   free(g_IncludeCall); // Will be initialized in initBigArrays
   free(g_MathToken);
   g_dummyVars = 0; // For Proof Assistant
-  free(g_sourcePtr);
+  if (g_sourcePtr) free_vstring(g_sourcePtr);
   free(g_labelKey);
   free(g_mathKey);
   free(g_allLabelKeyBase);
+  free(g_labelHash);
+  g_labelHash = NULL;
+  eraseScopeFrames();
 
   // Deallocate the texdef/htmldef storage
   eraseTexDefs();
+  eraseSectionOutline();
 
   g_extHtmlStmt = 0; // May be used by a non-zero test; init to be safe
 
@@ -4586,14 +4887,118 @@ void eraseSource(void) // ERASE command
   g_statements = 0; // getContrib uses g_statements for loop limit
 } // eraseSource
 
+// For VERIFY PROOF / STATS and / CSV:  the cost of one statement's proof
+struct verifyStats_struct {
+  long stmt;
+  double parseTime; // Seconds in parseProof()
+  double verifyTime; // Seconds in verifyProof()
+  long steps;
+  long backtracks; // Variable assignments retried by assignVar()
+};
+
+// CPU seconds since the start of the program (0 if not available)
+static double cpuSeconds(void) {
+#ifdef CLOCKS_PER_SEC
+  return (double)clock() / CLOCKS_PER_SEC;
+#else
+  return 0.0;
+#endif
+}
+
+// qsort comparison:  decreasing total time, then database order
+static int verifyStatsCmp(const void *p1, const void *p2) {
+  const struct verifyStats_struct *s1 = p1;
+  const struct verifyStats_struct *s2 = p2;
+  double t1 = s1->parseTime + s1->verifyTime;
+  double t2 = s2->parseTime + s2->verifyTime;
+  if (t1 > t2) return -1;
+  if (t1 < t2) return 1;
+  return s1->stmt < s2->stmt ? -1 : (s1->stmt > s2->stmt);
+}
+
+// Print the statsCount slowest statements of the n in stats[] (which is
+// sorted here) and a histogram of the time per statement
+static void printVerifyStats(struct verifyStats_struct *stats, long n,
+    long statsCount) {
+  // Upper bounds of the histogram buckets (the last one is unbounded)
+  static const double bucketLimit[] = {1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1.0};
+  static const char *bucketName[] = {"< 10 us", "< 100 us", "< 1 ms",
+      "< 10 ms", "< 100 ms", "< 1 s", ">= 1 s"};
+  const long buckets = 7;
+  long bucketCount[7] = {0};
+  long i, j, maxCount;
+  double t;
+  vstring_def(bar);
+
+  qsort(stats, (size_t)n, sizeof(struct verifyStats_struct), verifyStatsCmp);
+  if (statsCount > n) statsCount = n;
+  print2("\n");
+  print2("The %ld slowest of %ld statement(s):\n", statsCount, n);
+  print2("   Total s    Parse s   Verify s    Steps Backtracks Label\n");
+  for (i = 0; i < statsCount; i++) {
+    print2("%10.6f %10.6f %10.6f %8ld %10ld %s\n",
+        stats[i].parseTime + stats[i].verifyTime,
+        stats[i].parseTime, stats[i].verifyTime,
+        stats[i].steps, stats[i].backtracks,
+        g_Statement[stats[i].stmt].labelName);
+  }
+
+  for (i = 0; i < n; i++) {
+    t = stats[i].parseTime + stats[i].verifyTime;
+    for (j = 0; j < buckets - 1; j++) {
+      if (t < bucketLimit[j]) break;
+    }
+    bucketCount[j]++;
+  }
+  maxCount = 1;
+  for (j = 0; j < buckets; j++) {
+    if (bucketCount[j] > maxCount) maxCount = bucketCount[j];
+  }
+  print2("\n");
+  print2("Time per statement:\n");
+  for (j = 0; j < buckets; j++) {
+    // Bars of up to 50 characters; any nonempty bucket gets at least one
+    let(&bar, string((bucketCount[j] * 50 + maxCount - 1) / maxCount, '*'));
+    print2("%9s %8ld%s%s\n", bucketName[j], bucketCount[j],
+        bar[0] ? " " : "", bar);
+  }
+  free_vstring(bar);
+} // printVerifyStats
+
+// Write the statistics of the n statements in stats[] to a CSV file
+static void writeVerifyStats(struct verifyStats_struct *stats, long n,
+    vstring csvFileName) {
+  FILE *fp;
+  long i;
+
+  fp = fSafeOpen(csvFileName, "w", 1); // noVersioningFlag
+  if (fp == NULL) return; // (Error msg already provided by fSafeOpen)
+  fprintf(fp, "label,parse_seconds,verify_seconds,steps,backtracks\n");
+  for (i = 0; i < n; i++) {
+    fprintf(fp, "%s,%.6f,%.6f,%ld,%ld\n", g_Statement[stats[i].stmt].labelName,
+        stats[i].parseTime, stats[i].verifyTime, stats[i].steps,
+        stats[i].backtracks);
+  }
+  fclose(fp);
+  print2("The statistics of %ld statement(s) were written to \"%s\".\n", n,
+      csvFileName);
+} // writeVerifyStats
+
 // If verify = 0, parse the proofs only for gross error checking.
 // If verify = 1, do the full verification.
-void verifyProofs(vstring labelMatch, flag verifyFlag) {
+void verifyProofs(vstring labelMatch, flag verifyFlag, long statsCount,
+    vstring csvFileName) {
   vstring_def(emptyProofList);
   long i, k;
   long lineLen = 0;
   vstring_def(header);
   flag errorFound;
+  struct profileMark_struct mark; // For SET PROFILE STATEMENTS
+  // For / STATS and / CSV
+  struct verifyStats_struct *stats = NULL;
+  long statsLen = 0;
+  double t;
+  long backtracks = 0;
 #ifdef CLOCKS_PER_SEC
   clock_t clockStart;
 #endif
@@ -4612,6 +5017,12 @@ void verifyProofs(vstring labelMatch, flag verifyFlag) {
     free_vstring(header);
   }
 
+  if (statsCount > 0 || csvFileName[0]) {
+    stats = malloc((size_t)(g_statements + 1)
+        * sizeof(struct verifyStats_struct));
+    if (stats == NULL) outOfMemory("#152 (verifyStats)");
+  }
+
   errorFound = 0;
   for (i = 1; i <= g_statements; i++) {
     if (!strcmp("*", labelMatch) && verifyFlag) {
@@ -4633,14 +5044,34 @@ void verifyProofs(vstring labelMatch, flag verifyFlag) {
       print2("%s ",g_Statement[i].labelName);
     }
 
+    if (g_profileFlag == 2) profileMark(&mark);
+    if (stats) {
+      stats[statsLen].stmt = i;
+      stats[statsLen].verifyTime = 0.0;
+      backtracks = g_assignVarBacktracks;
+      t = cpuSeconds();
+    }
     k = parseProof(i);
+    if (stats) {
+      stats[statsLen].parseTime = cpuSeconds() - t;
+      stats[statsLen].steps = g_WrkProof.numSteps;
+    }
     if (k >= 2) errorFound = 1;
     if (k < 2) { // $p with no error
       if (verifyFlag) {
+        if (stats) t = cpuSeconds();
         if (verifyProof(i) >= 2) errorFound = 1;
+        if (stats) stats[statsLen].verifyTime = cpuSeconds() - t;
         cleanWrkProof(); // Deallocate verifyProof storage
       }
     }
+    if (stats) {
+      stats[statsLen].backtracks = g_assignVarBacktracks - backtracks;
+      statsLen++;
+    }
+    if (g_profileFlag == 2) {
+      profileRecord('s', g_Statement[i].labelName, &mark);
+    }
     if (k == 1) {
       let(&emptyProofList, cat(emptyProofList, ", ", g_Statement[i].labelName,
           NULL));
@@ -4667,38 +5098,389 @@ void verifyProofs(vstring labelMatch, flag verifyFlag) {
       print2("All proofs in the database passed the syntax-only check.\n");
     }
   }
+  if (stats) {
+    // The CSV file keeps the database order, so write it before sorting
+    if (csvFileName[0]) writeVerifyStats(stats, statsLen, csvFileName);
+    if (statsCount > 0) printVerifyStats(stats, statsLen, statsCount);
+    free(stats);
+  }
   free_vstring(emptyProofList); // Deallocate
 } // verifyProofs
 
+// Check date consistency and comment markup of the statements firstStmt
+// through lastStmt for verifyMarkup().  *mostRecentDate and *mostRecentStmt
+// are updated with the most recent date found.
+// Return 1 if error found, 0 otherwise
+static flag verifyMarkupComments(long firstStmt, long lastStmt,
+    vstring labelMatch, flag dateCheck, flag fileCheck,
+    vstring *mostRecentDate, long *mostRecentStmt)
+{
+  flag f;
+  flag errFound = 0;
+  long stmtNum, p1;
+  vstring_def(descr);
+  vstring_def(str1);
+
+  for (stmtNum = firstStmt; stmtNum <= lastStmt; stmtNum++) {
+    if (g_Statement[stmtNum].type != a_ && g_Statement[stmtNum].type != p_) {
+      continue;
+    }
+    if (!matchesList(g_Statement[stmtNum].labelName, labelMatch, '*', '?')) {
+      continue;
+    }
+
+    // Check the contributor
+    free_vstring(str1);
+    str1 = getContrib(stmtNum, CONTRIBUTOR);
+    if (!strcmp(str1, DEFAULT_CONTRIBUTOR)) {
+      printLongLine(cat(
+          "?Warning: Contributor \"", DEFAULT_CONTRIBUTOR,
+          "\" should be updated in statement \"",
+          g_Statement[stmtNum].labelName, "\".", NULL), "    ", " ");
+      errFound = 1;
+    }
+    free_vstring(str1);
+    str1 = getContrib(stmtNum, REVISER);
+    if (!strcmp(str1, DEFAULT_CONTRIBUTOR)) {
+      printLongLine(cat(
+          "?Warning: Reviser \"", DEFAULT_CONTRIBUTOR,
+          "\" should be updated in statement \"",
+          g_Statement[stmtNum].labelName, "\".", NULL), "    ", " ");
+      errFound = 1;
+    }
+
+    if (dateCheck) {
+
+      // Check date consistency of the statement.
+      // Use the error-checking feature of getContrib() extractor.
+      free_vstring(str1);
+      str1 = getContrib(stmtNum, GC_ERROR_CHECK_PRINT); // Returns P or F
+      if (str1[0] == 'F') errFound = 1;
+      free_vstring(str1);
+      str1 = getContrib(stmtNum, MOST_RECENT_DATE);
+
+      // Save most recent date in file - used to check Version date below
+      if (compareDates(*mostRecentDate, str1) == -1) {
+        let(&(*mostRecentDate), str1);
+        *mostRecentStmt = stmtNum;
+      }
+    }
+
+    free_vstring(descr);
+    descr = getDescription(stmtNum);
+
+    // Check comment markup of the statement
+    g_showStatement /* global */ = stmtNum; // For printTexComment
+    g_texFilePtr /* global */  = NULL; // Not used, but set to something
+    // Use the errors-only (no output) feature of printTexComment()
+    f = printTexComment(descr,
+        0, // 1 = htmlCenterFlag (irrelevant for this call)
+        PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
+        fileCheck);
+    if (f == 1) errFound = 1;
+
+    // Check that $a has no "(Proof modification is discouraged.)"
+    if (g_Statement[stmtNum].type == a_) {
+      if (getMarkupFlag(stmtNum, PROOF_DISCOURAGED) == 1) {
+        printLongLine(cat(
+            "?Warning: Statement \"", g_Statement[stmtNum].labelName,
+            "\" is a $a but has a \"(Proof modification is discouraged.)\" tag.",
+            NULL), "    ", " ");
+        errFound = 1;
+      }
+    }
+    // Check that *OLD and *ALT have both discouragements.
+    // See discussion at https://groups.google.com/d/msg/metamath/NhPM9XNNh1E/otl0uskKBgAJ
+    p1 = (long)strlen(g_Statement[stmtNum].labelName);
+    let(&str1, right(g_Statement[stmtNum].labelName, p1 - 2)); // Last 3 chars.
+    if (!strcmp(str1, "OLD") || !strcmp(str1, "ALT")) {
+      if (getMarkupFlag(stmtNum, PROOF_DISCOURAGED) != 1
+          && g_Statement[stmtNum].type == p_ // Ignore $a's
+          ) {
+        printLongLine(cat(
+            "?Warning: Statement \"", g_Statement[stmtNum].labelName,
+            "\" has suffix \"", str1,
+            "\" but has no \"(Proof modification is discouraged.)\" tag.",
+            NULL), "    ", " ");
+        errFound = 1;
+      }
+      if (getMarkupFlag(stmtNum, USAGE_DISCOURAGED) != 1) {
+        printLongLine(cat(
+            "?Warning: Statement \"", g_Statement[stmtNum].labelName,
+            "\" has suffix \"", str1,
+            "\" but has no \"(New usage is discouraged.)\" tag.",
+            NULL), "    ", " ");
+        errFound = 1;
+      }
+    }
+  } // next stmtNum
+
+  free_vstring(descr);
+  free_vstring(str1);
+  return errFound;
+} // verifyMarkupComments
+
+// Check the section header comments above the statements firstStmt
+// through lastStmt for verifyMarkup().
+// Return 1 if error found, 0 otherwise
+static flag verifyMarkupHeaders(long firstStmt, long lastStmt,
+    vstring labelMatch, flag fileCheck)
+{
+  flag f;
+  flag errFound = 0;
+  long stmtNum;
+  vstring_def(hugeHdr);
+  vstring_def(bigHdr);
+  vstring_def(smallHdr);
+  vstring_def(tinyHdr);
+  vstring_def(hugeHdrComment);
+  vstring_def(bigHdrComment);
+  vstring_def(smallHdrComment);
+  vstring_def(tinyHdrComment);
+
+  for (stmtNum = firstStmt; stmtNum <= lastStmt; stmtNum++) {
+    if (g_Statement[stmtNum].type != a_ && g_Statement[stmtNum].type != p_) {
+      continue;
+    }
+    if (!matchesList(g_Statement[stmtNum].labelName, labelMatch, '*', '?')) {
+      continue;
+    }
+
+    free_vstring(hugeHdr);
+    free_vstring(bigHdr);
+    free_vstring(smallHdr);
+    free_vstring(tinyHdr);
+    free_vstring(hugeHdrComment);
+    free_vstring(bigHdrComment);
+    free_vstring(smallHdrComment);
+    free_vstring(tinyHdrComment);
+    f = getSectionHeadings(stmtNum, &hugeHdr, &bigHdr, &smallHdr,
+        &tinyHdr,
+        &hugeHdrComment, &bigHdrComment, &smallHdrComment,
+        &tinyHdrComment,
+        0, // fineResolution
+        0); // fullComment
+    if (f != 0) errFound = 1;
+
+    g_showStatement /* global */ = stmtNum; // For printTexComment()
+    g_texFilePtr /* global */  = NULL; // Not used, but set to something
+
+    f = 0;
+    if (hugeHdrComment[0] != 0)
+      f = (char)(f + printTexComment(hugeHdrComment,
+          0, // 1 = htmlCenterFlag (irrelevant for this call)
+          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
+          fileCheck));
+    if (bigHdrComment[0] != 0)
+      f = (char)(f + printTexComment(bigHdrComment,
+          0, // 1 = htmlCenterFlag (irrelevant for this call)
+          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
+          fileCheck));
+    if (smallHdrComment[0] != 0)
+      f = (char)(f + printTexComment(smallHdrComment,
+          0, // 1 = htmlCenterFlag (irrelevant for this call)
+          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
+          fileCheck));
+    if (tinyHdrComment[0] != 0)
+      f = (char)(f + printTexComment(tinyHdrComment,
+          0, // 1 = htmlCenterFlag (irrelevant for this call)
+          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
+          fileCheck));
+
+    if (f != 0) printf(
+"    (The warning above refers to a header above the referenced statement.)\n");
+    if (f != 0) errFound = 1;
+  } // next stmtNum
+
+  free_vstring(hugeHdr);
+  free_vstring(bigHdr);
+  free_vstring(smallHdr);
+  free_vstring(tinyHdr);
+  free_vstring(hugeHdrComment);
+  free_vstring(bigHdrComment);
+  free_vstring(smallHdrComment);
+  free_vstring(tinyHdrComment);
+  return errFound;
+} // verifyMarkupHeaders
+
+// Maximum number of worker processes for VERIFY MARKUP ... / THREADS
+#define MAX_MARKUP_WORKERS 64
+
+// A range of statements checked by verifyMarkup().  With / THREADS, each
+// range is checked by a forked worker process, which has its own copy of
+// the global state used by the checks (g_htmlFlag, g_showStatement,
+// g_outputToString, the string stacks, etc.).  The worker's screen output
+// is captured in temporary files and printed by the parent in source order.
+struct markupWorker_struct {
+  long firstStmt;
+  long lastStmt;
+  flag forked; // 1 = the range is being checked by a worker process
+#ifdef VERIFY_MARKUP_FORK
+  pid_t pid;
+#endif
+  FILE *commentFp; // Output of verifyMarkupComments()
+  FILE *headerFp; // Output of verifyMarkupHeaders()
+  FILE *dateFp; // Most recent date statement number
+};
+
+// Divide the statements to be checked into ranges with about the same
+// number of $a/$p statements matching labelMatch, and start a worker
+// process for each range if possible.  Return the number of ranges.
+static long startMarkupWorkers(struct markupWorker_struct *worker,
+    long threads, vstring labelMatch, flag dateCheck, flag fileCheck)
+{
+  long stmtNum, w, workers, matches, count;
+
+  if (threads > MAX_MARKUP_WORKERS) threads = MAX_MARKUP_WORKERS;
+#ifndef VERIFY_MARKUP_FORK
+  threads = 1; // Worker processes are not supported on this platform
+#endif
+  if (threads < 1) threads = 1;
+
+  matches = 0;
+  if (threads > 1) {
+    for (stmtNum = 1; stmtNum <= g_statements; stmtNum++) {
+      if (g_Statement[stmtNum].type != a_ && g_Statement[stmtNum].type != p_) {
+        continue;
+      }
+      if (!matchesList(g_Statement[stmtNum].labelName, labelMatch, '*', '?')) {
+        continue;
+      }
+      matches++;
+    }
+    if (threads > matches) threads = matches;
+  }
+  for (w = 0; w < threads; w++) {
+    worker[w].forked = 0;
+    worker[w].commentFp = NULL;
+    worker[w].headerFp = NULL;
+    worker[w].dateFp = NULL;
+  }
+  if (threads <= 1) {
+    worker[0].firstStmt = 1;
+    worker[0].lastStmt = g_statements;
+    return 1;
+  }
+
+  // Assign the ranges
+  workers = 0;
+  count = 0;
+  worker[0].firstStmt = 1;
+  for (stmtNum = 1; stmtNum <= g_statements; stmtNum++) {
+    if (g_Statement[stmtNum].type != a_ && g_Statement[stmtNum].type != p_) {
+      continue;
+    }
+    if (!matchesList(g_Statement[stmtNum].labelName, labelMatch, '*', '?')) {
+      continue;
+    }
+    count++;
+    if (count >= ((workers + 1) * matches) / threads) {
+      worker[workers].lastStmt = stmtNum;
+      workers++;
+      if (workers == threads) break;
+      worker[workers].firstStmt = stmtNum + 1;
+    }
+  }
+  if (workers != threads) bug(275);
+  worker[workers - 1].lastStmt = g_statements;
+
+#ifdef VERIFY_MARKUP_FORK
+  fflush(NULL); // So that buffered output isn't duplicated by the workers
+  for (w = 0; w < workers; w++) {
+    worker[w].commentFp = tmpfile();
+    worker[w].headerFp = tmpfile();
+    worker[w].dateFp = tmpfile();
+    if (worker[w].commentFp == NULL || worker[w].headerFp == NULL
+        || worker[w].dateFp == NULL) {
+      continue; // Check this range in this process instead
+    }
+    worker[w].pid = fork();
+    if (worker[w].pid < 0) continue; // Check in this process instead
+    if (worker[w].pid == 0) {
+      // This is the worker process.  Send everything printed to the
+      // temporary files, without prompts, paging, or logging.
+      flag errFound;
+      vstring_def(mostRecentDate);
+      long mostRecentStmt = 0;
+      g_scrollMode = 0;
+      g_logFileOpenFlag = 0;
+      g_commandFileSilentFlag = 0;
+      g_outputToString = 0;
+      if (!freopen("/dev/null", "r", stdin)) _exit(2);
+      if (dup2(fileno(worker[w].commentFp), STDOUT_FILENO) < 0) _exit(2);
+      errFound = verifyMarkupComments(worker[w].firstStmt,
+          worker[w].lastStmt, labelMatch, dateCheck, fileCheck,
+          &mostRecentDate, &mostRecentStmt);
+      fprintf(worker[w].dateFp, "%ld\n", mostRecentStmt);
+      fflush(stdout);
+      if (dup2(fileno(worker[w].headerFp), STDOUT_FILENO) < 0) _exit(2);
+      if (verifyMarkupHeaders(worker[w].firstStmt, worker[w].lastStmt,
+          labelMatch, fileCheck)) {
+        errFound = 1;
+      }
+      fflush(stdout);
+      fflush(worker[w].dateFp);
+      _exit(errFound);
+    }
+    worker[w].forked = 1;
+  } // next w
+#endif
+  return workers;
+} // startMarkupWorkers
+
+// Print a worker's captured output through print2(), so that paging and
+// any open log file see it as if it had been printed directly.
+static void printMarkupWorkerOutput(FILE *fp)
+{
+  vstring_def(line);
+  rewind(fp);
+  while (linput(fp, NULL, &line)) {
+    print2("%s\n", line);
+  }
+  free_vstring(line);
+} // printMarkupWorkerOutput
+
+// Wait for the worker process of a range to finish.
+// Return 1 if it found an error, 0 if not; if the worker failed, its range
+// is changed to be checked in this process and 0 is returned.
+static flag waitMarkupWorker(struct markupWorker_struct *worker)
+{
+#ifdef VERIFY_MARKUP_FORK
+  int status;
+  if (!worker->forked) return 0;
+  if (waitpid(worker->pid, &status, 0) != worker->pid
+      || !WIFEXITED(status) || WEXITSTATUS(status) > 1) {
+    worker->forked = 0;
+    return 0;
+  }
+  return (flag)WEXITSTATUS(status);
+#else
+  (void)worker;
+  return 0;
+#endif
+} // waitMarkupWorker
+
 void verifyMarkup(vstring labelMatch,
     flag dateCheck, // 1 = check date consistency
     flag topDateCheck, // 1 = check top date
     flag fileCheck, // 1 = check external files (gifs and bib)
     flag underscoreCheck, // 1 = check labels for "_" characters)
     flag mathboxCheck, // 1 = check mathbox cross-references)
-    flag verboseMode) // 1 = more details
+    flag verboseMode, // 1 = more details
+    long threads) // Number of worker processes for statement checks
 {
   flag f;
   flag saveHtmlFlag, saveAltHtmlFlag;
   flag errFound = 0;
   long stmtNum, p1, p2, p3;
   long flen, lnum, lstart; // For line length check
+  struct markupWorker_struct worker[MAX_MARKUP_WORKERS];
+  long w; // Number of statement ranges (workers)
 
   vstring_def(mmVersionDate); // Version date at top of .mm file
   vstring_def(mostRecentDate); // For entire .mm file
   long mostRecentStmt = 0; // For error message
 
-  // For getSectionHeadings() call
-  vstring_def(hugeHdr);
-  vstring_def(bigHdr);
-  vstring_def(smallHdr);
-  vstring_def(tinyHdr);
-  vstring_def(hugeHdrComment);
-  vstring_def(bigHdrComment);
-  vstring_def(smallHdrComment);
-  vstring_def(tinyHdrComment);
-
-  vstring_def(descr);
   vstring_def(str1);
   vstring_def(str2);
 
@@ -5022,101 +5804,31 @@ void verifyMarkup(vstring labelMatch,
   if (f != 0) errFound = 1;
 
   // Check date consistency and comment markup in all statements
+  w = startMarkupWorkers(worker, threads, labelMatch, dateCheck, fileCheck);
   print2("Checking statement comments...\n");
   let(&mostRecentDate, "");
-  for (stmtNum = 1; stmtNum <= g_statements; stmtNum++) {
-    if (g_Statement[stmtNum].type != a_ && g_Statement[stmtNum].type != p_) {
-      continue;
-    }
-    if (!matchesList(g_Statement[stmtNum].labelName, labelMatch, '*', '?')) {
-      continue;
-    }
-
-    // Check the contributor
-    free_vstring(str1);
-    str1 = getContrib(stmtNum, CONTRIBUTOR);
-    if (!strcmp(str1, DEFAULT_CONTRIBUTOR)) {
-      printLongLine(cat(
-          "?Warning: Contributor \"", DEFAULT_CONTRIBUTOR,
-          "\" should be updated in statement \"",
-          g_Statement[stmtNum].labelName, "\".", NULL), "    ", " ");
-      errFound = 1;
-    }
-    free_vstring(str1);
-    str1 = getContrib(stmtNum, REVISER);
-    if (!strcmp(str1, DEFAULT_CONTRIBUTOR)) {
-      printLongLine(cat(
-          "?Warning: Reviser \"", DEFAULT_CONTRIBUTOR,
-          "\" should be updated in statement \"",
-          g_Statement[stmtNum].labelName, "\".", NULL), "    ", " ");
-      errFound = 1;
-    }
-
-    if (dateCheck) {
-
-      // Check date consistency of the statement.
-      // Use the error-checking feature of getContrib() extractor.
-      free_vstring(str1);
-      str1 = getContrib(stmtNum, GC_ERROR_CHECK_PRINT); // Returns P or F
-      if (str1[0] == 'F') errFound = 1;
-      free_vstring(str1);
-      str1 = getContrib(stmtNum, MOST_RECENT_DATE);
-
-      // Save most recent date in file - used to check Version date below
-      if (compareDates(mostRecentDate, str1) == -1) {
-        let(&mostRecentDate, str1);
-        mostRecentStmt = stmtNum;
-      }
-    }
-
-    free_vstring(descr);
-    descr = getDescription(stmtNum);
-
-    // Check comment markup of the statement
-    g_showStatement /* global */ = stmtNum; // For printTexComment
-    g_texFilePtr /* global */  = NULL; // Not used, but set to something
-    // Use the errors-only (no output) feature of printTexComment()
-    f = printTexComment(descr,
-        0, // 1 = htmlCenterFlag (irrelevant for this call)
-        PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
-        fileCheck);
-    if (f == 1) errFound = 1;
-
-    // Check that $a has no "(Proof modification is discouraged.)"
-    if (g_Statement[stmtNum].type == a_) {
-      if (getMarkupFlag(stmtNum, PROOF_DISCOURAGED) == 1) {
-        printLongLine(cat(
-            "?Warning: Statement \"", g_Statement[stmtNum].labelName,
-            "\" is a $a but has a \"(Proof modification is discouraged.)\" tag.",
-            NULL), "    ", " ");
-        errFound = 1;
-      }
-    }
-    // Check that *OLD and *ALT have both discouragements.
-    // See discussion at https://groups.google.com/d/msg/metamath/NhPM9XNNh1E/otl0uskKBgAJ
-    p1 = (long)strlen(g_Statement[stmtNum].labelName);
-    let(&str1, right(g_Statement[stmtNum].labelName, p1 - 2)); // Last 3 chars.
-    if (!strcmp(str1, "OLD") || !strcmp(str1, "ALT")) {
-      if (getMarkupFlag(stmtNum, PROOF_DISCOURAGED) != 1
-          && g_Statement[stmtNum].type == p_ // Ignore $a's
-          ) {
-        printLongLine(cat(
-            "?Warning: Statement \"", g_Statement[stmtNum].labelName,
-            "\" has suffix \"", str1,
-            "\" but has no \"(Proof modification is discouraged.)\" tag.",
-            NULL), "    ", " ");
-        errFound = 1;
+  for (p1 = 0; p1 < w; p1++) {
+    if (waitMarkupWorker(&worker[p1])) errFound = 1;
+    if (worker[p1].forked) {
+      printMarkupWorkerOutput(worker[p1].commentFp);
+      rewind(worker[p1].dateFp);
+      if (fscanf(worker[p1].dateFp, "%ld", &stmtNum) != 1) bug(276);
+      if (stmtNum != 0) {
+        free_vstring(str1);
+        str1 = getContrib(stmtNum, MOST_RECENT_DATE);
+        if (compareDates(mostRecentDate, str1) == -1) {
+          let(&mostRecentDate, str1);
+          mostRecentStmt = stmtNum;
+        }
       }
-      if (getMarkupFlag(stmtNum, USAGE_DISCOURAGED) != 1) {
-        printLongLine(cat(
-            "?Warning: Statement \"", g_Statement[stmtNum].labelName,
-            "\" has suffix \"", str1,
-            "\" but has no \"(New usage is discouraged.)\" tag.",
-            NULL), "    ", " ");
+    } else {
+      if (verifyMarkupComments(worker[p1].firstStmt, worker[p1].lastStmt,
+          labelMatch, dateCheck, fileCheck,
+          &mostRecentDate, &mostRecentStmt)) {
         errFound = 1;
       }
     }
-  } // next stmtNum
+  } // next p1
 
   // Check that the version date of the .mm file is g.e. all statement dates.
   // This code expects a version date at the top of the file such as:
@@ -5157,59 +5869,19 @@ void verifyMarkup(vstring labelMatch,
   } // if (topDateCheck)
 
   print2("Checking section header comments...\n");
-  for (stmtNum = 1; stmtNum <= g_statements; stmtNum++) {
-    if (g_Statement[stmtNum].type != a_ && g_Statement[stmtNum].type != p_) {
-      continue;
-    }
-    if (!matchesList(g_Statement[stmtNum].labelName, labelMatch, '*', '?')) {
-      continue;
+  for (p1 = 0; p1 < w; p1++) {
+    if (worker[p1].forked) {
+      printMarkupWorkerOutput(worker[p1].headerFp);
+    } else {
+      if (verifyMarkupHeaders(worker[p1].firstStmt, worker[p1].lastStmt,
+          labelMatch, fileCheck)) {
+        errFound = 1;
+      }
     }
-
-    free_vstring(hugeHdr);
-    free_vstring(bigHdr);
-    free_vstring(smallHdr);
-    free_vstring(tinyHdr);
-    free_vstring(hugeHdrComment);
-    free_vstring(bigHdrComment);
-    free_vstring(smallHdrComment);
-    free_vstring(tinyHdrComment);
-    f = getSectionHeadings(stmtNum, &hugeHdr, &bigHdr, &smallHdr,
-        &tinyHdr,
-        &hugeHdrComment, &bigHdrComment, &smallHdrComment,
-        &tinyHdrComment,
-        0, // fineResolution
-        0); // fullComment
-    if (f != 0) errFound = 1;
-
-    g_showStatement /* global */ = stmtNum; // For printTexComment()
-    g_texFilePtr /* global */  = NULL; // Not used, but set to something
-
-    f = 0;
-    if (hugeHdrComment[0] != 0)
-      f = (char)(f + printTexComment(hugeHdrComment,
-          0, // 1 = htmlCenterFlag (irrelevant for this call)
-          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
-          fileCheck));
-    if (bigHdrComment[0] != 0)
-      f = (char)(f + printTexComment(bigHdrComment,
-          0, // 1 = htmlCenterFlag (irrelevant for this call)
-          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
-          fileCheck));
-    if (smallHdrComment[0] != 0)
-      f = (char)(f + printTexComment(smallHdrComment,
-          0, // 1 = htmlCenterFlag (irrelevant for this call)
-          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
-          fileCheck));
-    if (tinyHdrComment[0] != 0)
-      f = (char)(f + printTexComment(tinyHdrComment,
-          0, // 1 = htmlCenterFlag (irrelevant for this call)
-          PROCESS_EVERYTHING + ERRORS_ONLY, // actionBits
-          fileCheck));
-
-    if (f != 0) printf(
-"    (The warning above refers to a header above the referenced statement.)\n");
-    if (f != 0) errFound = 1;
-  } // next stmtNum
+    if (worker[p1].commentFp != NULL) fclose(worker[p1].commentFp);
+    if (worker[p1].headerFp != NULL) fclose(worker[p1].headerFp);
+    if (worker[p1].dateFp != NULL) fclose(worker[p1].dateFp);
+  } // next p1
 
   // Use the errors-only (no output) feature of writeBibliography()
   print2("Checking bibliographic references...\n");
@@ -5305,17 +5977,8 @@ void verifyMarkup(vstring labelMatch,
   // Deallocate string memory
   free_vstring(mostRecentDate);
   free_vstring(mmVersionDate);
-  free_vstring(descr);
   free_vstring(str1);
   free_vstring(str2);
-  free_vstring(hugeHdr);
-  free_vstring(bigHdr);
-  free_vstring(smallHdr);
-  free_vstring(tinyHdr);
-  free_vstring(hugeHdrComment);
-  free_vstring(bigHdrComment);
-  free_vstring(smallHdrComment);
-  free_vstring(tinyHdrComment);
   return;
 } // verifyMarkup
 
@@ -5694,6 +6357,7 @@ long getStatementNum(vstring stmtName, // Possibly with wildcards.
       if (maxStmt > g_statements) bug(247);
       // If a $e or $f, it must be a hypothesis of the statement being proved.
       if (typ == (char)e_ || typ == (char)f_){
+        buildOptHypList(maxStmt);
         if (!nmbrElementIn(1, g_Statement[maxStmt].reqHypList, stmt) &&
             !nmbrElementIn(1, g_Statement[maxStmt].optHypList, stmt))
             continue;
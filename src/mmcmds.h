@@ -67,6 +67,11 @@ vstring htmlDummyVars(long showStmt);
 vstring htmlAllowedSubst(long showStmt);
 
 void readInput(void);
+/*! READ / INCREMENTAL of the database that has already been read:  if some
+   of its source files changed, read and parse all of it again, and verify
+   only the proofs that may be affected by the changes.  Returns 1 if it was
+   read again. */
+flag rereadInput(void);
 /*! WRITE SOURCE command */
 void writeSource(
   flag reformatFlag, // 1 = "/ FORMAT", 2 = "/REWRAP"
@@ -84,15 +89,24 @@ void fixUndefinedLabels(vstring extractNeeded, vstring *buf);
 
 void writeDict(void);
 void eraseSource(void);
-void verifyProofs(vstring labelMatch, flag verifyFlag);
+/*! Implements VERIFY PROOF.  If verifyFlag = 0, the proofs are only parsed.
+   If statsCount > 0 (/ STATS), the statsCount slowest statements and a
+   histogram of the time per statement are printed; if csvFileName is not ""
+   (/ CSV), the time, step count and assignVar() backtracks of each statement
+   are written to it. */
+void verifyProofs(vstring labelMatch, flag verifyFlag, long statsCount,
+    vstring csvFileName);
 
 /*! If checkFiles = 0, do not open external files.
-   If checkFiles = 1, check for presence of gifs and biblio file */
+   If checkFiles = 1, check for presence of gifs and biblio file.
+   If threads > 1, the statement comment and section header checks are
+   divided among that many worker processes where supported. */
 void verifyMarkup(vstring labelMatch, flag dateCheck, flag topDateCheck,
     flag fileCheck,
     flag underscoreCheck,
     flag mathboxCheck,
-    flag verboseMode);
+    flag verboseMode,
+    long threads);
 
 void processMarkup(vstring inputFileName, vstring outputFileName,
     flag processCss, long actionBits);
@@ -12,6 +12,7 @@
  * to BASIC string functions; memory management; converts between proof formats
 */
 #include <stdarg.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mmvstr.h"
@@ -24,6 +25,8 @@
 #include "mmfatl.h"
 
 /*E*/long db=0,db0=0,db2=0,db3=0,db4=0,db5=0,db6=0,db7=0,db8=0,db9=0;
+long g_poolMallocCount = 0;
+long g_tempAllocCount = 0;
 flag g_listMode = 0; // 0 = metamath, 1 = list utility
 flag g_toolsMode = 0; // In metamath: 0 = metamath, 1 = text tools utility
 
@@ -55,7 +58,7 @@ char *g_sourcePtr = NULL;
 long g_sourceLen;
 
 // Null nmbrString
-struct nullNmbrStruct g_NmbrNull = {-1, sizeof(long), sizeof(long), -1};
+struct nullNmbrStruct g_NmbrNull = {-1, sizeof(nmbrString), sizeof(nmbrString), -1};
 
 // Null pntrString
 struct nullPntrStruct g_PntrNull = {-1, sizeof(long), sizeof(long), NULL};
@@ -83,11 +86,10 @@ vstring g_qsortKey; // Used by qsortStringCmp; pointer only, do not deallocate
  *
  * During execution chunks of memory, either complete \ref pgBlock "blocks" or
  * \ref pgFragmentation "fragments" thereof, become free again.  The
- * suballocator adds them then to internal **pools** for reuse, one dedicated
- * to totally free blocks (\ref memFreePool), the other to fragmented ones
- * (\ref memUsedPool).  We call these pools **free block array** and
- * **used block array** in this documentation.  Fully occupied blocks are not
- * tracked by the suballocator.
+ * suballocator adds them then to internal **pools** for reuse:  totally free
+ * blocks go to the **free lists** (\ref memFreePool), one per size class, and
+ * fragmented ones to the **used block array** (\ref memUsedPool).  Fully
+ * occupied blocks are not tracked by the suballocator.
  *
  * Although the suballocator tries to avoid returning memory to the system, it
  * can do so under extreme memory constraints, or when built-in limits are
@@ -155,10 +157,30 @@ vstring g_qsortKey; // Used by qsortStringCmp; pointer only, do not deallocate
  * In Metamath a pool has no gaps in between.
  *
  * The \ref pgSuballocator "suballocator" uses two pools:
- * - the **free block array** pointed to by \ref memFreePool;
+ * - the **free lists** headed by \ref memFreePool, which are linked lists
+ *   rather than arrays (see \ref pgSizeClass);
  * - the **used block array** pointed to by \ref memUsedPool.
  */
 
+/*! \page pgSizeClass Size classes
+ * Free \ref pgBlock "blocks" are kept in segregated free lists, one for each
+ * size class, so that a block of the right size is found in constant time.
+ * The class sizes are the multiples of 8 bytes up to 64, then four classes
+ * per power of 2:  64, 80, 96, 112, 128, 160, ...  The waste of rounding up
+ * to a class is thus at most 25% (plus up to 7 bytes).
+ *
+ * \ref poolMalloc rounds the requested size up to its class and allocates
+ * blocks of exactly the class size, so a block freed by \ref poolFree returns
+ * to the class it came from and serves the next request of that class.  A
+ * block of another size (from \ref poolFixedMalloc) goes to the largest
+ * class not exceeding its size; every block in a free list is therefore at
+ * least as large as its class.  Blocks smaller than 8 bytes are returned to
+ * the system directly.
+ *
+ * The free lists are linked through element 0 of the free blocks, so freeing
+ * and allocating never needs to grow an array.
+ */
+
 /*! \page pgStack Temporary Allocated Memory
  * Very often a routine needs some memory, that must live only as long as the
  * routine is active.  Such memory is called **temporary**, or short **local**.
@@ -229,7 +251,7 @@ vstring g_qsortKey; // Used by qsortStringCmp; pointer only, do not deallocate
 
 /*!
  * \def MEM_POOL_GROW
- * Amount that \ref memUsedPool and \ref memFreePool grows when it overflows.
+ * Amount that \ref memUsedPool grows when it overflows.
  */
 #define MEM_POOL_GROW 1000
 // ??? Let user set this from menu.
@@ -244,7 +266,9 @@ vstring g_qsortKey; // Used by qsortStringCmp; pointer only, do not deallocate
  * taking unnecessary action such as saving RAM to disk, a limit to the amount
  * of free memory managed by the suballocator can be set up.  This limit is
  * checked in frequent operations, and an automatic purge process is initiated
- * in \ref memFreePoolPurge should \ref poolTotalFree exceed this value.
+ * in \ref memFreePoolPurge should \ref memFreePoolBytes exceed this value.
+ * (The free space at the end of partially used blocks is not counted:  the
+ * purge cannot return it.)
  */
 long poolAbsoluteMax = 1000000; // Pools will be purged when this is reached
 
@@ -252,9 +276,7 @@ long poolAbsoluteMax = 1000000; // Pools will be purged when this is reached
  * \var long poolTotalFree
  * contains the number of free space available in bytes, in both pools
  * \ref memFreePool and \ref memUsedPool, never counting the hidden headers at
- * the beginning of each block, see \ref pgBlock.  Exceeding
- * \ref poolAbsoluteMax may trigger an automatic purge process by
- * \ref memFreePoolPurge.
+ * the beginning of each block, see \ref pgBlock.
  */
 long poolTotalFree = 0; // Total amount of free space allocated in pool
 /*E*/long i1,j1_,k1; // 'j1' is a built-in function
@@ -319,54 +341,102 @@ long memUsedPoolSize = 0; // Current # of partially filled arrays in use
 long memUsedPoolMax = 0; 
 
 /*!
- * \var void** memFreePool
- * \brief pointer to the pool of completely free memory blocks
- *
- * The \ref pgSuballocator "suballocator" is initially not equipped with a
- * **free block array**, pointed to by memFreePool, indicated by a null value.
- *
- * Once a \ref pgBlock "memory block" is returned to the \ref pgSuballocator
- * again, it allocates some space for the now needed array.
- *
- * The **free block array** contains only totally free \ref pgBlock "blocks".
- * This array may only be partially occupied, in which case the elements at the
- * end are the unused ones.  Its current fill size is given by
- * \ref memFreePoolSize.  Its capacity is given by \ref memFreePoolMax.
- *
- * Fragmented blocks are kept in a separate \ref memUsedPool.  The suballocator
- * never tracks fully used blocks.
+ * \def POOL_CLASSES
+ * Number of \ref pgSizeClass "size classes":  7 below 64 bytes, then 4 for
+ * each power of 2 up to the largest long.
  */
-void **memFreePool = NULL;
+#define POOL_CLASSES (7 + 4 * ((long)(8 * sizeof(long)) - 6))
 
 /*!
- * \var long memFreePoolSize
- * \attention this is the number of individual free blocks, not the accumulated
- * bytes contained.
+ * \var void* memFreePool[POOL_CLASSES]
+ * \brief heads of the free lists of completely free memory blocks
  *
- * The Metamath suballocator holds free blocks in a free block array.  The
- * number of occupied entries is kept in this variable.  Elements at the end of
- * the free block array may not be used.  The fill size is given by this
- * variable.  For further information see \ref memFreePool.
+ * memFreePool[c] points to the first free \ref pgBlock "block" of size class
+ * c (see \ref pgSizeClass), or is NULL if there is none.  Element 0 of each
+ * free block points to the next free block of the same class.
  *
- * \invariant memFreePoolSize <= \ref memFreePoolMax.
+ * Fragmented blocks are kept in a separate \ref memUsedPool.  The suballocator
+ * never tracks fully used blocks.
  */
-long memFreePoolSize = 0; // Current # of available, allocated arrays
+static void *memFreePool[POOL_CLASSES];
 
 /*!
- * \var long memFreePoolMax
- * \attention this is the number of individual free blocks, not the accumulated
- * bytes contained.
- *
- * The Metamath suballocator holds free blocks in a **free block array**.  It
- * may only be partially occupied.  Its total capacity is kept in this variable.  For
- * further information see \ref memFreePool.
- *
- * This variable may grow during a reallocation process.
- *
- * \invariant (memFreePoolMax > 0) == (\ref memFreePool != 0)
+ * \var long memFreePoolBytes
+ * The number of bytes in all blocks of the free lists \ref memFreePool, not
+ * counting the hidden headers.  Exceeding \ref poolAbsoluteMax triggers an
+ * automatic purge by \ref memFreePoolPurge.
  */
-// Maximum # of entries in 'free' table (grows as necessary)
-long memFreePoolMax = 0;
+long memFreePoolBytes = 0;
+
+// Statistics per size class for SHOW MEMORY
+static long poolClassFree[POOL_CLASSES]; // Blocks in the free list now
+static long poolClassMallocs[POOL_CLASSES]; // poolMalloc() calls
+static long poolClassReuses[POOL_CLASSES]; // ...served from the free list
+
+// The size of size class c in bytes
+static long poolClassSize(long c) {
+  if (c < 7) return 8 * (c + 1);
+  return (4 + (c - 7) % 4) << ((c - 7) / 4 + 4);
+}
+
+// The position of the highest bit set in size, which must be at least 64
+static long poolLog2(long size) {
+#ifdef __GNUC__
+  return (long)(8 * sizeof(long)) - 1 - __builtin_clzl((unsigned long)size);
+#else
+  long k;
+  for (k = 6; (size >> (k + 1)) != 0; k++);
+  return k;
+#endif
+}
+
+// The smallest size class of at least size bytes
+static long poolClassUp(long size) {
+  long k;
+  if (size <= 64) return size <= 8 ? 0 : (size - 1) / 8;
+  // 2^k < size <= 2^(k+1); the classes between are 2^k + j * 2^(k-2)
+  k = poolLog2(size - 1);
+  return 7 + (k - 6) * 4 + ((size - (1L << k)) + (1L << (k - 2)) - 1)
+      / (1L << (k - 2));
+}
+
+// The largest size class of at most size bytes, -1 if size < 8
+static long poolClassDown(long size) {
+  long k;
+  if (size < 64) return size / 8 - 1;
+  k = poolLog2(size);
+  return 7 + (k - 6) * 4 + (size - (1L << k)) / (1L << (k - 2));
+}
+
+// Remove the first block from the free list of class c, which must not be
+// empty
+static void *poolPop(long c) {
+  void *ptr = memFreePool[c];
+  memFreePool[c] = *(void **)ptr;
+  poolClassFree[c]--;
+  memFreePoolBytes = memFreePoolBytes - ((long *)ptr)[-2];
+  poolTotalFree = poolTotalFree - ((long *)ptr)[-2];
+  return ptr;
+}
+
+// Allocate a new block of allocSize bytes from the system, deallocating the
+// free lists and trying again if memory is low
+static void *poolSystemMalloc(long allocSize, const char *caller) {
+  void *ptr;
+  ptr = malloc(3 * sizeof(long) + (size_t)allocSize);
+  if (!ptr) {
+    // Try freeing space
+    print2("Memory is low.  Deallocating storage pool...\n");
+    memFreePoolPurge(0);
+    ptr = malloc(3 * sizeof(long) + (size_t)allocSize);
+    if (!ptr) outOfMemory(
+        // Nothing more can be done
+        cat(caller, str((double)allocSize), ")", NULL));
+  }
+  ptr = (long *)ptr + 3;
+  ((long *)ptr)[-2] = allocSize; // Allocated size
+  return ptr;
+}
 
 // poolFixedMalloc should be called when the allocated array will rarely be
 // changed; a malloc or realloc with no unused array bytes will be done.
@@ -374,140 +444,65 @@ void *poolFixedMalloc(long size) // bytes
 {
   void *ptr;
   void *ptr2;
+  long c;
 /*E*/ // Don't call print2() if db9 is set, since it will
 /*E*/ // recursively call the pool stuff causing a crash.
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("a0: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
-  if (!memFreePoolSize) { // The pool is empty; we must allocate memory
-    ptr = malloc( 3 * sizeof(long) + (size_t)size);
-    if (!ptr) outOfMemory(
-        cat("#25 (poolFixedMalloc ", str((double)size), ")", NULL));
-
-    ptr = (long *)ptr + 3;
-    ((long *)ptr)[-1] = size; // Actual size
-    ((long *)ptr)[-2] = size; // Allocated size
-    ((long *)ptr)[-3] = -1; // Location in memUsedPool (-1 = none)
-    return (ptr);
+  c = poolClassUp(size);
+  if (!memFreePool[c]) { // The free list is empty; we must allocate memory
+    ptr = poolSystemMalloc(size, "#25 (poolFixedMalloc ");
   } else {
-    memFreePoolSize--;
-    ptr = memFreePool[memFreePoolSize];
-    poolTotalFree = poolTotalFree - ((long *)ptr)[-2];
+    ptr = poolPop(c);
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("a: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
-    if (size <= ((long *)ptr)[-2]) { // We have enough space already
-      ptr2 = realloc( (long *)ptr - 3, 3 * sizeof(long) + (size_t)size);
-      // Reallocation cannot fail, since we are shrinking space
-      if (!ptr2) bug(1382);
-      ptr = ptr2;
-    } else { // The pool's last entry is too small; free and allocate new
-      free((long *)ptr - 3);
-      ptr = malloc( 3 * sizeof(long) + (size_t)size);
-    }
-    if (!ptr) {
-      // Try freeing space
-      print2("Memory is low.  Deallocating storage pool...\n");
-      memFreePoolPurge(0);
-      ptr = malloc( 3 * sizeof(long) + (size_t)size);
-      if (!ptr) outOfMemory(
-          // Nothing more can be done
-          cat("#26 (poolMalloc ", str((double)size), ")", NULL));                 
-    }
-    ptr = (long *)ptr + 3;
-    ((long *)ptr)[-1] = size; // Actual size
+    // The block is large enough; shrink it to the exact size
+    ptr2 = realloc((long *)ptr - 3, 3 * sizeof(long) + (size_t)size);
+    // Reallocation cannot fail, since we are shrinking space
+    if (!ptr2) bug(1382);
+    ptr = (long *)ptr2 + 3;
     ((long *)ptr)[-2] = size; // Allocated size
-    ((long *)ptr)[-3] = -1; // Location in memUsedPool (-1 = none)
-    return ptr;
   }
+  ((long *)ptr)[-1] = size; // Actual size
+  ((long *)ptr)[-3] = -1; // Location in memUsedPool (-1 = none)
+  return ptr;
 }
 
-// poolMalloc tries first to use an array in the memFreePool before actually malloc'ing
+// poolMalloc tries first to use an array in the free list of the size class
+// before actually malloc'ing
 void *poolMalloc(long size) // bytes
 {
   void *ptr;
-  long memUsedPoolTmpMax;
-  void *memUsedPoolTmpPtr;
+  long c;
 
-  // Check to see if the pool total exceeds max.
-  if (poolTotalFree > poolAbsoluteMax) {
+  g_poolMallocCount++;
+  // Check to see if the free lists exceed the max.
+  if (memFreePoolBytes > poolAbsoluteMax) {
     memFreePoolPurge(1);
   }
 
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("b0: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
-  if (!memFreePoolSize) { // The pool is empty; we must allocate memory
-    ptr = malloc( 3 * sizeof(long) + (size_t)size);
-    if (!ptr) {
-      outOfMemory(cat("#27 (poolMalloc ", str((double)size), ")", NULL));
-    }
-    ptr = (long *)ptr + 3;
-    ((long *)ptr)[-1] = size; // Actual size
-    ((long *)ptr)[-2] = size; // Allocated size
-    ((long *)ptr)[-3] = -1; // Location in memUsedPool (-1 = none)
-    return (ptr);
-  } else {
-    memFreePoolSize--;
-    ptr = memFreePool[memFreePoolSize];
-    poolTotalFree = poolTotalFree - ((long *)ptr)[-2];
+  c = poolClassUp(size);
+  poolClassMallocs[c]++;
+  if (memFreePool[c]) {
+    ptr = poolPop(c);
+    poolClassReuses[c]++;
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("b: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
-    if (size <= ((long *)ptr)[-2]) { // We have enough space already
-      ((long *)ptr)[-1] = size; // Actual size
-      ((long *)ptr)[-3] = -1; // Not in storage pool yet
-    } else { // We must reallocate
-      free((long *)ptr - 3);
-      ptr = malloc( 3 * sizeof(long) + (size_t)size);
-      if (!ptr) {
-        // Try freeing space
-        print2("Memory is low.  Deallocating storage pool...\n");
-        memFreePoolPurge(0);
-        ptr = malloc( 3 * sizeof(long) + (size_t)size);
-        if (!ptr) outOfMemory(
-            // Nothing more can be done
-            cat("#28 (poolMalloc ", str((double)size), ")", NULL));                    
-      }
-      ptr = (long *)ptr + 3;
-      ((long *)ptr)[-1] = size; // Actual size
-      ((long *)ptr)[-2] = size; // Allocated size
-      ((long *)ptr)[-3] = -1;  // Location in memUsedPool (-1 = none)
-/*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("bb: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
-      return (ptr);
-    }
+  } else { // The free list is empty; allocate a block of the class size
+    ptr = poolSystemMalloc(poolClassSize(c), "#27 (poolMalloc ");
   }
+  ((long *)ptr)[-1] = size; // Actual size
+  ((long *)ptr)[-3] = -1; // Location in memUsedPool (-1 = none)
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("bc: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
   if (((long *)ptr)[-1] == ((long *)ptr)[-2]) return (ptr);
   // Allocated and actual sizes are different, so add this array to used pool
-  poolTotalFree = poolTotalFree + ((long *)ptr)[-2] - ((long *)ptr)[-1];
-  if (memUsedPoolSize >= memUsedPoolMax) { // Increase size of used pool
-    memUsedPoolTmpMax = memUsedPoolMax + MEM_POOL_GROW;
-/*E*/if(db9)printf("Growing used pool to %ld\n",memUsedPoolTmpMax);
-    if (!memUsedPoolMax) {
-      // The program has just started; initialize
-      memUsedPoolTmpPtr = malloc((size_t)memUsedPoolTmpMax
-          * sizeof(void *));
-      // Shouldn't have allocation problems when program first starts
-      if (!memUsedPoolTmpPtr) bug(1303); 
-    } else {
-      // Normal reallocation
-      memUsedPoolTmpPtr = realloc(memUsedPool,
-          (size_t)memUsedPoolTmpMax * sizeof(void *));
-    }
-    if (!memUsedPoolTmpPtr) {
-      outOfMemory(cat("#29 (poolMalloc ", str((double)memUsedPoolTmpMax), ")", NULL));
-    } else {
-      // Reallocation successful
-      memUsedPool = memUsedPoolTmpPtr;
-      memUsedPoolMax = memUsedPoolTmpMax;
-    }
-  }
-  memUsedPool[memUsedPoolSize] = ptr;
-  ((long *)ptr)[-3] = memUsedPoolSize;
-  memUsedPoolSize++;
-/*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("c: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
+  addToUsedPool(ptr);
   return ptr;
 }
 
-// poolFree puts freed up space in memFreePool.
+// poolFree puts freed up space in the free list of its size class.
 void poolFree(void *ptr) {
   void *ptr1;
   long usedLoc;
-  long memFreePoolTmpMax;
-  void *memFreePoolTmpPtr;
+  long c;
 
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("c0: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
   // First, see if the array is in memUsedPool; if so, remove it.
@@ -524,38 +519,21 @@ void poolFree(void *ptr) {
     }
   }
 
-  // Next, add the array to the memFreePool
-  // First, allocate more memFreePool pointer space if needed
-  if (memFreePoolSize >= memFreePoolMax) { // Increase size of free pool
-    memFreePoolTmpMax = memFreePoolMax + MEM_POOL_GROW;
-/*E*/if(db9)printf("Growing free pool to %ld\n",memFreePoolTmpMax);
-    if (!memFreePoolMax) {
-      // The program has just started; initialize
-      memFreePoolTmpPtr = malloc((size_t)memFreePoolTmpMax
-          * sizeof(void *));
-      // Shouldn't have allocation problems when program first starts
-      if (!memFreePoolTmpPtr) bug(1304);
-    } else {
-      // Normal reallocation
-      memFreePoolTmpPtr = realloc(memFreePool,
-          (size_t)memFreePoolTmpMax * sizeof(void *));
-    }
-    if (!memFreePoolTmpPtr) {
-/*E*/if(db9)printf("Realloc failed\n");
-      outOfMemory(cat("#30 (poolFree ", str((double)memFreePoolTmpMax), ")", NULL));
-    } else {
-      // Reallocation successful
-      memFreePool = memFreePoolTmpPtr;
-      memFreePoolMax = memFreePoolTmpMax;
-    }
+  // Next, push the array on the free list of its class
+  c = poolClassDown(((long *)ptr)[-2]);
+  if (c < 0) {
+    // Too small to hold the link to the next free block
+    free((long *)ptr - 3);
+    return;
   }
-  // Add the free array to the free pool
-  memFreePool[memFreePoolSize] = ptr;
+  *(void **)ptr = memFreePool[c];
+  memFreePool[c] = ptr;
+  poolClassFree[c]++;
   // In theory, [-3] should never get referenced for an entry in the
-  // memFreePool. However, here we make it a definite (illegal) value in
+  // free lists. However, here we make it a definite (illegal) value in
   // case it is referenced by code with a bug.
   ((long *)ptr)[-3] = -2;
-  memFreePoolSize++;
+  memFreePoolBytes = memFreePoolBytes + ((long *)ptr)[-2];
   poolTotalFree = poolTotalFree + ((long *)ptr)[-2];
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("e: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
   return;
@@ -601,42 +579,46 @@ void addToUsedPool(void *ptr)
   return;
 }
 
-// Free all arrays in the free pool.
+// Set the actual size of a block in place, keeping memUsedPool and
+// poolTotalFree up to date (as nmbrLet() does for a reused target)
+static void poolSetActualSize(void *ptr, long size) {
+  long oldSize = ((long *)ptr)[-1];
+  if (size > ((long *)ptr)[-2]) bug(1314);
+  ((long *)ptr)[-1] = size;
+  if (((long *)ptr)[-3] != -1) {
+    // It's already in the used pool, so adjust free space tally
+    poolTotalFree = poolTotalFree + oldSize - size;
+  } else if (size != ((long *)ptr)[-2]) {
+    addToUsedPool(ptr);
+  }
+}
+
+// Free all arrays in the free lists.
 
 /*!
  * \fn void memFreePoolPurge(flag untilOK)
  * \brief returns memory held in \ref memFreePool
- * Starting with the last entry in \ref memFreePool, memory held in that pool
- * is returned to the system until all, or at least a sufficient amount is
- * freed again (see \p untilOK).
+ * Starting with the largest size class, memory held in the free lists is
+ * returned to the system until all, or at least a sufficient amount is freed
+ * again (see \p untilOK).
  * \param[in] untilOK
- *   - if 1 freeing \ref pgBlock "blocks" stops the moment \ref poolTotalFree
- *     gets within the range of \ref poolAbsoluteMax again.  Note that it is
- *     not guaranteed that the limit \ref poolAbsoluteMax is undercut because
- *     still too much free memory might be held in the \ref memUsedPool.
- *   - If 0, all \ref memFreePool entries are freed, and the pool itself is
- *     shrunk back to \ref MEM_POOL_GROW size.
+ *   - if 1 freeing \ref pgBlock "blocks" stops the moment
+ *     \ref memFreePoolBytes gets within the range of \ref poolAbsoluteMax
+ *     again.
+ *   - If 0, all free lists are emptied.
  */
 void memFreePoolPurge(flag untilOK) {
+  long c;
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("e0: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
-  while (memFreePoolSize) {
-    memFreePoolSize--;
-    // Free an array
-    poolTotalFree = poolTotalFree -
-        ((long *)(memFreePool[memFreePoolSize]))[-2];
-    free((long *)(memFreePool[memFreePoolSize]) - 3);
-    if (untilOK) {
-      // If pool size is OK, return.
-      if (poolTotalFree <= poolAbsoluteMax) return;
-    }
-  }
-  // memFreePoolSize = 0 now.
-  if (memFreePoolMax != MEM_POOL_GROW) {
-    // Reduce size of pool pointer array to minimum growth increment.
-    if (memFreePool) free(memFreePool); // Only when starting program.
-    memFreePool = malloc(MEM_POOL_GROW
-        * sizeof(void *)); // Allocate starting increment
-    memFreePoolMax = MEM_POOL_GROW;
+  for (c = POOL_CLASSES - 1; c >= 0; c--) {
+    while (memFreePool[c]) {
+      // Free an array
+      free((long *)poolPop(c) - 3);
+      if (untilOK) {
+        // If pool size is OK, return.
+        if (memFreePoolBytes <= poolAbsoluteMax) return;
+      }
+    }
   }
 /*E*/if(db9)getPoolStats(&i1,&j1_,&k1); if(db9)printf("g: pool %ld stat %ld\n",poolTotalFree,i1+j1_);
   return;
@@ -646,11 +628,14 @@ void memFreePoolPurge(flag untilOK) {
 void getPoolStats(long *freeAlloc, long *usedAlloc, long *usedActual)
 {
   long i;
+  void *ptr;
   *freeAlloc = 0;
   *usedAlloc = 0;
   *usedActual = 0;
-  for (i = 0; i < memFreePoolSize; i++) {
-    *freeAlloc = *freeAlloc + /* 12 + */ ((long *)(memFreePool[i]))[-2];
+  for (i = 0; i < POOL_CLASSES; i++) {
+    for (ptr = memFreePool[i]; ptr; ptr = *(void **)ptr) {
+      *freeAlloc = *freeAlloc + /* 12 + */ ((long *)ptr)[-2];
+    }
   }
   for (i = 0; i < memUsedPoolSize; i++) {
     *usedActual = *usedActual + 12 + ((long *)(memUsedPool[i]))[-1];
@@ -661,6 +646,29 @@ void getPoolStats(long *freeAlloc, long *usedAlloc, long *usedActual)
 /*E*/   *usedAlloc);
 }
 
+void showPoolStats(void) {
+  long c;
+  long mallocs = 0, reuses = 0;
+  for (c = 0; c < POOL_CLASSES; c++) {
+    mallocs = mallocs + poolClassMallocs[c];
+    reuses = reuses + poolClassReuses[c];
+  }
+  print2("The memory pool served %ld allocations, %ld (%ld%%) from its free"
+      " lists.\n", mallocs, reuses, mallocs ? (reuses * 100) / mallocs : 0);
+  print2("It holds %ld free bytes in its free lists and %ld in partially used"
+      " blocks.\n", memFreePoolBytes, poolTotalFree - memFreePoolBytes);
+  if (!mallocs) return;
+  print2("   Class bytes  Allocations     Reused  Hit %%  Free blocks\n");
+  for (c = 0; c < POOL_CLASSES; c++) {
+    if (!poolClassMallocs[c] && !poolClassFree[c]) continue;
+    print2("%14ld %12ld %10ld %6ld %12ld\n", poolClassSize(c),
+        poolClassMallocs[c], poolClassReuses[c],
+        poolClassMallocs[c] ? (poolClassReuses[c] * 100) / poolClassMallocs[c]
+            : 0,
+        poolClassFree[c]);
+  }
+}
+
 void initBigArrays(void)
 {
 
@@ -989,6 +997,7 @@ temp_nmbrString *nmbrTempAlloc(long size)
   // When "size" is 0, all memory previously allocated with this.
   // function is deallocated, down to g_nmbrStartTempAllocStack.
   if (size) {
+    g_tempAllocCount++;
     if (g_nmbrTempAllocStackTop>=(M_MAX_ALLOC_STACK-1)) {
       // ??? Fix to allocate more
       outOfMemory("#105 (nmbrString stack array)");
@@ -1635,6 +1644,69 @@ temp_nmbrString *nmbrAddElement(const nmbrString *g, long element) {
   return v;
 }
 
+// Make sure the nmbrString *s has room for n elements, keeping its contents.
+// The builder functions nmbrReserve(), nmbrPush(), nmbrAppend() and
+// nmbrFinalize() change *s in place; unlike nmbrLet(nmbrAddElement(...)),
+// which copies the whole string, growing a string element by element costs
+// amortized O(1) per element.
+void nmbrReserve(nmbrString **s, long n) {
+  nmbrString *t;
+  long length;
+  if (nmbrAllocLen(*s) >= n) return;
+  length = nmbrLen(*s);
+  t = poolMalloc((n + 1) * (long)(sizeof(nmbrString)));
+  memcpy(t, *s, (size_t)(length + 1) * sizeof(nmbrString));
+  poolSetActualSize(t, (length + 1) * (long)(sizeof(nmbrString)));
+  if (*s != NULL_NMBRSTRING) poolFree(*s);
+  *s = t;
+}
+
+// Add a single number to the end of the nmbrString *s in place
+void nmbrPush(nmbrString **s, long element) {
+  long length = nmbrLen(*s);
+  // Grow geometrically
+  if (nmbrAllocLen(*s) <= length) nmbrReserve(s, 2 * length + 1);
+  (*s)[length] = (nmbrString)element;
+  (*s)[length + 1] = *NULL_NMBRSTRING; // End of string
+  poolSetActualSize(*s, (length + 2) * (long)(sizeof(nmbrString)));
+/*E*/db3 = db3 + (long)(sizeof(nmbrString));
+}
+
+// Add the elements of source to the end of the nmbrString *s in place.
+// source may be a temporary, but not *s itself.
+void nmbrAppend(nmbrString **s, const nmbrString *source) {
+  long length = nmbrLen(*s);
+  long sourceLength = nmbrLen(source);
+  if (!sourceLength) return;
+  if (nmbrAllocLen(*s) < length + sourceLength) {
+    // Grow geometrically
+    nmbrReserve(s, length + sourceLength > 2 * length
+        ? length + sourceLength : 2 * length);
+  }
+  memcpy(*s + length, source,
+      (size_t)(sourceLength + 1) * sizeof(nmbrString)); // With end of string
+  poolSetActualSize(*s,
+      (length + sourceLength + 1) * (long)(sizeof(nmbrString)));
+/*E*/db3 = db3 + sourceLength * (long)(sizeof(nmbrString));
+}
+
+// Give back the unused room of a nmbrString built with nmbrPush() or
+// nmbrAppend(), for a string that will be kept.  Like nmbrLet(), this frees
+// the temporary nmbrStrings.
+void nmbrFinalize(nmbrString **s) {
+  nmbrString *t = *s;
+  // Nothing to give back if the block is no larger than the pool would
+  // allocate for its contents
+  if (((long *)t)[-2] <= poolClassSize(poolClassUp(
+      (nmbrLen(t) + 1) * (long)(sizeof(nmbrString))))) {
+    nmbrTempAlloc(0);
+    return;
+  }
+  *s = NULL_NMBRSTRING;
+  nmbrLet(s, t); // Allocates the smallest block that holds it
+  poolFree(t);
+}
+
 // Get the set union of two math token strings (presumably variable lists)
 temp_nmbrString *nmbrUnion(const nmbrString *m1, const nmbrString *m2) {
   long i,j,len1,len2;
@@ -1701,254 +1773,530 @@ temp_nmbrString *nmbrSetMinus(const nmbrString *m1, const nmbrString *m2)
 // This is a utility function that returns the length of a subproof that ends at step.
 // 22-Aug-2012 nm - this doesn't seem to be used outside of mmdata.c -
 // should we replace it with subproofLen() in mmpfas.c?
+// The subproof is scanned backwards once, counting the hypotheses still
+// needed, instead of calling this function recursively for each hypothesis.
 long nmbrGetSubproofLen(const nmbrString *proof, long step)
 {
-  long stmt, hyps, pos, i;
+  long stmt, pos, lvl;
   char type;
 
   if (step < 0) bug(1329);
-  stmt = proof[step];
-  if (stmt < 0) return (1); // Unknown or label ref
-  type = g_Statement[stmt].type;
-  if (type == f_ || type == e_) return (1); // Hypothesis
-  hyps = g_Statement[stmt].numReqHyp;
-  pos = step - 1;
-  for (i = 0; i < hyps; i++) {
-    pos = pos - nmbrGetSubproofLen(proof, pos);
+  lvl = 1;
+  pos = step + 1;
+  while (lvl) {
+    pos--;
+    lvl--;
+    if (pos < 0) bug(1306);
+    stmt = proof[pos];
+    if (stmt < 0) continue; // Unknown or label ref
+    type = g_Statement[stmt].type;
+    if (type == f_ || type == e_) continue; // Hypothesis
+    lvl = lvl + g_Statement[stmt].numReqHyp;
+  }
+  return (step - pos + 1);
+}
+
+// Make sure the arrays of a proof structure index have room for len steps,
+// preserving their contents.
+static void growProofIndex(struct proofIndex_struct *index, long len)
+{
+  long *subproofStart, *parentStep, *hypIndex, *depth;
+  char *essential;
+
+  if (len <= index->alloc) return;
+  if (len < 2 * index->alloc) len = 2 * index->alloc;
+  subproofStart = realloc(index->subproofStart, (size_t)len * sizeof(long));
+  if (subproofStart) index->subproofStart = subproofStart;
+  parentStep = realloc(index->parentStep, (size_t)len * sizeof(long));
+  if (parentStep) index->parentStep = parentStep;
+  hypIndex = realloc(index->hypIndex, (size_t)len * sizeof(long));
+  if (hypIndex) index->hypIndex = hypIndex;
+  depth = realloc(index->depth, (size_t)len * sizeof(long));
+  if (depth) index->depth = depth;
+  essential = realloc(index->essential, (size_t)len * sizeof(char));
+  if (essential) index->essential = essential;
+  if (!subproofStart || !parentStep || !hypIndex || !depth || !essential) {
+    outOfMemory("#124 (proof index)");
+  }
+  index->alloc = len;
+}
+
+// Fill in the index entries of steps first through first + len - 1 of proof,
+// which must be a sequence of complete subproofs.  The last step of each
+// subproof gets parentStep -1, depth 0, and essential 1.  Returns the number
+// of subproofs, or -1 if a step has more hypotheses than there are
+// subproofs before it.
+static long indexSubProofs(struct proofIndex_struct *index,
+    const nmbrString *proof, long first, long len)
+{
+  long *stack; // Last steps of the subproofs not yet used as hypotheses
+  long stackPtr, step, stmt, hyps, hyp, parent, i;
+  char type;
+  nmbrString *reqHypList;
+
+  stack = malloc((size_t)(len + 1) * sizeof(long));
+  if (!stack) outOfMemory("#125 (proof index)");
+  stackPtr = 0;
+  for (step = first; step < first + len; step++) {
+    stmt = proof[step];
+    hyps = 0;
+    if (stmt >= 0) {
+      type = g_Statement[stmt].type;
+      if (type != f_ && type != e_) hyps = g_Statement[stmt].numReqHyp;
+    }
+    if (hyps > stackPtr) {
+      free(stack);
+      return -1;
+    }
+    // The hypotheses are the last hyps subproofs on the stack
+    index->subproofStart[step] = hyps ?
+        index->subproofStart[stack[stackPtr - hyps]] : step;
+    for (hyp = 0; hyp < hyps; hyp++) {
+      i = stack[stackPtr - hyps + hyp];
+      index->parentStep[i] = step;
+      index->hypIndex[i] = hyp;
+    }
+    stackPtr = stackPtr - hyps;
+    stack[stackPtr] = step;
+    stackPtr++;
+  }
+  for (i = 0; i < stackPtr; i++) {
+    index->parentStep[stack[i]] = -1;
+    index->hypIndex[stack[i]] = -1;
   }
-  return (step - pos);
+  free(stack);
+
+  // Parents come after their hypotheses, so scan backwards for the depth and
+  // essential flag.
+  for (step = first + len - 1; step >= first; step--) {
+    parent = index->parentStep[step];
+    if (parent == -1) {
+      index->depth[step] = 0;
+      index->essential[step] = 1;
+    } else {
+      index->depth[step] = index->depth[parent] + 1;
+      reqHypList = g_Statement[proof[parent]].reqHypList;
+      index->essential[step] = (char)(index->essential[parent] &&
+          g_Statement[reqHypList[index->hypIndex[step]]].type == e_);
+    }
+  }
+  return stackPtr;
 }
 
+// Build the proof structure index of proof in one pass.  Returns 1 if the
+// proof is a single complete subproof, 0 otherwise (in which case the index
+// describes each of its complete subproofs, if possible).
+flag buildProofIndex(struct proofIndex_struct *index, const nmbrString *proof)
+{
+  long plen;
+  plen = nmbrLen(proof);
+  growProofIndex(index, plen);
+  index->len = plen;
+  return (indexSubProofs(index, proof, 0, plen) == 1);
+}
+
+// Update the proof structure index after the subproof at steps firstStep
+// through lastStep was replaced by a new subproof of newLen steps, which
+// is now at step firstStep of proof.
+void spliceProofIndex(struct proofIndex_struct *index, const nmbrString *proof,
+    long firstStep, long lastStep, long newLen)
+{
+  long oldLen, tailLen, delta, rootParent, rootHyp, rootDepth, step;
+  char rootEssential;
+
+  oldLen = lastStep - firstStep + 1;
+  delta = newLen - oldLen;
+  if (firstStep < 0 || lastStep >= index->len || oldLen < 1 || newLen < 1
+      || nmbrLen(proof) != index->len + delta) {
+    bug(1307);
+  }
+  rootParent = index->parentStep[lastStep];
+  rootHyp = index->hypIndex[lastStep];
+  rootDepth = index->depth[lastStep];
+  rootEssential = index->essential[lastStep];
+
+  // Move the steps after the old subproof
+  growProofIndex(index, index->len + delta);
+  tailLen = index->len - lastStep - 1;
+  memmove(index->subproofStart + lastStep + 1 + delta,
+      index->subproofStart + lastStep + 1, (size_t)tailLen * sizeof(long));
+  memmove(index->parentStep + lastStep + 1 + delta,
+      index->parentStep + lastStep + 1, (size_t)tailLen * sizeof(long));
+  memmove(index->hypIndex + lastStep + 1 + delta,
+      index->hypIndex + lastStep + 1, (size_t)tailLen * sizeof(long));
+  memmove(index->depth + lastStep + 1 + delta,
+      index->depth + lastStep + 1, (size_t)tailLen * sizeof(long));
+  memmove(index->essential + lastStep + 1 + delta,
+      index->essential + lastStep + 1, (size_t)tailLen * sizeof(char));
+  index->len = index->len + delta;
+
+  // References to steps after the old subproof move too.  (Outside of the
+  // subproof, the only references into it are subproof starts at
+  // firstStep, which don't move.)
+  for (step = 0; step < index->len; step++) {
+    if (step == firstStep) step = firstStep + newLen; // Skip new subproof
+    if (step >= index->len) break;
+    if (index->subproofStart[step] > lastStep) {
+      index->subproofStart[step] = index->subproofStart[step] + delta;
+    }
+    if (index->parentStep[step] > lastStep) {
+      index->parentStep[step] = index->parentStep[step] + delta;
+    }
+  }
+
+  // Index the new subproof and attach it where the old one was
+  if (indexSubProofs(index, proof, firstStep, newLen) != 1) bug(1308);
+  for (step = firstStep; step < firstStep + newLen; step++) {
+    index->depth[step] = index->depth[step] + rootDepth;
+    index->essential[step] = (char)(index->essential[step] && rootEssential);
+  }
+  step = firstStep + newLen - 1;
+  index->parentStep[step] = rootParent > lastStep
+      ? rootParent + delta : rootParent;
+  index->hypIndex[step] = rootHyp;
+}
+
+void freeProofIndex(struct proofIndex_struct *index)
+{
+  free(index->subproofStart);
+  free(index->parentStep);
+  free(index->hypIndex);
+  free(index->depth);
+  free(index->essential);
+  index->subproofStart = NULL;
+  index->parentStep = NULL;
+  index->hypIndex = NULL;
+  index->depth = NULL;
+  index->essential = NULL;
+  index->len = 0;
+  index->alloc = 0;
+}
+
+// Get the length of each step's subproof, in steps, as it would be in the
+// uncompressed proof (with local label references expanded).  The lengths
+// are doubles since they can grow exponentially with the proof length.
+// Returns the total uncompressed length of the proof.
+static double getUnsquishedLens(const nmbrString *proof, double *expLen)
+{
+  long plen, step, stmt, hyps, i;
+  long *stack; // Steps whose subproofs haven't been used as hypotheses yet
+  long stackPtr;
+  double total;
+  char type;
+
+  plen = nmbrLen(proof);
+  stack = malloc((size_t)(plen + 1) * sizeof(long));
+  if (!stack) outOfMemory("#128 (unsquish)");
+  stackPtr = 0;
+  for (step = 0; step < plen; step++) {
+    stmt = proof[step];
+    if (stmt <= -1000) { // Local label reference
+      if (-1000 - stmt >= step) bug(1309);
+      expLen[step] = expLen[-1000 - stmt];
+    } else {
+      expLen[step] = 1;
+      hyps = 0;
+      if (stmt >= 0) {
+        type = g_Statement[stmt].type;
+        if (type != f_ && type != e_) hyps = g_Statement[stmt].numReqHyp;
+      }
+      if (hyps > stackPtr) bug(1310);
+      for (i = 0; i < hyps; i++) {
+        stackPtr--;
+        expLen[step] = expLen[step] + expLen[stack[stackPtr]];
+      }
+    }
+    stack[stackPtr] = step;
+    stackPtr++;
+  }
+  total = 0;
+  for (i = 0; i < stackPtr; i++) total = total + expLen[stack[i]];
+  free(stack);
+  return total;
+} // getUnsquishedLens
+
+// Return the number of steps the proof would have uncompressed (with local
+// label references to previous subproofs expanded), without building it.
+double nmbrGetUnsquishedLen(const nmbrString *proof)
+{
+  double *expLen;
+  double total;
+
+  expLen = malloc((size_t)(nmbrLen(proof) + 1) * sizeof(double));
+  if (!expLen) outOfMemory("#129 (unsquish)");
+  total = getUnsquishedLens(proof, expLen);
+  free(expLen);
+  return total;
+} // nmbrGetUnsquishedLen
+
 // This function returns a packed or "squished" proof, putting in local label
-// references to previous subproofs.
+// references to previous subproofs.  The input may be an uncompressed proof
+// or one that already has local label references, which are followed
+// without expanding them.  The result is the same in either case:  the
+// first occurrence of each subproof (with more than one step) is kept and
+// each later occurrence is replaced with a reference to its last step.
+//
+// The subproofs are identified by hashing each step's statement together
+// with the identities of its hypotheses' subproofs, so the time is linear
+// in the length of the input proof.
 temp_nmbrString *nmbrSquishProof(const nmbrString *proof) {
-  nmbrString_def(newProof);
-  nmbrString_def(dummyProof);
-  nmbrString_def(subProof);
-  long step, dummyStep, subPrfLen, matchStep, plen;
-  flag foundFlag;
-
-  nmbrLet(&newProof,proof); // In case of temp. alloc. of proof
-  plen = nmbrLen(newProof);
-  dummyStep = 0;
-  // Parallel proof with test subproof replaced
-  // with a reference to itself, for matching.
-  nmbrLet(&dummyProof, newProof);
+  long plen, step, stmt, hyps, i, j, k, id, nodes, hashSize, slot, outLen;
+  long stackPtr, framePtr, childCount;
+  unsigned long hash;
+  char type;
+  long *stepNode; // Subproof identity of each input step
+  long *nodeStmt; // Last step's statement of each distinct subproof
+  long *nodeChild; // Start of its hypotheses' subproofs in childList
+  long *nodeChildren; // Number of hypotheses
+  long *childList; // Hypotheses' subproof identities of each subproof
+  long *nodeOutStep; // Step of its first occurrence in the output, or -1
+  long *hashTable; // Open-addressing hash table of subproof identities
+  long *stack; // Used for both the input scan and the output
+  long *frameChild; // Next hypothesis to output of each stack entry
+  long *topNodes; // Subproofs left on the stack at the end of the input
+  long topCount;
+  nmbrString *newProof;
+
+  plen = nmbrLen(proof);
+  hashSize = 16;
+  while (hashSize < 2 * plen) hashSize = 2 * hashSize;
+  stepNode = malloc((size_t)(plen + 1) * sizeof(long));
+  nodeStmt = malloc((size_t)(plen + 1) * sizeof(long));
+  nodeChild = malloc((size_t)(plen + 1) * sizeof(long));
+  nodeChildren = malloc((size_t)(plen + 1) * sizeof(long));
+  childList = malloc((size_t)(plen + 1) * sizeof(long));
+  nodeOutStep = malloc((size_t)(plen + 1) * sizeof(long));
+  hashTable = malloc((size_t)hashSize * sizeof(long));
+  stack = malloc((size_t)(plen + 1) * sizeof(long));
+  frameChild = malloc((size_t)(plen + 1) * sizeof(long));
+  if (!stepNode || !nodeStmt || !nodeChild || !nodeChildren || !childList
+      || !nodeOutStep || !hashTable || !stack || !frameChild) {
+    outOfMemory("#130 (squish)");
+  }
+  for (i = 0; i < hashSize; i++) hashTable[i] = -1;
+
+  // Scan the input, giving identical subproofs the same identity
+  nodes = 0;
+  childCount = 0;
+  stackPtr = 0;
   for (step = 0; step < plen; step++) {
-    subPrfLen = nmbrGetSubproofLen(dummyProof, dummyStep);
-    if (subPrfLen <= 1) {
-      dummyStep++;
+    stmt = proof[step];
+    if (stmt <= -1000) { // Local label reference
+      if (-1000 - stmt >= step) bug(1311);
+      stepNode[step] = stepNode[-1000 - stmt];
+      stack[stackPtr] = stepNode[step];
+      stackPtr++;
       continue;
     }
-    nmbrLet(&subProof, nmbrSeg(dummyProof, dummyStep - subPrfLen + 2,
-        dummyStep + 1));
-    matchStep = step + 1;
-    foundFlag = 0;
+    hyps = 0;
+    if (stmt >= 0) {
+      type = g_Statement[stmt].type;
+      if (type != f_ && type != e_) hyps = g_Statement[stmt].numReqHyp;
+    }
+    if (hyps > stackPtr) bug(1312);
+    hash = 2166136261UL; // FNV-1a
+    hash = (hash ^ (unsigned long)stmt) * 16777619UL;
+    for (i = stackPtr - hyps; i < stackPtr; i++) {
+      hash = (hash ^ (unsigned long)stack[i]) * 16777619UL;
+    }
+    slot = (long)(hash & (unsigned long)(hashSize - 1));
     while (1) {
-      matchStep = nmbrInstr(matchStep + 1, newProof, subProof);
-      if (!matchStep) break; // No more occurrences
-      foundFlag = 1;
-      // Replace the found subproof with a reference to this subproof
-      nmbrLet(&newProof,
-            nmbrCat(nmbrAddElement(nmbrLeft(newProof, matchStep - 1),
-            -1000 - step), nmbrRight(newProof, matchStep + subPrfLen), NULL));
-      matchStep = matchStep - subPrfLen + 1;
-    }
-    if (foundFlag) {
-      plen = nmbrLen(newProof); // Update the new proof length
-      // Replace this subproof with a reference to itself, for later matching
-      // and add on rest of real proof.
-      dummyStep = dummyStep + 1 - subPrfLen;
-      nmbrLet(&dummyProof,
-          nmbrCat(nmbrAddElement(nmbrLeft(dummyProof, dummyStep),
-          -1000 - step), nmbrRight(newProof, step + 2), NULL));
-    }
-    dummyStep++;
-  } // Next step
-  free_nmbrString(subProof);
-  free_nmbrString(dummyProof);
-  return nmbrMakeTempAlloc(newProof); // Flag it for deallocation
+      id = hashTable[slot];
+      if (id == -1) break;
+      if (nodeStmt[id] == stmt && nodeChildren[id] == hyps) {
+        for (j = 0; j < hyps; j++) {
+          if (childList[nodeChild[id] + j] != stack[stackPtr - hyps + j]) {
+            break;
+          }
+        }
+        if (j == hyps) break; // Found it
+      }
+      slot = (slot + 1) & (hashSize - 1); // Linear probing
+    }
+    if (id == -1) { // A new subproof
+      id = nodes;
+      nodes++;
+      hashTable[slot] = id;
+      nodeStmt[id] = stmt;
+      nodeChildren[id] = hyps;
+      nodeChild[id] = childCount;
+      for (j = 0; j < hyps; j++) {
+        childList[childCount] = stack[stackPtr - hyps + j];
+        childCount++;
+      }
+      nodeOutStep[id] = -1;
+    }
+    stepNode[step] = id;
+    stackPtr = stackPtr - hyps;
+    stack[stackPtr] = id;
+    stackPtr++;
+  }
+  topCount = stackPtr;
+  topNodes = malloc((size_t)(topCount + 1) * sizeof(long));
+  if (!topNodes) outOfMemory("#131 (squish)");
+  for (i = 0; i < topCount; i++) topNodes[i] = stack[i];
+
+  // Output each subproof in full the first time, and as a local label
+  // reference after that.  Each subproof is output in full at most once,
+  // so the output has at most topCount + childCount steps.
+  newProof = nmbrSpace(topCount + childCount);
+  outLen = 0;
+  for (k = 0; k < topCount; k++) {
+    framePtr = 0;
+    stack[framePtr] = topNodes[k];
+    frameChild[framePtr] = 0;
+    while (framePtr >= 0) {
+      id = stack[framePtr];
+      if (nodeChildren[id] > 0 && nodeOutStep[id] != -1) {
+        // A repeated subproof
+        newProof[outLen] = -1000 - nodeOutStep[id];
+        outLen++;
+        framePtr--;
+        continue;
+      }
+      if (frameChild[framePtr] < nodeChildren[id]) {
+        // Output the next hypothesis first
+        i = childList[nodeChild[id] + frameChild[framePtr]];
+        frameChild[framePtr]++;
+        framePtr++;
+        stack[framePtr] = i;
+        frameChild[framePtr] = 0;
+        continue;
+      }
+      newProof[outLen] = nodeStmt[id];
+      if (nodeChildren[id] > 0) nodeOutStep[id] = outLen;
+      outLen++;
+      framePtr--;
+    }
+  }
+  newProof[outLen] = *NULL_NMBRSTRING;
+  nmbrZapLen(newProof, outLen);
+
+  free(stepNode);
+  free(nodeStmt);
+  free(nodeChild);
+  free(nodeChildren);
+  free(childList);
+  free(nodeOutStep);
+  free(hashTable);
+  free(stack);
+  free(frameChild);
+  free(topNodes);
+  return newProof;
 }
 
 // This function unpacks a "squished" proof, replacing local label references
-// to previous subproofs by the subproofs themselves.
+// to previous subproofs by the subproofs themselves.  Each reference is
+// copied from the part of the output already built, so the time is linear
+// in the length of the output.
 temp_nmbrString *nmbrUnsquishProof(const nmbrString *proof) {
-  nmbrString_def(newProof);
-  nmbrString_def(subProof);
-  long step, plen, subPrfLen, stmt;
-
-  nmbrLet(&newProof, proof);
-  plen = nmbrLen(newProof);
-  for (step = plen - 1; step >= 0; step--) {
-    stmt = newProof[step];
-    if (stmt > -1000) continue;
-    // It's a local label reference
-    stmt = -1000 - stmt;
-    subPrfLen = nmbrGetSubproofLen(newProof, stmt);
-    nmbrLet(&newProof, nmbrCat(nmbrLeft(newProof, step),
-        nmbrSeg(newProof, stmt - subPrfLen + 2, stmt + 1),
-        nmbrRight(newProof, step + 2), NULL));
-    step = step + subPrfLen - 1;
-  }
-  free_nmbrString(subProof);
-  return nmbrMakeTempAlloc(newProof); // Flag it for deallocation
+  long plen, step, stmt, outLen, ref;
+  double *expLen;
+  long *outEnd; // Step after the end of each input step's subproof in output
+  double total;
+  nmbrString *newProof;
+
+  plen = nmbrLen(proof);
+  expLen = malloc((size_t)(plen + 1) * sizeof(double));
+  outEnd = malloc((size_t)(plen + 1) * sizeof(long));
+  if (!expLen || !outEnd) outOfMemory("#132 (unsquish)");
+  total = getUnsquishedLens(proof, expLen);
+  if (total >= (double)LONG_MAX / (double)sizeof(nmbrString)) {
+    outOfMemory("#133 (unsquish)");
+  }
+  newProof = nmbrSpace((long)total);
+  outLen = 0;
+  for (step = 0; step < plen; step++) {
+    stmt = proof[step];
+    if (stmt <= -1000) { // Local label reference
+      ref = -1000 - stmt;
+      memcpy(newProof + outLen, newProof + outEnd[ref] - (long)expLen[ref],
+          (size_t)expLen[ref] * sizeof(nmbrString));
+      outLen = outLen + (long)expLen[ref];
+    } else {
+      newProof[outLen] = stmt;
+      outLen++;
+    }
+    outEnd[step] = outLen;
+  }
+  if (outLen != (long)total) bug(1313);
+
+  free(expLen);
+  free(outEnd);
+  return newProof;
 }
 
 // This function returns the indentation level vs. step number of a proof
 // string.  This information is used for formatting proof displays.  The
-// function calls itself recursively, but the first call should be with
-// startingLevel = 0.
-// ???Optimization:  remove nmbrString calls and use static variables
-// to communicate to recursive calls.
+// top-level step has indentation startingLevel (normally 0).
 temp_nmbrString *nmbrGetIndentation(const nmbrString *proof, long startingLevel) {
-  long plen, stmt, pos, splen, hyps, i, j;
-  char type;
+  long plen, step;
   nmbrString_def(indentationLevel);
-  nmbrString_def(subProof);
-  nmbrString_def(nmbrTmp);
+  struct proofIndex_struct index = {NULL, NULL, NULL, NULL, NULL, 0, 0};
 
   plen = nmbrLen(proof);
-  stmt = proof[plen - 1];
+  if (!buildProofIndex(&index, proof)) bug(333);
   nmbrLet(&indentationLevel, nmbrSpace(plen));
-  indentationLevel[plen - 1] = startingLevel;
-  if (stmt < 0) { // A local label reference or unknown
-    if (plen != 1) bug(1330);
-    return nmbrMakeTempAlloc(indentationLevel); // Flag it for deallocation
-  }
-  type = g_Statement[stmt].type;
-  if (type == f_ || type == e_) { // A hypothesis
-    if (plen != 1) bug(1331);
-    return nmbrMakeTempAlloc(indentationLevel); // Flag it for deallocation
-  }
-  // An assertion
-  if (type != a_ && type != p_) bug(1332);
-  hyps = g_Statement[stmt].numReqHyp;
-  pos = plen - 2;
-  for (i = 0; i < hyps; i++) {
-    splen = nmbrGetSubproofLen(proof, pos);
-    nmbrLet(&subProof, nmbrSeg(proof, pos - splen + 2, pos + 1));
-    nmbrLet(&nmbrTmp, nmbrGetIndentation(subProof, startingLevel + 1));
-    for (j = 0; j < splen; j++) {
-      indentationLevel[j + pos - splen + 1] = nmbrTmp[j];
-    }
-    pos = pos - splen;
-  }
-  if (pos != -1) bug(333);
-
-  free_nmbrString(subProof); // Deallocate
-  free_nmbrString(nmbrTmp); // Deallocate
+  for (step = 0; step < plen; step++) {
+    indentationLevel[step] = startingLevel + index.depth[step];
+  }
+
+  freeProofIndex(&index); // Deallocate
   return nmbrMakeTempAlloc(indentationLevel); // Flag it for deallocation
 } // nmbrGetIndentation
 
 // This function returns essential (1) or floating (0) vs. step number of a
-// proof string.  This information is used for formatting proof displays.  The
-// function calls itself recursively.
-// ???Optimization:  remove nmbrString calls and use static variables
-// to communicate to recursive calls.
+// proof string.  This information is used for formatting proof displays.
 nmbrString *nmbrGetEssential(const nmbrString *proof) {
-  long plen, stmt, pos, splen, hyps, i, j;
-  char type;
+  long plen, step, stmt;
   nmbrString_def(essentialFlags);
-  nmbrString_def(subProof);
-  nmbrString_def(nmbrTmp);
-  nmbrString *nmbrTmpPtr2;
+  struct proofIndex_struct index = {NULL, NULL, NULL, NULL, NULL, 0, 0};
 
   plen = nmbrLen(proof);
   if (plen == 0) bug(1343);
-  stmt = proof[plen - 1];
+  if (!buildProofIndex(&index, proof)) bug(1338);
   nmbrLet(&essentialFlags, nmbrSpace(plen));
-  essentialFlags[plen - 1] = 1;
-  if (stmt < 0) { // A local label reference or unknown
-    if (plen != 1) bug(1334);
-    // The only time it should get here is if the original proof has only one
-    // step, which would be an unknown step.
-    if (stmt != -(long)'?' && stmt > -1000) bug(1335);
-    return nmbrMakeTempAlloc(essentialFlags); // Flag it for deallocation
-  }
-  type = g_Statement[stmt].type;
-  if (type == f_ || type == e_) { // A hypothesis
-    // The only time it should get here is if the original proof has only one step
-    if (plen != 1) bug(1336);
-    return nmbrMakeTempAlloc(essentialFlags); // Flag it for deallocation
-  }
-  // An assertion
-  if (type != a_ && type != p_) bug(1337);
-  hyps = g_Statement[stmt].numReqHyp;
-  pos = plen - 2;
-  nmbrTmpPtr2 = g_Statement[stmt].reqHypList;
-  for (i = 0; i < hyps; i++) {
-    splen = nmbrGetSubproofLen(proof, pos);
-    if (g_Statement[nmbrTmpPtr2[hyps - i - 1]].type == e_) {
-      nmbrLet(&subProof, nmbrSeg(proof, pos - splen + 2, pos + 1));
-      nmbrLet(&nmbrTmp, nmbrGetEssential(subProof));
-      for (j = 0; j < splen; j++) {
-        essentialFlags[j + pos - splen + 1] = nmbrTmp[j];
-      }
+  for (step = 0; step < plen; step++) {
+    essentialFlags[step] = index.essential[step];
+    stmt = proof[step];
+    // An essential unknown step or local label reference
+    if (stmt < 0 && essentialFlags[step]) {
+      if (stmt != -(long)'?' && stmt > -1000) bug(1335);
     }
-    pos = pos - splen;
   }
-  if (pos != -1) bug (1338);
 
-  free_nmbrString(subProof); // Deallocate
-  free_nmbrString(nmbrTmp); // Deallocate
+  freeProofIndex(&index); // Deallocate
   return nmbrMakeTempAlloc(essentialFlags); // Flag it for deallocation
 } // nmbrGetEssential
 
 // This function returns the target hypothesis vs. step number of a proof
-// string.  This information is used for formatting proof displays.  The
-// function calls itself recursively.
-// statemNum is the statement being proved.
-// ???Optimization:  remove nmbrString calls and use static variables
-// to communicate to recursive calls.
+// string.  This information is used for formatting proof displays.
+// statemNum is the statement being proved (or 0 if the top-level step has
+// no target).
 temp_nmbrString *nmbrGetTargetHyp(const nmbrString *proof, long statemNum) {
-  long plen, stmt, pos, splen, hyps, i, j;
-  char type;
+  long plen, step, parent;
   nmbrString_def(targetHyp);
-  nmbrString_def(subProof);
-  nmbrString_def(nmbrTmp);
+  struct proofIndex_struct index = {NULL, NULL, NULL, NULL, NULL, 0, 0};
 
   plen = nmbrLen(proof);
-  stmt = proof[plen - 1];
-  nmbrLet(&targetHyp, nmbrSpace(plen));
-  if (statemNum) { // First (rather than recursive) call
-    targetHyp[plen - 1] = statemNum; // Statement being proved
-  }
-  if (stmt < 0) { // A local label reference or unknown
-    if (plen != 1) bug(1339);
+  if (plen == 1 && proof[0] < 0) {
     // The only time it should get here is if the original proof has only one
     // step, which would be an unknown step.
-    if (stmt != -(long)'?') bug(1340);
-    return nmbrMakeTempAlloc(targetHyp); // Flag it for deallocation
-  }
-  type = g_Statement[stmt].type;
-  if (type == f_ || type == e_) { // A hypothesis
-    // The only time it should get here is if the original proof has only one step
-    if (plen != 1) bug(1341);
-    return nmbrMakeTempAlloc(targetHyp); // Flag it for deallocation
-  }
-  // An assertion
-  if (type != a_ && type != p_) bug(1342);
-  hyps = g_Statement[stmt].numReqHyp;
-  pos = plen - 2;
-  for (i = 0; i < hyps; i++) {
-    splen = nmbrGetSubproofLen(proof, pos);
-    if (splen > 1) {
-      nmbrLet(&subProof, nmbrSeg(proof, pos - splen + 2, pos + 1));
-      nmbrLet(&nmbrTmp, nmbrGetTargetHyp(subProof,
-          g_Statement[stmt].reqHypList[hyps - i - 1]));
-      for (j = 0; j < splen; j++) {
-        targetHyp[j + pos - splen + 1] = nmbrTmp[j];
-      }
+    if (proof[0] != -(long)'?') bug(1340);
+  }
+  if (!buildProofIndex(&index, proof)) bug(343);
+  nmbrLet(&targetHyp, nmbrSpace(plen));
+  for (step = 0; step < plen; step++) {
+    parent = index.parentStep[step];
+    if (parent == -1) {
+      targetHyp[step] = statemNum; // Statement being proved
     } else {
-      // A one-step subproof; don't bother with recursive call
-      targetHyp[pos] = g_Statement[stmt].reqHypList[hyps - i - 1];
+      targetHyp[step] = g_Statement[proof[parent]].reqHypList[
+          index.hypIndex[step]];
     }
-    pos = pos - splen;
   }
-  if (pos != -1) bug (343);
 
-  free_nmbrString(subProof); // Deallocate
-  free_nmbrString(nmbrTmp); // Deallocate
+  freeProofIndex(&index); // Deallocate
   return nmbrMakeTempAlloc(targetHyp); // Flag it for deallocation
 } // nmbrGetTargetHyp
 
@@ -2451,6 +2799,7 @@ temp_pntrString *pntrTempAlloc(long size) {
   // When "size" is 0, all memory previously allocated with this
   // function is deallocated, down to g_pntrStartTempAllocStack.
   if (size) {
+    g_tempAllocCount++;
     if (g_pntrTempAllocStackTop>=(M_MAX_ALLOC_STACK-1))
       // ??? Fix to allocate more
       outOfMemory("#109 (pntrString stack array)");
@@ -2868,6 +3217,67 @@ temp_pntrString *pntrAddElement(const pntrString *g)
   return v;
 }
 
+// Make sure the pntrString *s has room for n elements, keeping its contents.
+// See nmbrReserve() for the builder functions.
+void pntrReserve(pntrString **s, long n) {
+  pntrString *t;
+  long length;
+  if (pntrAllocLen(*s) >= n) return;
+  length = pntrLen(*s);
+  t = poolMalloc((n + 1) * (long)(sizeof(pntrString)));
+  memcpy(t, *s, (size_t)(length + 1) * sizeof(pntrString));
+  poolSetActualSize(t, (length + 1) * (long)(sizeof(pntrString)));
+  if (*s != NULL_PNTRSTRING) poolFree(*s);
+  *s = t;
+}
+
+// Add a single pointer to the end of the pntrString *s in place
+void pntrPush(pntrString **s, void *element) {
+  long length = pntrLen(*s);
+  // Grow geometrically
+  if (pntrAllocLen(*s) <= length) pntrReserve(s, 2 * length + 1);
+  (*s)[length] = element;
+  (*s)[length + 1] = *NULL_PNTRSTRING; // End of string
+  poolSetActualSize(*s, (length + 2) * (long)(sizeof(pntrString)));
+/*E*/db3 = db3 + (long)(sizeof(pntrString));
+}
+
+// Add the elements of source to the end of the pntrString *s in place.
+// source may be a temporary, but not *s itself.  Only the pointers are
+// copied, so *s shares the strings they point to with source.
+void pntrAppend(pntrString **s, const pntrString *source) {
+  long length = pntrLen(*s);
+  long sourceLength = pntrLen(source);
+  if (!sourceLength) return;
+  if (pntrAllocLen(*s) < length + sourceLength) {
+    // Grow geometrically
+    pntrReserve(s, length + sourceLength > 2 * length
+        ? length + sourceLength : 2 * length);
+  }
+  memcpy(*s + length, source,
+      (size_t)(sourceLength + 1) * sizeof(pntrString)); // With end of string
+  poolSetActualSize(*s,
+      (length + sourceLength + 1) * (long)(sizeof(pntrString)));
+/*E*/db3 = db3 + sourceLength * (long)(sizeof(pntrString));
+}
+
+// Give back the unused room of a pntrString built with pntrPush() or
+// pntrAppend(), for a string that will be kept.  Like pntrLet(), this frees
+// the temporary pntrStrings.
+void pntrFinalize(pntrString **s) {
+  pntrString *t = *s;
+  // Nothing to give back if the block is no larger than the pool would
+  // allocate for its contents
+  if (((long *)t)[-2] <= poolClassSize(poolClassUp(
+      (pntrLen(t) + 1) * (long)(sizeof(pntrString))))) {
+    pntrTempAlloc(0);
+    return;
+  }
+  *s = NULL_PNTRSTRING;
+  pntrLet(s, t); // Allocates the smallest block that holds it
+  poolFree(t);
+}
+
 // Add a single null pntrString element to a pntrString -faster than pntrCat
 temp_pntrString *pntrAddGElement(const pntrString *g)
 {
@@ -2887,8 +3297,8 @@ temp_pntrString *pntrAddGElement(const pntrString *g)
 // Returns the maximum worth (value) for items that can fit into maxSize.
 // itemIncluded[] will be populated with 'y'/'n' if item included/excluded.
 long knapsack01(long items, // # of items available to populate knapsack
-    long *size, // size of item 0,...,items-1
-    long *worth, // worth (value) of item 0,...,items-1
+    nmbrString *size, // size of item 0,...,items-1
+    nmbrString *worth, // worth (value) of item 0,...,items-1
     long maxSize, // size of knapsack (largest total size that will fit)
     char *itemIncluded) // output: 'y'/'n' if item 0..items-1 incl/excluded
 {
@@ -2980,25 +3390,27 @@ void free2DMatrix(long **matrix, size_t xsize /* , size_t ysize */)
 } // free2DMatrix
 
 // Returns the amount of indentation of a statement label.  Used to
-// determine how much to indent a saved proof.
+// determine how much to indent a saved proof.  This is the number of spaces
+// at the start of the line with the label, i.e. after the last line feed in
+// the label section.  (The label section is scanned rather than the source
+// buffer before the label, since SAVE PROOF may have replaced the label
+// section with a copy outside of the source buffer.)
 long getSourceIndentation(long statemNum) {
-  char *fbPtr; // Source buffer pointer
   char *startLabel;
-  long indentation = 0;
+  long len, pos, indentation = 0;
 
-  fbPtr = g_Statement[statemNum].mathSectionPtr;
-  if (fbPtr[0] == 0) return 0;
+  if (g_Statement[statemNum].mathSectionPtr[0] == 0) return 0;
   startLabel = g_Statement[statemNum].labelSectionPtr;
   if (startLabel[0] == 0) return 0;
-  while (1) { // Go back to first line feed prior to the label
-    if (fbPtr <= startLabel) break;
-    if (fbPtr[0] == '\n') break;
-    if (fbPtr[0] == ' ') {
-      indentation++; // Space increments indentation
-    } else {
-      indentation = 0; // Non-space (i.e. a label character) resets back to 0
-    }
-    fbPtr--;
+  len = g_Statement[statemNum].labelSectionLen;
+  // Go back to first line feed prior to the label
+  pos = len - 1;
+  while (pos > 0 && startLabel[pos] != '\n') pos--;
+  // Count the spaces after it
+  pos++;
+  while (pos < len && startLabel[pos] == ' ') {
+    indentation++;
+    pos++;
   }
   return indentation;
 } // getSourceIndentation
@@ -3834,6 +4246,104 @@ void freeData(void) {
   free(g_IncludeCall);
   free(g_Statement);
   free(g_MathToken);
-  free(memFreePool);
   free(memUsedPool);
 }
+
+//=================   Regression tests   =====================
+
+#ifdef TEST_ENABLE
+
+// nmbrPush(), nmbrAppend() and nmbrReserve() keep the contents and the end
+// of string, grow geometrically, and nmbrFinalize() gives back the room
+static bool test_nmbrBuilder(void) {
+  nmbrString_def(s);
+  nmbrString *last;
+  long i, moves = 0;
+
+  last = s;
+  for (i = 0; i < 1000; i++) {
+    nmbrPush(&s, i);
+    if (s != last) moves++;
+    last = s;
+  }
+  ASSERT(nmbrLen(s) == 1000);
+  ASSERT(nmbrAllocLen(s) >= 1000);
+  ASSERT(s[1000] == *NULL_NMBRSTRING);
+  for (i = 0; i < 1000; i++) ASSERT(s[i] == i);
+  ASSERTF(moves <= 11, "%ld moves for 1000 elements", moves);
+
+  nmbrAppend(&s, nmbrAddElement(nmbrSpace(2), 7)); // A temporary source
+  ASSERT(nmbrLen(s) == 1003);
+  ASSERT(s[999] == 999 && s[1000] == 0 && s[1001] == 0 && s[1002] == 7);
+  ASSERT(s[1003] == *NULL_NMBRSTRING);
+  nmbrAppend(&s, NULL_NMBRSTRING);
+  ASSERT(nmbrLen(s) == 1003);
+
+  nmbrReserve(&s, 5000);
+  ASSERT(nmbrAllocLen(s) >= 5000);
+  ASSERT(nmbrLen(s) == 1003 && s[500] == 500 && s[1002] == 7);
+
+  nmbrFinalize(&s);
+  // The block is rounded up to a pool size class, at most 25% larger
+  ASSERT(nmbrAllocLen(s) >= 1003 && nmbrAllocLen(s) <= 1003 * 5 / 4);
+  ASSERT(nmbrLen(s) == 1003 && s[500] == 500 && s[1002] == 7);
+  ASSERT(s[1003] == *NULL_NMBRSTRING);
+  last = s;
+  nmbrFinalize(&s); // Nothing more to give back
+  ASSERT(s == last && s[1002] == 7);
+
+  free_nmbrString(s);
+  nmbrFinalize(&s); // The empty string stays empty
+  ASSERT(s == NULL_NMBRSTRING);
+  return true;
+}
+
+// The same for pntrPush(), pntrAppend(), pntrReserve() and pntrFinalize()
+static bool test_pntrBuilder(void) {
+  static char items[1000];
+  pntrString_def(s);
+  pntrString_def(source);
+  pntrString *last;
+  long i, moves = 0;
+
+  last = s;
+  for (i = 0; i < 1000; i++) {
+    pntrPush(&s, &items[i]);
+    if (s != last) moves++;
+    last = s;
+  }
+  ASSERT(pntrLen(s) == 1000);
+  ASSERT(pntrAllocLen(s) >= 1000);
+  ASSERT(s[1000] == *NULL_PNTRSTRING);
+  for (i = 0; i < 1000; i++) ASSERT(s[i] == &items[i]);
+  ASSERTF(moves <= 11, "%ld moves for 1000 elements", moves);
+
+  // Only the pointers are copied
+  pntrPush(&source, &items[1]);
+  pntrPush(&source, &items[2]);
+  pntrAppend(&s, source);
+  ASSERT(pntrLen(s) == 1002);
+  ASSERT(s[1000] == &items[1] && s[1001] == &items[2]);
+  ASSERT(s[1002] == *NULL_PNTRSTRING);
+  ASSERT(pntrLen(source) == 2);
+
+  pntrReserve(&s, 5000);
+  ASSERT(pntrAllocLen(s) >= 5000);
+  ASSERT(pntrLen(s) == 1002 && s[500] == &items[500]);
+
+  pntrFinalize(&s);
+  ASSERT(pntrAllocLen(s) >= 1002 && pntrAllocLen(s) <= 1002 * 5 / 4);
+  ASSERT(pntrLen(s) == 1002 && s[500] == &items[500]);
+  ASSERT(s[1001] == &items[2] && s[1002] == *NULL_PNTRSTRING);
+
+  free_pntrString(s);
+  free_pntrString(source);
+  return true;
+}
+
+void test_mmdata(void) {
+  RUN_TEST(test_nmbrBuilder);
+  RUN_TEST(test_pntrBuilder);
+}
+
+#endif // TEST_ENABLE
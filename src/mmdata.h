@@ -89,6 +89,28 @@
  */
 /*E*/extern long db9;
 
+/*!
+ * \var g_poolMallocCount
+ * \brief number of calls to \ref poolMalloc so far.
+ *
+ * Like \ref g_tempAllocCount and \ref g_letCount, only ever incremented;
+ * SET PROFILE reports the difference over each phase and command.
+ */
+extern long g_poolMallocCount;
+
+/*!
+ * \var g_tempAllocCount
+ * \brief number of temporaries pushed on the \ref tempAllocStack or
+ * allocated by \ref nmbrTempAlloc and \ref pntrTempAlloc so far.
+ */
+extern long g_tempAllocCount;
+
+/*!
+ * \var g_letCount
+ * \brief number of calls to \ref let so far.
+ */
+extern long g_letCount;
+
 /*!
  * \typedef flag
  * a char whose range is restricted to 0 (equivalent to false/no) and 1
@@ -117,7 +139,14 @@ extern flag g_listMode; // 0 = metamath, 1 = list utility
  */
 extern flag g_toolsMode; // In metamath mode:  0 = metamath, 1 = tools
 
+#ifdef NMBRSTRING_INT32
+// Build option: 32-bit elements halve the size of math strings and proofs.
+// Token, statement and step numbers must then fit in 32 bits.
+#include <stdint.h>
+typedef int32_t nmbrString; // String of numbers
+#else
 typedef long nmbrString; // String of numbers
+#endif
 
 /*!
  * \typedef pntrString
@@ -268,6 +297,12 @@ struct includeCall_struct {
       only if we may need it for a later Begin comparison */
   long current_includeLength; /*!< Length of the file
       to be included (0 if the file was previously included) */
+  flag fileRead; /*!< 1 if included_fn was read from disk here, so that the
+      fields below are assigned (for READ / INCREMENTAL) */
+  long modTime; /*!< Modification time of the file when read, -1 if
+      unknown or in the second it was read */
+  long fileSize; /*!< Size in bytes of the file when read, -1 if unknown */
+  unsigned long contentHash; /*!< Hash of the contents of the file */
 };
 
 /*! The data associated with a math token. */
@@ -337,12 +372,12 @@ void *poolFixedMalloc(long size /* bytes */);
  * \fn void *poolMalloc(long size)
  * \brief allocates and initializes a new \ref pgBlock
  *
- * allocates a \ref pgBlock, first removing and using the last element of the
- * \ref memFreePool.  If this block exists, but has not sufficient size, it is
- * reallocated from the system.  If the pool is empty, a new \ref pgBlock of
- * the given size is allocated from the system.  In any case, the header of the
- * \ref pgBlock is properly initialized.  Exits program on out of memory
- * condition.
+ * allocates a \ref pgBlock, first removing and using the first block in
+ * the free list of the \ref pgSizeClass "size class" of \p size.  If that
+ * list is empty, a new \ref pgBlock of the class size is allocated from the
+ * system.  In any case, the header of the \ref pgBlock is properly
+ * initialized, and a block with more capacity than \p size is added to the
+ * \ref memUsedPool.  Exits program on out of memory condition.
  * \param[in] size (in bytes) of the block, not including the block header.
  * \return a \ref pgBlock with enough capacity for \p size bytes of data.
  *  \post
@@ -355,18 +390,17 @@ void *poolMalloc(long size /* bytes */);
 /*!
  * \fn poolFree(void *ptr)
  *
- * Removes \p ptr from the \ref memUsedPool, if it is listed there.  Then tries
- * adding it to the \ref memFreePool.  If this pool is full, it is increased by
- * \ref MEM_POOL_GROW.  If this fails, the program is exited, else \p ptr is
- * added.
+ * Removes \p ptr from the \ref memUsedPool, if it is listed there.  Then
+ * pushes it on the free list in \ref memFreePool of the largest
+ * \ref pgSizeClass "size class" not exceeding its capacity.  A block too
+ * small for any class is returned to the system.
  * \param[in] ptr pointer to a \ref pgBlock.
  * \pre
  *   - \p ptr refers to dynamically allocated memory on the heap.
  *   - all memory pointed to by \p ptr is considered free.  This holds even if it
  *     it is kept in \ref memUsedPool.
  * \post
- *   - \ref poolTotalFree is updated
- *   - Exit on out-of-memory (the \ref memFreePool overflows)
+ *   - \ref poolTotalFree and \ref memFreePoolBytes are updated
  * \attention never submit a \p ptr referring to memory not on the heap, like
  *   NULL_PTRSTRING.
  */
@@ -409,7 +443,7 @@ void memFreePoolPurge(flag untilOK);
  * \brief Provide information about memory in pools at the instant of call.
  *
  * Return the overall statistics about the pools \ref memFreePool
- * "free block array" and the \ref memUsedPool "used block array".  In MEMORY
+ * "free lists" and the \ref memUsedPool "used block array".  In MEMORY
  * STATUS mode ON, a diagnostic message compares the contents of
  * \ref poolTotalFree to the values found in this statistics.  They should not
  * differ!
@@ -432,6 +466,15 @@ void memFreePoolPurge(flag untilOK);
  */
 void getPoolStats(long *freeAlloc, long *usedAlloc, long *usedActual);
 
+/*!
+ * \brief print the reuse rates of the memory pool for SHOW MEMORY.
+ *
+ * Prints how many \ref poolMalloc calls were served from the free lists,
+ * overall and for each \ref pgSizeClass "size class" used so far, and the
+ * free space held by the pools.
+ */
+void showPoolStats(void);
+
 /*! Initial memory allocation */
 void initBigArrays(void);
 
@@ -654,6 +697,33 @@ long nmbrElementIn(long start, const nmbrString *g, long element);
 /*! Add a single number to end of a nmbrString - faster than nmbrCat */
 temp_nmbrString *nmbrAddElement(const nmbrString *g, long element);
 
+/*!
+ * \fn void nmbrReserve(nmbrString **s, long n)
+ * \brief Make sure the nmbrString *s has room for n elements
+ *
+ * The functions nmbrReserve(), nmbrPush(), nmbrAppend() and nmbrFinalize()
+ * build a nmbrString in place.  Where `nmbrLet(&s, nmbrAddElement(s, e))`
+ * copies the whole string for each element added, so that building a string
+ * of n elements costs O(n^2), nmbrPush() and nmbrAppend() grow the block
+ * geometrically and cost amortized O(1) per element.  They do not free the
+ * temporary nmbrStrings, so they may be called with a temporary argument.
+ *
+ * \param[in,out] s the nmbrString; its contents are kept, but it may move
+ * \param[in] n the number of elements needed, not counting the end of string
+ */
+void nmbrReserve(nmbrString **s, long n);
+
+/*! Add a single number to the end of the nmbrString *s in place */
+void nmbrPush(nmbrString **s, long element);
+
+/*! Add the elements of source to the end of the nmbrString *s in place.
+   source may be a temporary, but not *s itself. */
+void nmbrAppend(nmbrString **s, const nmbrString *source);
+
+/*! Give back the unused room of a nmbrString built in place, for a string
+   that will be kept.  Frees the temporary nmbrStrings like nmbrLet(). */
+void nmbrFinalize(nmbrString **s);
+
 /*! Get the set union of two math token strings (presumably
    variable lists) */
 temp_nmbrString *nmbrUnion(const nmbrString *m1, const nmbrString *m2);
@@ -670,30 +740,60 @@ temp_nmbrString *nmbrSetMinus(const nmbrString *m1,const nmbrString *m2);
    ends at step */
 long nmbrGetSubproofLen(const nmbrString *proof, long step);
 
+/*! Proof structure index of an RPN proof, with one entry per proof step in
+   each array.  Unknown steps and local label references are treated as
+   one-step subproofs.  Declare it initialized to
+   {NULL, NULL, NULL, NULL, NULL, 0, 0} and deallocate it with
+   freeProofIndex(). */
+struct proofIndex_struct {
+  long *subproofStart; /*!< First step of the subproof ending at the step */
+  long *parentStep; /*!< Step that the step is a hypothesis of (-1 if none) */
+  long *hypIndex; /*!< Which required hypothesis of parentStep (0 = first) */
+  long *depth; /*!< Indentation level (0 for the last step) */
+  char *essential; /*!< 1 if the step is in the essential part of the proof */
+  long len; /*!< Number of proof steps */
+  long alloc; /*!< Allocated length of the arrays */
+};
+
+/*! Build the proof structure index of proof in one pass.
+  \return 1 if the proof is a single complete subproof, 0 otherwise */
+flag buildProofIndex(struct proofIndex_struct *index, const nmbrString *proof);
+
+/*! Update the proof structure index after the subproof at steps firstStep
+   through lastStep was replaced by a new subproof of newLen steps, which
+   is now at step firstStep of proof. */
+void spliceProofIndex(struct proofIndex_struct *index, const nmbrString *proof,
+    long firstStep, long lastStep, long newLen);
+
+/*! Deallocate a proof structure index */
+void freeProofIndex(struct proofIndex_struct *index);
+
 /*! This function returns a "squished" proof, putting in {} references
-   to previous subproofs. */
+   to previous subproofs.  The input may be uncompressed or already
+   squished; in the latter case it is not expanded first. */
 temp_nmbrString *nmbrSquishProof(const nmbrString *proof);
 
 /*! This function un-squishes a "squished" proof, replacing {} references
    to previous subproofs by the subproofs themselves. */
 temp_nmbrString *nmbrUnsquishProof(const nmbrString *proof);
 
+/*! Return the number of steps a "squished" proof would have un-squished,
+   without building it.  (A double, since it can be exponentially larger
+   than the squished proof.) */
+double nmbrGetUnsquishedLen(const nmbrString *proof);
+
 /*! This function returns the indentation level vs. step number of a proof
    string.  This information is used for formatting proof displays.  The
-   function calls itself recursively, but the first call should be with
-   startingLevel = 0. */
+   top-level step has indentation startingLevel (normally 0). */
 temp_nmbrString *nmbrGetIndentation(const nmbrString *proof,
   long startingLevel);
 
 /*! This function returns essential (1) or floating (0) vs. step number of a
-   proof string.  This information is used for formatting proof displays.  The
-   function calls itself recursively, but the first call should be with
-   startingLevel = 0. */
+   proof string.  This information is used for formatting proof displays. */
 temp_nmbrString *nmbrGetEssential(const nmbrString *proof);
 
 /*! This function returns the target hypothesis vs. step number of a proof
-   string.  This information is used for formatting proof displays.  The
-   function calls itself recursively.
+   string.  This information is used for formatting proof displays.
    statemNum is the statement being proved. */
 temp_nmbrString *nmbrGetTargetHyp(const nmbrString *proof, long statemNum);
 
@@ -888,10 +988,25 @@ temp_pntrString *pntrAddElement(const pntrString *g);
 /*! Add a single null pntrString element to a pntrString - faster than pntrCat */
 temp_pntrString *pntrAddGElement(const pntrString *g);
 
+/*! Make sure the pntrString *s has room for n elements, keeping its
+   contents (see \ref nmbrReserve) */
+void pntrReserve(pntrString **s, long n);
+
+/*! Add a single pointer to the end of the pntrString *s in place */
+void pntrPush(pntrString **s, void *element);
+
+/*! Add the elements of source to the end of the pntrString *s in place;
+   only the pointers are copied */
+void pntrAppend(pntrString **s, const pntrString *source);
+
+/*! Give back the unused room of a pntrString built in place.  Frees the
+   temporary pntrStrings like pntrLet(). */
+void pntrFinalize(pntrString **s);
+
 // Utility functions
 
 /*! 0/1 knapsack algorithm */
-long knapsack01(long items, long *size, long *worth, long maxSize,
+long knapsack01(long items, nmbrString *size, nmbrString *worth, long maxSize,
        char *itemIncluded /* output: 1 = item included, 0 = not included */);
 
 /*! 2D matrix allocation */
@@ -945,4 +1060,10 @@ int qsortStringCmp(const void *p1, const void *p2);
 /*! Call on exit to free memory */
 void freeData(void);
 
+#ifdef TEST_ENABLE
+
+extern void test_mmdata(void);
+
+#endif // TEST_ENABLE
+
 #endif // METAMATH_MMDATA_H_
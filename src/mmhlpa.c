@@ -864,7 +864,7 @@ H("");
 }
 
 if (!strcmp(saveHelpCmd, "HELP READ")) {
-H("Syntax:  READ <file> [/ VERIFY]");
+H("Syntax:  READ <file> [/ VERIFY] [/ INCREMENTAL]");
 H("");
 H("This command will read in a Metamath language source file and any included");
 H("files.  Normally it will be the first thing you do when entering Metamath.");
@@ -883,9 +883,20 @@ H("If you are prompted for the file name (by pressing <return> after READ)");
 H("you should _not_ put quotes around it, even if it is a Unix file name.");
 H("with slashes.");
 H("");
-H("Optional qualifier:");
+H("Optional qualifiers:");
 H("    / VERIFY - Verify all proofs as the database is read in.  This");
 H("        qualifier will slow down reading in the file.");
+H("    / INCREMENTAL - If <file> has already been READ in, read it again");
+H("        only if it or one of its included files has changed (by");
+H("        modification time and contents).  The whole database is then");
+H("        read and parsed again, as with ERASE and READ, so the statements");
+H("        before the first changed file keep their numbers.  What is");
+H("        incremental is the proof checking:  only the proofs that may be");
+H("        affected are verified, i.e. those of new or changed statements");
+H("        (including changed optional $d's) and those that use a statement");
+H("        whose assertion or hypotheses changed.  Errors in other proofs");
+H("        are not reported again.  The changes made in the database by");
+H("        Metamath must have been saved with WRITE SOURCE first.");
 H("");
 H("See also HELP ERASE.");
 H("");
@@ -104,6 +104,10 @@ H("");
 H("This command shows the available memory left.  It is not meaningful");
 H("on modern machines with virtual memory.");
 H("");
+H("It also shows how often the memory pool for math strings and proofs");
+H("could reuse a freed block instead of allocating a new one, for each");
+H("size class of blocks, and how much free space the pool holds.");
+H("");
 }
 
 if (!strcmp(saveHelpCmd, "HELP SHOW SETTINGS")) {
@@ -121,6 +125,22 @@ H("previous use of SHOW ELAPSED_TIME.");
 H("");
 }
 
+if (!strcmp(saveHelpCmd, "HELP SHOW PROFILE")) {
+H("Syntax:  SHOW PROFILE [/ JSON]");
+H("");
+H("This command shows what was recorded since the last SET PROFILE command:");
+H("the phases of READ, each command, and with SET PROFILE STATEMENTS each");
+H("statement checked by VERIFY PROOF.  For each it shows the wall clock time");
+H("and CPU time in seconds, the number of memory pool allocations, of");
+H("temporary strings, and of string assignments (let), and the peak memory");
+H("of the process at its end in kB (-1 if the system does not tell).");
+H("");
+H("Optional qualifier:");
+H("    / JSON - Show the records as a JSON object {\"profile\": [...]} with");
+H("        one record per line, for processing by other programs.");
+H("");
+}
+
 if (!strcmp(saveHelpCmd, "HELP SHOW LABELS")) {
 H("Syntax:  SHOW LABELS <label-match> [/ ALL] [/ LINEAR]");
 H("");
@@ -258,7 +278,9 @@ H("    / STATEMENT_SUMMARY - Summarizes all statements (like a brief SHOW");
 H("        STATEMENT) used by the proof.  May not be used with any other");
 H("        qualifier except / ESSENTIAL.");
 H("    / SIZE - Shows size of the proof in the source.  The size depends on");
-H("        how it was last SAVEd (compressed or normal).");
+H("        how it was last SAVEd (compressed or normal).  The number of steps");
+H("        of the uncompressed proof is also shown (without uncompressing it,");
+H("        since it can be much larger).");
 H("    / DETAILED_STEP <step> - Shows the details of what is happening at");
 H("        a specific proof step.  May not be used with any other qualifier.");
 H("    / NORMAL, / COMPRESSED, / EXPLICIT, / PACKED, / FAST,");
@@ -565,7 +587,7 @@ H("reset it to be the working directory.");
 }
 
 if (!strcmp(saveHelpCmd, "HELP SET UNIFICATION_TIMEOUT")) {
-H("Syntax:  SET UNIFICATION_TIMEOUT <number>");
+H("Syntax:  SET UNIFICATION_TIMEOUT <number> [/ SECONDS]");
 H("");
 H("(This command affects the Proof Assistant only.)");
 H("");
@@ -576,6 +598,12 @@ H("exponentially with the number of variables.  If you want Metamath to try");
 H("harder (and you're willing to wait longer) you may increase this");
 H("parameter.  SHOW SETTINGS will show you the current value.");
 H("");
+H("The <number> is the number of unification trials (backtracks).  With");
+H("/ SECONDS it is instead the wall clock time in seconds that a single");
+H("unification may take, whatever the number of trials; 0 (the default)");
+H("means no time limit.  Both limits apply, so a unification times out at");
+H("whichever comes first.");
+H("");
 H("Often, a better solution to resolve a unification timeout is to manually");
 H("assign some or all of the unknowns (see HELP LET) then try to unify");
 H("again.");
@@ -614,6 +642,53 @@ H("value.");
 H("");
 }
 
+if (!strcmp(saveHelpCmd, "HELP SET MATH_CACHE")) {
+H("Syntax:  SET MATH_CACHE <number>");
+H("");
+H("This command sets the number of typeset math strings (hypotheses and");
+H("assertions converted to HTML or LaTeX) that are kept in memory and reused");
+H("when the same math string is typeset again, such as by WRITE THEOREM_LIST");
+H("or SHOW STATEMENT / HTML.  When the cache is full, the least recently used");
+H("entry is discarded.  The default is 0, meaning no cache.  The SHOW");
+H("SETTINGS command tells you its current value and how many lookups were");
+H("found in the cache.");
+H("");
+}
+
+if (!strcmp(saveHelpCmd, "HELP SET STEP_SHARING")) {
+H("Syntax:  SET STEP_SHARING ON or SET STEP_SHARING OFF");
+H("");
+H("When this is ON, proof verification keeps a single copy of each distinct");
+H("math string that results from a proof step, and remembers the result of");
+H("each assertion applied to given hypotheses.  A step that repeats an");
+H("earlier one, in the same proof or (if the assertion has no $d");
+H("requirements) in another proof, is then looked up instead of unified");
+H("again.  This speeds up VERIFY PROOF and SHOW PROOF on proofs with many");
+H("repeated steps at the cost of memory.  The shared strings are discarded");
+H("when they become too large, when the database is erased, or when this");
+H("setting is turned OFF.  The default is OFF.  The SHOW SETTINGS command");
+H("tells you how many steps were reused.");
+H("");
+}
+
+if (!strcmp(saveHelpCmd, "HELP SET PROFILE")) {
+H("Syntax:  SET PROFILE ON or SET PROFILE STATEMENTS or SET PROFILE OFF");
+H("");
+H("When this is ON, the time, allocations and peak memory of each command");
+H("and of each phase of READ (such as parseKeywords, parseLabels,");
+H("parseMathDecl and parseStatements) are recorded.  STATEMENTS also records");
+H("each statement checked by VERIFY PROOF, which makes it slower.  Each SET");
+H("PROFILE command discards what was recorded before.  Use SHOW PROFILE to");
+H("see the records.  The default is OFF.");
+H("");
+H("While profiling, each command whose search reached the unifier (such as");
+H("IMPROVE, MINIMIZE_WITH or UNIFY) is followed by a \"Search:\" report of");
+H("how many statements were tried as candidates, how many were rejected by");
+H("the quick filter before unification, and the number of unification");
+H("timeouts, backtracks, and unifications discarded by the Henty filter.");
+H("");
+}
+
 if (!strcmp(saveHelpCmd, "HELP SET JEREMY_HENTY_FILTER")) {
 H("Syntax:  SET JEREMY_HENTY_FILTER ON or SET JEREMY_HENTY_FILTER OFF");
 H("");
@@ -627,7 +702,8 @@ H("");
 }
 
 if (!strcmp(saveHelpCmd, "HELP VERIFY PROOF")) {
-H("Syntax:  VERIFY PROOF <label-match> [/ SYNTAX_ONLY]");
+H("Syntax:  VERIFY PROOF <label-match> [/ SYNTAX_ONLY] [/ STATS <number>]");
+H("            [/ CSV <file>]");
 H("");
 H("This command verifies the proofs of the specified statements.");
 H("<label-match> may contain * and ? wildcard characters to verify more than");
@@ -636,10 +712,18 @@ H("\"abc\" followed by any single character followed by \"def\".");
 H("VERIFY PROOF * will verify all proofs in the database.");
 H("See HELP SEARCH for complete wildcard matching rules.");
 H("");
-H("Optional qualifier:");
+H("Optional qualifiers:");
 H("    / SYNTAX_ONLY - This qualifier will perform a check of syntax and RPN");
 H("        stack violations only.  It will not verify that the proof is");
 H("        correct.");
+H("    / STATS <number> - After the verification, list the <number> (default");
+H("        10) statements whose proofs took the most CPU time, with the time");
+H("        spent parsing and verifying each, its number of proof steps, and");
+H("        how often the unification of its steps had to retry a variable");
+H("        assignment (backtracks).  A histogram of the time per statement");
+H("        follows.");
+H("    / CSV <file> - Write the same figures for every statement checked to");
+H("        <file>, as comma-separated values in database order.");
 H("");
 H("Note: READ, followed by VERIFY PROOF *, will ensure the database is free");
 H("from errors in Metamath language but will not check the markup language");
@@ -650,6 +734,7 @@ H("");
 if (!strcmp(saveHelpCmd, "HELP VERIFY MARKUP")) {
 H("Syntax:  VERIFY MARKUP <label-match> [/ DATE_SKIP] [/ TOP_DATE_CHECK]");
 H("            [/ FILE_CHECK] [/ UNDERSCORE_SKIP] [/ MATHBOX_SKIP] [/VERBOSE]");
+H("            [/ THREADS <number>]");
 H("");
 H("This command checks comment markup and other informal conventions we have");
 H("adopted.  It error-checks the latexdef, htmldef, and althtmldef statements");
@@ -682,6 +767,10 @@ H("        independence i.e. that no mathbox proof references a statement");
 H("        in another (earlier) mathbox.");
 H("    / VERBOSE - Provides more information.  Currently it provides a list");
 H("        of axXXX vs. ax-XXX matches.");
+H("    / THREADS <number> - Divides the checks of statement comments and");
+H("        section headers among <number> worker processes running in");
+H("        parallel.  The warnings are still listed in source order.  Ignored");
+H("        on systems without fork() support.  The default is 1.");
 H("");
 H("See also HELP LANGUAGE, HELP HTML, HELP WRITE THEOREM_LIST, and");
 H("HELP SET DISCOURAGEMENT for more details on the markup syntax.");
@@ -717,6 +806,36 @@ H("        file itself).  The screen output of any operating system commands");
 H("        inside the command file (see HELP SYSTEM) is not suppressed.");
 }
 
+if (!strcmp(saveHelpCmd, "HELP SERVE")) {
+H("Syntax:  SERVE [/ SOCKET <filename>]");
+H("");
+H("This command turns Metamath into a server that keeps the database in");
+H("memory and answers commands sent by another program, so that the");
+H("database need not be read again for each query.  Each request is one");
+H("command line.  Each reply starts with a header line containing the number");
+H("of bytes of command output that follow and the current prompt (MM>,");
+H("MM-PA>, etc.), for example \"273 MM>\", followed by the output itself.  Any");
+H("question the command asks is answered with its default, and the question");
+H("is included in the output.  Scrolling is always continuous.");
+H("");
+H("Without a qualifier, requests are read from the standard input and");
+H("replies are written to the standard output, starting with an empty");
+H("reply.  At end of input, EXIT is executed.");
+H("");
+H("Optional qualifier:");
+H("    / SOCKET <filename> - Listen for connections on a Unix domain socket");
+H("        with this name instead.  Each client gets an empty reply when it");
+H("        connects.  The requests of all clients are executed in turn by the");
+H("        same Metamath session, so all clients share one Proof Assistant");
+H("        session.  SHOW, SEARCH, VERIFY, and HELP requests, which do not");
+H("        change the database, are answered by separate worker processes");
+H("        so that they may run at the same time as other requests, except");
+H("        while a LOG or TeX file is open (see OPEN LOG), when they are");
+H("        answered in turn so that their output reaches the file.  An EXIT");
+H("        from the MM> prompt stops the server.");
+H("");
+}
+
 if (!strcmp(saveHelpCmd, "HELP SYSTEM")) {
 H("A line enclosed in single or double quotes will be executed by your");
 H("computer's operating system, if it has such a feature.  For example, on a");
@@ -1156,6 +1275,7 @@ H("         IMPROVE LAST [/ DEPTH <number>] [/ NO_DISTINCT] [/ 2] [/ 3]");
 H("                       [/ SUBPROOFS] [/ INCLUDE_MATHBOXES] [/ OVERRIDE]");
 H("         IMPROVE ALL [/ DEPTH <number>] [/ NO_DISTINCT] [/ 2] [/ 3]");
 H("                       [/ SUBPROOFS] [/ INCLUDE_MATHBOXES] [/ OVERRIDE]");
+H("         (All forms also accept [/ BUDGET <seconds>].)");
 H("");
 H("This command, available in the Proof Assistant only, tries to");
 H("find proofs automatically for unknown steps whose symbol sequences are");
@@ -1223,6 +1343,9 @@ H("        the PROVE argument.  This qualifier allows them to be included.");
 H("    / OVERRIDE - By default, IMPROVE skips statements that have");
 H("        \"(New usage is discouraged.)\" in their description comment.");
 H("        This qualifier tries to use them anyway.");
+H("    / BUDGET <seconds> - Stop searching after about <seconds> of wall");
+H("        clock time and keep the proofs found so far.  The running");
+H("        unification times out at the limit as well.");
 H("");
 H("Note that / 2 includes the search of / 1, and / 3 includes / 2.");
 H("Specifying / 1 / 2 / 3 has the same effect as specifying just / 3, so");
@@ -1239,7 +1362,7 @@ H("Syntax:  MINIMIZE_WITH <label-match> [/ VERBOSE] [/ MAY_GROW]");
 H("              [/ EXCEPT <label-match>] [/ INCLUDE_MATHBOXES]");
 H("              [/ ALLOW_NEW_AXIOMS <label-match>]");
 H("              [/ NO_NEW_AXIOMS_FROM <label-match>] [/ FORBID <label-match>]");
-H("              [/ OVERRIDE] [/ TIME]");
+H("              [/ OVERRIDE] [/ TIME] [/ BUDGET <seconds>]");
 H("");
 H("This command, available in the Proof Assistant only, checks whether");
 H("the proof can be shortened by using earlier $p or $a statements matching");
@@ -1302,6 +1425,9 @@ H("    / OVERRIDE - By default, MINIMIZE_WITH skips statements that have");
 H("        \"(New usage is discouraged.)\" in their description comment.");
 H("        With this qualifier it will try to use them anyway.");
 H("    / TIME - prints out the run time used by the MINIMIZE_WITH run.");
+H("    / BUDGET <seconds> - Stop scanning after about <seconds> of wall");
+H("        clock time and keep the shortest proof found so far.  The backward");
+H("        scan is skipped if the forward scan ran out of time.");
 H("");
 }
 
@@ -12,11 +12,31 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
 #include <time.h>
 #include "mmvstr.h"
 #include "mmdata.h"
 #include "mminou.h"
 #include "mmcmdl.h" // for g_commandPrompt global
+#if defined(__unix__) || defined(__APPLE__)
+// Unix domain socket and worker processes for SERVE / SOCKET
+#define SERVE_SOCKET
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+// Wall time and peak memory for SET PROFILE
+#define PROFILE_RUSAGE
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
 
 #ifdef __WATCOMC__
   // Bugs in WATCOMC:
@@ -53,6 +73,39 @@ vstring_def(g_printString);
 long g_commandFileNestingLevel = 0;
 FILE *g_commandFilePtr[MAX_COMMAND_FILE_NESTING + 1];
 vstring g_commandFileName[MAX_COMMAND_FILE_NESTING + 1];
+// Global variables used by SERVE
+flag g_serveMode = 0;
+// The screen output of the current SERVE request, sent as its reply
+static vstring_def(serveOutput);
+// Global variables used by SET PROFILE
+flag g_profileFlag = 0;
+// The intervals recorded so far
+static struct profileRecord_struct {
+  char kind; // 'p' parser phase, 'c' command, 's' statement
+  vstring name;
+  double wallTime, cpuTime; // Seconds
+  long poolMallocs, tempAllocs, lets; // Counts during the interval
+  long peakMemory; // kB at the end of the interval, -1 if unknown
+} *profileRecords = NULL;
+static long profileRecordCount = 0;
+static long profileRecordRoom = 0;
+
+/*!
+ * \brief a \ref vstring that is built by appending text to its end.
+ *
+ * The string is allocated with spare room that is doubled when it runs out,
+ * so appending copies only the new text instead of the whole string, as
+ * let() with cat() would.  This keeps page-long captures such as HTML proof
+ * tables linear in their size.
+ */
+struct appendString_struct {
+  vstring str; // The allocation last made by appendString(), or ""
+  size_t length; // strlen(str)
+  size_t room; // Allocated size of str, excluding the terminating NUL
+};
+// For g_printString and serveOutput
+static struct appendString_struct printStringBuf = {"", 0, 0};
+static struct appendString_struct serveOutputBuf = {"", 0, 0};
 
 /*!
  * \var flag g_commandFileSilent[]
@@ -176,6 +229,44 @@ long backBufferPos = 0;
  */
 flag backFromCmdInput = 0;
 
+// Append text to *target, which is tracked by buf.  If *target is not the
+// string last built by buf (it was emptied by let() or the like since), its
+// length is found again.
+static void appendString(struct appendString_struct *buf, vstring *target,
+    const char *text) {
+  size_t textLength = strlen(text);
+  char *newStr;
+  if (!textLength) return;
+  if (*target != buf->str) {
+    buf->str = *target;
+    buf->length = strlen(*target);
+    buf->room = buf->length; // At least
+  }
+  if (buf->length + textLength > buf->room) {
+    buf->room = 2 * buf->room;
+    if (buf->room < buf->length + textLength) {
+      buf->room = buf->length + textLength;
+    }
+    if (buf->room < 1000) buf->room = 1000;
+    newStr = reallocVstring(buf->str, buf->room);
+    if (!newStr) outOfMemory("#150 (appendString)");
+    buf->str = newStr;
+  }
+  memcpy(buf->str + buf->length, text, textLength + 1);
+#ifndef VSTRING_HEADER // Else reallocVstring() counts the room
+/*E*/db += (long)textLength + (buf->length ? 0 : 1); // As let() would count
+#endif
+  buf->length += textLength;
+  *target = buf->str;
+} // appendString
+
+void setPrintString(const char *source) {
+  let(&g_printString, source);
+  printStringBuf.str = g_printString;
+  printStringBuf.length = strlen(g_printString);
+  printStringBuf.room = printStringBuf.length;
+} // setPrintString
+
 // Special: if global flag g_outputToString = 1, then the output is not
 // printed but is added to global string g_printString.
 // Returns 0 if user typed "q" during scroll prompt; this lets a procedure
@@ -212,7 +303,7 @@ flag print2(const char* fmt, ...) {
 
   if ((!g_quitPrint && g_commandFileNestingLevel == 0 && (g_scrollMode == 1
            && localScrollMode == 1)
-      && printedLines >= g_screenHeight && !g_outputToString)
+      && printedLines >= g_screenHeight && !g_outputToString && !g_serveMode)
       || backFromCmdInput) {
     // It requires a scrolling prompt
 
@@ -371,8 +462,9 @@ flag print2(const char* fmt, ...) {
     goto PRINT2_RETURN;
   }
 
-  if (!g_outputToString && !g_commandFileSilentFlag) {
-    if (nlpos == 0) { // Partial line (usu. status bar) - print immediately
+  if (!g_outputToString && !g_commandFileSilentFlag && !g_serveMode) {
+    if (nlpos == 0) {
+      // Partial line (usu. status bar) - print immediately
 
 // step (7) print to screen, part 1
 
@@ -450,7 +542,12 @@ flag print2(const char* fmt, ...) {
 
 // step (11) redirect output to a string
 
-    let(&g_printString, cat(g_printString, printBuffer, NULL));
+    appendString(&printStringBuf, &g_printString, printBuffer);
+  } else if (g_serveMode && !g_commandFileSilentFlag) {
+    // The screen output of a SERVE request is redirected in the same way, to
+    // its reply.  (Not to g_printString, which a command may be using to
+    // capture part of its output and then discard it.)
+    appendString(&serveOutputBuf, &serveOutput, printBuffer);
   }
 
   // Check for lines too long
@@ -502,6 +599,10 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
   vstring_def(startNextLine1);
   vstring_def(breakMatch1);
   long i, p;
+  long multiPos; // Start of the next caller's line in multiLine
+  char *rest; // Part of longLine still to be printed
+  long restLen;
+  const char *newLine;
   long startNextLineLen;
   flag firstLine;
   flag tildeFlag = 0;
@@ -589,23 +690,31 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
     let(&startNextLine1, " ");
   }
 
-  while (multiLine[0]) { // While there are multiple caller-inserted newlines
+  // Lines are consumed by advancing multiPos and rest rather than by
+  // cutting them off the front of multiLine and longLine, which would copy
+  // the remaining text again for every line printed.
+  multiPos = 0;
+  while (multiLine[multiPos]) { // While there are caller-inserted newlines
 
     // Process caller-inserted newlines
-    p = instr(1, multiLine, "\n");
-    if (p) {
+    newLine = strchr(multiLine + multiPos, '\n');
+    if (newLine) {
       // Get the next caller's line
-      let(&longLine, left(multiLine, p - 1));
-      let(&multiLine, right(multiLine, p + 1));
+      let(&longLine, mid(multiLine, multiPos + 1,
+          newLine - multiLine - multiPos));
+      multiPos = newLine - multiLine + 1;
     } else {
-      let(&longLine, multiLine);
-      free_vstring(multiLine);
+      let(&longLine, multiLine + multiPos);
+      multiPos += (long)strlen(multiLine + multiPos);
     }
+    rest = longLine;
+    restLen = (long)strlen(longLine);
 
     saveScreenWidth = g_screenWidth;
    HTML_RESTART:
     // Now we will break up one line from the caller i.e. longLine;
-    // multiLine has any remaining lines to be processed in next pass.
+    // multiLine has any remaining lines (from multiPos on) to be processed
+    // in next pass.
     firstLine = 1;
 
     startNextLineLen = (long)strlen(startNextLine1);
@@ -621,7 +730,7 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
     // for LaTeX.
     // Otherwise, if first line:  use length of longLine;
     // if not first line:  use length of longLine - startNextLineLen.
-    while ((signed)(strlen(longLine)) + (1 - firstLine) * startNextLineLen >
+    while (restLen + (1 - firstLine) * startNextLineLen >
         g_screenWidth - (long)tildeFlag - (long)(breakMatch1[0] == '\\')) {
       // Get screen width + 1 (default is 79 + 1)
       p = g_screenWidth - (long)tildeFlag - (long)(breakMatch1[0] == '\\') + 1;
@@ -630,16 +739,17 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
       if (p < 4) bug(1524); // This may cause out-of-string ref below
       // Assume compressed proof if 1st char of breakMatch1 is "&"
       if (breakMatch1[0] == '&'
-          && ((!instr(p, left(longLine, (long)strlen(longLine) - 3), " ")
-              && longLine[p - 3] != ' ') // Don't split trailing "$."
-            || longLine[p - 4] == ')')) /* Label sect ends in col 77 */ {
+          && ((!(restLen - 3 > p - 1 // No space from p on, except in "$."
+                && memchr(rest + p - 1, ' ', (size_t)(restLen - 3 - (p - 1))))
+              && rest[p - 3] != ' ') // Don't split trailing "$."
+            || rest[p - 4] == ')')) /* Label sect ends in col 77 */ {
         // We're in the compressed proof section; break line anywhere
         p = p + 0; // Don't change position
         // In the case where the last space occurs at column 79 i.e.
         // g_screenWidth, break the line at column 78.  This can happen
         // when compressed proof ends at column 78, followed by space
         // and "$."  It prevents an extraneous trailing space on the line.
-        if (longLine[p - 2] == ' ') p--;
+        if (rest[p - 2] == ' ') p--;
       } else {
         if (!breakMatch1[0]) {
           p = p + 0; // Break line anywhere; don't change position
@@ -648,7 +758,7 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
           // For LaTeX, match space, not backslash
           // (Todo:  is backslash match mode really needed?)
           while (strchr(breakMatch1[0] != '\\' ? breakMatch1 : " ",
-              longLine[p - 1]) == NULL) {
+              rest[p - 1]) == NULL) {
             p--;
             if (!p) break;
           }
@@ -678,7 +788,7 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
       // If we broke at a non-space 1st char, line length won't get reduced
       // Hopefully this will never happen with the breakMatch's we use,
       // otherwise the code will require a rework.
-      if (p == 1 && longLine[0] != ' ') bug(1516);
+      if (p == 1 && rest[0] != ' ') bug(1516);
       if (firstLine) {
         firstLine = 0;
         free_vstring(prefix);
@@ -693,35 +803,37 @@ void printLongLine(const char *line, const char *startNextLine, const char *brea
         }
       }
       if (!tildeFlag) {
-        print2("%s\n",cat(prefix, left(longLine,p - 1), NULL));
+        print2("%s\n",cat(prefix, left(rest,p - 1), NULL));
       } else {
-        print2("%s\n",cat(prefix, left(longLine,p - 1), "~", NULL));
+        print2("%s\n",cat(prefix, left(rest,p - 1), "~", NULL));
       }
-      if (longLine[p - 1] == ' ' &&
+      if (rest[p - 1] == ' ' &&
           breakMatch1[0] /* But not "break anywhere" line */) {
         // (Note:  search for "p--" ~100 lines above for the place
         // where the backward search for space happens.)
         // Remove leading space for neatness.
-        if (longLine[p] == ' ') {
+        if (rest[p] == ' ') {
           // There could be 2 spaces at the end of a sentence.
-          let(&longLine, right(longLine, p + 2));
-        } else {
-          let(&longLine, right(longLine,p + 1));
+          p++;
         }
       } else {
-        let(&longLine, right(longLine,p));
+        p--;
       }
+      // Skip the p characters printed or removed
+      if (p > restLen) p = restLen;
+      rest += p;
+      restLen -= p;
     } // end while longLine too long
     if (!firstLine) {
       if (treeIndentationFlag) {
         // Right justify output for continuation lines
         print2("%s\n",cat(startNextLine1, space(g_screenWidth
-            - startNextLineLen - (long)(strlen(longLine))), longLine, NULL));
+            - startNextLineLen - restLen), rest, NULL));
       } else {
-        print2("%s\n",cat(startNextLine1, longLine, NULL));
+        print2("%s\n",cat(startNextLine1, rest, NULL));
       }
     } else {
-      print2("%s\n",longLine);
+      print2("%s\n",rest);
     }
     g_screenWidth = saveScreenWidth; // Restore to normal
   } // end while multiLine != ""
@@ -774,7 +886,9 @@ vstring cmdInput(FILE *stream, const char *ask) {
 #endif
     }
     i = (long)strlen(g);
+#ifndef VSTRING_HEADER // Else let() counts the room, not the text
 /*E*/db = db - (CMD_BUFFER_SIZE - i); // Adjust string usage to detect leaks.
+#endif
     // Detect operating system bug of inputting no characters.
     if (!i) {
       printf("***BUG #1507\n");
@@ -793,7 +907,9 @@ vstring cmdInput(FILE *stream, const char *ask) {
         }
         // Add a new-line so processing below will behave correctly.
         let(&g, cat(g, chr('\n'), NULL));
+#ifndef VSTRING_HEADER
 /*E*/db = db + (CMD_BUFFER_SIZE - i); // Cancel extra piece of string
+#endif
         i++;
       }
     }
@@ -807,7 +923,9 @@ vstring cmdInput(FILE *stream, const char *ask) {
 #endif
       }
       g[i]=0; // Eliminate new-line character by zapping it
+#ifndef VSTRING_HEADER
 /*E*/db = db - 1;
+#endif
     } else {
       if (g[0] != '\n') {
         printf("***BUG #1521\n");
@@ -901,7 +1019,11 @@ vstring cmdInput1(const char *ask) {
 
   while (1) {
     if (g_commandFileNestingLevel == 0) {
-      commandLn = cmdInput(stdin, ask1);
+      if (g_serveMode) {
+        commandLn = serveInput(ask1);
+      } else {
+        commandLn = cmdInput(stdin, ask1);
+      }
       if (!commandLn) {
         commandLn = ""; // Init vstring (was NULL)
         // Allow ^D to exit
@@ -913,7 +1035,9 @@ vstring cmdInput1(const char *ask) {
           // Force exit with Y, to prevent infinite loop
           let(&commandLn, "Y");
         }
-        printf("%s\n", commandLn); // Let user see what's happening
+        if (!g_serveMode) {
+          printf("%s\n", commandLn); // Let user see what's happening
+        }
       }
       if (g_logFileOpenFlag) fprintf(g_logFilePtr, "%s%s\n", ask1, commandLn);
 
@@ -968,6 +1092,333 @@ vstring cmdInput1(const char *ask) {
   return commandLn;
 } // cmdInput1
 
+// SERVE keeps the database in memory and takes its command lines from a
+// client program instead of the terminal.  Each command line is a request,
+// and its screen output is captured by print2() and sent back as a reply
+// frame:  a header line "<bytes> <prompt>" (the prompt being MM>, MM-PA>,
+// etc.) followed by exactly <bytes> bytes of output.
+
+#ifdef SERVE_SOCKET
+// A client connected to the SERVE / SOCKET socket
+struct serveClient_struct {
+  int fd; // -1 = unused slot
+  pid_t pid; // Worker process answering its request, 0 if none
+  vstring input; // Received text not yet taken as a request
+};
+static struct serveClient_struct *serveClients = NULL;
+static long serveClientCount = 0;
+static long serveNextClient = 0; // For round-robin service of the clients
+static int serveListenFd = -1;
+static vstring_def(serveSocketPath);
+static flag serveWorker = 0; // 1 = this is a worker process
+#endif
+static long serveClient = -1; // Client of the current request, -1 = none
+static FILE *serveFramePtr = NULL; // Reply stream when serving stdin
+static flag serveEof = 0; // 1 = end of file was reached on stdin
+
+#ifdef SERVE_SOCKET
+// Write all of a string to a socket.  A client that has gone away is
+// noticed (and closed) the next time it is read.
+static void serveWrite(int fd, const char *s) {
+  size_t left = strlen(s);
+  ssize_t n;
+  while (left > 0) {
+    n = write(fd, s, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    s += n;
+    left -= (size_t)n;
+  }
+} // serveWrite
+#endif
+
+// Send the captured output as the reply to the current request, and clear
+// it.  The output is discarded if there is no client to send it to.
+static void serveReply(void) {
+  vstring_def(frame);
+  let(&frame, cat(str((double)strlen(serveOutput)), " ",
+      edit(g_commandPrompt, 128 /* discard trailing spaces */), "\n",
+      serveOutput, NULL));
+  if (serveFramePtr != NULL) {
+    fputs(frame, serveFramePtr);
+    fflush(serveFramePtr);
+  }
+#ifdef SERVE_SOCKET
+  else if (serveClient >= 0) {
+    serveWrite(serveClients[serveClient].fd, frame);
+  }
+#endif
+  free_vstring(frame);
+  free_vstring(serveOutput);
+} // serveReply
+
+#ifdef SERVE_SOCKET
+// Wait for the next request line from any socket client.  New clients are
+// greeted with an empty reply, and finished worker processes are reaped.
+static vstring serveSocketInput(void) {
+  vstring_def(line);
+  char buf[4097];
+  struct timeval timeout;
+  fd_set readFds;
+  ssize_t n;
+  pid_t pid;
+  long c, k, p;
+  int fd, maxFd, status;
+  flag busy;
+
+  serveClient = -1;
+  while (1) {
+    // Reap the workers that have answered their requests
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (c = 0; c < serveClientCount; c++) {
+        if (serveClients[c].pid != pid) continue;
+        serveClients[c].pid = 0;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          // The worker didn't reply, so reply for it
+          serveClient = c;
+          appendString(&serveOutputBuf, &serveOutput,
+              "?The request could not be completed.\n");
+          serveReply();
+          serveClient = -1;
+        }
+      }
+    }
+
+    // Take the next complete line from an idle client, round-robin
+    for (k = 0; k < serveClientCount; k++) {
+      c = (serveNextClient + k) % serveClientCount;
+      if (serveClients[c].fd < 0 || serveClients[c].pid) continue;
+      p = instr(1, serveClients[c].input, "\n");
+      if (!p) continue;
+      let(&line, left(serveClients[c].input, p - 1));
+      let(&serveClients[c].input, right(serveClients[c].input, p + 1));
+      // Tolerate CRs from clients on Windows-style line endings
+      let(&line, edit(line, 8192 /* remove CR */));
+      serveClient = c;
+      serveNextClient = c + 1;
+      return line;
+    }
+
+    // Wait for a connection, more input, or a worker to finish.  The input
+    // of a client is not read while its worker is busy, so its requests
+    // are answered in order.
+    FD_ZERO(&readFds);
+    FD_SET(serveListenFd, &readFds);
+    maxFd = serveListenFd;
+    busy = 0;
+    for (c = 0; c < serveClientCount; c++) {
+      if (serveClients[c].fd < 0) continue;
+      if (serveClients[c].pid) {
+        busy = 1;
+        continue;
+      }
+      FD_SET(serveClients[c].fd, &readFds);
+      if (serveClients[c].fd > maxFd) maxFd = serveClients[c].fd;
+    }
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 20000; // Poll for finished workers every 20 msec
+    if (select(maxFd + 1, &readFds, NULL, NULL, busy ? &timeout : NULL) < 0) {
+      if (errno == EINTR) continue;
+      return NULL; // Treated as end of input
+    }
+
+    if (FD_ISSET(serveListenFd, &readFds)) {
+      fd = accept(serveListenFd, NULL, NULL);
+      if (fd >= FD_SETSIZE) {
+        close(fd); // Too many clients for select()
+      } else if (fd >= 0) {
+        for (c = 0; c < serveClientCount; c++) {
+          if (serveClients[c].fd < 0) break;
+        }
+        if (c == serveClientCount) {
+          serveClients = realloc(serveClients,
+              (size_t)(serveClientCount + 1) * sizeof(*serveClients));
+          if (!serveClients) outOfMemory("#149 (serveClients)");
+          serveClients[c].input = "";
+          serveClientCount++;
+        }
+        serveClients[c].fd = fd;
+        serveClients[c].pid = 0;
+        serveClient = c;
+        serveReply(); // Greeting (an empty reply with the prompt)
+        serveClient = -1;
+      }
+    }
+
+    for (c = 0; c < serveClientCount; c++) {
+      if (serveClients[c].fd < 0 || serveClients[c].pid) continue;
+      if (!FD_ISSET(serveClients[c].fd, &readFds)) continue;
+      n = read(serveClients[c].fd, buf, sizeof(buf) - 1);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        // The client disconnected
+        close(serveClients[c].fd);
+        serveClients[c].fd = -1;
+        free_vstring(serveClients[c].input);
+        continue;
+      }
+      buf[n] = 0;
+      let(&serveClients[c].input, cat(serveClients[c].input, buf, NULL));
+    }
+  } // while 1
+} // serveSocketInput
+#endif
+
+flag serveStart(const char *socketPath) {
+  if (g_serveMode) bug(1529);
+  serveClient = -1;
+  serveEof = 0;
+  free_vstring(serveOutput);
+  if (socketPath[0] == 0) {
+    // Serve stdin and stdout
+#ifdef SERVE_SOCKET
+    // Send the replies to a copy of stdout, and send anything printed
+    // directly with printf() (not through print2()) to stderr instead, so
+    // that it can't corrupt the replies.
+    int fd;
+    fflush(stdout);
+    fd = dup(STDOUT_FILENO);
+    if (fd >= 0) {
+      serveFramePtr = fdopen(fd, "w");
+      if (serveFramePtr == NULL) close(fd);
+    }
+    if (serveFramePtr != NULL && dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+      fclose(serveFramePtr);
+      serveFramePtr = NULL;
+    }
+#endif
+    if (serveFramePtr == NULL) serveFramePtr = stdout;
+    g_serveMode = 1;
+    return 1;
+  }
+
+#ifdef SERVE_SOCKET
+  struct sockaddr_un addr;
+  struct stat st;
+  if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+    printLongLine(cat("?The socket name \"", socketPath, "\" is too long.",
+        NULL), "", " ");
+    return 0;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socketPath);
+  // Remove a socket left behind by an earlier SERVE, but no other file
+  if (!stat(socketPath, &st) && S_ISSOCK(st.st_mode)) unlink(socketPath);
+  serveListenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (serveListenFd < 0
+      || bind(serveListenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+      || listen(serveListenFd, 16) < 0) {
+    printLongLine(cat("?Could not listen on socket \"", socketPath, "\": ",
+        strerror(errno), NULL), "", " ");
+    if (serveListenFd >= 0) close(serveListenFd);
+    serveListenFd = -1;
+    return 0;
+  }
+  // A client that disconnects before reading its reply must not stop us
+  signal(SIGPIPE, SIG_IGN);
+  let(&serveSocketPath, socketPath);
+  printLongLine(cat("Serving requests on socket \"", socketPath, "\".",
+      NULL), "", " ");
+  g_serveMode = 1;
+  return 1;
+#else
+  print2("?SERVE / SOCKET is not supported on this computer.\n");
+  return 0;
+#endif
+} // serveStart
+
+vstring serveInput(const char *ask) {
+  vstring_def(line);
+  if (strcmp(ask, g_commandPrompt)) {
+    // A question asked during a request gets its default answer
+    if (serveEof) return NULL;
+    appendString(&serveOutputBuf, &serveOutput, ask);
+    appendString(&serveOutputBuf, &serveOutput, "\n");
+    return line;
+  }
+
+  serveReply(); // Reply to the previous request
+#ifdef SERVE_SOCKET
+  if (serveWorker) {
+    // The request was answered by a worker process, which is done now
+    _exit(0);
+  }
+  if (serveListenFd >= 0) return serveSocketInput();
+#endif
+  if (serveEof || !linput(stdin, NULL, &line)) {
+    serveEof = 1;
+    free_vstring(line);
+    return NULL;
+  }
+  let(&line, edit(line, 8192 /* remove CR */));
+  return line;
+} // serveInput
+
+flag serveFork(void) {
+#ifdef SERVE_SOCKET
+  pid_t pid;
+  if (serveListenFd < 0 || serveClient < 0) return 0;
+  // Only a command line from the client itself:  a command file being read
+  // by SUBMIT would be read on by both processes
+  if (g_commandFileNestingLevel > 0) return 0;
+  // Output to an open LOG file must stay in the order of the requests, so
+  // it is written by this process
+  if (g_logFileOpenFlag) return 0;
+  fflush(NULL); // So that buffered output isn't duplicated by the worker
+  pid = fork();
+  if (pid < 0) return 0; // Answer the request in this process instead
+  if (pid == 0) {
+    // This is the worker process.  It has its own copy of the database,
+    // and it exits after replying at the next command prompt.
+    serveWorker = 1;
+    return 0;
+  }
+  serveClients[serveClient].pid = pid;
+  serveClient = -1;
+  free_vstring(serveOutput);
+  return 1;
+#else
+  return 0;
+#endif
+} // serveFork
+
+void serveStop(void) {
+  if (!g_serveMode) return;
+  serveReply(); // Reply to the request that stopped the server
+#ifdef SERVE_SOCKET
+  long c;
+  int status;
+  for (c = 0; c < serveClientCount; c++) {
+    // Let the busy workers finish their replies
+    if (serveClients[c].pid) waitpid(serveClients[c].pid, &status, 0);
+    if (serveClients[c].fd >= 0) close(serveClients[c].fd);
+    free_vstring(serveClients[c].input);
+  }
+  free(serveClients);
+  serveClients = NULL;
+  serveClientCount = 0;
+  serveNextClient = 0;
+  if (serveListenFd >= 0) {
+    close(serveListenFd);
+    unlink(serveSocketPath);
+    serveListenFd = -1;
+  }
+  free_vstring(serveSocketPath);
+  if (serveFramePtr != NULL && serveFramePtr != stdout) {
+    // Restore stdout
+    fflush(stdout);
+    dup2(fileno(serveFramePtr), STDOUT_FILENO);
+    fclose(serveFramePtr);
+  }
+#endif
+  serveFramePtr = NULL;
+  serveClient = -1;
+  g_serveMode = 0;
+} // serveStop
+
 void errorMessage(vstring line, long lineNum, long column, long tokenLength,
   vstring error, vstring fileName, long statementNum, flag severity)
 {
@@ -1325,7 +1776,7 @@ vstring readFileToString(const char *fileName, char verbose, long *charCount) {
   // Add a factor for unknown text formats (just a guess)
   fileBufSize = fileBufSize + 10;
 
-  fileBuf = malloc((size_t)fileBufSize);
+  fileBuf = allocVstring((size_t)fileBufSize - 1);
   if (!fileBuf) {
     if (verbose) print2(
         "?Sorry, there was not enough memory to read the file \"%s\".\n",
@@ -1356,7 +1807,7 @@ vstring readFileToString(const char *fileName, char verbose, long *charCount) {
         if (verbose) print2(
 "?Sorry, there are an odd number of characters (%ld) %s \"%s\".\n",
             (*charCount), "in Unicode file", fileName);
-        free(fileBuf);
+        deallocVstring(fileBuf);
         return NULL;
       }
       i = 0; // ASCII character position
@@ -1367,14 +1818,14 @@ vstring readFileToString(const char *fileName, char verbose, long *charCount) {
               "?Sorry, the Unicode file \"%s\" %s %ld at byte %ld.\n",
               fileName, "has a non-ASCII \ncharacter code",
               (long)(fileBuf[j]) + ((long)(fileBuf[j + 1]) * 256), j);
-          free(fileBuf);
+          deallocVstring(fileBuf);
           return NULL;
         }
         if (fileBuf[j] == 0) {
           if (verbose) print2(
               "?Sorry, the Unicode file \"%s\" %s at byte %ld.\n",
               fileName, "has a null character", j);
-          free(fileBuf);
+          deallocVstring(fileBuf);
           return NULL;
         }
         fileBuf[i] = fileBuf[j];
@@ -1442,7 +1893,9 @@ vstring readFileToString(const char *fileName, char verbose, long *charCount) {
           (*charCount), strlen(fileBuf));
     }
   }
+#ifndef VSTRING_HEADER // Else allocVstring() counted the room
 /*E*/db = db + i; // For memory usage tracking (ignore stuff after null)
+#endif
 
   //******* For debugging
   // print2("In binary mode the file has %ld bytes.\n", fileBufSize - 10);
@@ -1473,9 +1926,169 @@ double getRunTime(double *timeSinceLastCall) {
 #endif
 }
 
+double getWallTime(void) {
+#ifdef PROFILE_RUSAGE
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (double)now.tv_sec + (double)now.tv_usec / 1e6;
+#else
+  return (double)time(NULL);
+#endif
+}
+
+// Peak resident memory of the process so far in kB, or -1 if unknown
+static long profilePeakMemory(void) {
+#ifdef PROFILE_RUSAGE
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) return -1;
+#ifdef __APPLE__
+  return (long)(usage.ru_maxrss / 1024); // Bytes on macOS
+#else
+  return (long)usage.ru_maxrss;
+#endif
+#else
+  return -1;
+#endif
+}
+
+void profileMark(struct profileMark_struct *mark) {
+  mark->wallTime = getWallTime();
+  mark->cpuTime = (double)clock() / CLOCKS_PER_SEC;
+  mark->poolMallocs = g_poolMallocCount;
+  mark->tempAllocs = g_tempAllocCount;
+  mark->lets = g_letCount;
+}
+
+void profileRecord(char kind, const char *name,
+    const struct profileMark_struct *start) {
+  struct profileMark_struct end;
+  struct profileRecord_struct *record;
+  profileMark(&end);
+  if (profileRecordCount == profileRecordRoom) {
+    profileRecordRoom = profileRecordRoom ? 2 * profileRecordRoom : 64;
+    record = realloc(profileRecords,
+        (size_t)profileRecordRoom * sizeof(struct profileRecord_struct));
+    if (!record) outOfMemory("#151 (profileRecords)");
+    profileRecords = record;
+  }
+  record = &profileRecords[profileRecordCount++];
+  record->kind = kind;
+  record->name = "";
+  let(&record->name, name);
+  record->wallTime = end.wallTime - start->wallTime;
+  record->cpuTime = end.cpuTime - start->cpuTime;
+  record->poolMallocs = end.poolMallocs - start->poolMallocs;
+  record->tempAllocs = end.tempAllocs - start->tempAllocs;
+  record->lets = end.lets - start->lets;
+  record->peakMemory = profilePeakMemory();
+} // profileRecord
+
+void profileClear(void) {
+  long i;
+  for (i = 0; i < profileRecordCount; i++) {
+    free_vstring(profileRecords[i].name);
+  }
+  free(profileRecords);
+  profileRecords = NULL;
+  profileRecordCount = 0;
+  profileRecordRoom = 0;
+}
+
+// Name of the kind of a profile record
+static const char *profileKind(char kind) {
+  switch (kind) {
+    case 'p': return "phase";
+    case 'c': return "command";
+    case 's': return "statement";
+    default: bug(1530);
+  }
+  return "";
+}
+
+// Returns s as a JSON string literal
+static temp_vstring jsonString(const char *s) {
+  temp_vstring result;
+  long i, j;
+  // Find the length first, so that the result is built in one string
+  j = 2;
+  for (i = 0; s[i]; i++) {
+    if (s[i] == '"' || s[i] == '\\') {
+      j += 2;
+    } else if ((unsigned char)s[i] < 32) {
+      j += 6;
+    } else {
+      j++;
+    }
+  }
+  result = space(j);
+  j = 0;
+  result[j++] = '"';
+  for (i = 0; s[i]; i++) {
+    if (s[i] == '"' || s[i] == '\\') {
+      result[j++] = '\\';
+      result[j++] = s[i];
+    } else if ((unsigned char)s[i] < 32) {
+      result[j++] = '\\';
+      result[j++] = 'u';
+      result[j++] = '0';
+      result[j++] = '0';
+      result[j++] = (s[i] < 16) ? '0' : '1';
+      result[j++] = "0123456789abcdef"[s[i] % 16];
+    } else {
+      result[j++] = s[i];
+    }
+  }
+  result[j] = '"';
+  return result;
+} // jsonString
+
+void showProfile(flag jsonFlag) {
+  long i;
+  long saveScreenWidth = g_screenWidth;
+  vstring_def(name);
+  struct profileRecord_struct *record;
+  if (!jsonFlag && !profileRecordCount) {
+    print2("Nothing has been profiled.  Use SET PROFILE ON first.\n");
+    return;
+  }
+  // Don't let print2() wrap the lines with long names, which would also break
+  // the JSON syntax
+  g_screenWidth = LONG_MAX - 1;
+  if (!jsonFlag) {
+    print2(
+"Kind         Wall s     CPU s     Pool     Temps      Lets  Peak kB  Name\n");
+    for (i = 0; i < profileRecordCount; i++) {
+      record = &profileRecords[i];
+      print2("%-9s %9.3f %9.3f %8ld %9ld %9ld %8ld  %s\n",
+          profileKind(record->kind), record->wallTime, record->cpuTime,
+          record->poolMallocs, record->tempAllocs, record->lets,
+          record->peakMemory, record->name);
+    }
+  } else {
+    print2("{\"profile\": [\n");
+    for (i = 0; i < profileRecordCount; i++) {
+      record = &profileRecords[i];
+      // (Assigned with let() so that the temporaries of each line are freed)
+      let(&name, jsonString(record->name));
+      print2("{\"kind\": \"%s\", \"name\": %s, \"wall_s\": %.6f, "
+          "\"cpu_s\": %.6f, \"pool_mallocs\": %ld, \"temp_allocs\": %ld, "
+          "\"lets\": %ld, \"peak_rss_kb\": %s}%s\n",
+          profileKind(record->kind), name,
+          record->wallTime, record->cpuTime, record->poolMallocs,
+          record->tempAllocs, record->lets,
+          record->peakMemory < 0 ? "null" : str((double)record->peakMemory),
+          i < profileRecordCount - 1 ? "," : "");
+    }
+    free_vstring(name);
+    print2("]}\n");
+  }
+  g_screenWidth = saveScreenWidth;
+} // showProfile
+
 void freeInOu(void) {
   long i, j;
   j = pntrLen(backBuffer);
   for (i = 0; i < j; i++) free_vstring(*(vstring *)(&backBuffer[i]));
   free_pntrString(backBuffer);
+  profileClear();
 }
@@ -49,9 +49,21 @@ extern flag g_outputToString;
  * \var vstring g_printString
  * If output is redirected to a string by \ref g_outputToString, this variable
  * receives the contents.
+ *
+ * \ref print2 appends to it in place, keeping spare room at its end.  It may
+ * be emptied with let(&g_printString, "") or free_vstring, or taken over by
+ * assigning it elsewhere and setting it to "", but any other new contents
+ * must be assigned with \ref setPrintString.
  */
 extern vstring g_printString;
 
+/*!
+ * \brief assign \ref g_printString.
+ * \param[in] source the new contents.  It may be a temporary string computed
+ *   from g_printString itself.
+ */
+void setPrintString(const char *source);
+
 // Global variables used by cmdInput()
 
 /*!
@@ -717,6 +729,56 @@ vstring cmdInput1(const char *ask);
 
 flag cmdInputIsY(const char *ask);
 
+/*!
+ * \var flag g_serveMode
+ * 1 while the SERVE command is in effect.  Command lines are then read by
+ * \ref serveInput instead of from the terminal, and the screen output of
+ * \ref print2 is captured as the reply to the current request.
+ */
+extern flag g_serveMode;
+
+/*!
+ * \brief start serving requests.
+ *
+ * Requests are command lines read from stdin, or from the clients connected
+ * to the Unix domain socket \p socketPath if it is not empty.  Every request
+ * gets exactly one reply, which is a header line "<bytes> <prompt>" followed
+ * by <bytes> bytes of the screen output of the command.  A socket client is
+ * also sent an empty reply when it connects.
+ * \param[in] socketPath name of the socket, or "" to serve stdin and stdout.
+ * \return 1 if \ref g_serveMode was set, 0 on error (with a message).
+ */
+flag serveStart(const char *socketPath);
+
+/*!
+ * \brief get the next request (called by \ref cmdInput1).
+ *
+ * At the command prompt, the reply to the previous request is sent first.
+ * Any other question is answered with its default (an empty line), and is
+ * added to the reply.
+ * \param[in] ask the prompt.
+ * \return the request line, or NULL at end of input.
+ */
+vstring serveInput(const char *ask);
+
+/*!
+ * \brief answer the current request in a worker process.
+ *
+ * Used for commands that do not change the database, so that the requests
+ * of other socket clients can be answered while it runs.  The worker is a
+ * forked copy of this process; it replies and exits at the next command
+ * prompt.  Only a command line from a socket client is answered this way,
+ * not one read from a SUBMIT command file, and not while a LOG file is open.
+ * \return 1 in the server process, which must skip the command; 0 in the
+ *   worker, or if no worker could be started, which must execute it.
+ */
+flag serveFork(void);
+
+/*!
+ * \brief reply to the current request and stop serving.
+ */
+void serveStop(void);
+
 enum severity {notice_,warning_,error_,fatal_};
 void errorMessage(vstring line, long lineNum, long column, long tokenLength,
   vstring error, vstring fileName, long statementNum, flag warnFlag);
@@ -747,6 +809,54 @@ vstring readFileToString(const char *fileName, char verbose, long *charCount);
    argument is assigned the time since the last call to this function. */
 double getRunTime(double *timeSinceLastCall);
 
+/*! Returns the wall clock time in seconds since an arbitrary origin, to
+   microseconds where the system has gettimeofday(), otherwise to seconds. */
+double getWallTime(void);
+
+/*!
+ * \var flag g_profileFlag
+ * Set by SET PROFILE:  0 = OFF, 1 = ON (the phases of READ and each command
+ * are recorded), 2 = STATEMENTS (also each statement of VERIFY PROOF).
+ */
+extern flag g_profileFlag;
+
+/*!
+ * \brief the state of the clocks and allocation counters at the start of a
+ * profiled interval.
+ */
+struct profileMark_struct {
+  double wallTime; //!< seconds since an arbitrary origin
+  double cpuTime; //!< CPU seconds used by the process
+  long poolMallocs; //!< \ref g_poolMallocCount
+  long tempAllocs; //!< \ref g_tempAllocCount
+  long lets; //!< \ref g_letCount
+};
+
+/*!
+ * \brief start a profiled interval.
+ * \param[out] mark receives the current clocks and counters.
+ */
+void profileMark(struct profileMark_struct *mark);
+
+/*!
+ * \brief record the profiled interval from \p start until now for SHOW
+ * PROFILE, with the peak memory of the process so far.
+ * \param[in] kind 'p' (parser phase), 'c' (command) or 's' (statement).
+ * \param[in] name of the phase or statement, or the command line.
+ * \param[in] start the mark set by \ref profileMark at the start.
+ */
+void profileRecord(char kind, const char *name,
+    const struct profileMark_struct *start);
+
+/*! Discard all recorded intervals */
+void profileClear(void);
+
+/*!
+ * \brief implement SHOW PROFILE:  print the recorded intervals.
+ * \param[in] jsonFlag 1 for JSON output (/ JSON), 0 for a table.
+ */
+void showProfile(flag jsonFlag);
+
 /*! Call before exiting to free memory allocated by this module */
 void freeInOu(void);
 
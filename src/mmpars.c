@@ -8,6 +8,20 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <limits.h>
+#include <time.h>
+#if defined(__unix__) || defined(__APPLE__) || defined(_WIN32)
+// File modification times for READ / INCREMENTAL
+#define SOURCE_FILE_STAT
+#include <sys/stat.h>
+#endif
+// SSE2 is part of the x86-64 baseline.  The block scanners below read whole
+// aligned 16-byte blocks, which may extend past the terminating null (but
+// never past its page); that is harmless but would be reported by the address
+// sanitizer, so it gets the scalar code.
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(__SANITIZE_ADDRESS__)
+#define SCAN_SSE2
+#include <emmintrin.h>
+#endif
 #include "mmvstr.h"
 #include "mmdata.h"
 #include "mminou.h"
@@ -16,6 +30,7 @@
 #include "mmpfas.h" // Needed for g_pipDummyVars, subproofLen()
 #include "mmunif.h" // Needed for g_minSubstLen
 #include "mmcmdl.h" // Needed for g_rootDirectory
+#include "mmwtex.h" // Needed for eraseSectionOutline()
 // Potential statements in source file (upper limit) for
 // memory allocation purposes.
 long potentialStatements;
@@ -29,12 +44,77 @@ long g_numLabelKeys; // Number of assertion labels
 long *g_allLabelKeyBase; // Start of all labels
 long g_numAllLabelKeys; // Number of all labels
 
+// Hash table of all labels, built by parseLabels().  An entry is 0 for an
+// empty slot, the statement number of the label, or minus the statement
+// number if the label is declared more than once.
+long *g_labelHash = NULL;
+long g_labelHashMask = 0; // Table size - 1 (the size is a power of 2)
+
+// Set by benchCompressedProofs() to time the sorted label key lookups
+static flag noLabelHash = 0;
+
 // Working structure for parsing proofs.
 // This structure should be deallocated by the ERASE command.
 long g_wrkProofMaxSize = 0; // Maximum size so far - it may grow
 long wrkMathPoolMaxSize = 0; // Max mathStringPool size so far - it may grow
 struct wrkProof_struct g_WrkProof;
 
+// Return a pointer to the first '$' or null character at or after ptr.
+static char *scanToDollar(char *ptr) {
+#ifdef SCAN_SSE2
+  __m128i block, dollar, zero;
+  int mask;
+  while ((size_t)ptr & 15) { // Scalar until aligned
+    if (ptr[0] == '$' || ptr[0] == 0) return ptr;
+    ptr++;
+  }
+  dollar = _mm_set1_epi8('$');
+  zero = _mm_setzero_si128();
+  while (1) {
+    block = _mm_load_si128((const __m128i *)ptr);
+    mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, dollar),
+        _mm_cmpeq_epi8(block, zero)));
+    if (mask) return ptr + __builtin_ctz((unsigned)mask);
+    ptr += 16;
+  }
+#else
+  while (ptr[0] != '$' && ptr[0] != 0) ptr++;
+  return ptr;
+#endif
+} // scanToDollar
+
+// Return a pointer to the first character at or after ptr that is '$',
+// null, or neither printable nor white space (i.e. illegal in a source file).
+static char *scanSourceText(char *ptr) {
+#ifdef SCAN_SSE2
+  __m128i block, legal;
+  int mask;
+  while ((size_t)ptr & 15) { // Scalar until aligned
+    if (ptr[0] == '$' || (!isgraph((unsigned char)ptr[0])
+        && !isspace((unsigned char)ptr[0]))) return ptr;
+    ptr++;
+  }
+  while (1) {
+    block = _mm_load_si128((const __m128i *)ptr);
+    // Legal: ' ' through '~' except '$', or '\t' through '\r' (the comparisons
+    // are signed, so bytes 128 and up are never legal, as in the C locale)
+    legal = _mm_andnot_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('$')),
+        _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(' ' - 1)),
+        _mm_cmplt_epi8(block, _mm_set1_epi8(127))));
+    legal = _mm_or_si128(legal,
+        _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8('\t' - 1)),
+        _mm_cmplt_epi8(block, _mm_set1_epi8('\r' + 1))));
+    mask = _mm_movemask_epi8(legal) ^ 0xFFFF;
+    if (mask) return ptr + __builtin_ctz((unsigned)mask);
+    ptr += 16;
+  }
+#else
+  while (ptr[0] != '$' && (isgraph((unsigned char)ptr[0])
+      || isspace((unsigned char)ptr[0]))) ptr++;
+  return ptr;
+#endif
+} // scanSourceText
+
 // This function returns a pointer to a buffer containing the contents of an
 // input file and its 'include' calls. 'Size' returns the buffer's size.
 // Partial parsing is done; when 'include' statements are found, this function
@@ -57,7 +137,8 @@ char *readRawSource(vstring fileBuf, long *size) {
   mode = 0; // 0 = outside of 'include', 1 = inside of 'include'
   insideComment = 0; // 1 = inside $( $) comment
   while (1) {
-    // Find a keyword or newline
+    // Find a keyword, an illegal character or the end of file
+    fbPtr = scanSourceText(fbPtr);
     tmpch = fbPtr[0];
     if (!tmpch) { // End of file
       if (insideComment) {
@@ -72,13 +153,11 @@ char *readRawSource(vstring fileBuf, long *size) {
       }
       break;
     }
-    if (tmpch != '$') {
-      if (!isgraph((unsigned char)tmpch) && !isspace((unsigned char)tmpch)) {
-        rawSourceError(fileBuf, fbPtr, 1,
-            cat("Illegal character (ASCII code ",
-            str((double)((unsigned char)tmpch)),
-            " decimal).",NULL));
-      }
+    if (tmpch != '$') { // Illegal character
+      rawSourceError(fileBuf, fbPtr, 1,
+          cat("Illegal character (ASCII code ",
+          str((double)((unsigned char)tmpch)),
+          " decimal).",NULL));
       fbPtr++;
       continue;
     }
@@ -171,6 +250,70 @@ char *readRawSource(vstring fileBuf, long *size) {
   return fileBuf;
 } // readRawSource
 
+// Hash function (FNV-1a) for g_labelHash[]
+static unsigned long labelHashValue(const char *label, long len)
+{
+  return textHash(TEXT_HASH_INIT, label, len);
+} // labelHashValue
+
+// Continue the FNV-1a hash value hash with len characters of text
+unsigned long textHash(unsigned long hash, const char *text, long len)
+{
+  long i;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned char)(text[i])) * 16777619UL;
+  }
+  return hash;
+} // textHash
+
+// Return the g_labelHash[] slot for the len-character label at ptr (which
+// need not be null-terminated); the slot is empty if there is no such label.
+static long labelHashSlot(const char *ptr, long len)
+{
+  long slot, stmt;
+  const char *name;
+  slot = (long)(labelHashValue(ptr, len) & (unsigned long)g_labelHashMask);
+  while (g_labelHash[slot]) {
+    stmt = g_labelHash[slot] > 0 ? g_labelHash[slot] : -g_labelHash[slot];
+    name = g_Statement[stmt].labelName;
+    if (!strncmp(name, ptr, (size_t)len) && !name[len]) break;
+    slot = (slot + 1) & g_labelHashMask;
+  }
+  return slot;
+} // labelHashSlot
+
+// Look up the len-character label at ptr.  Returns its statement number,
+// 0 if there is no such label, or minus the statement number of one of its
+// declarations if it is declared more than once.
+long lookupLabelHash(const char *ptr, long len)
+{
+  if (!g_labelHash) return 0;
+  return g_labelHash[labelHashSlot(ptr, len)];
+} // lookupLabelHash
+
+// Build g_labelHash[] from g_allLabelKeyBase[]
+static void buildLabelHash(void)
+{
+  long i, size, slot, stmt;
+  free(g_labelHash);
+  size = 16;
+  while (size < 2 * g_numAllLabelKeys) size = size * 2;
+  g_labelHash = calloc((size_t)size, sizeof(long));
+  if (!g_labelHash) outOfMemory("#139 (g_labelHash)");
+  g_labelHashMask = size - 1;
+  for (i = 0; i < g_numAllLabelKeys; i++) {
+    stmt = g_allLabelKeyBase[i];
+    slot = labelHashSlot(g_Statement[stmt].labelName,
+        (long)strlen(g_Statement[stmt].labelName));
+    if (g_labelHash[slot]) {
+      // Duplicate label; make all lookups of it use the sorted keys
+      if (g_labelHash[slot] > 0) g_labelHash[slot] = -g_labelHash[slot];
+    } else {
+      g_labelHash[slot] = stmt;
+    }
+  }
+} // buildLabelHash
+
 // This function initializes the g_Statement[] structure array and assigns
 // sections of the raw input text.  statements is updated.
 // g_sourcePtr is assumed to point to the raw input buffer.
@@ -254,7 +397,8 @@ void parseKeywords(void)
   startSection = fbPtr;
 
   while (1) {
-    // Find a keyword or newline
+    // Find a keyword or the end of file
+    fbPtr = scanToDollar(fbPtr);
     tmpch = fbPtr[0];
     if (!tmpch) { // End of file
       if (mode != 0) {
@@ -268,10 +412,6 @@ void parseKeywords(void)
       break;
     }
 
-    if (tmpch != '$') {
-      fbPtr++;
-      continue;
-    }
     fbPtr++;
     switch (fbPtr[0]) {
       case '$': // "$$" means literal "$"
@@ -524,6 +664,7 @@ void parseLabels(void) {
   if (!g_allLabelKeyBase) outOfMemory("#60 (g_allLabelKeyBase)");
   memcpy(g_allLabelKeyBase, g_labelKeyBase, (size_t)g_numLabelKeys * sizeof(long));
   g_numAllLabelKeys = g_numLabelKeys;
+  buildLabelHash();
 
   // Now back to the regular label stuff.
   // Check for duplicate labels.
@@ -592,7 +733,7 @@ void parseMathDecl(void) {
           i = whiteSpaceLen(fbPtr);
           j = tokenLen(fbPtr + i);
           if (!j) break;
-          tmpPtr = malloc((size_t)j + 1); // Math symbol name
+          tmpPtr = allocVstring((size_t)j); // Math symbol name
           if (!tmpPtr) outOfMemory("#8 (symbol name)");
           tmpPtr[j] = 0; // End of string
           memcpy(tmpPtr, fbPtr + i, (size_t)j);
@@ -693,6 +834,305 @@ void parseMathDecl(void) {
   }
 }
 
+// Scope frames.  Each variable, $f hypothesis, and $d pair that
+// parseStatements() puts on its active stacks is also recorded as a frame
+// node whose parent is the node below it on the same stack.  Nodes are never
+// removed, so the chain from a node back to the root is the stack as it was
+// when that node was on top, and nested scopes share the nodes of their
+// enclosing scopes.  For each $a and $p statement the three top nodes are
+// recorded, and (when the database has no errors) the optional hypothesis,
+// variable, and $d lists of a $p statement are built from them on first use
+// by buildOptHypList() and buildOptVarLists().
+struct frameNode_struct {
+  long item; // Variable token, $f statement, or 1st variable of a $d pair
+  long item2; // 2nd variable of a $d pair
+  long stmt; // Statement of a $d pair
+  long parent; // Node below this one on its stack, or -1
+};
+static struct frameNode_struct *frameNode = NULL;
+static long frameNodes = 0;
+static long frameNodeAlloc = 0;
+struct stmtFrame_struct {
+  long varTop; // Top node of the active variables
+  long fHypTop; // Top node of the active $f hypotheses
+  long disjTop; // Top node of the active $d pairs
+  flag deferred; // The optional lists are built on first use
+};
+static struct stmtFrame_struct *stmtFrame = NULL; // Indexed by statement
+static flag *frameVarFlag = NULL; // Required variable flags, by math token
+static long *frameScratch = NULL; // Nodes of one chain, in stack order
+static long frameScratchAlloc = 0;
+
+// Add a frame node and return its index
+static long pushFrameNode(long item, long item2, long stmt, long parent)
+{
+  if (frameNodes >= frameNodeAlloc) {
+    frameNodeAlloc = frameNodeAlloc ? 2 * frameNodeAlloc : 1024;
+    frameNode = realloc(frameNode, (size_t)frameNodeAlloc
+        * sizeof(struct frameNode_struct));
+    if (!frameNode) outOfMemory("#141 (frameNode)");
+  }
+  frameNode[frameNodes].item = item;
+  frameNode[frameNodes].item2 = item2;
+  frameNode[frameNodes].stmt = stmt;
+  frameNode[frameNodes].parent = parent;
+  frameNodes++;
+  return frameNodes - 1;
+} // pushFrameNode
+
+// Put the chain ending at node top into frameScratch[] in stack order and
+// return its length
+static long getFrameChain(long top)
+{
+  long n = 0, node;
+  for (node = top; node != -1; node = frameNode[node].parent) n++;
+  if (n > frameScratchAlloc) {
+    frameScratchAlloc = 2 * n;
+    free(frameScratch);
+    frameScratch = malloc((size_t)frameScratchAlloc * sizeof(long));
+    if (!frameScratch) outOfMemory("#142 (frameScratch)");
+  }
+  node = top;
+  for (long i = n - 1; i >= 0; i--) {
+    frameScratch[i] = node;
+    node = frameNode[node].parent;
+  }
+  return n;
+} // getFrameChain
+
+// Set (flagValue = 1) or clear (flagValue = 0) the frameVarFlag[] entries of
+// the required variables of stmt
+static void flagReqVars(long stmt, flag flagValue)
+{
+  nmbrString *reqVars = g_Statement[stmt].reqVarList;
+  for (long i = 0; reqVars[i] != -1; i++) frameVarFlag[reqVars[i]] = flagValue;
+} // flagReqVars
+
+// Frame nodes of the $d pairs on parseStatements()' active $d stack, by
+// stack position, and a hash table that maps a pair to its stack position
+// (or -1 for an empty slot).  Hash entries are not removed when the stack
+// shrinks; an entry is only valid if the stack still holds its pair at that
+// position, and the table is rebuilt when stale entries accumulate.
+static long *disjNode = NULL;
+static long disjNodeAlloc = 0;
+static long *disjHash = NULL;
+static long disjHashMask = 0;
+static long disjHashUsed = 0; // Slots used since the last rebuild
+
+static long disjHashSlot(long tokenA, long tokenB)
+{
+  return (long)((((unsigned long)tokenA * 2654435761UL)
+      ^ (unsigned long)tokenB) & (unsigned long)disjHashMask);
+} // disjHashSlot
+
+// Return the stack position of the active $d pair tokenA, tokenB, or -1
+static long findDisjPair(long tokenA, long tokenB, long stackPtr)
+{
+  long slot, pos;
+  if (!disjHash) return -1;
+  for (slot = disjHashSlot(tokenA, tokenB); disjHash[slot] != -1;
+      slot = (slot + 1) & disjHashMask) {
+    pos = disjHash[slot];
+    if (pos < stackPtr && frameNode[disjNode[pos]].item == tokenA
+        && frameNode[disjNode[pos]].item2 == tokenB) return pos;
+  }
+  return -1;
+} // findDisjPair
+
+// Record the frame node of the $d pair pushed at stack position stackPtr
+static void addDisjPair(long tokenA, long tokenB, long stmt, long stackPtr)
+{
+  long slot, size, pos;
+  if (stackPtr >= disjNodeAlloc) {
+    disjNodeAlloc = disjNodeAlloc ? 2 * disjNodeAlloc : 1024;
+    disjNode = realloc(disjNode, (size_t)disjNodeAlloc * sizeof(long));
+    if (!disjNode) outOfMemory("#143 (disjNode)");
+  }
+  disjNode[stackPtr] = pushFrameNode(tokenA, tokenB, stmt,
+      stackPtr ? disjNode[stackPtr - 1] : -1);
+  if (2 * (disjHashUsed + 1) > disjHashMask + 1) {
+    // Rebuild the table without its stale entries
+    size = 1024;
+    while (size < 4 * (stackPtr + 1)) size = 2 * size;
+    free(disjHash);
+    disjHash = malloc((size_t)size * sizeof(long));
+    if (!disjHash) outOfMemory("#144 (disjHash)");
+    disjHashMask = size - 1;
+    for (slot = 0; slot < size; slot++) disjHash[slot] = -1;
+    disjHashUsed = 0;
+    for (pos = 0; pos <= stackPtr; pos++) {
+      slot = disjHashSlot(frameNode[disjNode[pos]].item,
+          frameNode[disjNode[pos]].item2);
+      while (disjHash[slot] != -1) slot = (slot + 1) & disjHashMask;
+      disjHash[slot] = pos;
+      disjHashUsed++;
+    }
+    return;
+  }
+  // Use an empty slot, or one whose stack position has been popped
+  for (slot = disjHashSlot(tokenA, tokenB);
+      disjHash[slot] != -1 && disjHash[slot] < stackPtr;
+      slot = (slot + 1) & disjHashMask);
+  if (disjHash[slot] == -1) disjHashUsed++;
+  disjHash[slot] = stackPtr;
+} // addDisjPair
+
+static void freeDisjPairs(void)
+{
+  free(disjNode);
+  disjNode = NULL;
+  disjNodeAlloc = 0;
+  free(disjHash);
+  disjHash = NULL;
+  disjHashMask = 0;
+  disjHashUsed = 0;
+} // freeDisjPairs
+
+// Comparison of nmbrString elements for qsort
+static int nmbrElementCmp(const void *key1, const void *key2)
+{
+  nmbrString n1 = *(const nmbrString *)key1;
+  nmbrString n2 = *(const nmbrString *)key2;
+  return (n1 > n2) - (n1 < n2);
+} // nmbrElementCmp
+
+// Return a permanent copy of the first len elements of list, with a -1
+// terminator.  (The lists in g_Statement[] must be allocated with their exact
+// lengths, which nmbrLen() relies on.)
+static nmbrString *poolNmbrCopy(const nmbrString *list, long len)
+{
+  nmbrString *copy = poolFixedMalloc((len + 1) * (long)(sizeof(nmbrString)));
+  memcpy(copy, list, (size_t)len * sizeof(nmbrString));
+  copy[len] = -1;
+  return copy;
+} // poolNmbrCopy
+
+void buildOptHypList(long stmt)
+{
+  long i, n, numOpt, fHyp, tokenNum;
+  nmbrString *mathString;
+  nmbrString *optHyps;
+  if (g_Statement[stmt].type != p_
+      || g_Statement[stmt].optHypList != NULL_NMBRSTRING) return;
+  if (!stmtFrame || !stmtFrame[stmt].deferred) bug(1774);
+  n = getFrameChain(stmtFrame[stmt].fHypTop);
+  optHyps = malloc(((size_t)n + 1) * sizeof(nmbrString));
+  if (!optHyps) outOfMemory("#146 (optHyps)");
+  flagReqVars(stmt, 1);
+  numOpt = 0;
+  for (i = 0; i < n; i++) {
+    // A $f hypothesis is required if its variable is required
+    fHyp = frameNode[frameScratch[i]].item;
+    mathString = g_Statement[fHyp].mathString;
+    for (tokenNum = mathString[0]; tokenNum != -1; tokenNum = *(++mathString)) {
+      if (g_MathToken[tokenNum].tokenType == (char)var_) break;
+    }
+    if (tokenNum != -1 && !frameVarFlag[tokenNum]) {
+      optHyps[numOpt] = fHyp;
+      numOpt++;
+    }
+  }
+  flagReqVars(stmt, 0);
+  g_Statement[stmt].optHypList = poolNmbrCopy(optHyps, numOpt);
+  free(optHyps);
+} // buildOptHypList
+
+void buildOptVarLists(long stmt)
+{
+  long i, n, numOpt;
+  struct frameNode_struct *node;
+  nmbrString *optA; // Optional variables, or 1st variables of $d pairs
+  nmbrString *optB;
+  nmbrString *optStmt;
+  if (g_Statement[stmt].type != p_
+      || g_Statement[stmt].optVarList != NULL_NMBRSTRING) return;
+  if (!stmtFrame || !stmtFrame[stmt].deferred) bug(1775);
+  flagReqVars(stmt, 1);
+
+  // Optional variables are the active ones that are not required
+  n = getFrameChain(stmtFrame[stmt].varTop);
+  optA = malloc(((size_t)n + 1) * sizeof(nmbrString));
+  if (!optA) outOfMemory("#147 (optVars)");
+  numOpt = 0;
+  for (i = 0; i < n; i++) {
+    if (!frameVarFlag[frameNode[frameScratch[i]].item]) {
+      optA[numOpt] = frameNode[frameScratch[i]].item;
+      numOpt++;
+    }
+  }
+  g_Statement[stmt].optVarList = poolNmbrCopy(optA, numOpt);
+  free(optA);
+
+  // Optional $d pairs are the active ones with a variable that is not
+  // required
+  n = getFrameChain(stmtFrame[stmt].disjTop);
+  optA = malloc(((size_t)n + 1) * sizeof(nmbrString));
+  optB = malloc(((size_t)n + 1) * sizeof(nmbrString));
+  optStmt = malloc(((size_t)n + 1) * sizeof(nmbrString));
+  if (!optA || !optB || !optStmt) outOfMemory("#148 (optDisjVars)");
+  numOpt = 0;
+  for (i = 0; i < n; i++) {
+    node = &frameNode[frameScratch[i]];
+    if (!frameVarFlag[node->item] || !frameVarFlag[node->item2]) {
+      optA[numOpt] = node->item;
+      optB[numOpt] = node->item2;
+      optStmt[numOpt] = node->stmt;
+      numOpt++;
+    }
+  }
+  g_Statement[stmt].optDisjVarsA = poolNmbrCopy(optA, numOpt);
+  g_Statement[stmt].optDisjVarsB = poolNmbrCopy(optB, numOpt);
+  g_Statement[stmt].optDisjVarsStmt = poolNmbrCopy(optStmt, numOpt);
+  free(optA);
+  free(optB);
+  free(optStmt);
+
+  flagReqVars(stmt, 0);
+} // buildOptVarLists
+
+flag activeDisjPair(long stmt, long tokenA, long tokenB)
+{
+  long i, node;
+  nmbrString *disjA;
+  nmbrString *disjB;
+  if (stmtFrame && stmtFrame[stmt].deferred) {
+    for (node = stmtFrame[stmt].disjTop; node != -1;
+        node = frameNode[node].parent) {
+      if (frameNode[node].item == tokenA && frameNode[node].item2 == tokenB) {
+        return 1;
+      }
+    }
+    return 0;
+  }
+  disjA = g_Statement[stmt].reqDisjVarsA;
+  disjB = g_Statement[stmt].reqDisjVarsB;
+  for (i = 0; disjA[i] != -1; i++) {
+    if (disjA[i] == tokenA && disjB[i] == tokenB) return 1;
+  }
+  disjA = g_Statement[stmt].optDisjVarsA;
+  disjB = g_Statement[stmt].optDisjVarsB;
+  for (i = 0; disjA[i] != -1; i++) {
+    if (disjA[i] == tokenA && disjB[i] == tokenB) return 1;
+  }
+  return 0;
+} // activeDisjPair
+
+void eraseScopeFrames(void)
+{
+  freeDisjPairs();
+  free(frameNode);
+  frameNode = NULL;
+  frameNodes = 0;
+  frameNodeAlloc = 0;
+  free(stmtFrame);
+  stmtFrame = NULL;
+  free(frameVarFlag);
+  frameVarFlag = NULL;
+  free(frameScratch);
+  frameScratch = NULL;
+  frameScratchAlloc = 0;
+} // eraseScopeFrames
+
 // This functions parses statement contents, except for proofs
 void parseStatements(void) {
   long stmt;
@@ -707,6 +1147,7 @@ void parseStatements(void) {
   int maxScope;
   long reqHyps, optHyps, reqVars, optVars;
   flag reqFlag;
+  flag deferOptLists;
   int undeclErrorCount = 0;
   vstring_def(tmpStr);
 
@@ -730,6 +1171,8 @@ void parseStatements(void) {
     long tokenNum;
     int scope;
     char tmpFlag; // Used by hypothesis variable scan; must be 0 otherwise
+    long fHypStmt; // The active $f hypothesis of the variable, or -1
+    long frameNode; // Scope frame node
   };
   struct activeVarStack_struct *activeVarStack; // Stack of active variables
   nmbrString *wrkVarPtr1;
@@ -747,9 +1190,15 @@ void parseStatements(void) {
     long statemNum;
     nmbrString *varList; // List of variables in the hypothesis
     int scope;
+    long frameNode; // Scope frame node
   };
   struct activeFHypStack_struct *activeFHypStack;
   long activeFHypStackPtr = 0;
+  // Active $f hypotheses that do not have exactly one variable, or whose
+  // variable is also in an earlier active $f hypothesis.  When there are
+  // none (and no errors), the required hypotheses of a $a or $p statement are
+  // found from its variables without scanning the $f stack.
+  long irregularFHyps = 0;
   nmbrString *wrkHypPtr1;
   nmbrString *wrkHypPtr2;
   nmbrString *wrkHypPtr3;
@@ -870,6 +1319,19 @@ void parseStatements(void) {
       || !wrkDisjHPtr2A || !wrkDisjHPtr2B || !wrkDisjHPtr2Stmt)
       outOfMemory("#27 (activeDisjHypStack)");
 
+  // Initialize the scope frames
+  eraseScopeFrames();
+  stmtFrame = malloc(((size_t)g_statements + 1)
+      * sizeof(struct stmtFrame_struct));
+  frameVarFlag = malloc((size_t)g_MAX_MATHTOKENS * sizeof(flag));
+  if (!stmtFrame || !frameVarFlag) outOfMemory("#145 (stmtFrame)");
+  for (i = 0; i <= g_statements; i++) {
+    stmtFrame[i].deferred = 0;
+  }
+  for (i = 0; i < g_MAX_MATHTOKENS; i++) {
+    frameVarFlag[i] = 0;
+  }
+
   // Initialize temporary working space for parsing tokens
   wrkLen = 1;
   wrkNmbrPtr = malloc((size_t)wrkLen * sizeof(nmbrString));
@@ -951,7 +1413,18 @@ void parseStatements(void) {
           activeFHypStackPtr--;
           // Make the label inactive
           labelActiveFlag[activeFHypStack[activeFHypStackPtr].statemNum] = 0;
-          free(activeFHypStack[activeFHypStackPtr].varList);
+          nmbrTmpPtr = activeFHypStack[activeFHypStackPtr].varList;
+          if (nmbrTmpPtr[0] == -1 || nmbrTmpPtr[1] != -1) {
+            irregularFHyps--;
+          } else if (activeVarStack[g_MathToken[nmbrTmpPtr[0]].tmp].fHypStmt
+              == activeFHypStack[activeFHypStackPtr].statemNum) {
+            // (The variable's stack entry may have just been popped, but it
+            // is still intact.)
+            activeVarStack[g_MathToken[nmbrTmpPtr[0]].tmp].fHypStmt = -1;
+          } else {
+            irregularFHyps--;
+          }
+          free(nmbrTmpPtr);
         }
         while (activeDisjHypStackPtr) {
           if (activeDisjHypStack[activeDisjHypStackPtr - 1].scope
@@ -1046,6 +1519,10 @@ void parseStatements(void) {
             activeVarStack[activeVarStackPtr].tokenNum = tokenNum;
             activeVarStack[activeVarStackPtr].scope = g_currentScope;
             activeVarStack[activeVarStackPtr].tmpFlag = 0;
+            activeVarStack[activeVarStackPtr].fHypStmt = -1;
+            activeVarStack[activeVarStackPtr].frameNode = pushFrameNode(
+                tokenNum, 0, 0, activeVarStackPtr
+                ? activeVarStack[activeVarStackPtr - 1].frameNode : -1);
             activeVarStackPtr++;
           } else {
 
@@ -1137,6 +1614,9 @@ void parseStatements(void) {
                   activeVarStack[activeVarStackPtr].tokenNum = tokenNum;
                   activeVarStack[activeVarStackPtr].scope = g_currentScope;
                   activeVarStack[activeVarStackPtr].tmpFlag = 0;
+                  activeVarStack[activeVarStackPtr].fHypStmt = -1;
+                  activeVarStack[activeVarStackPtr].frameNode
+                      = pushFrameNode(tokenNum, 0, 0, -1);
                   activeVarStackPtr++;
                 }
               }
@@ -1152,6 +1632,9 @@ void parseStatements(void) {
                   activeVarStack[activeVarStackPtr].tokenNum = tokenNum;
                   activeVarStack[activeVarStackPtr].scope = g_currentScope;
                   activeVarStack[activeVarStackPtr].tmpFlag = 0;
+                  activeVarStack[activeVarStackPtr].fHypStmt = -1;
+                  activeVarStack[activeVarStackPtr].frameNode
+                      = pushFrameNode(tokenNum, 0, 0, -1);
                   activeVarStackPtr++;
                 }
               }
@@ -1186,6 +1669,9 @@ void parseStatements(void) {
               activeVarStack[activeVarStackPtr].tokenNum = tokenNum;
               activeVarStack[activeVarStackPtr].scope = g_currentScope;
               activeVarStack[activeVarStackPtr].tmpFlag = 0;
+              activeVarStack[activeVarStackPtr].fHypStmt = -1;
+              activeVarStack[activeVarStackPtr].frameNode
+                  = pushFrameNode(tokenNum, 0, 0, -1);
               activeVarStackPtr++;
             }
           }
@@ -1308,12 +1794,7 @@ void parseStatements(void) {
             }
             // See if this pair of disjoint variables is already on the stack;
             // if so, don't add it again.
-            for (k = 0; k < activeDisjHypStackPtr; k++) {
-              if (m == activeDisjHypStack[k].tokenNumA)
-                if (n == activeDisjHypStack[k].tokenNumB)
-                  break; // It matches
-            }
-            if (k == activeDisjHypStackPtr) {
+            if (findDisjPair(m, n, activeDisjHypStackPtr) == -1) {
               // It wasn't already on the stack, so add it.
               // Increase stack size if necessary.
               if (activeDisjHypStackPtr >= activeDisjHypStackSize) {
@@ -1323,7 +1804,7 @@ void parseStatements(void) {
                 free(wrkDisjHPtr2A);
                 free(wrkDisjHPtr2B);
                 free(wrkDisjHPtr2Stmt);
-                activeDisjHypStackSize = activeDisjHypStackSize + 100;
+                activeDisjHypStackSize = 2 * activeDisjHypStackSize;
                 activeDisjHypStack = realloc(activeDisjHypStack,
                     (size_t)activeDisjHypStackSize
                     * sizeof(struct activeDisjHypStack_struct));
@@ -1348,6 +1829,7 @@ void parseStatements(void) {
               activeDisjHypStack[activeDisjHypStackPtr].tokenNumB = n;
               activeDisjHypStack[activeDisjHypStackPtr].scope = g_currentScope;
               activeDisjHypStack[activeDisjHypStackPtr].statemNum = stmt;
+              addDisjPair(m, n, stmt, activeDisjHypStackPtr);
 
               activeDisjHypStackPtr++;
             }
@@ -1368,7 +1850,7 @@ void parseStatements(void) {
           free(wrkHypPtr1);
           free(wrkHypPtr2);
           free(wrkHypPtr3);
-          activeHypStackSize = activeHypStackSize + 100;
+          activeHypStackSize = 2 * activeHypStackSize;
           activeEHypStack = realloc(activeEHypStack, (size_t)activeHypStackSize
               * sizeof(struct activeEHypStack_struct));
           activeFHypStack = realloc(activeFHypStack, (size_t)activeHypStackSize
@@ -1420,6 +1902,17 @@ void parseStatements(void) {
           activeEHypStackPtr++;
         } else {
           activeFHypStack[activeFHypStackPtr].varList = nmbrTmpPtr;
+          activeFHypStack[activeFHypStackPtr].frameNode = pushFrameNode(stmt,
+              0, 0, activeFHypStackPtr
+              ? activeFHypStack[activeFHypStackPtr - 1].frameNode : -1);
+          if (reqVars != 1) {
+            irregularFHyps++;
+          } else if (activeVarStack[g_MathToken[nmbrTmpPtr[0]].tmp].fHypStmt
+              == -1) {
+            activeVarStack[g_MathToken[nmbrTmpPtr[0]].tmp].fHypStmt = stmt;
+          } else {
+            irregularFHyps++;
+          }
           activeFHypStackPtr++;
         }
 
@@ -1482,70 +1975,95 @@ void parseStatements(void) {
         nmbrTmpPtr[reqVars] = -1;
         g_Statement[stmt].reqVarList = nmbrTmpPtr;
 
+        // If the database is free of errors and each active variable has at
+        // most one active $f hypothesis, the optional lists of a $p statement
+        // are left to buildOptHypList() and buildOptVarLists(), and only the
+        // required lists are built here.
+        deferOptLists = (flag)(!g_errorCount && !irregularFHyps);
+
         // Scan the list of $f hypotheses to find those that are required
         optHyps = 0;
-        for (i = 0; i < activeFHypStackPtr; i++) {
-          nmbrTmpPtr = activeFHypStack[i].varList; // Variable list
-          tokenNum = nmbrTmpPtr[0];
-          if (tokenNum == -1) {
-            // Default if no variables (an error in current version):
-            // Add it to list of required hypotheses.
-            wrkHypPtr1[reqHyps] = activeFHypStack[i].statemNum;
+        if (deferOptLists) {
+          // The required $f hypotheses are those of the required variables
+          for (i = 0; i < reqVars; i++) {
+            k = activeVarStack[g_MathToken[wrkVarPtr1[i]].tmp].fHypStmt;
+            if (k == -1) continue;
+            wrkHypPtr1[reqHyps] = k;
             reqHyps++;
-            continue;
-          } else {
-            reqFlag = activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag;
-          }
-          if (reqFlag) {
-            // Add it to list of required hypotheses
-            wrkHypPtr1[reqHyps] = activeFHypStack[i].statemNum;
-            reqHyps++;
-            reqFlag = 1;
             // Could have been 2; 1 = in some hypothesis
-            activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag = 1;
-          } else {
-            // Add it to list of optional hypotheses
-            wrkHypPtr2[optHyps] = activeFHypStack[i].statemNum;
-            optHyps++;
+            activeVarStack[g_MathToken[wrkVarPtr1[i]].tmp].tmpFlag = 1;
           }
-
-          // Scan the other variables in the $f hyp to check for conflicts.
-          j = 1;
-          tokenNum = nmbrTmpPtr[1];
-          while (tokenNum != -1) {
-            if (activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag == 2) {
-              // 2 = in $p; 1 = in some hypothesis
+          // Put them in stack (i.e. statement number) order
+          qsort(wrkHypPtr1 + activeEHypStackPtr,
+              (size_t)(reqHyps - activeEHypStackPtr), sizeof(nmbrString),
+              nmbrElementCmp);
+        } else {
+          for (i = 0; i < activeFHypStackPtr; i++) {
+            nmbrTmpPtr = activeFHypStack[i].varList; // Variable list
+            tokenNum = nmbrTmpPtr[0];
+            if (tokenNum == -1) {
+              // Default if no variables (an error in current version):
+              // Add it to list of required hypotheses.
+              wrkHypPtr1[reqHyps] = activeFHypStack[i].statemNum;
+              reqHyps++;
+              continue;
+            } else {
+              reqFlag = activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag;
+            }
+            if (reqFlag) {
+              // Add it to list of required hypotheses
+              wrkHypPtr1[reqHyps] = activeFHypStack[i].statemNum;
+              reqHyps++;
+              reqFlag = 1;
+              // Could have been 2; 1 = in some hypothesis
               activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag = 1;
+            } else {
+              // Add it to list of optional hypotheses
+              wrkHypPtr2[optHyps] = activeFHypStack[i].statemNum;
+              optHyps++;
             }
-            if (reqFlag != activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag) {
-              k = activeFHypStack[i].statemNum;
-              m = nmbrElementIn(1, g_Statement[k].mathString, tokenNum);
-              n = nmbrTmpPtr[0];
-              if (reqFlag) {
-                mathTokenError(m - 1, g_Statement[k].mathString, k,
-                    cat("This variable does not occur in statement ",
-                    str((double)stmt)," (label \"",g_Statement[stmt].labelName,
-                    "\") or statement ", str((double)stmt),
-                    "'s \"$e\" hypotheses, whereas variable \"",
-                    g_MathToken[n].tokenName,
-                   "\" DOES occur.  A \"$f\" hypothesis may not contain such a",
-                    " mixture of variables.",NULL));
-              } else {
-                mathTokenError(m - 1, g_Statement[k].mathString, k,
-                    cat("This variable occurs in statement ",
-                    str((double)stmt)," (label \"",g_Statement[stmt].labelName,
-                    "\") or statement ", str((double)stmt),
-                    "'s \"$e\" hypotheses, whereas variable \"",
-                    g_MathToken[n].tokenName,
-               "\" does NOT occur.  A \"$f\" hypothesis may not contain such a",
-                    " mixture of variables.",NULL));
+
+            // Scan the other variables in the $f hyp to check for conflicts.
+            j = 1;
+            tokenNum = nmbrTmpPtr[1];
+            while (tokenNum != -1) {
+              if (activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag == 2) {
+                // 2 = in $p; 1 = in some hypothesis
+                activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag = 1;
               }
-              break;
-            } // End if
-            j++;
-            tokenNum = nmbrTmpPtr[j];
-          } // End while
-        } // Next i
+              if (reqFlag
+                  != activeVarStack[g_MathToken[tokenNum].tmp].tmpFlag) {
+                k = activeFHypStack[i].statemNum;
+                m = nmbrElementIn(1, g_Statement[k].mathString, tokenNum);
+                n = nmbrTmpPtr[0];
+                if (reqFlag) {
+                  mathTokenError(m - 1, g_Statement[k].mathString, k,
+                      cat("This variable does not occur in statement ",
+                      str((double)stmt)," (label \"",
+                      g_Statement[stmt].labelName,
+                      "\") or statement ", str((double)stmt),
+                      "'s \"$e\" hypotheses, whereas variable \"",
+                      g_MathToken[n].tokenName,
+                      "\" DOES occur.  A \"$f\" hypothesis may not contain",
+                      " such a mixture of variables.",NULL));
+                } else {
+                  mathTokenError(m - 1, g_Statement[k].mathString, k,
+                      cat("This variable occurs in statement ",
+                      str((double)stmt)," (label \"",
+                      g_Statement[stmt].labelName,
+                      "\") or statement ", str((double)stmt),
+                      "'s \"$e\" hypotheses, whereas variable \"",
+                      g_MathToken[n].tokenName,
+                      "\" does NOT occur.  A \"$f\" hypothesis may not",
+                      " contain such a mixture of variables.",NULL));
+                }
+                break;
+              } // End if
+              j++;
+              tokenNum = nmbrTmpPtr[j];
+            } // End while
+          } // Next i
+        } // End if (deferOptLists)
 
         // Error check:  make sure that all variables in the original statement
         // appeared in some hypothesis.
@@ -1605,7 +2123,8 @@ void parseStatements(void) {
 
         // We have finished determining optional $f hyps, so allocate the
         // permanent list for the statement array.
-        if (type == p_) { // Optional ones are not used by $a statements
+        // Optional ones are not used by $a statements
+        if (type == p_ && !deferOptLists) {
           nmbrTmpPtr = poolFixedMalloc((optHyps + 1)
               * (long)(sizeof(nmbrString)));
           memcpy(nmbrTmpPtr, wrkHypPtr2, (size_t)optHyps * sizeof(nmbrString));
@@ -1617,28 +2136,55 @@ void parseStatements(void) {
         // that are required.
         optHyps = 0;
         reqHyps = 0;
-        for (i = 0; i < activeDisjHypStackPtr; i++) {
-          m = activeDisjHypStack[i].tokenNumA; // First var in disjoint pair
-          n = activeDisjHypStack[i].tokenNumB; // 2nd var in disjoint pair
-          if (activeVarStack[g_MathToken[m].tmp].tmpFlag &&
-              activeVarStack[g_MathToken[n].tmp].tmpFlag) {
-            // Both variables in the disjoint pair are required, so put the
-            // disjoint hypothesis in the required list.
-            wrkDisjHPtr1A[reqHyps] = m;
-            wrkDisjHPtr1B[reqHyps] = n;
-            wrkDisjHPtr1Stmt[reqHyps] =
-                activeDisjHypStack[i].statemNum;
-            reqHyps++;
-          } else {
-            // At least one variable is not required, so the disjoint hypothesis
-            // is not required.
-            wrkDisjHPtr2A[optHyps] = m;
-            wrkDisjHPtr2B[optHyps] = n;
-            wrkDisjHPtr2Stmt[optHyps] =
-                activeDisjHypStack[i].statemNum;
-            optHyps++;
+        if (deferOptLists
+            && reqVars * (reqVars - 1) / 2 < activeDisjHypStackPtr) {
+          // Look up the pairs of required variables instead of scanning the
+          // whole stack
+          for (i = 0; i < reqVars; i++) {
+            for (j = i + 1; j < reqVars; j++) {
+              m = wrkVarPtr1[i];
+              n = wrkVarPtr1[j];
+              k = (m < n) ? findDisjPair(m, n, activeDisjHypStackPtr)
+                  : findDisjPair(n, m, activeDisjHypStackPtr);
+              if (k != -1) {
+                wrkDisjHPtr2A[reqHyps] = k; // Stack position
+                reqHyps++;
+              }
+            }
           }
-        }
+          // Put them in stack order
+          qsort(wrkDisjHPtr2A, (size_t)reqHyps, sizeof(nmbrString),
+              nmbrElementCmp);
+          for (i = 0; i < reqHyps; i++) {
+            k = wrkDisjHPtr2A[i];
+            wrkDisjHPtr1A[i] = activeDisjHypStack[k].tokenNumA;
+            wrkDisjHPtr1B[i] = activeDisjHypStack[k].tokenNumB;
+            wrkDisjHPtr1Stmt[i] = activeDisjHypStack[k].statemNum;
+          }
+        } else {
+          for (i = 0; i < activeDisjHypStackPtr; i++) {
+            m = activeDisjHypStack[i].tokenNumA; // First var in disjoint pair
+            n = activeDisjHypStack[i].tokenNumB; // 2nd var in disjoint pair
+            if (activeVarStack[g_MathToken[m].tmp].tmpFlag &&
+                activeVarStack[g_MathToken[n].tmp].tmpFlag) {
+              // Both variables in the disjoint pair are required, so put the
+              // disjoint hypothesis in the required list.
+              wrkDisjHPtr1A[reqHyps] = m;
+              wrkDisjHPtr1B[reqHyps] = n;
+              wrkDisjHPtr1Stmt[reqHyps] =
+                  activeDisjHypStack[i].statemNum;
+              reqHyps++;
+            } else {
+              // At least one variable is not required, so the disjoint
+              // hypothesis is not required.
+              wrkDisjHPtr2A[optHyps] = m;
+              wrkDisjHPtr2B[optHyps] = n;
+              wrkDisjHPtr2Stmt[optHyps] =
+                  activeDisjHypStack[i].statemNum;
+              optHyps++;
+            }
+          }
+        } // End if (deferOptLists)
 
         // We have finished determining required $d hyps, so allocate the
         // permanent list for the statement array.
@@ -1667,7 +2213,8 @@ void parseStatements(void) {
         // We have finished determining optional $d hyps, so allocate the
         // permanent list for the statement array.
 
-        if (type == p_) { // Optional ones are not used by $a statements
+        // Optional ones are not used by $a statements
+        if (type == p_ && !deferOptLists) {
 
           nmbrTmpPtr = poolFixedMalloc((optHyps + 1)
               * (long)(sizeof(nmbrString)));
@@ -1691,6 +2238,22 @@ void parseStatements(void) {
           g_Statement[stmt].optDisjVarsStmt = nmbrTmpPtr;
         }
 
+        if (deferOptLists) {
+          // Clear the variable flags for future use
+          for (i = 0; i < reqVars; i++) {
+            activeVarStack[g_MathToken[wrkVarPtr1[i]].tmp].tmpFlag = 0;
+          }
+          // Save the scope frame for the optional lists
+          stmtFrame[stmt].varTop = activeVarStackPtr
+              ? activeVarStack[activeVarStackPtr - 1].frameNode : -1;
+          stmtFrame[stmt].fHypTop = activeFHypStackPtr
+              ? activeFHypStack[activeFHypStackPtr - 1].frameNode : -1;
+          stmtFrame[stmt].disjTop = activeDisjHypStackPtr
+              ? disjNode[activeDisjHypStackPtr - 1] : -1;
+          stmtFrame[stmt].deferred = 1;
+          break; // Switch case break
+        }
+
         // Create list of optional variables (i.e. active but not required)
         optVars = 0;
         for (i = 0; i < activeVarStackPtr; i++) {
@@ -1881,6 +2444,7 @@ void parseStatements(void) {
   free(wrkStrPtr);
   free(symbolLenExists);
   free_vstring(tmpStr);
+  freeDisjPairs(); // Only needed while parsing
 }
 
 // Parse proof of one statement in source file.  Uses g_WrkProof structure.
@@ -1941,6 +2505,7 @@ char parseProof(long statemNum)
   // The worst case is less than the number of chars in the source,
   // plus the number of active hypotheses.
 
+  buildOptHypList(statemNum);
   numOptHyp = nmbrLen(g_Statement[statemNum].optHypList);
   if (g_Statement[statemNum].proofSectionLen + g_Statement[statemNum].numReqHyp
       + numOptHyp > g_wrkProofMaxSize) {
@@ -1979,7 +2544,7 @@ char parseProof(long statemNum)
     g_WrkProof.proofString =
         poolFixedMalloc(g_wrkProofMaxSize * (long)(sizeof(nmbrString)));
     g_WrkProof.mathStringPtrs =
-        malloc((size_t)g_wrkProofMaxSize * sizeof(nmbrString));
+        malloc((size_t)g_wrkProofMaxSize * sizeof(pntrString));
     g_WrkProof.RPNStack = malloc((size_t)g_wrkProofMaxSize * sizeof(nmbrString));
     g_WrkProof.compressedPfLabelMap =
          malloc((size_t)g_wrkProofMaxSize * sizeof(nmbrString));
@@ -2763,6 +3328,8 @@ char parseCompressedProof(long statemNum)
   vstring tmpStrPtr;
   flag hypLocUnkFlag; // Hypothesis, local label ref, or unknown step
   long labelMapIndex;
+  flag hypFlag; // Label list entry is an optional (1) or required (2) hyp
+  flag hypsSorted; // hypAndLocLabel has been built for bsearch lookups
 
   static unsigned char chrWeight[256]; // Proof label character weights
   static unsigned char chrType[256]; // Proof character types
@@ -2839,6 +3406,7 @@ char parseCompressedProof(long statemNum)
   // The worst case is less than the number of chars in the source,
   // plus the number of active hypotheses.
 
+  buildOptHypList(statemNum);
   numOptHyp = nmbrLen(g_Statement[statemNum].optHypList);
   if (g_Statement[statemNum].proofSectionLen + g_Statement[statemNum].numReqHyp
       + numOptHyp > g_wrkProofMaxSize) {
@@ -2875,7 +3443,7 @@ char parseCompressedProof(long statemNum)
     g_WrkProof.proofString =
         poolFixedMalloc(g_wrkProofMaxSize * (long)(sizeof(nmbrString)));
     g_WrkProof.mathStringPtrs =
-        malloc((size_t)g_wrkProofMaxSize * sizeof(nmbrString));
+        malloc((size_t)g_wrkProofMaxSize * sizeof(pntrString));
     g_WrkProof.RPNStack = malloc((size_t)g_wrkProofMaxSize * sizeof(nmbrString));
     g_WrkProof.compressedPfLabelMap =
          malloc((size_t)g_wrkProofMaxSize * sizeof(nmbrString));
@@ -2932,34 +3500,6 @@ char parseCompressedProof(long statemNum)
 
   fbStartProof = fbPtr; // Save pointer to start of compressed proof
 
-  // Copy active (opt + req) hypotheses to hypAndLocLabel look-up table
-  nmbrTmpPtr = g_Statement[statemNum].optHypList;
-  // Transfer optional hypotheses
-  while (1) {
-    i = nmbrTmpPtr[g_WrkProof.numHypAndLoc];
-    if (i == -1) break;
-    g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelTokenNum = i;
-    g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelName =
-        g_Statement[i].labelName;
-    g_WrkProof.numHypAndLoc++;
-  }
-  // Transfer required hypotheses
-  j = g_Statement[statemNum].numReqHyp;
-  nmbrTmpPtr = g_Statement[statemNum].reqHypList;
-  for (i = 0; i < j; i++) {
-    k = nmbrTmpPtr[i];
-    // Required hypothesis labels are not allowed; the -1000 - k is a
-    // flag that tells that they are required for error detection.
-    g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelTokenNum = -1000 - k;
-    g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelName =
-        g_Statement[k].labelName;
-    g_WrkProof.numHypAndLoc++;
-  }
-
-  // Sort the hypotheses by label name for lookup
-  qsort(g_WrkProof.hypAndLocLabel, (size_t)(g_WrkProof.numHypAndLoc),
-      sizeof(struct sortHypAndLoc), hypAndLocSortCmp);
-
   // Build the proof string (actually just a list of labels)
   g_WrkProof.proofString[g_WrkProof.numSteps] = -1; // End of proof
   // Zap mem pool actual length (because nmbrLen will be used later on this)
@@ -2967,27 +3507,100 @@ char parseCompressedProof(long statemNum)
 
   // Scan proof string with the label list (not really proof steps; we're just
   // using the structure for convenience).
+  hypsSorted = 0;
   for (step = 0; step < g_WrkProof.numSteps; step++) {
     tokLength = g_WrkProof.stepSrcPtrNmbr[step];
     fbPtr = g_WrkProof.stepSrcPtrPntr[step];
 
-    // Temporarily zap the token's end with a null for string comparisons
-    zapSave = fbPtr[tokLength];
-    fbPtr[tokLength] = 0; // Zap source
+    // Look up the label in the label hash table.  An active hypothesis is
+    // one of the statement's required or optional hypotheses; an inactive
+    // one is treated like an unknown label.
+    hypFlag = 0; // 1 = optional hypothesis, 2 = required hypothesis
+    j = noLabelHash ? -1 : lookupLabelHash(fbPtr, tokLength);
+    if (j > 0 && (g_Statement[j].type == e_ || g_Statement[j].type == f_)) {
+      numReqHyp = g_Statement[statemNum].numReqHyp;
+      nmbrTmpPtr = g_Statement[statemNum].reqHypList;
+      for (i = 0; i < numReqHyp; i++) {
+        if (nmbrTmpPtr[i] == j) {
+          hypFlag = 2;
+          break;
+        }
+      }
+      nmbrTmpPtr = g_Statement[statemNum].optHypList;
+      for (i = 0; !hypFlag && nmbrTmpPtr[i] != -1; i++) {
+        if (nmbrTmpPtr[i] == j) hypFlag = 1;
+      }
+      if (!hypFlag) j = 0; // Not an active hypothesis
+    }
 
-    // See if the proof token is a hypothesis
-    voidPtr = (void *)bsearch(fbPtr, g_WrkProof.hypAndLocLabel,
-        (size_t)(g_WrkProof.numHypAndLoc), sizeof(struct sortHypAndLoc),
-        hypAndLocSrchCmp);
-    if (voidPtr) {
-      // It's a hypothesis reference
+    if (j < 0) {
+      // The label is declared more than once (an error reported by
+      // parseLabels()), so look it up with the sorted keys instead
+      if (!hypsSorted) {
+        hypsSorted = 1;
+        // Copy active (opt + req) hypotheses to hypAndLocLabel look-up table
+        g_WrkProof.numHypAndLoc = 0;
+        nmbrTmpPtr = g_Statement[statemNum].optHypList;
+        // Transfer optional hypotheses
+        while (1) {
+          i = nmbrTmpPtr[g_WrkProof.numHypAndLoc];
+          if (i == -1) break;
+          g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelTokenNum = i;
+          g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelName =
+              g_Statement[i].labelName;
+          g_WrkProof.numHypAndLoc++;
+        }
+        // Transfer required hypotheses
+        k = g_Statement[statemNum].numReqHyp;
+        nmbrTmpPtr = g_Statement[statemNum].reqHypList;
+        for (i = 0; i < k; i++) {
+          // Required hypothesis labels are not allowed; the -1000 - k is a
+          // flag that tells that they are required for error detection.
+          g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelTokenNum =
+              -1000 - nmbrTmpPtr[i];
+          g_WrkProof.hypAndLocLabel[g_WrkProof.numHypAndLoc].labelName =
+              g_Statement[nmbrTmpPtr[i]].labelName;
+          g_WrkProof.numHypAndLoc++;
+        }
+
+        // Sort the hypotheses by label name for lookup
+        qsort(g_WrkProof.hypAndLocLabel, (size_t)(g_WrkProof.numHypAndLoc),
+            sizeof(struct sortHypAndLoc), hypAndLocSortCmp);
+      }
+
+      // Temporarily zap the token's end with a null for string comparisons
+      zapSave = fbPtr[tokLength];
+      fbPtr[tokLength] = 0; // Zap source
+
+      // See if the proof token is a hypothesis
+      voidPtr = (void *)bsearch(fbPtr, g_WrkProof.hypAndLocLabel,
+          (size_t)(g_WrkProof.numHypAndLoc), sizeof(struct sortHypAndLoc),
+          hypAndLocSrchCmp);
+      if (voidPtr) {
+        // Label lookup number
+        j = ((struct sortHypAndLoc *)voidPtr)->labelTokenNum;
+        hypFlag = 1;
+        if (j < 0) { // Minus is used as flag for required hypothesis
+          j = -1000 - j;
+          hypFlag = 2;
+        }
+      } else {
+        // See if token is an assertion label
+        voidPtr = (void *)bsearch(fbPtr, g_labelKeyBase,
+            (size_t)g_numLabelKeys, sizeof(long), labelSrchCmp);
+        j = voidPtr ? *(long *)voidPtr : 0;
+        if (j && g_Statement[j].type != a_ && g_Statement[j].type != p_) {
+          bug(1714);
+        }
+      }
       fbPtr[tokLength] = zapSave; // Unzap source
-      // Label lookup number
-      j = ((struct sortHypAndLoc *)voidPtr)->labelTokenNum;
+    }
+
+    if (hypFlag) {
+      // It's a hypothesis reference
 
       // Make sure it's not a required hypothesis, which is implicitly declared.
-      if (j < 0) { // Minus is used as flag for required hypothesis
-        j = -1000 - j; // Restore it to prevent side effects of the error
+      if (hypFlag == 2) {
         if (!g_WrkProof.errorCount) {
           sourceError(fbPtr, tokLength, statemNum,
               "Required hypotheses may not be explicitly declared.");
@@ -3003,11 +3616,7 @@ char parseCompressedProof(long statemNum)
       continue;
     } // End if hypothesis
 
-    // See if token is an assertion label
-    voidPtr = (void *)bsearch(fbPtr, g_labelKeyBase, (size_t)g_numLabelKeys,
-        sizeof(long), labelSrchCmp);
-    fbPtr[tokLength] = zapSave; // Unzap source
-    if (!voidPtr) {
+    if (!j) {
       if (!g_WrkProof.errorCount) {
         sourceError(fbPtr, tokLength, statemNum,
          "This token is not the label of an assertion or optional hypothesis.");
@@ -3019,8 +3628,6 @@ char parseCompressedProof(long statemNum)
     }
 
     // It's an assertion ($a or $p)
-    j = *(long *)voidPtr; // Statement number
-    if (g_Statement[j].type != a_ && g_Statement[j].type != p_) bug(1714);
     g_WrkProof.proofString[step] = j; // Proof string
 
     if (j >= statemNum) { // Error
@@ -3380,6 +3987,49 @@ char parseCompressedProof(long statemNum)
   return returnFlag;
 } // parseCompressedProof
 
+void benchCompressedProofs(void)
+{
+  long stmt, i, pass, numProofs;
+  unsigned long hash;
+  unsigned long *results; // Hash of each proof's parse result in pass 0
+  flag sameFlag = 1;
+  double seconds[2];
+  clock_t clockStart;
+  char *ptr;
+
+  results = malloc(((size_t)g_statements + 1) * sizeof(unsigned long));
+  if (!results) outOfMemory("#140 (benchCompressedProofs)");
+  numProofs = 0;
+  for (pass = 0; pass < 2; pass++) {
+    noLabelHash = (flag)pass;
+    clockStart = clock();
+    for (stmt = 1; stmt <= g_statements; stmt++) {
+      if (g_Statement[stmt].type != p_) continue;
+      ptr = g_Statement[stmt].proofSectionPtr;
+      if (ptr[0] == 0) continue;
+      if (ptr[whiteSpaceLen(ptr)] != '(') continue; // Not compressed
+      hash = (unsigned long)parseCompressedProof(stmt);
+      for (i = 0; i < g_WrkProof.numSteps; i++) {
+        hash = (hash ^ (unsigned long)g_WrkProof.proofString[i]) * 16777619UL;
+      }
+      if (pass == 0) {
+        results[stmt] = hash;
+        numProofs++;
+      } else if (results[stmt] != hash) {
+        sameFlag = 0;
+      }
+    }
+    seconds[pass] = (double)(clock() - clockStart) / CLOCKS_PER_SEC;
+  }
+  noLabelHash = 0;
+  free(results);
+
+  print2("%ld compressed proofs were parsed.\n", numProofs);
+  print2("With the label hash table:  %1.3f s\n", seconds[0]);
+  print2("With the sorted label keys: %1.3f s\n", seconds[1]);
+  print2("The results are %s.\n", sameFlag ? "identical" : "DIFFERENT");
+} // benchCompressedProofs
+
 // The caller must deallocate the returned nmbrString!
 // This function just gets the proof so the caller doesn't have to worry
 // about cleaning up the g_WrkProof structure. The returned proof is normal
@@ -3681,20 +4331,10 @@ long whiteSpaceLen(char *ptr) {
     if (tmpchr == '$') {
       if (ptr[i + 1] == '(') {
         while (1) {
-          // ptr1 = strchr(ptr + i + 2, '$');
-          // in-line code for speed
-          // (for the lcc-win32 compiler, this speeds it up from 94 sec
-          // for set.mm read to 4 sec).
-          for (ptr1 = ptr + i + 2; ptr1[0] != '$'; ptr1++) {
-            if (ptr1[0] == 0) {
-              if ('$' != 0)
-                ptr1 = NULL;
-              break;
-            }
-          }
-          // end in-line strchr code
-          if (!ptr1) {
-            return i + (long)strlen(&ptr[i]); // Unterminated comment - goto EOF
+          // Like strchr(ptr + i + 2, '$') but a block at a time
+          ptr1 = scanToDollar(ptr + i + 2);
+          if (!ptr1[0]) {
+            return (long)(ptr1 - ptr); // Unterminated comment - goto EOF
           }
           if (ptr1[1] == ')') break;
           i = ptr1 - ptr;
@@ -4269,6 +4909,7 @@ vstring outputStatement(long stmt, flag reformatFlag) {
   // in the g_Statement[] array for any future write source.  Eventually
   // we should replace WRITE SOURCE.../REWRAP with a REWRAP(?) command.
   if (strcmp(labelSection, labelSectionSave)) {
+    eraseSectionOutline(); // Rebuild on next use by getSectionHeadings()
     g_Statement[stmt].labelSectionLen = (long)strlen(labelSection);
     if (g_Statement[stmt].labelSectionChanged == 1) {
       let(&(g_Statement[stmt].labelSectionPtr), labelSection);
@@ -4872,15 +5513,18 @@ void getNextInclusion(char *fileBuf, long startOffset, // inputs
 
   while (1) {
     fbPtr = fbPtr + rawWhiteSpaceLen(fbPtr); // Count $( as a token
+    if (fbPtr[0] != '$') {
+      // Skip ordinary tokens:  find the next '$' that starts a token
+      fbPtr = scanToDollar(fbPtr);
+      while (fbPtr[0] && isgraph((unsigned char)(fbPtr[-1]))) {
+        fbPtr = scanToDollar(fbPtr + 1);
+      }
+    }
     j = rawTokenLen(fbPtr); // Treat $(, $[ as tokens
     if (j == 0) {
       *cmdType = 'N'; // No include found
       break; // End of file
     }
-    if (fbPtr[0] != '$') {
-      fbPtr = fbPtr + j;
-      continue;
-    }
 
     // Process normal include $[ $]
     if (fbPtr[1] == '[') {
@@ -5126,9 +5770,9 @@ vstring writeSourceToBuffer(void) {
   } // next stmt
 
   // Create the output buffer.
-  // We could have created it with let(&buf, space(size)), but malloc should
-  // be slightly faster since we don't have to initialize each entry.
-  buf = malloc((size_t)(size + 1) * sizeof(char));
+  // We could have created it with let(&buf, space(size)), but allocVstring
+  // should be slightly faster since we don't have to initialize each entry.
+  buf = allocVstring((size_t)size);
 
   ptr = buf; // Pointer to keep track of buf location
   // Transfer the g_Statement[] array to buf
@@ -5466,6 +6110,38 @@ void assignStmtFileAndLineNum(long stmtNum) {
 // If NULL is returned, it means a serious error occurred (like missing file)
 // and reading should be aborted.
 // Globals used:  g_IncludeCall[], g_includeCalls
+// Get the modification time and size of a file, -1 if unknown
+static void getFileStamp(const char *fileName, long *modTime, long *fileSize)
+{
+#ifdef SOURCE_FILE_STAT
+  struct stat st;
+  if (stat(fileName, &st) == 0) {
+    *modTime = (long)st.st_mtime;
+    *fileSize = (long)st.st_size;
+    return;
+  }
+#endif
+  *modTime = -1;
+  *fileSize = -1;
+} // getFileStamp
+
+// Record in g_IncludeCall[inclCall] that its file was read from disk, for
+// sourceFileChanged()
+static void stampSourceFile(long inclCall, const char *fullFileName,
+    const char *contents, long size)
+{
+  g_IncludeCall[inclCall].fileRead = 1;
+  getFileStamp(fullFileName, &g_IncludeCall[inclCall].modTime,
+      &g_IncludeCall[inclCall].fileSize);
+  // A change later in the same second would not change the modification
+  // time, so don't rely on it then
+  if (g_IncludeCall[inclCall].modTime >= (long)time(NULL)) {
+    g_IncludeCall[inclCall].modTime = -1;
+  }
+  g_IncludeCall[inclCall].contentHash = textHash(TEXT_HASH_INIT, contents,
+      size);
+} // stampSourceFile
+
 vstring readInclude(const char *fileBuf, long fileBufOffset,
     const char *sourceFileName, long *size, long parentLineNum, flag *errorFlag)
 {
@@ -5572,10 +6248,12 @@ vstring readInclude(const char *fileBuf, long fileBufOffset,
       if (g_IncludeCall == NULL) outOfMemory("#2 (g_IncludeCall)");
     }
     g_IncludeCall[g_includeCalls].pushOrPop = 0;
+    g_IncludeCall[g_includeCalls].fileRead = 0;
 
     // This entry is identified by pushOrPop = 1
     g_includeCalls++;
     g_IncludeCall[g_includeCalls].pushOrPop = 1;
+    g_IncludeCall[g_includeCalls].fileRead = 0;
     // Save the value before recursive calls will increment the global
     // g_includeCalls.
     saveInclCalls = g_includeCalls;
@@ -5663,6 +6341,8 @@ vstring readInclude(const char *fileBuf, long fileBufOffset,
           } else {
             print2("Reading included file \"%s\"... %ld bytes\n",
                 fullIncludeFn, inclSize);
+            stampSourceFile(saveInclCalls - 1, fullIncludeFn, tmpSource,
+                inclSize);
           }
 
           // Change inclusion command to Begin...End comment.
@@ -5734,6 +6414,9 @@ vstring readInclude(const char *fileBuf, long fileBufOffset,
             *errorFlag = 1;
             tmpSource = ""; // Prevent seg fault
             inclSize = 0;
+          } else {
+            stampSourceFile(saveInclCalls - 1, fullIncludeFn, tmpSource,
+                inclSize);
           }
 
           // Change Skip comment to Begin...End comment
@@ -5975,7 +6658,6 @@ vstring readSourceAndIncludes(const char *inputFn /* input */, long *size /* out
     // goto RETURN_POINT;
   }
   print2("Reading source file \"%s\"... %ld bytes\n", fullInputFn, *size);
-  free_vstring(fullInputFn);
 
   // Create a fictitious initial include for the main file (at least 2
   // g_IncludeCall structure array entries have been already been allocated
@@ -5998,6 +6680,11 @@ vstring readSourceAndIncludes(const char *inputFn /* input */, long *size /* out
   g_IncludeCall[g_includeCalls].current_includeSource = "";
   // Length of the file to be included (0 if the file was previously included)
   g_IncludeCall[g_includeCalls].current_includeLength = *size;
+  g_IncludeCall[g_includeCalls].fileRead = 0;
+  if (!errorFlag) {
+    stampSourceFile(g_includeCalls, fullInputFn, fileBuf, *size);
+  }
+  free_vstring(fullInputFn);
 
   // Create a fictitious entry for the "continuation" after the
   // main file, to make error message line searching easier.
@@ -6019,6 +6706,7 @@ vstring readSourceAndIncludes(const char *inputFn /* input */, long *size /* out
   g_IncludeCall[g_includeCalls].current_includeSource = "";
   // The "continuation" of the main file is fictitious, so just set it to 0 length
   g_IncludeCall[g_includeCalls].current_includeLength = 0;
+  g_IncludeCall[g_includeCalls].fileRead = 0;
 
   // Recursively expand the source of an included file
   newFileBuf = "";
@@ -6055,3 +6743,35 @@ vstring readSourceAndIncludes(const char *inputFn /* input */, long *size /* out
   }
 } // readSourceAndIncludes
 
+// For READ / INCREMENTAL:  return 1 if the file of g_IncludeCall[inclCall],
+// which was read from disk, has changed or is missing, 0 if not
+flag sourceFileChanged(long inclCall)
+{
+  vstring_def(fullFileName);
+  vstring_def(contents);
+  long modTime, fileSize, size;
+  flag changed;
+
+  if (!g_IncludeCall[inclCall].fileRead) bug(1776);
+  let(&fullFileName, cat(g_rootDirectory, g_IncludeCall[inclCall].included_fn,
+      NULL));
+  getFileStamp(fullFileName, &modTime, &fileSize);
+  if (modTime != -1 && modTime == g_IncludeCall[inclCall].modTime
+      && fileSize == g_IncludeCall[inclCall].fileSize) {
+    // Not modified since it was read
+    free_vstring(fullFileName);
+    return 0;
+  }
+  // It may have been touched only, so compare the contents
+  contents = readFileToString(fullFileName, 0 /* quiet */, &size);
+  if (contents == NULL) {
+    changed = 1; // It is missing
+  } else {
+    changed = (textHash(TEXT_HASH_INIT, contents, size)
+        != g_IncludeCall[inclCall].contentHash);
+    free_vstring(contents);
+  }
+  free_vstring(fullFileName);
+  return changed;
+} // sourceFileChanged
+
@@ -17,8 +17,25 @@ void parseKeywords(void);
 void parseLabels(void);
 void parseMathDecl(void);
 void parseStatements(void);
+/*! Assign g_Statement[stmt].optHypList of a $p statement from its scope
+   frame if parseStatements() did not build it.  Call it before using the
+   list. */
+void buildOptHypList(long stmt);
+/*! Likewise for optVarList, optDisjVarsA, optDisjVarsB, and
+   optDisjVarsStmt. */
+void buildOptVarLists(long stmt);
+/*! Return 1 if the $d pair \p tokenA, \p tokenB (with
+   \p tokenA < \p tokenB) is active in statement \p stmt, required or
+   not. */
+flag activeDisjPair(long stmt, long tokenA, long tokenB);
+/*! Deallocate the scope frames.  Called by eraseSource(). */
+void eraseScopeFrames(void);
 char parseProof(long statemNum);
 char parseCompressedProof(long statemNum);
+/*! Developer benchmark (DBG "PARSE_BENCH"):  parse all compressed proofs
+   with the label hash table and with the sorted label keys, and compare the
+   times and results. */
+void benchCompressedProofs(void);
 nmbrString *getProof(long statemNum, flag printFlag);
 
 void rawSourceError(char *startFile, char *ptr, long tokenLen, vstring errMsg);
@@ -92,6 +109,28 @@ long countLines(const char *start, long length);
 extern long *g_allLabelKeyBase;
 extern long g_numAllLabelKeys;
 
+/*! \brief Hash table of all labels, built by parseLabels()
+
+   An entry is 0 for an empty slot, the statement number of a label, or minus
+   the statement number if the label is declared more than once.  The size of
+   the table is \ref g_labelHashMask + 1, a power of 2. */
+extern long *g_labelHash;
+extern long g_labelHashMask;
+
+/*! Look up the \p len character label at \p ptr, which need not be
+   null-terminated.  Returns its statement number, 0 if there is no such
+   label, or minus the statement number of one of its declarations if it is
+   declared more than once. */
+long lookupLabelHash(const char *ptr, long len);
+
+/*! The initial value of \ref textHash */
+#define TEXT_HASH_INIT 2166136261UL
+
+/*! Continue the hash value \p hash (FNV-1a) with the \p len characters at
+   \p text, which need not be null-terminated.  Start with
+   \ref TEXT_HASH_INIT. */
+unsigned long textHash(unsigned long hash, const char *text, long len);
+
 extern long g_wrkProofMaxSize; /*!< Maximum size so far - it may grow */
 struct sortHypAndLoc { // Used for sorting hypAndLocLabel field
   long labelTokenNum;
@@ -204,4 +243,11 @@ vstring readInclude(const char *fileBuf, long fileBufOffset,
     /* vstring inclFileName, */ const char *sourceFileName,
     long *size, long parentLineNum, flag *errorFlag);
 
+/*! For READ / INCREMENTAL:  return 1 if the file g_IncludeCall[inclCall]
+   read from disk has changed or is missing since it was read, 0 if not.
+   The modification time and size are compared first; if they differ, the
+   file is read again and its contents are compared by their hash, so a file
+   that was only touched does not count as changed. */
+flag sourceFileChanged(long inclCall);
+
 #endif // METAMATH_MMPARS_H_
@@ -29,6 +29,12 @@ flag g_proofChangedFlag; // Flag to push 'undo' stack - global
 // (which needs >= 23884 to generate with 'show statement / html').
 // g_userMaxProveFloat can be overridden by user with SET SEARCH_LIMIT
 long g_userMaxProveFloat = 50000; // Upper limit for proveFloating
+// Wall clock time (getWallTime()) at which the searches of IMPROVE and
+// MINIMIZE_WITH / BUDGET give up; 0 means no limit
+double g_pfasDeadline = 0;
+// Search statistics for SET PROFILE
+long g_quickMatchRejects = 0; // Statements rejected by quickMatchFilter()
+long g_unifCandidates = 0; // Statements whose unification was tried
 
 long g_dummyVars = 0; // Total number of dummy variables declared
 long g_pipDummyVars = 0; // Number of dummy variables used by proof in progress
@@ -38,6 +44,13 @@ long g_pipDummyVars = 0; // Number of dummy variables used by proof in progress
 struct pip_struct g_ProofInProgress = {
     NULL_NMBRSTRING, NULL_PNTRSTRING, NULL_PNTRSTRING, NULL_PNTRSTRING };
 
+// Proof structure index of g_ProofInProgress.proof.  It is updated in place
+// by addSubProof() and deleteSubProof(), and rebuilt by getPipIndex() after
+// the proof is replaced as a whole (pipIndexValid = 0).
+static struct proofIndex_struct pipIndex = {NULL, NULL, NULL, NULL, NULL,
+    0, 0};
+static flag pipIndexValid = 0;
+
 // Interactively select statement assignments that match.
 // maxEssential is the maximum number of essential hypotheses that a
 // statement may have in order to be included in the matched list.
@@ -269,8 +282,12 @@ nmbrString *proveByReplacement(long prfStmt,
   prfMath = (g_ProofInProgress.target)[prfStep];
   prfMbox = getMathboxNum(prfStmt);
   for (trialStmt = 1; trialStmt < prfStmt; trialStmt++) {
+    if (pfasTimeUp()) break;
 
-    if (quickMatchFilter(trialStmt, prfMath, dummyVarFlag) == 0) continue;
+    if (quickMatchFilter(trialStmt, prfMath, dummyVarFlag) == 0) {
+      g_quickMatchRejects++;
+      continue;
+    }
 
     // Skip statements with discouraged usage (the above skips non-$a,p)
     if (overrideFlag == 0 && getMarkupFlag(trialStmt, USAGE_DISCOURAGED)) {
@@ -343,7 +360,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
   pntrString_def(hypList);
   nmbrString_def(hypSortMap); // Order remapping for speedup
   pntrString_def(hypProofList);
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
   nmbrString *replStmtSchemePtr;
   nmbrString *hypSchemePtr;
   nmbrString *hypProofPtr;
@@ -388,7 +405,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
     // Get length of the existing subproof at the replacement step.  The
     // existing subproof will be scanned to see if there is a match to
     // the $e hypotheses of the replacement statement.
-    subPfLen = subproofLen(g_ProofInProgress.proof, prfStep);
+    subPfLen = pipSubproofLen(prfStep);
     scanLen = subPfLen;
     scanUpperBound = prfStep;
     scanLowerBound = scanUpperBound - scanLen + 1;
@@ -495,6 +512,9 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
   // (We will really only use up to schEHyp entries, but allocate all
   // for possible future use).
   pntrLet(&hypStateVectorList, pntrPSpace(schReqHyps));
+  for (hyp = 0; hyp < schReqHyps; hyp++) {
+    hypStateVectorList[hyp] = NULL; // No unification yet
+  }
   // Initialize unification reentry flags for hypothesis unifications.
   // (1 means 0, and 2 means 1, because 0 means end-of-character-string.)
   // (3 means previous proveFloating call found proof)
@@ -504,6 +524,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
   // Initialize list of hypotheses after substitutions made
   pntrLet(&hypMakeSubstList, pntrNSpace(schReqHyps));
 
+  g_unifCandidates++;
   g_unifTrialCount = 1; // Reset unification timeout
   reEntryFlag = 0; // For unifyH()
 
@@ -669,7 +690,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
           bug(1851);
         tmpFlag = unifyH(hypMakeSubstList[hypSortMap[hyp]],
             hypTestPtr,
-            (pntrString **)(&(hypStateVectorList[hypSortMap[hyp]])),
+            (struct unifState_struct **)(&(hypStateVectorList[hypSortMap[hyp]])),
             // (Remember: 1 = false, 2 = true in hypReEntryFlagList)
             hypReEntryFlagList[hypSortMap[hyp]] - 1);
         if (!tmpFlag || tmpFlag == 2) {
@@ -679,7 +700,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
             g_unifTrialCount = 1; // Reset unification timeout
             // Deallocate unification state vector
             purgeStateVector(
-                (pntrString **)(&(hypStateVectorList[hypSortMap[hyp]])));
+                (struct unifState_struct **)(&(hypStateVectorList[hypSortMap[hyp]])));
           }
 
           // If this is a reenter, and there are no dummy vars in replacement
@@ -740,7 +761,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
               // This subproof step was already considered earlier, so
               // we can skip considering it again.
               // Deallocate unification state vector
-              purgeStateVector((pntrString **)(&(hypStateVectorList[hypSortMap[hyp]])));
+              purgeStateVector((struct unifState_struct **)(&(hypStateVectorList[hypSortMap[hyp]])));
               continue;
             }
           } // end if not reentry
@@ -757,7 +778,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
                 trialStep - (scanLowerBound - reqHyps)]));
           } else {
             // We're scanning the subproof
-            i = subproofLen(g_ProofInProgress.proof, trialStep);
+            i = pipSubproofLen(trialStep);
             nmbrLet((nmbrString **)(&hypProofList[hypSortMap[hyp]]),
                 nmbrSeg(g_ProofInProgress.proof, trialStep - i + 2,
                 trialStep + 1));
@@ -797,7 +818,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
               // stateVector to allow further substitutions.
               tmpFlag = unifyH(hypMakeSubstList[hypSortMap[hyp]],
                   hypMakeSubstList[hypSortMap[hyp]],
-                  (pntrString **)(&(hypStateVectorList[hypSortMap[hyp]])),
+                  (struct unifState_struct **)(&(hypStateVectorList[hypSortMap[hyp]])),
                   // (Remember: 1 = false, 2 = true in hypReEntryFlagList)
                   hypReEntryFlagList[hypSortMap[hyp]] - 1);
               // This should be a trivial unification, so it should never fail
@@ -915,12 +936,17 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
     // Proofs were found for all hypotheses
 
     // Build the proof
+    k = 1;
     for (hyp = 0; hyp < schReqHyps; hyp++) {
       if (nmbrLen(hypProofList[hyp]) == 0) bug(1852); // Should have proof
-      nmbrLet(&proof, nmbrCat(proof, hypProofList[hyp], NULL));
+      k = k + nmbrLen(hypProofList[hyp]);
+    }
+    nmbrReserve(&proof, k);
+    for (hyp = 0; hyp < schReqHyps; hyp++) {
+      nmbrAppend(&proof, hypProofList[hyp]);
     }
     // Complete the proof
-    nmbrLet(&proof, nmbrAddElement(proof, replStatemNum));
+    nmbrPush(&proof, replStatemNum);
 
     goto returnPoint;
   } // End while (next unifyH() call for main replacement statement)
@@ -934,7 +960,7 @@ nmbrString *replaceStatement(long replStatemNum, long prfStep,
     free_nmbrString(*(nmbrString **)(&hypList[hyp]));
     free_nmbrString(*(nmbrString **)(&hypProofList[hyp]));
     free_nmbrString(*(nmbrString **)(&hypMakeSubstList[hyp]));
-    purgeStateVector((pntrString **)(&hypStateVectorList[hyp]));
+    purgeStateVector((struct unifState_struct **)(&hypStateVectorList[hyp]));
   }
 
   // Deallocate unification state vector
@@ -984,7 +1010,7 @@ vstring getIndepKnownSteps(long proofStmt, long refStep)
   for (prfStep = proofLen - 2; // next to last step
       prfStep >= 0;
       prfStep--) {
-    wrkSubPfLen = subproofLen(g_ProofInProgress.proof, prfStep);
+    wrkSubPfLen = pipSubproofLen(prfStep);
     if (prfStep >= refStep && prfStep - wrkSubPfLen + 1 <= refStep) {
       // The subproof includes the refStep; reject it
       continue;
@@ -1121,6 +1147,9 @@ void addSubProof(const nmbrString *subProof, long step) {
   sbPfLen = nmbrLen(subProof);
   nmbrLet(&g_ProofInProgress.proof, nmbrCat(nmbrLeft(g_ProofInProgress.proof, step),
       subProof, nmbrRight(g_ProofInProgress.proof, step + 2), NULL));
+  if (pipIndexValid) {
+    spliceProofIndex(&pipIndex, g_ProofInProgress.proof, step, step, sbPfLen);
+  }
   pntrLet(&g_ProofInProgress.target, pntrCat(pntrLeft(g_ProofInProgress.target,
       step), pntrNSpace(sbPfLen - 1), pntrRight(g_ProofInProgress.target,
       step + 1), NULL));
@@ -1227,8 +1256,7 @@ nmbrString *expandProof(
             bug(1873);
           }
           // Assign unknown to the target proof
-          nmbrLet(&expandedSubproof, nmbrAddElement(expandedSubproof,
-              -(long)'?'));
+          nmbrPush(&expandedSubproof, -(long)'?');
           continue;
         }
         srcStepType = g_Statement[sourceProof[srcStep]].type;
@@ -1244,8 +1272,7 @@ nmbrString *expandProof(
           }
           if (srcHypNum > -1) {
             // It's a required hypothesis
-            nmbrLet(&expandedSubproof, nmbrCat(expandedSubproof,
-                hypSubproofs[srcHypNum], NULL));
+            nmbrAppend(&expandedSubproof, hypSubproofs[srcHypNum]);
           } else if (srcStepType == (char)e_) {
             // A non-required hypothesis cannot be $e
             bug(1874);
@@ -1254,20 +1281,13 @@ nmbrString *expandProof(
             // know what it will be in final proof, so make it an unknown
             // step in final proof.
             hasDummyVar = 1;
-            nmbrLet(&expandedSubproof, nmbrAddElement(expandedSubproof,
-                -(long)'?'));
+            nmbrPush(&expandedSubproof, -(long)'?');
           }
         } else if (srcStepType != (char)a_ && srcStepType != (char)p_) {
           bug(1875);
         } else {
           // It's a normal statement reference ($a, $p); use it as is.
-          // (This adds normal ref steps one by one, each requiring a new
-          // allocation in nmbrAddElement.  This should be OK if, as expected,
-          // only relatively short proofs are expanded.  If it becomes a problem,
-          // we can modify the code to do bigger chunks of $a, $p steps at a
-          // time.)
-          nmbrLet(&expandedSubproof, nmbrAddElement(expandedSubproof,
-              sourceProof[srcStep]));
+          nmbrPush(&expandedSubproof, sourceProof[srcStep]);
         } // if srcStepType... *?
       } // next srcStep
       // Insert the expanded subproof into the final expanded proof
@@ -1330,10 +1350,14 @@ void deleteSubProof(long step) {
   // Don't do anything if step is unassigned.
   if ((g_ProofInProgress.proof)[step] == -(long)'?') return;
 
-  sbPfLen = subproofLen(g_ProofInProgress.proof, step);
+  sbPfLen = pipSubproofLen(step);
   nmbrLet(&g_ProofInProgress.proof, nmbrCat(nmbrAddElement(
       nmbrLeft(g_ProofInProgress.proof, step - sbPfLen + 1), -(long)'?'),
       nmbrRight(g_ProofInProgress.proof, step + 2), NULL));
+  if (pipIndexValid) {
+    spliceProofIndex(&pipIndex, g_ProofInProgress.proof, step - sbPfLen + 1,
+        step, 1);
+  }
   for (pos = step - sbPfLen + 1; pos <= step; pos++) {
     if (pos < step) {
       // Deallocate .target and .user
@@ -1361,7 +1385,7 @@ char checkStmtMatch(long statemNum, long step)
 {
   char targetFlag;
   char userFlag = 1; // Default if no user field
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
   nmbrString *mString; // Pointer only; not allocated
   nmbrString_def(scheme);
   long targetLen, mStringLen, reqVars, stsym, tasym, sym, var, hyp, numHyps;
@@ -1385,6 +1409,7 @@ char checkStmtMatch(long statemNum, long step)
       }
     }
     if (!breakFlag) { // Not a required hypothesis; is it optional?
+      buildOptHypList(g_proveStatement);
       numHyps = nmbrLen(g_Statement[g_proveStatement].optHypList);
       for (hyp = 0; hyp < numHyps; hyp++) {
         if (g_Statement[g_proveStatement].optHypList[hyp] == statemNum) {
@@ -1494,7 +1519,7 @@ char checkStmtMatch(long statemNum, long step)
 // g_ProofInProgress.target (or .user) of an step.  Returns 1 if match, 0 if
 // not, 2 if unification timed out.
 char checkMStringMatch(const nmbrString *mString, long step) {
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
   char targetFlag;
   char sourceFlag = 1; // Default if no .source
 
@@ -1527,13 +1552,13 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
     flag mathboxFlag) {
 
   long reqHyps, optHyps;
-  long hyp, stmt, sym, var, i, j;
+  long hyp, stmt, sym, var, i, j, k;
   nmbrString_def(proof);
   nmbrString_def(scheme);
   pntrString_def(hypList);
   nmbrString_def(hypOrdMap); // Order remapping for speedup
   pntrString_def(hypProofList);
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
   nmbrString *stmtMathPtr;
   nmbrString *hypSchemePtr;
   nmbrString *hypProofPtr;
@@ -1571,6 +1596,11 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
         (long)(step + 1));
     goto returnPoint;
   }
+  if (pfasTimeUp()) {
+    // The caller reports it
+    free_nmbrString(proof);
+    goto returnPoint;
+  }
 
   if (maxDepthExceeded) {
     // Pop out of the recursive calls to avoid an infinite loop
@@ -1604,6 +1634,7 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
       goto returnPoint;
     }
   }
+  buildOptHypList(statemNum);
   optHyps = nmbrLen(g_Statement[statemNum].optHypList);
   for (hyp = 0; hyp < optHyps; hyp++) {
     if (nmbrEq(mString,
@@ -1632,7 +1663,7 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
       // Note that for subproof length of 1, the 2nd argument of nmbrSeg
       // evaluates to selfScanStep + 1, so nmbrSeg will be length 1.
       nmbrLet(&proof, nmbrSeg(g_ProofInProgress.proof, selfScanStep -
-          subproofLen(g_ProofInProgress.proof, selfScanStep) + 2,
+          pipSubproofLen(selfScanStep) + 2,
           selfScanStep + 1));
 
       // Check to see that the subproof has no unknown steps.
@@ -1658,7 +1689,10 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
   for (stmt = statemNum - 1; stmt >= 1; stmt--) {
 
     // Separated quick filter for reuse in other functions
-    if (quickMatchFilter(stmt, mString, 0 /* no dummy vars */) == 0) continue;
+    if (quickMatchFilter(stmt, mString, 0 /* no dummy vars */) == 0) {
+      g_quickMatchRejects++;
+      continue;
+    }
 
     if (!overrideFlag && getMarkupFlag(stmt, USAGE_DISCOURAGED)) {
       // Skip usage-discouraged statements
@@ -1764,6 +1798,7 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
       hypOrdMap[hyp] = hyp;
     }
 
+    g_unifCandidates++;
     g_unifTrialCount = 1; // Reset unification timeout
     reEntryFlag = 0; // For unifyH()
 
@@ -1817,8 +1852,8 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
       if (breakFlag) {
        // Proof is not possible for some hypothesis.
 
-       // Perhaps the search limit was reached.
-       if (trials > g_userMaxProveFloat) {
+       // Perhaps the search or time limit was reached.
+       if (trials > g_userMaxProveFloat || pfasTimeUp()) {
          // Deallocate hypothesis schemes and proofs
          for (hyp = 0; hyp < schReqHyps; hyp++) {
            free_nmbrString(*(nmbrString **)(&hypList[hyp]));
@@ -1844,8 +1879,13 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
       // Proofs were found for all hypotheses
 
       // Build the proof
+      k = 1;
+      for (hyp = 0; hyp < schReqHyps; hyp++) {
+        k = k + nmbrLen(hypProofList[hyp]);
+      }
+      nmbrReserve(&proof, k);
       for (hyp = 0; hyp < schReqHyps; hyp++) {
-        nmbrLet(&proof, nmbrCat(proof, hypProofList[hyp], NULL));
+        nmbrAppend(&proof, hypProofList[hyp]);
       }
 
       if (getMarkupFlag(stmt, USAGE_DISCOURAGED)) {
@@ -1881,7 +1921,7 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
         }
       }
 
-      nmbrLet(&proof, nmbrAddElement(proof, stmt)); // Complete the proof
+      nmbrPush(&proof, stmt); // Complete the proof
 
       // Deallocate hypothesis schemes and proofs
       for (hyp = 0; hyp < schReqHyps; hyp++) {
@@ -1918,6 +1958,11 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
   return proof; // Caller must deallocate
 } // proveFloating
 
+// Return 1 if the / BUDGET deadline of the current command has passed.
+flag pfasTimeUp(void) {
+  return g_pfasDeadline > 0 && getWallTime() >= g_pfasDeadline;
+} // pfasTimeUp
+
 // This function does quick check for some common conditions that prevent
 // a trial statement (scheme) from being unified with a given instance.
 // Return value 0 means it can't be unified, 1 means it might be unifiable.
@@ -2087,7 +2132,7 @@ void minimizeProof(long repStatemNum, long prvStatemNum,
       }
 
       // Get the subproof at step s
-      sublen = subproofLen(g_ProofInProgress.proof, step);
+      sublen = pipSubproofLen(step);
       if (sublen > nmbrLen(newSubProofPtr) || allowGrowthFlag) {
         // Success - proof length was reduced.
         // Delete the old subproof only if it is not an unknown
@@ -2165,7 +2210,7 @@ void initStep(long step)
         g_Statement[g_Statement[stmt].reqHypList[hyp]].mathString);           
     if (hyp > 0) { // Don't care about subproof length for 1st hyp
       // Get to step with previous hyp
-      pos = pos - subproofLen(g_ProofInProgress.proof, pos);                            
+      pos = pos - pipSubproofLen(pos);                            
     }
   }
 
@@ -2219,7 +2264,7 @@ void assignKnownSubProofs(void)
   plen = nmbrLen(g_ProofInProgress.proof);
   // Scan proof for known subproofs (backwards, to get biggest ones first)
   for (pos = plen - 1; pos >= 0; pos--) {
-    subplen = subproofLen(g_ProofInProgress.proof, pos); // Find length of subproof
+    subplen = pipSubproofLen(pos); // Find length of subproof
     breakFlag = 0;
     for (q = pos - subplen + 1; q <= pos; q++) {
       if ((g_ProofInProgress.proof)[q] == -(long)'?') {
@@ -2255,7 +2300,7 @@ void assignKnownSteps(long startStep, long sbProofLen)
   long pos, stmt, reqHyps, instLen, instPos, schemeLen, schemePos, hypLen,
       hypPos, hyp, reqVars, var, assLen, assPos;
   flag tmpFlag;
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
 
   nmbrLet(&stack, nmbrSpace(sbProofLen));
   stackPtr = 0;
@@ -2417,7 +2462,7 @@ void assignKnownSteps(long startStep, long sbProofLen)
 // if step is already unified.
 void interactiveUnifyStep(long step, char messageFlag)
 {
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
   char unifFlag;
 
   // Target should never be empty
@@ -2479,7 +2524,7 @@ void interactiveUnifyStep(long step, char messageFlag)
 //           2 = unification timed out
 //           3 = no unification was selected
 char interactiveUnify(const nmbrString *schemeA, const nmbrString *schemeB,
-    pntrString **stateVector)
+    struct unifState_struct **stateVector)
 {
 
   long var, i;
@@ -2488,8 +2533,8 @@ char interactiveUnify(const nmbrString *schemeA, const nmbrString *schemeB,
   flag reEntryFlag;
   nmbrString *stackUnkVar; // Pointer only - not allocated
   nmbrString *unifiedScheme; // Pointer only - not allocated
-  nmbrString *stackUnkVarLen; // Pointer only - not allocated
-  nmbrString *stackUnkVarStart; // Pointer only - not allocated
+  long *stackUnkVarLen; // Pointer only - not allocated
+  long *stackUnkVarStart; // Pointer only - not allocated
   long stackTop;
   vstring_def(tmpStr);
   nmbrString_def(nmbrTmp);
@@ -2538,10 +2583,10 @@ char interactiveUnify(const nmbrString *schemeA, const nmbrString *schemeB,
     // most likely correct choice.  The heuristic was based on
     // empirical observations of typical unification sets.
 
-    stackTop = ((nmbrString *)((*stateVector)[11]))[1];
-    stackUnkVarStart = (nmbrString *)((*stateVector)[2]);
-    stackUnkVarLen = (nmbrString *)((*stateVector)[3]);
-    unifiedScheme = (nmbrString *)((*stateVector)[8]);
+    stackTop = (*stateVector)->stackTop;
+    stackUnkVarStart = (*stateVector)->stackUnkVarStart;
+    stackUnkVarLen = (*stateVector)->stackUnkVarLen;
+    unifiedScheme = (*stateVector)->unifiedScheme;
 
     // Heuristic
     thisUnifWeight = stackTop * 2;
@@ -2623,11 +2668,11 @@ char interactiveUnify(const nmbrString *schemeA, const nmbrString *schemeB,
       print2("Unification #%ld of %ld (weight = %ld):\n",
           unifTrials, unifCount, unifTrialWeight);
 
-      stackTop = ((nmbrString *)((*stateVector)[11]))[1];
-      stackUnkVar = (nmbrString *)((*stateVector)[1]);
-      stackUnkVarStart = (nmbrString *)((*stateVector)[2]);
-      stackUnkVarLen = (nmbrString *)((*stateVector)[3]);
-      unifiedScheme = (nmbrString *)((*stateVector)[8]);
+      stackTop = (*stateVector)->stackTop;
+      stackUnkVar = (*stateVector)->stackUnkVar;
+      stackUnkVarStart = (*stateVector)->stackUnkVarStart;
+      stackUnkVarLen = (*stateVector)->stackUnkVarLen;
+      unifiedScheme = (*stateVector)->unifiedScheme;
       for (var = 0; var <= stackTop; var++) {
         printLongLine(cat("  Replace \"",
           g_MathToken[stackUnkVar[var]].tokenName,"\" with \"",
@@ -2695,7 +2740,7 @@ void autoUnify(flag congrats)
   int pass;
   nmbrString *schemeAPtr; // Pointer only; not allocated
   nmbrString *schemeBPtr; // Pointer only; not allocated
-  pntrString_def(stateVector);
+  struct unifState_struct *stateVector = NULL;
   flag somethingNotUnified = 0;
 
   // Initialization to avoid compiler warning (should not be theoretically
@@ -2780,7 +2825,7 @@ void autoUnify(flag congrats)
 
 // Make stateVector substitutions in all steps.  The stateVector must
 // contain the result of a valid unification.
-void makeSubstAll(pntrString *stateVector) {
+void makeSubstAll(struct unifState_struct *stateVector) {
 
   nmbrString *nmbrTmpPtr; // Pointer only; not allocated
   long plen, step;
@@ -2964,7 +3009,7 @@ char checkDummyVarIsolation(long testStep) { // 0=1st step, 1=2nd, etc.
     // Skip computation at first loop iteration
     if (hyp < g_Statement[parentStmt].numReqHyp - 1) {
       // Skip to proof step of previous hypothesis of parent step
-      prfStep = prfStep - subproofLen(g_ProofInProgress.proof, prfStep);
+      prfStep = prfStep - pipSubproofLen(prfStep);
     }
     if (prfStep == testStep) { // Don't check the hypothesis of testStep
       bugCheckFlag = 1; // Make sure we encountered it during scan
@@ -2999,34 +3044,42 @@ char checkDummyVarIsolation(long testStep) { // 0=1st step, 1=2nd, etc.
   return dummyVarIndicator;
 } // checkDummyVarIsolation
 
+// Return the proof structure index of g_ProofInProgress.proof, building it
+// if needed.
+static struct proofIndex_struct *getPipIndex(void)
+{
+  if (!pipIndexValid) {
+    if (!buildProofIndex(&pipIndex, g_ProofInProgress.proof)) bug(1877);
+    pipIndexValid = 1;
+  }
+  if (pipIndex.len != nmbrLen(g_ProofInProgress.proof)) bug(1878);
+  return &pipIndex;
+} // getPipIndex
+
+// Get subproof length of g_ProofInProgress.proof, starting at endStep and
+// going backwards.  Same as subproofLen(g_ProofInProgress.proof, endStep)
+// but uses the proof structure index.
+long pipSubproofLen(long endStep)
+{
+  struct proofIndex_struct *index = getPipIndex();
+  if (endStep < 0 || endStep >= index->len) bug(1879);
+  return (endStep - index->subproofStart[endStep] + 1);
+} // pipSubproofLen
+
 // Given a starting step, find its parent (the step it is a hypothesis of).
 // If the starting step is the last proof step, just return it.
 long getParentStep(long startStep) // 0=1st step, 1=2nd, etc.
 {
-  long proofLen;
-  long stackPtr, prfStep, stmt;
+  struct proofIndex_struct *index = getPipIndex();
+  long parentStep;
 
-  // g_ProofInProgress is global
-  proofLen = nmbrLen(g_ProofInProgress.proof);
-
-  stackPtr = 0;
-  for (prfStep = startStep + 1; prfStep < proofLen; prfStep++) {
-    stmt = (g_ProofInProgress.proof)[prfStep];
-    if (stmt < 0) { // Unknown step or local label
-      if (stmt != -(long)'?') bug(1842); // We don't handle compact proofs
-      stackPtr++;
-    } else if (g_Statement[stmt].type == (char)e_ ||
-          g_Statement[stmt].type == (char)f_) { // A hypothesis
-      stackPtr++;
-    } else {
-      if (g_Statement[stmt].type != (char)a_ &&
-          g_Statement[stmt].type != (char)p_) bug(1843);
-      stackPtr = stackPtr - g_Statement[stmt].numReqHyp + 1;
-      if (stackPtr <= 0) return prfStep; // This identifies the parent step
-    }
-  } // next prfStep
-  if (startStep != proofLen - 1) bug(1844); // Didn't find parent...
-  return startStep; // ...unless we started with the last proof step
+  if (startStep < 0 || startStep >= index->len) bug(1880);
+  parentStep = index->parentStep[startStep];
+  if (parentStep == -1) {
+    if (startStep != index->len - 1) bug(1844); // Didn't find parent...
+    return startStep; // ...unless we started with the last proof step
+  }
+  return parentStep; // This identifies the parent step
 } // getParentStep
 
 // This function puts numNewVars dummy variables, named "$nnn", at the end
@@ -3082,6 +3135,7 @@ void copyProofStruct(struct pip_struct *outProofStruct,
 {
   long proofLen, j;
   // First, make sure the output structure is empty to prevent memory leaks.
+  // (This also invalidates the proof structure index of g_ProofInProgress.)
   deallocProofStruct(outProofStruct);
 
   // Get the proof length of the input structure
@@ -3127,6 +3181,7 @@ void initProofStruct(struct pip_struct *proofStruct, const nmbrString *proof,
 
   // Assign initial proof structure
   if (nmbrLen((*proofStruct).proof)) bug(1876); // Should've been deallocated
+  if (proofStruct == &g_ProofInProgress) pipIndexValid = 0;
   nmbrLet(&((*proofStruct).proof), tmpProof);
   plen = nmbrLen((*proofStruct).proof);
   pntrLet(&((*proofStruct).target), pntrNSpace(plen));
@@ -3161,6 +3216,7 @@ void initProofStruct(struct pip_struct *proofStruct, const nmbrString *proof,
 void deallocProofStruct(struct pip_struct *proofStruct)
 {
   long proofLen, j;
+  if (proofStruct == &g_ProofInProgress) pipIndexValid = 0;
   // Deallocate proof structure
   proofLen = nmbrLen(proofStruct->proof);
   if (proofLen == 0) return; // Already deallocated
@@ -3176,12 +3232,156 @@ void deallocProofStruct(struct pip_struct *proofStruct)
   return;
 } // deallocProofStruct
 
+// A proof step saved in the UNDO stack.  A step that is unchanged from one
+// UNDO level to the next is shared by both levels rather than copied, so
+// pushing a level only allocates the steps that changed.
+struct undoStep_struct {
+  long refCount; // Number of UNDO levels using this step
+  nmbrString *target;
+  nmbrString *source;
+  nmbrString *user;
+};
+
+// One level of the UNDO stack
+struct undoLevel_struct {
+  nmbrString *proof;
+  struct undoStep_struct **steps; // One per proof step
+};
+
+// Return 1 if step of proofStruct is the same as undo step undoStep of
+// level
+static flag undoStepEq(const struct pip_struct *proofStruct, long step,
+    const struct undoLevel_struct *level, long undoStep)
+{
+  const struct undoStep_struct *u = level->steps[undoStep];
+  return (flag)(proofStruct->proof[step] == level->proof[undoStep]
+      && nmbrEq(proofStruct->target[step], u->target)
+      && nmbrEq(proofStruct->source[step], u->source)
+      && nmbrEq(proofStruct->user[step], u->user));
+} // undoStepEq
+
+// Make level a snapshot of proofStruct, sharing the steps that are the same
+// as in prevLevel (which may be NULL).  The steps before and after the part
+// of the proof that changed are matched up with those of prevLevel, and
+// inside that part steps are matched by position.
+static void pushUndoLevel(struct undoLevel_struct *level,
+    const struct pip_struct *proofStruct,
+    const struct undoLevel_struct *prevLevel)
+{
+  long plen, prevLen, prefix, suffix, step, prevStep;
+  struct undoStep_struct *u;
+
+  plen = nmbrLen(proofStruct->proof);
+  // An empty proof should never occur here; proof should have at least
+  // one step (possibly unknown).
+  if (plen == 0) bug(1884);
+  if (plen != pntrLen(proofStruct->target)) bug(1885);
+  if (plen != pntrLen(proofStruct->source)) bug(1886);
+  if (plen != pntrLen(proofStruct->user)) bug(1887);
+  if (level->proof != NULL_NMBRSTRING) bug(1881); // Should've been freed
+  nmbrLet(&level->proof, proofStruct->proof);
+  level->steps = malloc((size_t)plen * sizeof(struct undoStep_struct *));
+  if (!level->steps) outOfMemory("#126 (undo stack)");
+
+  prevLen = prevLevel ? nmbrLen(prevLevel->proof) : 0;
+  prefix = 0;
+  while (prefix < plen && prefix < prevLen
+      && undoStepEq(proofStruct, prefix, prevLevel, prefix)) {
+    prefix++;
+  }
+  suffix = 0;
+  while (suffix < plen - prefix && suffix < prevLen - prefix
+      && undoStepEq(proofStruct, plen - 1 - suffix,
+          prevLevel, prevLen - 1 - suffix)) {
+    suffix++;
+  }
+
+  for (step = 0; step < plen; step++) {
+    if (step < prefix) {
+      prevStep = step;
+    } else if (step >= plen - suffix) {
+      prevStep = step - plen + prevLen;
+    } else if (step < prevLen - suffix
+        && undoStepEq(proofStruct, step, prevLevel, step)) {
+      prevStep = step;
+    } else {
+      prevStep = -1; // The step changed
+    }
+    if (prevStep != -1) {
+      u = prevLevel->steps[prevStep];
+      u->refCount++;
+    } else {
+      u = malloc(sizeof(struct undoStep_struct));
+      if (!u) outOfMemory("#127 (undo stack)");
+      u->refCount = 1;
+      u->target = NULL_NMBRSTRING;
+      u->source = NULL_NMBRSTRING;
+      u->user = NULL_NMBRSTRING;
+      nmbrLet(&u->target, proofStruct->target[step]);
+      nmbrLet(&u->source, proofStruct->source[step]);
+      nmbrLet(&u->user, proofStruct->user[step]);
+    }
+    level->steps[step] = u;
+  }
+} // pushUndoLevel
+
+// Copy an UNDO level into proofStruct
+static void restoreUndoLevel(struct pip_struct *proofStruct,
+    const struct undoLevel_struct *level)
+{
+  long plen, step;
+
+  // First, make sure the output structure is empty to prevent memory leaks.
+  deallocProofStruct(proofStruct);
+  plen = nmbrLen(level->proof);
+  if (plen == 0) bug(1882);
+  nmbrLet(&proofStruct->proof, level->proof);
+  pntrLet(&proofStruct->target, pntrNSpace(plen));
+  pntrLet(&proofStruct->source, pntrNSpace(plen));
+  pntrLet(&proofStruct->user, pntrNSpace(plen));
+  for (step = 0; step < plen; step++) {
+    nmbrLet((nmbrString **)(&proofStruct->target[step]),
+        level->steps[step]->target);
+    nmbrLet((nmbrString **)(&proofStruct->source[step]),
+        level->steps[step]->source);
+    nmbrLet((nmbrString **)(&proofStruct->user[step]),
+        level->steps[step]->user);
+  }
+} // restoreUndoLevel
+
+// Deallocate an UNDO level, and the steps no other level shares
+static void freeUndoLevel(struct undoLevel_struct *level)
+{
+  long plen, step;
+  struct undoStep_struct *u;
+
+  plen = nmbrLen(level->proof);
+  for (step = 0; step < plen; step++) {
+    u = level->steps[step];
+    u->refCount--;
+    if (u->refCount < 0) bug(1883);
+    if (u->refCount == 0) {
+      free_nmbrString(u->target);
+      free_nmbrString(u->source);
+      free_nmbrString(u->user);
+      free(u);
+    }
+  }
+  free(level->steps);
+  level->steps = NULL;
+  free_nmbrString(level->proof);
+} // freeUndoLevel
+
 #define DEFAULT_UNDO_STACK_SIZE 20
 // This function handles the UNDO/REDO commands.  It is called
 // with action PUS_INIT then with PUS_PUSH upon entering MM-PA.  It is
 // called with PUS_INIT upon exiting MM-PA.  It should be called with
 // PUS_PUSH after every command changing the proof.
 //
+// Each stack entry is a snapshot of the proof in progress.  Proof steps
+// that didn't change since the previous entry are shared with it (see
+// pushUndoLevel()), so a PUS_PUSH only copies the steps that changed.
+//
 // PUS_UNDO and PUS_REDO are called by the UNDO and REDO CLI commands.
 //
 // PUS_NEW_SIZE is called by the SET UNDO command to change the size
@@ -3219,7 +3419,7 @@ long processUndoStack(struct pip_struct *proofStruct,
     long newSize) // New maximum number of UNDOs for PUS_NEW_SIZE
 {
 
-  static struct pip_struct *proofStack = NULL;
+  static struct undoLevel_struct *proofStack = NULL;
   static pntrString_def(infoStack); // UNDO/REDO command info
   static long stackSize = DEFAULT_UNDO_STACK_SIZE; // Change w/ SET UNDO
   static long stackEnd = -1;
@@ -3236,13 +3436,12 @@ long processUndoStack(struct pip_struct *proofStruct,
 
   if (firstTime == 1) { // First time ever called
     firstTime = 0;
-    proofStack = malloc((size_t)(stackSize) * sizeof(struct pip_struct));
+    proofStack = malloc((size_t)(stackSize)
+        * sizeof(struct undoLevel_struct));
     if (!proofStack) bug(1859);
     for (i = 0; i < stackSize; i++) { // Set to empty proofs
       proofStack[i].proof = NULL_NMBRSTRING;
-      proofStack[i].target = NULL_PNTRSTRING;
-      proofStack[i].source = NULL_PNTRSTRING;
-      proofStack[i].user = NULL_PNTRSTRING;
+      proofStack[i].steps = NULL;
     }
     pntrLet(&infoStack, pntrSpace(stackSize)); // Set to empty vstrings
   }
@@ -3258,7 +3457,7 @@ long processUndoStack(struct pip_struct *proofStruct,
     case PUS_NEW_SIZE:
       // Deallocate old contents
       for (i = 0; i <= stackEnd; i++) {
-        deallocProofStruct(&proofStack[i]);
+        freeUndoLevel(&proofStack[i]);
         free_vstring(*(vstring *)(&infoStack[i]));
       }
 
@@ -3290,13 +3489,12 @@ long processUndoStack(struct pip_struct *proofStruct,
       // Reinitialize new stack
       stackSize = newSize + 1;
       if (stackSize < 1) bug(1867);
-      proofStack = malloc((size_t)(stackSize) * sizeof(struct pip_struct));
+      proofStack = malloc((size_t)(stackSize)
+          * sizeof(struct undoLevel_struct));
       if (!proofStack) bug(1861);
       for (i = 0; i < stackSize; i++) { // Set to empty proofs
         proofStack[i].proof = NULL_NMBRSTRING;
-        proofStack[i].target = NULL_PNTRSTRING;
-        proofStack[i].source = NULL_PNTRSTRING;
-        proofStack[i].user = NULL_PNTRSTRING;
+        proofStack[i].steps = NULL;
       }
       pntrLet(&infoStack, pntrSpace(stackSize)); // Set to empty vstrings
       break;
@@ -3309,7 +3507,7 @@ long processUndoStack(struct pip_struct *proofStruct,
       // Any new command after UNDO should erase the REDO part
       if (stackPtr < stackEnd) {
         for (i = stackPtr + 1; i <= stackEnd; i++) {
-          deallocProofStruct(&(proofStack[i]));
+          freeUndoLevel(&(proofStack[i]));
           free_vstring(*(vstring *)(&infoStack[i]));
         }
         stackEnd = stackPtr;
@@ -3319,24 +3517,18 @@ long processUndoStack(struct pip_struct *proofStruct,
       // down to make room for new stack entry.
       if (stackPtr == stackSize - 1) {
         stackOverflowed = 1; // To  modify user message if UNDO exhausted
-        deallocProofStruct(&(proofStack[0])); // Deallocate the bottom entry
+        freeUndoLevel(&(proofStack[0])); // Deallocate the bottom entry
         free_vstring(*(vstring *)(&(infoStack[0])));
         for (i = 0; i < stackSize - 1; i++) {
-          // Instead of "copyProofStruct(&(proofStack[i]), proofStack[i + 1]);
-          // (which involves de/reallocation), copy the pointers directly
-          // for improved speed.
-          proofStack[i].proof = proofStack[i + 1].proof;
-          proofStack[i].target = proofStack[i + 1].target;
-          proofStack[i].source = proofStack[i + 1].source;
-          proofStack[i].user = proofStack[i + 1].user;
+          // Copy the pointers directly rather than the contents, for
+          // improved speed.
+          proofStack[i] = proofStack[i + 1];
           infoStack[i] = infoStack[i + 1];
         }
         // Now initialize the top of the stack pointers (don't deallocate since
         // its old contents are pointed to by the next one down).
         proofStack[stackPtr].proof = NULL_NMBRSTRING;
-        proofStack[stackPtr].target = NULL_PNTRSTRING;
-        proofStack[stackPtr].source = NULL_PNTRSTRING;
-        proofStack[stackPtr].user = NULL_PNTRSTRING;
+        proofStack[stackPtr].steps = NULL;
         infoStack[stackPtr] = "";
         stackPtr--;
         stackEnd--;
@@ -3347,7 +3539,8 @@ long processUndoStack(struct pip_struct *proofStruct,
       stackPtr++;
       stackEnd++;
       if (stackPtr != stackEnd) bug(1863);
-      copyProofStruct(&(proofStack[stackPtr]), *proofStruct);
+      pushUndoLevel(&(proofStack[stackPtr]), proofStruct,
+          stackPtr > 0 ? &(proofStack[stackPtr - 1]) : NULL);
       let((vstring *)(&(infoStack[stackPtr])), info);
       break;
 
@@ -3370,7 +3563,7 @@ long processUndoStack(struct pip_struct *proofStruct,
               NULL), "", " ");
       stackPtr--;
       // Restore the version of the proof before that action
-      copyProofStruct(&(*proofStruct), proofStack[stackPtr]);
+      restoreUndoLevel(proofStruct, &(proofStack[stackPtr]));
       break;
 
     case PUS_REDO:
@@ -3382,7 +3575,7 @@ long processUndoStack(struct pip_struct *proofStruct,
       // Move up stack pointer and return its entry.
       stackPtr++;
       // Restore the last undo and print the message for its action
-      copyProofStruct(&(*proofStruct), proofStack[stackPtr]);
+      restoreUndoLevel(proofStruct, &(proofStack[stackPtr]));
       printLongLine(cat("Redid:  ", infoStack[stackPtr],
               NULL), "", " ");
       break;
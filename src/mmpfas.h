@@ -11,11 +11,17 @@
 
 #include "mmvstr.h"
 #include "mmdata.h"
+#include "mmunif.h"
 
 extern long g_proveStatement; /*!< The statement to be proved */
 extern flag g_proofChangedFlag; /*!< Flag to push 'undo' stack */
 
 extern long g_userMaxProveFloat; /*!< Upper limit for proveFloating */
+/*! Wall clock time (\ref getWallTime) at which the searches of IMPROVE and
+   MINIMIZE_WITH give up (/ BUDGET); 0 means no limit */
+extern double g_pfasDeadline;
+extern long g_quickMatchRejects; /*!< Statements quickMatchFilter() rejected */
+extern long g_unifCandidates; /*!< Statements whose unification was tried */
 
 extern long g_dummyVars; /*!< The number of dummy variables currently declared */
 extern long g_pipDummyVars; /*!< Number of dummy vars used by proof in progress */
@@ -122,6 +128,10 @@ nmbrString *proveFloating(const nmbrString *mString, long statemNum, long maxEDe
     flag mathboxFlag /*!< 1 means allow mathboxes */
 );
 
+/*! Returns 1 if \ref g_pfasDeadline has passed, 0 if there is time left or
+   no limit */
+flag pfasTimeUp(void);
+
 /*! This function does quick check for some common conditions that prevent
    a trial statement (scheme) from being unified with a given instance.
    Return value 0 means it can't be unified, 1 means it might be unifiable. */
@@ -156,14 +166,14 @@ void interactiveUnifyStep(long step, char messageFlag);
            * 2 = unification timed out
            * 3 = no unification was selected */
 char interactiveUnify(const nmbrString *schemeA, const nmbrString *schemeB,
-    pntrString **stateVector);
+    struct unifState_struct **stateVector);
 
 /*! Automatically unify steps with unique unification */
 void autoUnify(flag congrats);
 
 /*! Make stateVector substitutions in all steps.  The stateVector must
    contain the result of a valid unification. */
-void makeSubstAll(pntrString *stateVector);
+void makeSubstAll(struct unifState_struct *stateVector);
 
 /*! Replace a dummy variable with a user-specified math string */
 void replaceDummyVar(long dummyVar, const nmbrString *mString);
@@ -171,6 +181,10 @@ void replaceDummyVar(long dummyVar, const nmbrString *mString);
 /*! Get subproof length of a proof, starting at endStep and going backwards */
 long subproofLen(const nmbrString *proof, long endStep);
 
+/*! Get subproof length of g_ProofInProgress.proof, starting at endStep and
+   going backwards, using its proof structure index */
+long pipSubproofLen(long endStep);
+
 /*! If testStep has no dummy variables, return 0;
    if testStep has isolated dummy variables (that don't affect rest of
    proof), return 1;
@@ -8,6 +8,8 @@
 #include <stdbool.h>
 #include "mmtest.h"
 #include "mmfatl.h"
+#include "mmvstr.h"
+#include "mmdata.h"
 
 /*!
  * \file mmtest.c an implementation of a simple regression test framework
@@ -29,6 +31,7 @@ void runTest(bool (*test)(), const char* funcName, const char* testName) {
 
 void runTests(void) {
   test_mmfatl();
+  test_mmdata();
   exit(g_testFailed ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
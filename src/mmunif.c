@@ -7,96 +7,37 @@
 // mmunif.c - Unifications for proof assistant (note: unifications for normal
 // proof verification is done in mmveri.c).
 
-// This module deals with an object called the stateVector, which is a pntrString
-// of 16 pointers (called entries 0 through 15 below) to either other pntrStrings
-// or to nmbrStrings.  In the description, data in stateVector may be referred to
-// by the local C variable the data is typically assigned to, such as
-// "unkVarsLen".  The word "variable" in the context of scheme content refers
-// to temporary (or "work" or "dummy") variables $1, $2, etc.  The entries are not
-// organized in logical order for historical reasons, e.g. entry 11 logically
-// comes first.
+// This module deals with an object called the stateVector, which is a
+// struct unifState_struct (see mmunif.h) holding the state of a unification
+// between calls to unify().  The word "variable" in the context of scheme
+// content refers to temporary (or "work" or "dummy") variables $1, $2, etc.
 //
-// Entry 11 is a nmbrString of length 4 holding individual parameters.
+// unifiedScheme is the result of unifying schemeA and schemeB.  In
+// stackUnkVar, stackUnkVarStart and stackUnkVarLen, only variables 0 through
+// stackTop (inclusive) have meaning.  They determine what variables were
+// substituted and their substitutions:  stackUnkVar is the list of variables
+// that were substituted, stackUnkVarStart is the location of the
+// substitution in unifiedScheme for each variable, and stackUnkVarLen is the
+// length of the substitution.
 //
-// 11[0] is the total number of variables ($1, $2, etc.) in schemeA and schemeB,
-// i.e. the two schemes being unified.
+// The "undo trail" holds the data needed to resume unification at any point.
+// When a variable is put on the stack at level stackTop, the current
+// stackUnkVarStart, stackUnkVarLen, and schemes A and B (with the
+// substitutions made so far) are saved for that level.  Backtracking copies
+// them back into the same buffers, so no memory is allocated once the
+// buffers have grown to the needed size.  The trail entries for the scheme
+// copies are appended one after another to a single buffer, and popping a
+// level discards the entries after it.
 //
-//   unkVarsLen = ((nmbrString *)((*stateVector)[11]))[0];
+// oldStackUnkVarStart and oldStackUnkVarLen save stackUnkVarStart and
+// stackUnkVarLen in oneDirUnif() (only).
 //
-// 11[1] or stackTop is the number of variables (minus 1) that will require
-// substitutions in order to perform the unification.  Warning:  stackTop may be
-// -1, which could be confused with "end of nmbrString" by some nmbrString
-// functions.
-//
-//   stackTop = ((nmbrString *)((*stateVector)[11]))[1];
-//
-// 11[2] is the number of variables in schemeA, used by oneDirUnif() (only).
-//
-//   schemeAUnkVarsLen = ((nmbrString *)((*stateVector)[11]))[2];
-//
-// 11[3] is the number of entries in the "Henty filter", used by unifyH() (only).
-//
-//   g_hentyFilterSize = ((nmbrString *)((*stateVector)[11]))[3];
-//
-// Entry 8 is the result of unifying schemeA and schemeB, which are the two
-// schemes being unified.
-//
-//   unifiedScheme = (nmbrString *)((*stateVector)[8]);
-//
-// Entries 0 through 3 each have length unkVarsLen.  Entry 1 is a list of token
-// numbers for the temporary variables substituted in the unification.
-//
-// Entry 0 has all variables ($1, $2, etc.) in schemeA and schemeB.
-//
-//   unkVars = (nmbrString *)((*stateVector)[0]);
-//
-// In entries 1 through 3, only variables 0 through stackTop (inclusive) have
-// meaning.  These entries, along with unifiedScheme, determine what variables
-// were substituted and there substitutions.
-//
-// Entry 1 is the list of variables that were substituted.
-// Entry 2 is the location of the substitution in unifiedScheme, for each variable
-// in entry 1.
-// Entry 3 is the length of the substitution for each variable in entry 1.
-//
-//   stackUnkVar = (nmbrString *)((*stateVector)[1]);
-//   stackUnkVarStart = (nmbrString *)((*stateVector)[2]);
-//   stackUnkVarLen = (nmbrString *)((*stateVector)[3]);
-//
-// Entries 4 thru 7 each point to unkVarsLen nmbrString's.  These entries save the
-// data needed to resume unification at any point.  Entries 4 and 5 are
-// nmbrString's of length unkVarsLen.  Entries 6 and 7 will have variable length.
-// Only the first stackTop+1 nmbrString's have meaning.  Note that stackTop may be
-// -1.
-//
-//   stackSaveUnkVarStart = (pntrString *)((*stateVector)[4]);
-//   stackSaveUnkVarLen = (pntrString *)((*stateVector)[5]);
-//   stackSaveSchemeA = (pntrString *)((*stateVector)[6]);
-//   stackSaveSchemeB = (pntrString *)((*stateVector)[7]);
-//
-// Entries 9 and 10 save the contents of 2 and 3 in oneDirUnif (only)
-//
-//   nmbrLet((nmbrString **)(&(*stateVector)[9]),
-//       (nmbrString *)((*stateVector)[2]));
-//   nmbrLet((nmbrString **)(&(*stateVector)[10]),
-//       (nmbrString *)((*stateVector)[3]));
-//
-// Entries 12 through 15 hold the "Henty filter", i.e. a list of all "normalized"
-// unifications so far.  Used by unifyH() (only).  Each entry 12 through 15 is a
-// list of pointers of length g_hentyFilterSize, each pointing to g_hentyFilterSize
-// nmbrString's.  The Henty filter eliminates redundant equivalent unifications.
-//
-// Entry 12[i] is a list of variables substituted by the normalized unification.
-// Entry 13[i] is the start of each substitution in hentySubstList.
-// Entry 14[i] is the length of each substitution in hentySubstList.
-// Entry 15[i] is the unified scheme that resulted from the particular unification.
-// Note:  i = 0 through g_hentyFilterSize-1 below.
-//
-//   hentyVars = (nmbrString *)(((pntrString *)((*stateVector)[12]))[i]);
-//   hentyVarStart = (nmbrString *)(((pntrString *)((*stateVector)[13]))[i]);
-//   hentyVarLen = (nmbrString *)(((pntrString *)((*stateVector)[14]))[i]);
-//   hentySubstList = (nmbrString *)(((pntrString *)((*stateVector)[15]))[i]);
+// The "Henty filter" hentyKeys is a set of all "normalized" unifications so
+// far, used by unifyH() (only), and hashed by hentyTable.  The Henty filter
+// eliminates redundant equivalent unifications.
 
+#include <stdlib.h>
+#include <string.h>
 #include "mmvstr.h"
 #include "mmdata.h"
 #include "mminou.h"
@@ -117,22 +58,22 @@ long g_minSubstLen = 1;
 long g_userMaxUnifTrials = 100000; // Initial value
 long g_unifTrialCount = 0; // 0 means don't time out; 1 means start counting trials.
 long g_unifTimeouts = 0; // Number of timeouts so far for this command.
+// User-defined upper limit in wall clock seconds for one unification
+// (SET UNIFICATION_TIMEOUT ... / SECONDS); 0 means no limit.
+long g_userMaxUnifSeconds = 0;
 flag g_hentyFilter = 1; // Default to ON (turn OFF for debugging).
+// Search statistics for SET PROFILE
+long g_unifBacktracks = 0; // Backtracks of unify()
+long g_hentyRejects = 0; // Unifications discarded by the Henty filter
+// Wall clock time of the first backtrack since g_unifTrialCount was reset
+static double unifStartTime = 0;
 flag g_bracketMatchInit = 0; // Global so eraseSource() (mmcmds.c) can clear it.
 
 // Additional local prototypes
-void hentyNormalize(nmbrString **hentyVars, nmbrString **hentyVarStart,
-    nmbrString **hentyVarLen, nmbrString **hentySubstList,
-    pntrString **stateVector);
-flag hentyMatch(
-    nmbrString *hentyVars,
-    nmbrString *hentyVarStart,
-    // nmbrString *hentyVarLen,
-    nmbrString *hentySubstList,
-    pntrString **stateVector);
-void hentyAdd(nmbrString *hentyVars, nmbrString *hentyVarStart,
-    nmbrString *hentyVarLen, nmbrString *hentySubstList,
-    pntrString **stateVector);
+void hentyNormalize(nmbrString **hentyKey,
+    struct unifState_struct **stateVector);
+flag hentyMatch(nmbrString *hentyKey, struct unifState_struct **stateVector);
+void hentyAdd(nmbrString *hentyKey, struct unifState_struct **stateVector);
 
 // For heuristics
 int maxNestingLevel = -1;
@@ -143,6 +84,265 @@ nmbrString_def(g_firstConst);
 nmbrString_def(g_lastConst);
 nmbrString_def(g_oneConst);
 
+// Return a (temporary) nmbrString copy of a unification buffer for printing
+static temp_nmbrString *unifBufToNmbr(const nmbrString *buf)
+{
+  long len = 0;
+  temp_nmbrString *result;
+  while (buf[len] != -1) len++;
+  result = nmbrSpace(len);
+  memcpy(result, buf, (size_t)len * sizeof(nmbrString));
+  return result;
+} // unifBufToNmbr
+
+// Make sure the unification buffer *buf has room for need elements plus a
+// -1 terminator.  There is also a -1 guard element before the buffer, which
+// may be read by the overflow checks in unify() when a substitution of
+// length 0 starts at the beginning of a scheme.
+static void growUnifBuf(nmbrString **buf, long *alloc, long need)
+{
+  nmbrString *base;
+  long newAlloc;
+
+  if (need + 2 <= *alloc) return;
+  newAlloc = 2 * (*alloc);
+  if (newAlloc < need + 2) newAlloc = need + 2;
+  base = (*buf == NULL) ? NULL : *buf - 1;
+  base = realloc(base, (size_t)newAlloc * sizeof(nmbrString));
+  if (!base) outOfMemory("#119 (unification buffer)");
+  base[0] = -1; // Guard element
+  *buf = base + 1;
+  *alloc = newAlloc;
+} // growUnifBuf
+
+static void freeUnifBuf(nmbrString **buf, long *alloc)
+{
+  if (*buf != NULL) free(*buf - 1);
+  *buf = NULL;
+  *alloc = 0;
+} // freeUnifBuf
+
+// Allocate the per-variable arrays of a stateVector for vars variables.  Their
+// contents are not preserved.
+static void allocUnifVars(struct unifState_struct *stateVector, long vars)
+{
+  if (vars < 1) vars = 1; // So malloc() doesn't return NULL
+  if (vars <= stateVector->varsAlloc) return;
+  free(stateVector->stackUnkVar);
+  free(stateVector->stackUnkVarStart);
+  free(stateVector->stackUnkVarLen);
+  free(stateVector->oldStackUnkVarStart);
+  free(stateVector->oldStackUnkVarLen);
+  free(stateVector->trailVarStart);
+  free(stateVector->trailVarLen);
+  free(stateVector->trailSchemeStart);
+  free(stateVector->trailSchemeALen);
+  free(stateVector->trailSchemeBLen);
+  stateVector->stackUnkVar = malloc((size_t)vars * sizeof(nmbrString));
+  stateVector->stackUnkVarStart = malloc((size_t)vars * sizeof(long));
+  stateVector->stackUnkVarLen = malloc((size_t)vars * sizeof(long));
+  stateVector->oldStackUnkVarStart = malloc((size_t)vars * sizeof(long));
+  stateVector->oldStackUnkVarLen = malloc((size_t)vars * sizeof(long));
+  stateVector->trailVarStart = malloc((size_t)(vars * vars) * sizeof(long));
+  stateVector->trailVarLen = malloc((size_t)(vars * vars) * sizeof(long));
+  stateVector->trailSchemeStart = malloc((size_t)vars * sizeof(long));
+  stateVector->trailSchemeALen = malloc((size_t)vars * sizeof(long));
+  stateVector->trailSchemeBLen = malloc((size_t)vars * sizeof(long));
+  if (!stateVector->stackUnkVar || !stateVector->stackUnkVarStart
+      || !stateVector->stackUnkVarLen || !stateVector->oldStackUnkVarStart
+      || !stateVector->oldStackUnkVarLen || !stateVector->trailVarStart
+      || !stateVector->trailVarLen || !stateVector->trailSchemeStart
+      || !stateVector->trailSchemeALen || !stateVector->trailSchemeBLen) {
+    outOfMemory("#120 (stateVector)");
+  }
+  stateVector->varsAlloc = vars;
+} // allocUnifVars
+
+// Discard the unifications in the Henty filter of a stateVector
+static void clearHentyFilter(struct unifState_struct *stateVector)
+{
+  long i, k;
+  k = pntrLen(stateVector->hentyKeys);
+  for (i = 0; i < k; i++) {
+    free_nmbrString(*(nmbrString **)(&stateVector->hentyKeys[i]));
+  }
+  free_pntrString(stateVector->hentyKeys);
+  free(stateVector->hentyTable);
+  stateVector->hentyTable = NULL;
+  stateVector->hentyTableSize = 0;
+} // clearHentyFilter
+
+// Allocate an empty stateVector
+static struct unifState_struct *newStateVector(void)
+{
+  struct unifState_struct *stateVector;
+  stateVector = malloc(sizeof(struct unifState_struct));
+  if (!stateVector) outOfMemory("#121 (stateVector)");
+  memset(stateVector, 0, sizeof(struct unifState_struct));
+  stateVector->stackTop = -1;
+  stateVector->unifiedScheme = NULL_NMBRSTRING;
+  stateVector->hentyKeys = NULL_PNTRSTRING;
+  return stateVector;
+} // newStateVector
+
+// Save the current state in the undo trail for stack level stackTop
+static void pushUnifTrail(struct unifState_struct *stateVector,
+    long stackTop)
+{
+  long start;
+  long *row;
+
+  row = stateVector->trailVarStart + stackTop * stateVector->varsAlloc;
+  memcpy(row, stateVector->stackUnkVarStart,
+      (size_t)(stackTop + 1) * sizeof(long));
+  row = stateVector->trailVarLen + stackTop * stateVector->varsAlloc;
+  memcpy(row, stateVector->stackUnkVarLen,
+      (size_t)(stackTop + 1) * sizeof(long));
+  if (stackTop == 0) {
+    start = 0;
+  } else {
+    start = stateVector->trailSchemeStart[stackTop - 1]
+        + stateVector->trailSchemeALen[stackTop - 1]
+        + stateVector->trailSchemeBLen[stackTop - 1];
+  }
+  growUnifBuf(&stateVector->trailSchemes, &stateVector->trailSchemesAlloc,
+      start + stateVector->schALen + stateVector->schBLen);
+  memcpy(stateVector->trailSchemes + start, stateVector->schA,
+      (size_t)stateVector->schALen * sizeof(nmbrString));
+  memcpy(stateVector->trailSchemes + start + stateVector->schALen,
+      stateVector->schB, (size_t)stateVector->schBLen * sizeof(nmbrString));
+  stateVector->trailSchemeStart[stackTop] = start;
+  stateVector->trailSchemeALen[stackTop] = stateVector->schALen;
+  stateVector->trailSchemeBLen[stackTop] = stateVector->schBLen;
+} // pushUnifTrail
+
+// Restore schemes A and B saved in the undo trail for stack level stackTop
+static void restoreUnifTrail(struct unifState_struct *stateVector,
+    long stackTop)
+{
+  long start, lenA, lenB;
+
+  start = stateVector->trailSchemeStart[stackTop];
+  lenA = stateVector->trailSchemeALen[stackTop];
+  lenB = stateVector->trailSchemeBLen[stackTop];
+  growUnifBuf(&stateVector->schA, &stateVector->schAAlloc, lenA);
+  growUnifBuf(&stateVector->schB, &stateVector->schBAlloc, lenB);
+  memcpy(stateVector->schA, stateVector->trailSchemes + start,
+      (size_t)lenA * sizeof(nmbrString));
+  memcpy(stateVector->schB, stateVector->trailSchemes + start + lenA,
+      (size_t)lenB * sizeof(nmbrString));
+  stateVector->schA[lenA] = -1;
+  stateVector->schB[lenB] = -1;
+  stateVector->schALen = lenA;
+  stateVector->schBLen = lenB;
+} // restoreUnifTrail
+
+// Set a unification scheme buffer to scheme with the end-of-scheme token
+// g_mathTokens added
+static void setUnifScheme(nmbrString **buf, long *alloc, long *len,
+    const nmbrString *scheme, long schemeLen)
+{
+  growUnifBuf(buf, alloc, schemeLen + 1);
+  memcpy(*buf, scheme, (size_t)schemeLen * sizeof(nmbrString));
+  (*buf)[schemeLen] = g_mathTokens;
+  (*buf)[schemeLen + 1] = -1;
+  *len = schemeLen + 1;
+} // setUnifScheme
+
+// Copy the substitution of length substLen at position p in sch (of length
+// schLen) to the substitution buffer of the stateVector
+static void setUnifSubstitution(struct unifState_struct *stateVector,
+    const nmbrString *sch, long schLen, long p, long substLen)
+{
+  if (substLen > schLen - p) substLen = schLen - p;
+  if (substLen < 0) substLen = 0;
+  growUnifBuf(&stateVector->substitution, &stateVector->substitutionAlloc,
+      substLen);
+  memcpy(stateVector->substitution, sch + p,
+      (size_t)substLen * sizeof(nmbrString));
+  stateVector->substitution[substLen] = -1;
+  stateVector->substitutionLen = substLen;
+} // setUnifSubstitution
+
+// Substitute all occurrences of substToken in scheme A (if schemeAFlag is 1)
+// or B with the substitution in the stateVector.  If adjustFlag is 1 (the
+// token was taken from this scheme), adjust the scan position *p and the
+// starts and lengths of the earlier variable assignments.
+static void substituteUnifScheme(struct unifState_struct *stateVector,
+    flag schemeAFlag, long substToken, flag adjustFlag, long *p,
+    long stackTop)
+{
+  nmbrString *sch, *out, *tmp;
+  long *schLen, *schAlloc;
+  long *stackUnkVarStart = stateVector->stackUnkVarStart;
+  long *stackUnkVarLen = stateVector->stackUnkVarLen;
+  long j = stateVector->substitutionLen;
+  long i, k, q, v, count, alloc;
+
+  if (schemeAFlag) {
+    sch = stateVector->schA;
+    schLen = &stateVector->schALen;
+    schAlloc = &stateVector->schAAlloc;
+  } else {
+    sch = stateVector->schB;
+    schLen = &stateVector->schBLen;
+    schAlloc = &stateVector->schBAlloc;
+  }
+  count = 0;
+  for (i = 0; i < *schLen; i++) {
+    if (sch[i] == substToken) count++;
+  }
+  if (!count) return;
+  growUnifBuf(&stateVector->schTmp, &stateVector->schTmpAlloc,
+      *schLen + count * (j - 1));
+  out = stateVector->schTmp;
+  q = 0;
+  for (i = 0; i < *schLen; i++) {
+    if (sch[i] != substToken) {
+      out[q] = sch[i];
+      q++;
+      continue;
+    }
+    if (adjustFlag) {
+      // k is the position (starting at 1) of the token in the scheme
+      // with the substitutions so far
+      k = q + 1;
+      // Adjust position and earlier var. starts and lengths
+      if (k - 1 <= *p) {
+        if (k <= *p) {
+          // Adjust assignments in stack
+          for (v = 0; v <= stackTop; v++) {
+            if (k - 1 < stackUnkVarStart[v]) {
+              stackUnkVarStart[v] = stackUnkVarStart[v] + j - 1;
+            } else {
+              if (k <= stackUnkVarStart[v] +
+                  stackUnkVarLen[v]) {
+                stackUnkVarLen[v] = stackUnkVarLen[v] + j - 1;
+              }
+            }
+          }
+        }
+        *p = *p + j - 1; // Adjust scan position
+      }
+    }
+    memcpy(out + q, stateVector->substitution, (size_t)j * sizeof(nmbrString));
+    q = q + j;
+  }
+  out[q] = -1;
+  // Swap the scheme and the work space
+  tmp = sch;
+  alloc = *schAlloc;
+  if (schemeAFlag) {
+    stateVector->schA = out;
+  } else {
+    stateVector->schB = out;
+  }
+  *schAlloc = stateVector->schTmpAlloc;
+  stateVector->schTmp = tmp;
+  stateVector->schTmpAlloc = alloc;
+  *schLen = q;
+} // substituteUnifScheme
+
 // Typical call:
 //   nmbrStringXxx = makeSubstUnif(&newVarFlag,trialScheme,
 //       stateVector);
@@ -154,25 +354,25 @@ nmbrString_def(g_oneConst);
 //   newVarFlag is 1 if there are new $nn variables in nmbrStringXxx.
 // The caller must deallocate the returned nmbrString.
 nmbrString *makeSubstUnif(flag *newVarFlag,
-    const nmbrString *trialScheme, pntrString *stateVector)
+    const nmbrString *trialScheme, struct unifState_struct *stateVector)
 {
   long p,q,i,j,k,m,tokenNum;
   long schemeLen;
   nmbrString_def(result);
-  nmbrString_def(stackUnkVar);
+  nmbrString *stackUnkVar; // Pointer only - not allocated
   nmbrString *unifiedScheme; // Pointer only - not allocated
-  nmbrString *stackUnkVarLen; // Pointer only - not allocated
-  nmbrString *stackUnkVarStart; // Pointer only - not allocated
+  long *stackUnkVarLen; // Pointer only - not allocated
+  long *stackUnkVarStart; // Pointer only - not allocated
   long stackTop;
 /*E*/long d;
 /*E*/vstring_def(tmpStr);
 /*E*/let(&tmpStr,tmpStr);
 
-  stackTop = ((nmbrString *)(stateVector[11]))[1];
-  nmbrLet(&stackUnkVar,nmbrLeft((nmbrString *)(stateVector[1]), stackTop + 1));
-  stackUnkVarStart = (nmbrString *)(stateVector[2]); // stackUnkVarStart
-  stackUnkVarLen = (nmbrString *)(stateVector[3]); // stackUnkVarLen
-  unifiedScheme = (nmbrString *)(stateVector[8]);
+  stackTop = stateVector->stackTop;
+  stackUnkVar = stateVector->stackUnkVar;
+  stackUnkVarStart = stateVector->stackUnkVarStart;
+  stackUnkVarLen = stateVector->stackUnkVarLen;
+  unifiedScheme = stateVector->unifiedScheme;
 
 /*E*/if(db7)print2("Entered makeSubstUnif.\n");
 /*E*/if(db7)printLongLine(cat("unifiedScheme is ",
@@ -202,7 +402,13 @@ nmbrString *makeSubstUnif(flag *newVarFlag,
     } else {
       if (tokenNum > g_mathTokens) {
         // It's a candidate for substitution
-        m = nmbrElementIn(1,stackUnkVar,tokenNum);
+        m = 0;
+        for (i = 0; i <= stackTop; i++) {
+          if (stackUnkVar[i] == tokenNum) {
+            m = i + 1;
+            break;
+          }
+        }
 /*E*/if(db7)print2("token is %s, m is %ld\n",g_MathToken[tokenNum].tokenName,m);
         if (m) {
           // It will be substituted
@@ -258,15 +464,13 @@ nmbrString *makeSubstUnif(flag *newVarFlag,
 /*E*/if(db7)print2("after newVarFlag %d\n",(int)*newVarFlag);
 /*E*/if(db7)print2("final len is %ld\n",q);
 /*E*/if(db7)printLongLine(cat("result ",nmbrCvtMToVString(result),NULL),""," ");
-  free_nmbrString(stackUnkVar); // Deallocate
   return (result);
 } // makeSubstUnif
 
 char unify(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    // nmbrString **unifiedScheme, // stateVector[8] holds this
-    pntrString **stateVector,
+    struct unifState_struct **stateVector,
     long reEntryFlag)
 {
 
@@ -276,10 +480,9 @@ char unify(
 // found, and 2 if the unification timed out.
 // If reEntryFlag is 1, the next possible set of assignments, if any,
 // is returned.  (*stateVector) contains the state of the previous
-// call.  It is the caller's responsibility to deallocate the
-// contents of (*stateVector) when done, UNLESS a 0 is returned.
-// The caller must assign (*stateVector) to a legal pntrString
-// (e.g. NULL_PNTRSTRING) before calling.
+// call.  It is the caller's responsibility to deallocate
+// (*stateVector) with purgeStateVector() when done, UNLESS a 0 is returned.
+// The caller must assign NULL to (*stateVector) before the first call.
 //
 // All variables with a tokenNum > g_mathTokens are assumed
 // to be "unknown" variables that can be assigned; all other
@@ -290,32 +493,25 @@ char unify(
 // (which is a complex structure, described above).  Some "unknown"
 // variables may have no assignment, in which case they will
 // remain "unknown", and others may have assignments which include
-// "unknown" variables.  The (*stateVector) entries 9 and 10 are used
-// by oneDirUnif() only.
+// "unknown" variables.  The (*stateVector) entries oldStackUnkVarStart and
+// oldStackUnkVarLen are used by oneDirUnif() only.
 
+  struct unifState_struct *st; // Pointer only - same as (*stateVector)
   long stackTop;
   nmbrString *unkVars; // List of all unknown vars
   long unkVarsLen;
-  long schemeAUnkVarsLen;
   nmbrString *stackUnkVar; // Location of stacked var in unkVars
-  nmbrString *stackUnkVarStart; // Start of stacked var in unifiedScheme
-  nmbrString *stackUnkVarLen; // Length of stacked var assignment
-  // stackUnkVarStart at the time a variable was first stacked.
-  pntrString *stackSaveUnkVarStart;
-  // stackUnkVarLen at the time a variable was first stacked.
-  pntrString *stackSaveUnkVarLen;
-  // Pointer to saved schemeA at the time the variable was first stacked.
-  pntrString *stackSaveSchemeA;
-  // Pointer to saved schemeB at the time the variable was first stacked.
-  pntrString *stackSaveSchemeB;
-  nmbrString *unifiedScheme; // Final result
+  long *stackUnkVarStart; // Start of stacked var in unifiedScheme
+  long *stackUnkVarLen; // Length of stacked var assignment
+  long *trailRow; // stackUnkVarLen at the time a variable was first stacked
   long p; // Current position in schemeA or schemeB
   long substToken; // Token from schemeA or schemeB that will be substituted
-  nmbrString_def(substitution); // String to be subst. for substToken
+  nmbrString *substitution; // String to be subst. for substToken
   nmbrString *nmbrTmpPtr; // temp pointer only
-  pntrString *pntrTmpPtr; // temp pointer only
-  nmbrString_def(schA); // schemeA with dummy token at end
-  nmbrString_def(schB); // schemeB with dummy token at end
+  // schemeA and schemeB with dummy token at end; pointers only, to the
+  // buffers in (*stateVector), which move when substitutions are made
+  nmbrString *schA;
+  nmbrString *schB;
   long i,j,k,m, pairingMismatches;
   flag breakFlag;
   flag schemeAFlag;
@@ -365,10 +561,24 @@ char unify(
       }
     }
   }
+  if (!reEntryFlag) {
+    if (*stateVector == NULL) {
+      *stateVector = newStateVector();
+    } else {
+      // Discard the unifications found with the previous schemes
+      clearHentyFilter(*stateVector);
+    }
+  } else {
+    if (*stateVector == NULL) bug(1911); // Nothing to resume
+  }
+  st = *stateVector;
   // Add dummy token to end of schemeA and schemeB.
   // Use one beyond the last mathTokenArray entry for this.
-  nmbrLet(&schA, nmbrAddElement(schemeA, g_mathTokens));
-  nmbrLet(&schB, nmbrAddElement(schemeB, g_mathTokens));
+  setUnifScheme(&st->schA, &st->schAAlloc, &st->schALen, schemeA, j);
+  setUnifScheme(&st->schB, &st->schBAlloc, &st->schBLen, schemeB, k);
+  schA = st->schA;
+  schB = st->schB;
+  substitution = NULL; // Assigned before use
 
   // Initialize the usage of constants as the first, last,
   // only constant in a $a statement - for rejecting some simple impossible
@@ -410,8 +620,8 @@ char unify(
     // Collect the list of "unknown" variables.
     // (Pre-allocate max. length)
     // (Note j and k assignment above)
-    unkVars = NULL_NMBRSTRING;
-    nmbrLet(&unkVars, nmbrSpace(j + k));
+    growUnifBuf(&st->unkVars, &st->unkVarsAlloc, j + k);
+    unkVars = st->unkVars;
     unkVarsLen = 0;
     for (i = 0; i < j; i++) {
       if (schemeA[i] > g_mathTokens) {
@@ -430,7 +640,7 @@ char unify(
       }
     }
     // Save the length of the list of unknown variables in schemeA
-    schemeAUnkVarsLen = unkVarsLen;
+    st->schemeAUnkVarsLen = unkVarsLen; // Used by oneDirUnif()
     for (i = 0; i < k; i++) {
       if (schemeB[i] > g_mathTokens) {
         // It's an "unknown" variable
@@ -448,71 +658,13 @@ char unify(
       }
     }
 
-    // Deallocate old (*stateVector) assignments
-    if (pntrLen(*stateVector)) {
-    // if (((nmbrString *)((*stateVector)[11]))[0] != -1) { // ???Change to nmbrLen?
-      // If (*stateVector) not an empty nmbrString
-      for (i = 4; i <= 7; i++) {
-        pntrTmpPtr = (pntrString *)((*stateVector)[i]);
-        for (j = 0; j < ((nmbrString *)((*stateVector)[11]))[0]; j++) {
-          nmbrLet((nmbrString **)(&pntrTmpPtr[j]),
-              NULL_NMBRSTRING);
-        }
-        pntrLet((pntrString **)(&(*stateVector)[i]),
-            NULL_PNTRSTRING);
-      }
-      for (i = 0; i <= 3; i++) {
-        nmbrLet((nmbrString **)(&(*stateVector)[i]),
-            NULL_NMBRSTRING);
-      }
-      for (i = 8; i <= 10; i++) {
-        nmbrLet((nmbrString **)(&(*stateVector)[i]),
-            NULL_NMBRSTRING);
-      }
-      k = pntrLen((pntrString *)((*stateVector)[12]));
-      for (i = 12; i < 16; i++) {
-        pntrTmpPtr = (pntrString *)((*stateVector)[i]);
-        for (j = 0; j < k; j++) {
-          nmbrLet((nmbrString **)(&pntrTmpPtr[j]),
-              NULL_NMBRSTRING);
-        }
-        pntrLet((pntrString **)(&(*stateVector)[i]),
-            NULL_PNTRSTRING);
-      }
-      // Leave [11] pre-allocated to length 4
-    } else {
-      // It was never allocated before -- do it now
-      // Allocate stateVector - it will be assigned upon exiting
-      pntrLet(&(*stateVector), pntrPSpace(16));
-      nmbrLet((nmbrString **)(&(*stateVector)[11]), nmbrSpace(4));
-    }
-
-    // Pre-allocate the (*stateVector) structure
+    // Allocate the (*stateVector) arrays if they are not big enough
+    st->unkVarsLen = unkVarsLen;
+    allocUnifVars(st, unkVarsLen);
     stackTop = -1;
-    stackUnkVar = NULL_NMBRSTRING;
-    stackUnkVarStart = NULL_NMBRSTRING;
-    stackUnkVarLen = NULL_NMBRSTRING;
-    stackSaveUnkVarStart = NULL_PNTRSTRING;
-    stackSaveUnkVarLen = NULL_PNTRSTRING;
-    stackSaveSchemeA = NULL_PNTRSTRING;
-    stackSaveSchemeB = NULL_PNTRSTRING;
-    unifiedScheme = NULL_NMBRSTRING;
-    nmbrLet(&stackUnkVar, nmbrSpace(unkVarsLen));
-    nmbrLet(&stackUnkVarStart, stackUnkVar);
-    nmbrLet(&stackUnkVarLen, stackUnkVar);
-
-    // These next 4 hold pointers to nmbrStrings
-    pntrLet(&stackSaveUnkVarStart, pntrNSpace(unkVarsLen));
-    pntrLet(&stackSaveUnkVarLen, stackSaveUnkVarStart);
-    pntrLet(&stackSaveSchemeA, stackSaveUnkVarStart);
-    pntrLet(&stackSaveSchemeB, stackSaveUnkVarStart);
-    for (i = 0; i < unkVarsLen; i++) {
-      // Preallocate the stack space for these
-      nmbrLet((nmbrString **)(&stackSaveUnkVarStart[i]),
-          stackUnkVar);
-      nmbrLet((nmbrString **)(&stackSaveUnkVarLen[i]),
-          stackUnkVar);
-    }
+    stackUnkVar = st->stackUnkVar;
+    stackUnkVarStart = st->stackUnkVarStart;
+    stackUnkVarLen = st->stackUnkVarLen;
 
     // Set a flag that the "unknown" variables are not on the stack yet.
     // (Otherwise this will be the position on the stack.)
@@ -524,18 +676,12 @@ char unify(
     // We are re-entering to get the next possible assignment.
 
     // Restore the (*stateVector) variables
-    unkVarsLen = ((nmbrString *)((*stateVector)[11]))[0];
-    unkVars = (nmbrString *)((*stateVector)[0]);
-    stackTop = ((nmbrString *)((*stateVector)[11]))[1];
-    stackUnkVar = (nmbrString *)((*stateVector)[1]);
-    stackUnkVarStart = (nmbrString *)((*stateVector)[2]);
-    stackUnkVarLen = (nmbrString *)((*stateVector)[3]);
-    stackSaveUnkVarStart = (pntrString *)((*stateVector)[4]);
-    stackSaveUnkVarLen = (pntrString *)((*stateVector)[5]);
-    stackSaveSchemeA = (pntrString *)((*stateVector)[6]);
-    stackSaveSchemeB = (pntrString *)((*stateVector)[7]);
-    unifiedScheme = (nmbrString *)((*stateVector)[8]);
-    schemeAUnkVarsLen = ((nmbrString *)((*stateVector)[11]))[2]; // Used by oneDirUnif()
+    unkVarsLen = st->unkVarsLen;
+    unkVars = st->unkVars;
+    stackTop = st->stackTop;
+    stackUnkVar = st->stackUnkVar;
+    stackUnkVarStart = st->stackUnkVarStart;
+    stackUnkVarLen = st->stackUnkVarLen;
 
     // Set the location of the "unknown" variables on the stack.
     // (This may have been corrupted outside this function.)
@@ -556,8 +702,8 @@ char unify(
 
  scan:
 /*E*/if(db6)print2("Entered scan: p=%ld\n",p);
-/*E*/if(db6)print2("Enter scan sbA %s\n",nmbrCvtMToVString(schA));
-/*E*/if(db6)print2("Enter scan sbB %s\n",nmbrCvtMToVString(schB));
+/*E*/if(db6)print2("Enter scan sbA %s\n",nmbrCvtMToVString(unifBufToNmbr(schA)));
+/*E*/if(db6)print2("Enter scan sbB %s\n",nmbrCvtMToVString(unifBufToNmbr(schB)));
 /*E*/if(db6)let(&tmpStr,tmpStr);
   while (schA[p] == schB[p] &&
       schA[p + 1] != -1) {
@@ -634,18 +780,7 @@ char unify(
       // Start with a variable length of 0 or 1
       stackUnkVarLen[stackTop] = g_minSubstLen;
       // Save the rest of the current state for backtracking
-      nmbrTmpPtr = (nmbrString *)(stackSaveUnkVarStart[stackTop]);
-      for (i = 0; i <= stackTop; i++) {
-        nmbrTmpPtr[i] = stackUnkVarStart[i];
-      }
-      nmbrTmpPtr = (nmbrString *)(stackSaveUnkVarLen[stackTop]);
-      for (i = 0; i <= stackTop; i++) {
-        nmbrTmpPtr[i] = stackUnkVarLen[i];
-      }
-      nmbrLet((nmbrString **)(&stackSaveSchemeA[stackTop]),
-          schA);
-      nmbrLet((nmbrString **)(&stackSaveSchemeB[stackTop]),
-          schB);
+      pushUnifTrail(st, stackTop);
     }
 
     if (substToken != stackUnkVar[stackTop]) {
@@ -654,12 +789,11 @@ char unify(
       print2("stackTop %ld\n", stackTop);
       print2("p %ld stackUnkVar[stackTop] %s\n", p,
         g_MathToken[stackUnkVar[stackTop]].tokenName);
-      print2("schA %s\nschB %s\n", nmbrCvtMToVString(schA),
-        nmbrCvtMToVString(schB));
+      print2("schA %s\nschB %s\n", nmbrCvtMToVString(unifBufToNmbr(schA)),
+        nmbrCvtMToVString(unifBufToNmbr(schB)));
       bug(1903);
     }
-    nmbrLet(&substitution, nmbrMid(schA, p + 1,
-        stackUnkVarLen[stackTop]));
+    setUnifSubstitution(st, schA, st->schALen, p, stackUnkVarLen[stackTop]);
     goto substitute;
   }
 
@@ -678,18 +812,7 @@ char unify(
       // Start with a variable length of 0 or 1
       stackUnkVarLen[stackTop] = g_minSubstLen;
       // Save the rest of the current state for backtracking
-      nmbrTmpPtr = (nmbrString *)(stackSaveUnkVarStart[stackTop]);
-      for (i = 0; i <= stackTop; i++) {
-        nmbrTmpPtr[i] = stackUnkVarStart[i];
-      }
-      nmbrTmpPtr = (nmbrString *)(stackSaveUnkVarLen[stackTop]);
-      for (i = 0; i <= stackTop; i++) {
-        nmbrTmpPtr[i] = stackUnkVarLen[i];
-      }
-      nmbrLet((nmbrString **)(&stackSaveSchemeA[stackTop]),
-          schA);
-      nmbrLet((nmbrString **)(&stackSaveSchemeB[stackTop]),
-          schB);
+      pushUnifTrail(st, stackTop);
     }
 
     if (substToken != stackUnkVar[stackTop]) {
@@ -698,11 +821,10 @@ char unify(
 /*E*/print2("stack top %ld\n",stackTop);
 /*E*/print2("p %ld stackUnkVar[stackTop] %s\n",p,
 /*E*/g_MathToken[stackUnkVar[stackTop]].tokenName);
-/*E*/print2("schA %s\nschB %s\n",nmbrCvtMToVString(schA),nmbrCvtMToVString(schB));
+/*E*/print2("schA %s\nschB %s\n",nmbrCvtMToVString(unifBufToNmbr(schA)),nmbrCvtMToVString(unifBufToNmbr(schB)));
       bug(1904);
     }
-    nmbrLet(&substitution, nmbrMid(schB, p + 1,
-        stackUnkVarLen[stackTop]));
+    setUnifSubstitution(st, schB, st->schBLen, p, stackUnkVarLen[stackTop]);
     goto substitute;
   }
 
@@ -726,7 +848,11 @@ char unify(
 
   // First, we must make sure that the substToken doesn't occur in the
   // substutition.
-  if (nmbrElementIn(1, substitution, substToken)) {
+  substitution = st->substitution;
+  for (i = 0; i < st->substitutionLen; i++) {
+    if (substitution[i] == substToken) break;
+  }
+  if (i < st->substitutionLen) {
 /*E*/if(db6)print2("Substituted token occurs in substitution string\n");
     goto backtrack;
   }
@@ -784,10 +910,11 @@ char unify(
       if (g_bracketMatchInit == 0) { // Initialization pass
         if (g_Statement[m].type != a_) continue;
         nmbrTmpPtr = g_Statement[m].mathString;
+        j = nmbrLen(nmbrTmpPtr);
       } else { // Normal pass
         nmbrTmpPtr = substitution;
+        j = st->substitutionLen;
       }
-      j = nmbrLen(nmbrTmpPtr);
 
       // Make sure left and right parentheses match
       pairingMismatches = 0; // Counter of parens: + for "(" and - for ")"
@@ -900,7 +1027,7 @@ char unify(
 
   if (bracketMismatchFound) goto backtrack;
 
-  j = nmbrLen(substitution);
+  j = st->substitutionLen;
 
   // Quick scan to reject some impossible unifications: If the
   // first symbol in a substitution is a constant, it must match
@@ -924,81 +1051,26 @@ char unify(
       }
     }
     if (impossible) {
-/*E*/if(db6)print2("Impossible subst: %s\n", nmbrCvtMToVString(substitution));
+/*E*/if(db6)print2("Impossible subst: %s\n", nmbrCvtMToVString(unifBufToNmbr(substitution)));
       goto backtrack;
     }
   }
 
   // Now perform the substitutions
-/*E*/if(db6)print2("Substitution is '%s'\n",nmbrCvtMToVString(substitution));
-  k = 1;
-  while (1) {
-    // Perform the substitutions into scheme A
-    k = nmbrElementIn(k, schA, substToken);
-    if (!k) break;
-
-    if (schemeAFlag) {
-      // The token to be substituted was in scheme A
-      // Adjust position and earlier var. starts and lengths
-      if (k - 1 <= p) {
-        if (k <= p) {
-          // Adjust assignments in stack
-          for (i = 0; i <= stackTop; i++) {
-            if (k - 1 < stackUnkVarStart[i]) {
-              stackUnkVarStart[i] = stackUnkVarStart[i] + j-1;
-            } else {
-              if (k <= stackUnkVarStart[i] +
-                  stackUnkVarLen[i]) {
-                stackUnkVarLen[i] = stackUnkVarLen[i] + j - 1;
-              }
-            }
-          }
-        }
-        p = p + j - 1; // Adjust scan position
+/*E*/if(db6)print2("Substitution is '%s'\n",nmbrCvtMToVString(unifBufToNmbr(substitution)));
+  // Perform the substitutions into scheme A.  If the token to be substituted
+  // was in scheme A, adjust position and earlier var. starts and lengths.
+  substituteUnifScheme(st, 1, substToken, schemeAFlag, &p, stackTop);
 /*E*/if(db6)print2("Scheme A adjusted p=%ld\n",p);
-      }
-    }
-
-    nmbrLet(&schA, nmbrCat(
-        nmbrLeft(schA, k - 1), substitution, nmbrRight(schA, k + 1), NULL));
-    k = k + j - 1;
-  }
-  k = 1;
-  while (1) {
-    // Perform the substitutions into scheme B
-    k = nmbrElementIn(k, schB, substToken);
-    if (!k) break;
-
-    if (!schemeAFlag) {
-      // The token to be substituted was in scheme B.
-      // Adjust scan position and earlier var. starts and lengths.
-      if (k - 1 <= p) {
-        if (k <= p) {
-          // Adjust assignments in stack
-          for (i = 0; i <= stackTop; i++) {
-            if (k - 1 < stackUnkVarStart[i]) {
-              stackUnkVarStart[i] = stackUnkVarStart[i] + j-1;
-            } else {
-              if (k <= stackUnkVarStart[i] +
-                  stackUnkVarLen[i]) {
-                stackUnkVarLen[i] = stackUnkVarLen[i] + j - 1;
-              }
-            }
-          }
-        }
-        p = p + j - 1; // Adjust scan position
-      }
+  // Perform the substitutions into scheme B
+  substituteUnifScheme(st, 0, substToken, !schemeAFlag, &p, stackTop);
 /*E*/if(db6)print2("Scheme B adjusted p=%ld\n",p);
-    }
-
-    nmbrLet(&schB, nmbrCat(
-        nmbrLeft(schB, k - 1), substitution, nmbrRight(schB, k + 1), NULL));
-    k = k + j - 1;
-  }
+  schA = st->schA;
+  schB = st->schB;
   p++;
 /*E*/if(db6)print2("Scheme A or B final p=%ld\n",p);
-/*E*/if(db6)print2("after sub sbA %s\n",nmbrCvtMToVString(schA));
-/*E*/if(db6)print2("after sub sbB %s\n",nmbrCvtMToVString(schB));
+/*E*/if(db6)print2("after sub sbA %s\n",nmbrCvtMToVString(unifBufToNmbr(schA)));
+/*E*/if(db6)print2("after sub sbB %s\n",nmbrCvtMToVString(unifBufToNmbr(schB)));
 /*E*/for (d = 0; d <= stackTop; d++) {
 /*E*/  if(db6)print2("Unknown var %ld is %s.\n",d,
 /*E*/      g_MathToken[stackUnkVar[d]].tokenName);
@@ -1012,6 +1084,7 @@ char unify(
   if (stackTop < 0) {
     goto abort;
   }
+  g_unifBacktracks++;
   if (g_unifTrialCount > 0) { // Flag that timeout is active
     g_unifTrialCount++;
     if (g_unifTrialCount > g_userMaxUnifTrials) {
@@ -1021,19 +1094,36 @@ char unify(
       timeoutAbortFlag = 1;
       goto abort;
     }
+    // The wall clock limits are checked only every 1024 trials, to keep
+    // the clock out of the inner loop
+    if (g_userMaxUnifSeconds > 0 || g_pfasDeadline > 0) {
+      if (g_unifTrialCount == 2) {
+        unifStartTime = getWallTime();
+      } else if (g_unifTrialCount % 1024 == 0
+          && ((g_userMaxUnifSeconds > 0 && getWallTime() - unifStartTime
+                > (double)g_userMaxUnifSeconds)
+            || pfasTimeUp())) {
+        g_unifTimeouts++;
+        timeoutAbortFlag = 1;
+        goto abort;
+      }
+    }
   }
   // Add 1 to stackTop variable length
-  nmbrTmpPtr = (nmbrString *)(stackSaveUnkVarLen[stackTop]);
-  nmbrTmpPtr[stackTop]++;
+  trailRow = st->trailVarLen + stackTop * st->varsAlloc;
+  trailRow[stackTop]++;
   // Restore the state from the stack top
-  nmbrLet(&stackUnkVarStart, (nmbrString *)(stackSaveUnkVarStart[stackTop]));
-  nmbrLet(&schA, (nmbrString *)(stackSaveSchemeA[stackTop]));
-  nmbrLet(&schB, (nmbrString *)(stackSaveSchemeB[stackTop]));
+  memcpy(stackUnkVarStart, st->trailVarStart + stackTop * st->varsAlloc,
+      (size_t)(stackTop + 1) * sizeof(long));
+  restoreUnifTrail(st, stackTop);
+  schA = st->schA;
+  schB = st->schB;
   // Restore the scan position
   p = stackUnkVarStart[stackTop];
  switchVarToB:
   // Restore the state from the stack top
-  nmbrLet(&stackUnkVarLen, (nmbrString *)(stackSaveUnkVarLen[stackTop]));
+  memcpy(stackUnkVarLen, st->trailVarLen + stackTop * st->varsAlloc,
+      (size_t)(stackTop + 1) * sizeof(long));
 
   // If the variable overflows the end of the scheme its assigned to,
   // pop the stack.
@@ -1062,8 +1152,8 @@ char unify(
         // Start with a variable length of 0 or 1
         stackUnkVarLen[stackTop] = g_minSubstLen;
         // Initialize stackTop variable length
-        nmbrTmpPtr = (nmbrString *)(stackSaveUnkVarLen[stackTop]);
-        nmbrTmpPtr[stackTop] = g_minSubstLen;
+        trailRow = st->trailVarLen + stackTop * st->varsAlloc;
+        trailRow[stackTop] = g_minSubstLen;
         // Restart the backtrack with double variable switched to scheme B
         goto switchVarToB;
       }
@@ -1091,82 +1181,24 @@ char unify(
  done:
 
   // Assign the final result
-  nmbrLet(&unifiedScheme, nmbrLeft(schA, nmbrLen(schA) - 1));
+  nmbrLet(&st->unifiedScheme, nmbrSpace(st->schALen - 1));
+  memcpy(st->unifiedScheme, schA,
+      (size_t)(st->schALen - 1) * sizeof(nmbrString));
 /*E*/if(db5)print2("Backtrack count was %ld\n",g_unifTrialCount);
 /*E*/if(db5)printLongLine(cat("Unified scheme is ",
-/*E*/    nmbrCvtMToVString(unifiedScheme),".",NULL),"    ","  ");
-  // Assign the 12 components of (*stateVector).  Some of the components hold
-  // pointers to pointer strings.
-  // 0 holds the unkVars array and length.
-  ((nmbrString *)((*stateVector)[11]))[0] = unkVarsLen;
-  (*stateVector)[0] = unkVars;
-  // 1 holds the stack top and the "unknown" vars on the stack
-  ((nmbrString *)((*stateVector)[11]))[1] = stackTop;
-  (*stateVector)[1] = stackUnkVar;
-  (*stateVector)[2] = stackUnkVarStart;
-  (*stateVector)[3] = stackUnkVarLen;
-  (*stateVector)[4] = stackSaveUnkVarStart;
-  (*stateVector)[5] = stackSaveUnkVarLen;
-  (*stateVector)[6] = stackSaveSchemeA;
-  (*stateVector)[7] = stackSaveSchemeB;
-  // Save the result
-  (*stateVector)[8] = unifiedScheme;
-  // Components 9 and 10 save the previous assignment.
+/*E*/    nmbrCvtMToVString(st->unifiedScheme),".",NULL),"    ","  ");
+  // The other components of (*stateVector) were updated in place.
+  // oldStackUnkVarStart and oldStackUnkVarLen save the previous assignment.
   // This is handled by oneDirUnif() if oneDirUnif() is called.
-  ((nmbrString *)((*stateVector)[11]))[2] = schemeAUnkVarsLen; // Used by oneDirUnif()
+  st->stackTop = stackTop;
 
 /*E*/if(db5)printSubst(*stateVector);
-  // Deallocate nmbrStrings
-  free_nmbrString(schA);
-  free_nmbrString(schB);
-  free_nmbrString(substitution);
   return (1);
 
  abort:
 /*E*/if(db5)print2("Backtrack count was %ld\n",g_unifTrialCount);
-  // Deallocate stateVector contents
-  free_nmbrString(unkVars);
-  free_nmbrString(stackUnkVar);
-  free_nmbrString(stackUnkVarStart);
-  free_nmbrString(stackUnkVarLen);
-  for (i = 0; i < unkVarsLen; i++) {
-    // Deallocate the stack space for these
-    nmbrLet((nmbrString **)(&stackSaveUnkVarStart[i]),
-        NULL_NMBRSTRING);
-    nmbrLet((nmbrString **)(&stackSaveUnkVarLen[i]),
-        NULL_NMBRSTRING);
-    nmbrLet((nmbrString **)(&stackSaveSchemeA[i]),
-        NULL_NMBRSTRING);
-    nmbrLet((nmbrString **)(&stackSaveSchemeB[i]),
-        NULL_NMBRSTRING);
-  }
-  free_pntrString(stackSaveUnkVarStart);
-  free_pntrString(stackSaveUnkVarLen);
-  free_pntrString(stackSaveSchemeA);
-  free_pntrString(stackSaveSchemeB);
-  free_nmbrString(unifiedScheme);
-  // Deallocate entries used by oneDirUnif()
-  free_nmbrString(*(nmbrString **)(&(*stateVector)[9]));
-  free_nmbrString(*(nmbrString **)(&(*stateVector)[10]));
-  // Deallocate entries used by unifyH()
-  k = pntrLen((pntrString *)((*stateVector)[12]));
-  for (i = 12; i < 16; i++) {
-    pntrTmpPtr = (pntrString *)((*stateVector)[i]);
-    for (j = 0; j < k; j++) {
-      free_nmbrString(*(nmbrString **)(&pntrTmpPtr[j]));
-    }
-    free_pntrString(*(pntrString **)(&(*stateVector)[i]));
-  }
-  // Deallocate the stateVector itself
-  ((nmbrString *)((*stateVector)[11]))[1] = 0;
-  // stackTop: Make sure it's not -1 before calling nmbrLet()
-  free_nmbrString(*(nmbrString **)(&(*stateVector)[11]));
-  free_pntrString(*stateVector);
-
-  // Deallocate nmbrStrings
-  free_nmbrString(schA);
-  free_nmbrString(schB);
-  free_nmbrString(substitution);
+  // Deallocate stateVector
+  purgeStateVector(stateVector);
 
   if (timeoutAbortFlag) {
     return (2);
@@ -1184,25 +1216,22 @@ char unify(
 flag oneDirUnif(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    pntrString **stateVector,
+    struct unifState_struct **stateVector,
     long reEntryFlag)
 {
 long i;
 flag tmpFlag;
-long schemeAUnkVarsLen;
-nmbrString *stackUnkVarStart; // Pointer only - not allocated
-nmbrString *stackUnkVarLen; // Pointer only - not allocated
-nmbrString *oldStackUnkVarStart; // Pointer only - not allocated
-nmbrString *oldStackUnkVarLen; // Pointer only - not allocated
+struct unifState_struct *st; // Pointer only - not allocated
 
   if (!reEntryFlag) {
     tmpFlag = unify(schemeA, schemeB, stateVector, 0);
-    if (tmpFlag) {
+    if (tmpFlag == 1) {
       // Save the initial variable assignments
-      nmbrLet((nmbrString **)(&(*stateVector)[9]),
-          (nmbrString *)((*stateVector)[2]));
-      nmbrLet((nmbrString **)(&(*stateVector)[10]),
-          (nmbrString *)((*stateVector)[3]));
+      st = *stateVector;
+      memcpy(st->oldStackUnkVarStart, st->stackUnkVarStart,
+          (size_t)st->unkVarsLen * sizeof(long));
+      memcpy(st->oldStackUnkVarLen, st->stackUnkVarLen,
+          (size_t)st->unkVarsLen * sizeof(long));
     }
     return (tmpFlag);
   } else {
@@ -1210,24 +1239,16 @@ nmbrString *oldStackUnkVarLen; // Pointer only - not allocated
       tmpFlag = unify(schemeA, schemeB, stateVector, 1);
       if (!tmpFlag) return (0);
       // Check to see if the variables in schemeA changed
-      schemeAUnkVarsLen = ((nmbrString *)((*stateVector)[11]))[2];
-      stackUnkVarStart = (nmbrString *)((*stateVector)[2]);
-      stackUnkVarLen = (nmbrString *)((*stateVector)[3]);
-      oldStackUnkVarStart = (nmbrString *)((*stateVector)[9]);
-      oldStackUnkVarLen = (nmbrString *)((*stateVector)[10]);
-      for (i = 0; i < schemeAUnkVarsLen; i++) {
-        if (stackUnkVarStart[i] != oldStackUnkVarStart[i]) {
+      st = *stateVector;
+      for (i = 0; i < st->schemeAUnkVarsLen; i++) {
+        if (st->stackUnkVarStart[i] != st->oldStackUnkVarStart[i]
+            || st->stackUnkVarLen[i] != st->oldStackUnkVarLen[i]) {
           // The assignment changed
           // Save the new assignment
-          nmbrLet(&oldStackUnkVarStart, stackUnkVarStart);
-          nmbrLet(&oldStackUnkVarLen, stackUnkVarLen);
-          return (1);
-        }
-        if (stackUnkVarLen[i] != oldStackUnkVarLen[i]) {
-          // The assignment changed
-          // Save the new assignment
-          nmbrLet(&oldStackUnkVarStart, stackUnkVarStart);
-          nmbrLet(&oldStackUnkVarLen, stackUnkVarLen);
+          memcpy(st->oldStackUnkVarStart, st->stackUnkVarStart,
+              (size_t)st->unkVarsLen * sizeof(long));
+          memcpy(st->oldStackUnkVarLen, st->stackUnkVarLen,
+              (size_t)st->unkVarsLen * sizeof(long));
           return (1);
         }
       }
@@ -1236,6 +1257,70 @@ nmbrString *oldStackUnkVarLen; // Pointer only - not allocated
   return(0); // Dummy return value - never happens
 } // oneDirUnif
 
+// Return a copy of a stateVector
+static struct unifState_struct *copyStateVector(
+    const struct unifState_struct *stateVector)
+{
+  struct unifState_struct *copy;
+  long i, k, vars, trailLen;
+
+  copy = newStateVector();
+  vars = stateVector->unkVarsLen;
+  copy->unkVarsLen = vars;
+  copy->schemeAUnkVarsLen = stateVector->schemeAUnkVarsLen;
+  copy->stackTop = stateVector->stackTop;
+  growUnifBuf(&copy->unkVars, &copy->unkVarsAlloc, vars);
+  memcpy(copy->unkVars, stateVector->unkVars,
+      (size_t)vars * sizeof(nmbrString));
+  allocUnifVars(copy, vars);
+  memcpy(copy->stackUnkVar, stateVector->stackUnkVar,
+      (size_t)vars * sizeof(nmbrString));
+  memcpy(copy->stackUnkVarStart, stateVector->stackUnkVarStart,
+      (size_t)vars * sizeof(long));
+  memcpy(copy->stackUnkVarLen, stateVector->stackUnkVarLen,
+      (size_t)vars * sizeof(long));
+  memcpy(copy->oldStackUnkVarStart, stateVector->oldStackUnkVarStart,
+      (size_t)vars * sizeof(long));
+  memcpy(copy->oldStackUnkVarLen, stateVector->oldStackUnkVarLen,
+      (size_t)vars * sizeof(long));
+  nmbrLet(&copy->unifiedScheme, stateVector->unifiedScheme);
+  // Copy the undo trail (the rows have a different stride in the copy)
+  for (i = 0; i <= stateVector->stackTop; i++) {
+    memcpy(copy->trailVarStart + i * copy->varsAlloc,
+        stateVector->trailVarStart + i * stateVector->varsAlloc,
+        (size_t)(i + 1) * sizeof(long));
+    memcpy(copy->trailVarLen + i * copy->varsAlloc,
+        stateVector->trailVarLen + i * stateVector->varsAlloc,
+        (size_t)(i + 1) * sizeof(long));
+    copy->trailSchemeStart[i] = stateVector->trailSchemeStart[i];
+    copy->trailSchemeALen[i] = stateVector->trailSchemeALen[i];
+    copy->trailSchemeBLen[i] = stateVector->trailSchemeBLen[i];
+  }
+  i = stateVector->stackTop;
+  trailLen = (i < 0) ? 0 : stateVector->trailSchemeStart[i]
+      + stateVector->trailSchemeALen[i] + stateVector->trailSchemeBLen[i];
+  growUnifBuf(&copy->trailSchemes, &copy->trailSchemesAlloc, trailLen);
+  memcpy(copy->trailSchemes, stateVector->trailSchemes,
+      (size_t)trailLen * sizeof(nmbrString));
+  // Copy the Henty filter
+  k = pntrLen(stateVector->hentyKeys);
+  pntrLet(&copy->hentyKeys, pntrNSpace(k));
+  for (i = 0; i < k; i++) {
+    nmbrLet((nmbrString **)(&copy->hentyKeys[i]),
+        (nmbrString *)(stateVector->hentyKeys[i]));
+  }
+  if (stateVector->hentyTableSize > 0) {
+    copy->hentyTable = malloc((size_t)(stateVector->hentyTableSize)
+        * sizeof(long));
+    if (!copy->hentyTable) outOfMemory("#122 (Henty filter)");
+    memcpy(copy->hentyTable, stateVector->hentyTable,
+        (size_t)(stateVector->hentyTableSize) * sizeof(long));
+    copy->hentyTableSize = stateVector->hentyTableSize;
+  }
+  // (The scheme buffers are work space and are not copied.)
+  return copy;
+} // copyStateVector
+
 // uniqueUnif() is like unify(), but there is no reEntryFlag, and 3 possible
 // values are returned:
 //   0: no unification was possible.
@@ -1245,12 +1330,9 @@ nmbrString *oldStackUnkVarLen; // Pointer only - not allocated
 char uniqueUnif(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    pntrString **stateVector)
+    struct unifState_struct **stateVector)
 {
-  pntrString_def(saveStateVector);
-  pntrString *pntrTmpPtr1; // Pointer only; not allocated
-  pntrString *pntrTmpPtr2; // Pointer only; not allocated
-  long i, j, k;
+  struct unifState_struct *saveStateVector;
   char tmpFlag;
 
   tmpFlag = unifyH(schemeA, schemeB, stateVector, 0);
@@ -1262,54 +1344,8 @@ char uniqueUnif(
   }
 
   // Save the state vector
-  pntrLet(&saveStateVector,*stateVector);
-  if (pntrLen(*stateVector) != 16) bug(1906);
-  for (i = 0; i < 4; i++) {
-    // Force new space to be allocated for each pointer
-    saveStateVector[i] = NULL_NMBRSTRING;
-    nmbrLet((nmbrString **)(&saveStateVector[i]),
-        (nmbrString *)((*stateVector)[i]));
-  }
-  for (i = 4; i <= 7; i++) {
-    // Force new space to be allocated for each pointer
-    saveStateVector[i] = NULL_PNTRSTRING;
-    pntrLet((pntrString **)(&saveStateVector[i]),
-        (pntrString *)((*stateVector)[i]));
-  }
-  for (i = 8; i < 12; i++) {
-    // Force new space to be allocated for each pointer
-    saveStateVector[i] = NULL_NMBRSTRING;
-    nmbrLet((nmbrString **)(&saveStateVector[i]),
-        (nmbrString *)((*stateVector)[i]));
-  }
-  for (i = 12; i < 16; i++) {
-    // Force new space to be allocated for each pointer
-    saveStateVector[i] = NULL_PNTRSTRING;
-    pntrLet((pntrString **)(&saveStateVector[i]),
-        (pntrString *)((*stateVector)[i]));
-  }
-  k = ((nmbrString *)((*stateVector)[11]))[0]; // unkVarsLen
-  for (i = 4; i <= 7; i++) {
-    pntrTmpPtr1 = (pntrString *)(saveStateVector[i]);
-    pntrTmpPtr2 = (pntrString *)((*stateVector)[i]);
-    for (j = 0; j < k; j++) {
-      // Force new space to be allocated for each pointer
-      pntrTmpPtr1[j] = NULL_NMBRSTRING;
-      nmbrLet((nmbrString **)(&pntrTmpPtr1[j]),
-          (nmbrString *)(pntrTmpPtr2[j]));
-    }
-  }
-  k = pntrLen((pntrString *)((*stateVector)[12]));
-  for (i = 12; i < 16; i++) {
-    pntrTmpPtr1 = (pntrString *)(saveStateVector[i]);
-    pntrTmpPtr2 = (pntrString *)((*stateVector)[i]);
-    for (j = 0; j < k; j++) {
-      // Force new space to be allocated for each pointer
-      pntrTmpPtr1[j] = NULL_NMBRSTRING;
-      nmbrLet((nmbrString **)(&pntrTmpPtr1[j]),
-          (nmbrString *)(pntrTmpPtr2[j]));
-    }
-  }
+  if (*stateVector == NULL) bug(1906);
+  saveStateVector = copyStateVector(*stateVector);
 
   // See if there is a second unification
   tmpFlag = unifyH(schemeA, schemeB, stateVector, 1);
@@ -1323,33 +1359,7 @@ char uniqueUnif(
 
   // There are two or more unifications. Deallocate the stateVector
   // we just saved before returning, since we will not use it.
-  // stackTop: Make sure it's not -1 before calling nmbrLet().
-  ((nmbrString *)(saveStateVector[11]))[1] = 0;
-  for (i = 4; i <= 7; i++) {
-    pntrTmpPtr1 = (pntrString *)(saveStateVector[i]);
-    // ((nmbrString *)(saveStateVector[11]))[0] is unkVarsLen
-    for (j = 0; j < ((nmbrString *)(saveStateVector[11]))[0]; j++) {           
-      free_nmbrString(*(nmbrString **)(&pntrTmpPtr1[j]));
-    }
-  }
-  for (i = 0; i <= 3; i++) {
-    free_nmbrString(*(nmbrString **)(&saveStateVector[i]));
-  }
-  for (i = 4; i <= 7; i++) {
-    free_pntrString(*(pntrString **)(&saveStateVector[i]));
-  }
-  for (i = 8; i <= 11; i++) {
-    free_nmbrString(*(nmbrString **)(&saveStateVector[i]));
-  }
-  k = pntrLen((pntrString *)(saveStateVector[12]));
-  for (i = 12; i < 16; i++) {
-    pntrTmpPtr1 = (pntrString *)(saveStateVector[i]);
-    for (j = 0; j < k; j++) {
-      free_nmbrString(*(nmbrString **)(&pntrTmpPtr1[j]));
-    }
-    free_pntrString(*(pntrString **)(&saveStateVector[i]));
-  }
-  free_pntrString(saveStateVector);
+  purgeStateVector(&saveStateVector);
 
   if (tmpFlag == 2) {
     return (2); // Unification timed out
@@ -1358,64 +1368,55 @@ char uniqueUnif(
   return (3); // Return flag that unification is not unique
 } // uniqueUnif
 
-// Deallocates the contents of a stateVector.
+// Deallocates a stateVector.
 // Note:  If unifyH() returns 0, there were no more unifications and
 // the stateVector is left empty, so we don't have to call
 // purgeStateVector.  But no harm done if called anyway.
-void purgeStateVector(pntrString **stateVector) {
-
-  long i, j, k;
-  pntrString *pntrTmpPtr1;
-
-  if (!pntrLen(*stateVector)) return; // It's already been purged
-
-  // stackTop: Make sure it's not -1 before calling nmbrLet()
-  ((nmbrString *)((*stateVector)[11]))[1] = 0;
-  for (i = 4; i <= 7; i++) {
-    pntrTmpPtr1 = (pntrString *)((*stateVector)[i]);
-    // ((nmbrString *)((*stateVector)[11]))[0] is unkVarsLen
-    for (j = 0; j < ((nmbrString *)((*stateVector)[11]))[0]; j++) {
-      free_nmbrString(*(nmbrString **)(&pntrTmpPtr1[j]));
-    }
-  }
-  for (i = 0; i <= 3; i++) {
-    free_nmbrString(*(nmbrString **)(&(*stateVector)[i]));
-  }
-  for (i = 4; i <= 7; i++) {
-    free_pntrString(*(pntrString **)(&(*stateVector)[i]));
-  }
-  for (i = 8; i <= 11; i++) {
-    free_nmbrString(*(nmbrString **)(&(*stateVector)[i]));
-  }
-  k = pntrLen((pntrString *)((*stateVector)[12]));
-  for (i = 12; i < 16; i++) {
-    pntrTmpPtr1 = (pntrString *)((*stateVector)[i]);
-    for (j = 0; j < k; j++) {
-      free_nmbrString(*(nmbrString **)(&pntrTmpPtr1[j]));
-    }
-    free_pntrString(*(pntrString **)(&(*stateVector)[i]));
-  }
-  free_pntrString(*stateVector);
+void purgeStateVector(struct unifState_struct **stateVector) {
+  struct unifState_struct *st = *stateVector;
+
+  if (st == NULL) return; // It's already been purged
+
+  freeUnifBuf(&st->unkVars, &st->unkVarsAlloc);
+  free(st->stackUnkVar);
+  free(st->stackUnkVarStart);
+  free(st->stackUnkVarLen);
+  free(st->oldStackUnkVarStart);
+  free(st->oldStackUnkVarLen);
+  free(st->trailVarStart);
+  free(st->trailVarLen);
+  free(st->trailSchemeStart);
+  free(st->trailSchemeALen);
+  free(st->trailSchemeBLen);
+  freeUnifBuf(&st->trailSchemes, &st->trailSchemesAlloc);
+  freeUnifBuf(&st->schA, &st->schAAlloc);
+  freeUnifBuf(&st->schB, &st->schBAlloc);
+  freeUnifBuf(&st->schTmp, &st->schTmpAlloc);
+  freeUnifBuf(&st->substitution, &st->substitutionAlloc);
+  free_nmbrString(st->unifiedScheme);
+  clearHentyFilter(st);
+  free(st);
+  *stateVector = NULL;
 
   return;
 } // purgeStateVector
 
 // Prints the substitutions determined by unify for debugging purposes
-void printSubst(pntrString *stateVector) {
+void printSubst(struct unifState_struct *stateVector) {
   long d;
   nmbrString *stackUnkVar; // Pointer only - not allocated
   nmbrString *unifiedScheme; // Pointer only - not allocated
-  nmbrString *stackUnkVarLen; // Pointer only - not allocated
-  nmbrString *stackUnkVarStart; // Pointer only - not allocated
+  long *stackUnkVarLen; // Pointer only - not allocated
+  long *stackUnkVarStart; // Pointer only - not allocated
   long stackTop;
   vstring_def(tmpStr);
   nmbrString_def(nmbrTmp);
 
-  stackTop = ((nmbrString *)(stateVector[11]))[1];
-  stackUnkVar = (nmbrString *)(stateVector[1]);
-  stackUnkVarStart = (nmbrString *)(stateVector[2]);
-  stackUnkVarLen = (nmbrString *)(stateVector[3]);
-  unifiedScheme = (nmbrString *)(stateVector[8]);
+  stackTop = stateVector->stackTop;
+  stackUnkVar = stateVector->stackUnkVar;
+  stackUnkVarStart = stateVector->stackUnkVarStart;
+  stackUnkVarLen = stateVector->stackUnkVarLen;
+  unifiedScheme = stateVector->unifiedScheme;
 
   for (d = 0; d <= stackTop; d++) {
     printLongLine(cat(" Variable '",
@@ -1438,14 +1439,11 @@ void printSubst(pntrString *stateVector) {
 char unifyH(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    pntrString **stateVector,
+    struct unifState_struct **stateVector,
     long reEntryFlag)
 {
   char tmpFlag;
-  nmbrString_def(hentyVars);
-  nmbrString_def(hentyVarStart);
-  nmbrString_def(hentyVarLen);
-  nmbrString_def(hentySubstList);
+  nmbrString_def(hentyKey);
 
   // Bypass this filter if SET HENTY_FILTER OFF is selected.
   if (!g_hentyFilter) return unify(schemeA, schemeB, stateVector, reEntryFlag);
@@ -1455,12 +1453,10 @@ char unifyH(
     if (tmpFlag == 1) { // Unification OK
 
       // Get the normalized equivalent substitutions
-      hentyNormalize(&hentyVars, &hentyVarStart, &hentyVarLen,
-          &hentySubstList, stateVector);
+      hentyNormalize(&hentyKey, stateVector);
 
       // This is the first unification so add it to the filter then return 1
-      hentyAdd(hentyVars, hentyVarStart, hentyVarLen,
-          hentySubstList, stateVector);
+      hentyAdd(hentyKey, stateVector);
     }
     return (tmpFlag);
   } else {
@@ -1469,17 +1465,14 @@ char unifyH(
       if (tmpFlag == 1) { // 0 = not possible, 1 == OK, 2 = timed out
 
         // Get the normalized equivalent substitution
-        hentyNormalize(&hentyVars, &hentyVarStart, &hentyVarLen,
-            &hentySubstList, stateVector);
+        hentyNormalize(&hentyKey, stateVector);
 
-        // Scan the Henty filter to see if this substitution is in it
-        if (!hentyMatch(hentyVars, hentyVarStart, // hentyVarLen,
-            hentySubstList, stateVector)) {
+        // Look up this substitution in the Henty filter
+        if (!hentyMatch(hentyKey, stateVector)) {
 
           // If it's not in there, this is a new unification so add it
           // to the filter then return 1.
-          hentyAdd(hentyVars, hentyVarStart, hentyVarLen,
-              hentySubstList, stateVector);
+          hentyAdd(hentyKey, stateVector);
           return (1);
         }
       } else {
@@ -1489,61 +1482,62 @@ char unifyH(
 
       // If we get here this unification is in the Henty filter, so bypass it
       // and get the next unification.
+      g_hentyRejects++;
     } // End while (1)
 
     // Deallocate memory (when reEntryFlag is 1 and (not possible or timeout)).
-    // (In the other cases, hentyVars and hentySubsts pointers are assigned
-    // directly to stateVector so they should not be deallocated.)
-    free_nmbrString(hentyVars);
-    free_nmbrString(hentyVarStart);
-    free_nmbrString(hentyVarLen);
-    free_nmbrString(hentySubstList);
+    // (In the other cases, the hentyKey pointer is assigned directly to
+    // stateVector so it should not be deallocated.)
+    free_nmbrString(hentyKey);
     return (tmpFlag);
   }
 } // unifyH
 
 // Extract and normalize the unification substitutions.
-void hentyNormalize(nmbrString **hentyVars, nmbrString **hentyVarStart,
-    nmbrString **hentyVarLen, nmbrString **hentySubstList,
-    pntrString **stateVector)
+void hentyNormalize(nmbrString **hentyKey,
+    struct unifState_struct **stateVector)
 {
   long vars, var1, var2, schLen;
   long n, el, rra, rrb, rrc, ir, i, j; // Variables for heap sort
   long totalSubstLen, pos;
-  nmbrString_def(substList);
+  nmbrString_def(hentyVars);
+  nmbrString_def(hentyVarStart);
+  nmbrString_def(hentyVarLen);
+  nmbrString_def(hentySubstList);
 
   // Extract the substitutions.
-  vars = ((nmbrString *)((*stateVector)[11]))[1] + 1; // stackTop + 1
-  nmbrLet((nmbrString **)(&(*hentyVars)), nmbrLeft(
-      (nmbrString *)((*stateVector)[1]), vars)); // stackUnkVar
-  nmbrLet((nmbrString **)(&(*hentyVarStart)), nmbrLeft(
-      (nmbrString *)((*stateVector)[2]), vars)); // stackUnkVarStart
-  nmbrLet((nmbrString **)(&(*hentyVarLen)), nmbrLeft(
-      (nmbrString *)((*stateVector)[3]), vars)); // stackUnkVarLen
-  nmbrLet((nmbrString **)(&(*hentySubstList)),
-      (nmbrString *)((*stateVector)[8])); // unifiedScheme
+  vars = (*stateVector)->stackTop + 1;
+  nmbrLet(&hentyVars, nmbrSpace(vars));
+  nmbrLet(&hentyVarStart, nmbrSpace(vars));
+  nmbrLet(&hentyVarLen, nmbrSpace(vars));
+  for (i = 0; i < vars; i++) {
+    hentyVars[i] = (*stateVector)->stackUnkVar[i];
+    hentyVarStart[i] = (*stateVector)->stackUnkVarStart[i];
+    hentyVarLen[i] = (*stateVector)->stackUnkVarLen[i];
+  }
+  nmbrLet(&hentySubstList, (*stateVector)->unifiedScheme);
 
   // First, if a variable is substituted with another variable,
   // reverse the substitution if the substituted variable has a larger
   // tokenNum.
   for (i = 0; i < vars; i++) {
-    if ((*hentyVarLen)[i] == 1) {
-      var2 = (*hentySubstList)[(*hentyVarStart)[i]];
+    if (hentyVarLen[i] == 1) {
+      var2 = hentySubstList[hentyVarStart[i]];
       if (var2 > g_mathTokens) {
         // It's a variable-for-variable substitution
-        var1 = (*hentyVars)[i];
+        var1 = hentyVars[i];
         if (var1 > var2) {
           // Swap the variables
-          (*hentyVars)[i] = var2;
-          schLen = nmbrLen(*hentySubstList);
+          hentyVars[i] = var2;
+          schLen = nmbrLen(hentySubstList);
           for (j = 0; j < schLen; j++) {
-            if ((*hentySubstList)[(*hentyVarStart)[i]] == var2) {
-              (*hentySubstList)[(*hentyVarStart)[i]] = var1;
+            if (hentySubstList[hentyVarStart[i]] == var2) {
+              hentySubstList[hentyVarStart[i]] = var1;
             }
           } // Next j
         } // End if (var1 > var2)
       } // End if (var2 > g_mathTokens)
-    } // End if ((*hentyVarLen)[i] == 1)
+    } // End if (hentyVarLen[i] == 1)
   } // Next i
 
   // Next, sort the variables to be substituted in tokenNum order
@@ -1556,21 +1550,21 @@ void hentyNormalize(nmbrString **hentyVars, nmbrString **hentyVarStart,
  label10:
   if (el > 1) {
     el = el - 1;
-    rra = (*hentyVars)[el - 1];
-    rrb = (*hentyVarStart)[el - 1];
-    rrc = (*hentyVarLen)[el - 1];
+    rra = hentyVars[el - 1];
+    rrb = hentyVarStart[el - 1];
+    rrc = hentyVarLen[el - 1];
   } else {
-    rra = (*hentyVars)[ir - 1];
-    rrb = (*hentyVarStart)[ir - 1];
-    rrc = (*hentyVarLen)[ir - 1];
-    (*hentyVars)[ir - 1] = (*hentyVars)[0];
-    (*hentyVarStart)[ir - 1] = (*hentyVarStart)[0];
-    (*hentyVarLen)[ir - 1] = (*hentyVarLen)[0];
+    rra = hentyVars[ir - 1];
+    rrb = hentyVarStart[ir - 1];
+    rrc = hentyVarLen[ir - 1];
+    hentyVars[ir - 1] = hentyVars[0];
+    hentyVarStart[ir - 1] = hentyVarStart[0];
+    hentyVarLen[ir - 1] = hentyVarLen[0];
     ir = ir - 1;
     if (ir == 1) {
-      (*hentyVars)[0] = rra;
-      (*hentyVarStart)[0] = rrb;
-      (*hentyVarLen)[0] = rrc;
+      hentyVars[0] = rra;
+      hentyVarStart[0] = rrb;
+      hentyVarLen[0] = rrc;
       goto heapExit;
     }
   }
@@ -1579,12 +1573,12 @@ void hentyNormalize(nmbrString **hentyVars, nmbrString **hentyVarStart,
  label20:
   if (j <= ir) {
     if (j < ir) {
-      if ((*hentyVars)[j - 1] < (*hentyVars)[j]) j = j + 1;
+      if (hentyVars[j - 1] < hentyVars[j]) j = j + 1;
     }
-    if (rra < (*hentyVars)[j - 1]) {
-      (*hentyVars)[i - 1] = (*hentyVars)[j - 1];
-      (*hentyVarStart)[i - 1] = (*hentyVarStart)[j - 1];
-      (*hentyVarLen)[i - 1] = (*hentyVarLen)[j - 1];
+    if (rra < hentyVars[j - 1]) {
+      hentyVars[i - 1] = hentyVars[j - 1];
+      hentyVarStart[i - 1] = hentyVarStart[j - 1];
+      hentyVarLen[i - 1] = hentyVarLen[j - 1];
       i = j;
       j = j + j;
     } else {
@@ -1592,87 +1586,104 @@ void hentyNormalize(nmbrString **hentyVars, nmbrString **hentyVarStart,
     }
     goto label20;
   }
-  (*hentyVars)[i - 1] = rra;
-  (*hentyVarStart)[i - 1] = rrb;
-  (*hentyVarLen)[i - 1] = rrc;
+  hentyVars[i - 1] = rra;
+  hentyVarStart[i - 1] = rrb;
+  hentyVarLen[i - 1] = rrc;
   goto label10;
 
  heapExit:
 
-  // Finally, reconstruct the list of substitutions in
-  // variable tokenNum order.
+  // Finally, encode the substitutions in variable tokenNum order as the
+  // key for the Henty filter:  the number of variables, the variables, the
+  // length of each substitution, and the concatenated substitutions.
   totalSubstLen = 0;
   for (i = 0; i < vars; i++) {
-    totalSubstLen = totalSubstLen + (*hentyVarLen)[i];
+    totalSubstLen = totalSubstLen + hentyVarLen[i];
   }
-  // For speedup, preallocate total string needed for the substitution list
-  nmbrLet(&substList, nmbrSpace(totalSubstLen));
+  // For speedup, preallocate total string needed for the key
+  nmbrLet(hentyKey, nmbrSpace(1 + 2 * vars + totalSubstLen));
 
-  pos = 0; // Position in list of substitutions
+  (*hentyKey)[0] = vars;
+  pos = 1 + 2 * vars; // Position in key of the next substitution
   for (i = 0; i < vars; i++) {
-    for (j = 0; j < (*hentyVarLen)[i]; j++) {
-      substList[pos + j] = (*hentySubstList)[(*hentyVarStart)[i] + j];
+    (*hentyKey)[1 + i] = hentyVars[i];
+    (*hentyKey)[1 + vars + i] = hentyVarLen[i];
+    for (j = 0; j < hentyVarLen[i]; j++) {
+      (*hentyKey)[pos + j] = hentySubstList[hentyVarStart[i] + j];
     }
-    (*hentyVarStart)[i] = pos; // Never used, but assign in case it ever does
-    pos = pos + (*hentyVarLen)[i];
+    pos = pos + hentyVarLen[i];
   }
-  if (pos != totalSubstLen) bug(1907);
-  nmbrLet((nmbrString **)(&(*hentySubstList)), substList);
+  if (pos != 1 + 2 * vars + totalSubstLen) bug(1907);
 
   // Deallocate memory
-  free_nmbrString(substList);
+  free_nmbrString(hentyVars);
+  free_nmbrString(hentyVarStart);
+  free_nmbrString(hentyVarLen);
+  free_nmbrString(hentySubstList);
 
   return;
 } // hentyNormalize
 
-// Check to see if an equivalent unification exists in the Henty filter
-flag hentyMatch(
-    nmbrString *hentyVars, 
-    nmbrString *hentyVarStart,
-    // nmbrString *hentyVarLen,
-    nmbrString *hentySubstList,
-    pntrString **stateVector)
+// Hash function for Henty filter keys
+static unsigned long hentyHash(const nmbrString *hentyKey)
 {
-  long i, size;
-
-  size = pntrLen((pntrString *)((*stateVector)[12]));
-
-  for (i = 0; i < size; i++) {
-    if (nmbrEq(hentyVars,
-        (nmbrString *)(((pntrString *)((*stateVector)[12]))[i]))) {
-      if (nmbrEq(hentyVarStart,
-          (nmbrString *)(((pntrString *)((*stateVector)[13]))[i]))) {
-        // (We don't need to look at [14] because it is determined by [13])
-        if (nmbrEq(hentySubstList,
-            (nmbrString *)(((pntrString *)((*stateVector)[15]))[i]))) {
-          return(1); // A previous equivalent unification was found
-        }
-      }
+  unsigned long hash = 2166136261UL; // FNV-1a
+  long i;
+  for (i = 0; hentyKey[i] != -1; i++) {
+    hash = (hash ^ (unsigned long)hentyKey[i]) * 16777619UL;
+  }
+  return hash;
+} // hentyHash
+
+// Return the slot of hentyTable where hentyKey is, or the empty slot where it
+// would be added.  hentyTableSize must be > 0.
+static long hentySlot(const nmbrString *hentyKey,
+    const struct unifState_struct *stateVector)
+{
+  long mask, slot, k;
+  mask = stateVector->hentyTableSize - 1;
+  slot = (long)(hentyHash(hentyKey) & (unsigned long)mask);
+  while (1) {
+    k = stateVector->hentyTable[slot];
+    if (k == -1) return slot;
+    if (nmbrEq(hentyKey, (nmbrString *)(stateVector->hentyKeys[k]))) {
+      return slot;
     }
-  } // Next i
+    slot = (slot + 1) & mask; // Linear probing
+  }
+} // hentySlot
 
-  return (0); // There was no previous equivalent unification
+// Check to see if an equivalent unification exists in the Henty filter
+flag hentyMatch(nmbrString *hentyKey, struct unifState_struct **stateVector)
+{
+  if ((*stateVector)->hentyTableSize == 0) return (0);
+  if ((*stateVector)->hentyTable[hentySlot(hentyKey, *stateVector)] == -1) {
+    return (0); // There was no previous equivalent unification
+  }
+  return (1); // A previous equivalent unification was found
 } // hentyMatch
 
-// Add an entry to the Henty filter
-void hentyAdd(nmbrString *hentyVars, nmbrString *hentyVarStart,
-    nmbrString *hentyVarLen, nmbrString *hentySubstList,
-    pntrString **stateVector)
+// Add an entry to the Henty filter.  hentyKey is assigned directly to the
+// stateVector, so the caller should not deallocate it.
+void hentyAdd(nmbrString *hentyKey, struct unifState_struct **stateVector)
 {
-  long size;
-  size = pntrLen((pntrString *)((*stateVector)[12]));
-
-  pntrLet((pntrString **)(&(*stateVector)[12]), pntrAddGElement(
-      (pntrString *)((*stateVector)[12])));
-  ((pntrString *)((*stateVector)[12]))[size] = hentyVars;
-  pntrLet((pntrString **)(&(*stateVector)[13]), pntrAddGElement(
-      (pntrString *)((*stateVector)[13])));
-  ((pntrString *)((*stateVector)[13]))[size] = hentyVarStart;
-  pntrLet((pntrString **)(&(*stateVector)[14]), pntrAddGElement(
-      (pntrString *)((*stateVector)[14])));
-  ((pntrString *)((*stateVector)[14]))[size] = hentyVarLen;
-  pntrLet((pntrString **)(&(*stateVector)[15]), pntrAddGElement(
-      (pntrString *)((*stateVector)[15])));
-  ((pntrString *)((*stateVector)[15]))[size] =
-      hentySubstList;
+  long size, i, k;
+  struct unifState_struct *st = *stateVector;
+  size = pntrLen(st->hentyKeys);
+
+  // Keep the hash table at most half full
+  if (2 * (size + 1) > st->hentyTableSize) {
+    free(st->hentyTable);
+    st->hentyTableSize = (st->hentyTableSize == 0) ? 16
+        : 2 * st->hentyTableSize;
+    st->hentyTable = malloc((size_t)(st->hentyTableSize) * sizeof(long));
+    if (!st->hentyTable) outOfMemory("#123 (Henty filter)");
+    for (i = 0; i < st->hentyTableSize; i++) st->hentyTable[i] = -1;
+    for (k = 0; k < size; k++) {
+      st->hentyTable[hentySlot((nmbrString *)(st->hentyKeys[k]), st)] = k;
+    }
+  }
+
+  pntrPush(&st->hentyKeys, hentyKey);
+  st->hentyTable[hentySlot(hentyKey, st)] = size;
 } // hentyAdd
@@ -18,8 +18,15 @@ extern long g_userMaxUnifTrials;
 extern long g_unifTrialCount;
 /*!< Number of timeouts so far for this command */
 extern long g_unifTimeouts;
+/*!< User-defined upper limit in wall clock seconds for one unification;
+   0 means no limit */
+extern long g_userMaxUnifSeconds;
 /*!< Turns Henty filter on or off */
 extern flag g_hentyFilter;
+/*!< Backtracks of unify() */
+extern long g_unifBacktracks;
+/*!< Unifications discarded by the Henty filter */
+extern long g_hentyRejects;
 
 // Global so eraseSource() (mmcmds.c) can clear them
 extern flag g_bracketMatchInit;
@@ -27,8 +34,66 @@ extern nmbrString *g_firstConst;
 extern nmbrString *g_lastConst;
 extern nmbrString *g_oneConst;
 
+/*! State of a unification, which unify() keeps between calls so that it
+   can backtrack to the next possible unification.  The "unknown" variables
+   are the temporary (work) variables $1, $2, etc. in the two schemes.  The
+   caller holds a pointer to it, which must be NULL before the first call;
+   the callers only look at stackTop, stackUnkVar, stackUnkVarStart,
+   stackUnkVarLen, and unifiedScheme.  The arrays other than unifiedScheme
+   are allocated with malloc() and are reused by later unifications with the
+   same state, so backtracking doesn't allocate memory. */
+struct unifState_struct {
+  long unkVarsLen; /*!< Number of unknown variables in schemeA and schemeB */
+  long schemeAUnkVarsLen; /*!< Number of them in schemeA (for oneDirUnif()) */
+  /*! Index of the last variable that was substituted.  Warning:  stackTop
+     may be -1 if there were no substitutions. */
+  long stackTop;
+  nmbrString *unkVars; /*!< All unknown variables in schemeA and schemeB */
+  long unkVarsAlloc; /*!< Allocated length of unkVars */
+  nmbrString *stackUnkVar; /*!< Variables substituted, in order */
+  long *stackUnkVarStart; /*!< Start of each substitution in unifiedScheme */
+  long *stackUnkVarLen; /*!< Length of each substitution in unifiedScheme */
+  nmbrString *unifiedScheme; /*!< Result of the unification */
+  long varsAlloc; /*!< Allocated length of the arrays above */
+
+  /*! Undo trail: for each stack level, stackUnkVarStart and stackUnkVarLen
+     (rows of length varsAlloc) at the time the variable was stacked... */
+  long *trailVarStart;
+  long *trailVarLen;
+  /*! ...and schemes A and B at that time, copied one after another into
+     trailSchemes starting at trailSchemeStart[level] */
+  nmbrString *trailSchemes;
+  long *trailSchemeStart;
+  long *trailSchemeALen;
+  long *trailSchemeBLen;
+  long trailSchemesAlloc; /*!< Allocated length of trailSchemes */
+
+  /*! Schemes A and B being unified, with the end-of-scheme token
+     g_mathTokens appended and terminated by -1 (like an nmbrString) */
+  nmbrString *schA;
+  nmbrString *schB;
+  nmbrString *schTmp; /*!< Work space for making substitutions */
+  nmbrString *substitution; /*!< Substitution being tried */
+  long schALen, schBLen, substitutionLen;
+  long schAAlloc, schBAlloc, schTmpAlloc, substitutionAlloc;
+
+  /*! Assignments saved by oneDirUnif() */
+  long *oldStackUnkVarStart;
+  long *oldStackUnkVarLen;
+
+  /*! The "Henty filter" used by unifyH(), i.e. a set of all "normalized"
+     unifications so far.  Entry i of hentyKeys is an nmbrString encoding
+     normalized unification i as the number of variables substituted, the
+     variables, the length of each substitution, and the substitution list.
+     hentyTable is an open-addressing hash table of indices into hentyKeys
+     (-1 = empty slot) with hentyTableSize (a power of 2) slots. */
+  pntrString *hentyKeys;
+  long *hentyTable;
+  long hentyTableSize;
+};
+
 nmbrString *makeSubstUnif(flag *newVarFlag,
-    const nmbrString *trialScheme, pntrString *stateVector);
+    const nmbrString *trialScheme, struct unifState_struct *stateVector);
 
 /*! This function unifies two math token strings, schemeA and
    schemeB.  The result is contained in unifiedScheme.
@@ -36,10 +101,10 @@ nmbrString *makeSubstUnif(flag *newVarFlag,
    If reEntryFlag is 1, the next possible set of assignments, if any,
    is returned.  2 is returned if the unification times out.
    (*stateVector) contains the state of the previous
-   call.  It is the caller's responsibility to deallocate the
-   contents of (*stateVector) when done, UNLESS a 0 is returned.
-   The caller must assign (*stateVector) to a legal pntrString
-   (e.g. NULL_PNTRSTRING) before calling.
+   call.  It is the caller's responsibility to deallocate
+   (*stateVector) with purgeStateVector() when done, UNLESS a 0 is
+   returned.  The caller must assign NULL to (*stateVector) before
+   the first call.
 
    All variables with a tokenNum > saveMathTokens are assumed
    to be "unknown" variables that can be assigned; all other
@@ -47,7 +112,7 @@ nmbrString *makeSubstUnif(flag *newVarFlag,
    algorithm.
 
    The "unknown" variable assignments are contained in (*stateVector)
-   (which is a complex structure, described below).  Some "unknown"
+   (see struct unifState_struct).  Some "unknown"
    variables may have no assignment, in which case they will
    remain "unknown", and others may have assignments which include
    "unknown" variables.
@@ -55,8 +120,7 @@ nmbrString *makeSubstUnif(flag *newVarFlag,
 char unify(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    // nmbrString **unifiedScheme, // stateVector[8] holds this
-    pntrString **stateVector,
+    struct unifState_struct **stateVector,
     long reEntryFlag);
 
 /*! oneDirUnif() is like unify(), except that when reEntryFlag is 1,
@@ -66,7 +130,7 @@ char unify(
 flag oneDirUnif(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    pntrString **stateVector,
+    struct unifState_struct **stateVector,
     long reEntryFlag);
 
 /*! uniqueUnif() is like unify(), but there is no reEntryFlag, and 3 possible
@@ -78,7 +142,7 @@ flag oneDirUnif(
 char uniqueUnif(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    pntrString **stateVector);
+    struct unifState_struct **stateVector);
 
 /*! unifyH() is like unify(), except that when reEntryFlag is 1,
    a new unification is returned ONLY if the normalized unification
@@ -89,13 +153,13 @@ char uniqueUnif(
 char unifyH(
     const nmbrString *schemeA,
     const nmbrString *schemeB,
-    pntrString **stateVector,
+    struct unifState_struct **stateVector,
     long reEntryFlag);
 
-/*! Cleans out a stateVector if not empty */
-void purgeStateVector(pntrString **stateVector);
+/*! Cleans out a stateVector if not empty, leaving it NULL */
+void purgeStateVector(struct unifState_struct **stateVector);
 
 /*! Prints the substitutions determined by unify for debugging purposes */
-void printSubst(pntrString *stateVector);
+void printSubst(struct unifState_struct *stateVector);
 
 #endif // METAMATH_MMUNIF_H_
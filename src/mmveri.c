@@ -5,6 +5,7 @@
 /*34567890123456 (79-character line to adjust editor window) 2345678901234567*/
 
 #include <string.h>
+#include <stdlib.h>
 #include "mmvstr.h"
 #include "mmdata.h"
 #include "mminou.h"
@@ -17,6 +18,321 @@ struct getStep_struct getStep = {0, 0, 0, 0, 0,
     NULL_NMBRSTRING, NULL_NMBRSTRING, NULL_PNTRSTRING, NULL_NMBRSTRING,
     NULL_PNTRSTRING};
 
+// Sharing of step results (SET STEP_SHARING).  When it is on, every math
+// string assigned to a proof step by verifyProof() is replaced by a shared
+// copy from shareString[], so equal math strings have equal pointers.  The
+// results of assertion steps are also remembered in shareStep[] by the
+// assertion and the (shared) math strings of its hypotheses, so that a
+// repeated step is looked up instead of unified again.
+flag g_stepSharing = 0; // Default is OFF
+long g_stepShareHits = 0;
+long g_assignVarBacktracks = 0;
+
+struct shareString_struct {
+  nmbrString *mathString; // NULL if the slot is empty
+  unsigned long hash;
+};
+static struct shareString_struct *shareString = NULL;
+static long shareStringSize = 0; // Number of slots (a power of 2)
+static long shareStringCount = 0; // Number of slots in use
+static long shareStringTokens = 0; // Total length of the shared math strings
+
+struct shareStep_struct {
+  long stmt; // Assertion used by the step; -1 if the slot is empty
+  long owner; // Statement being proved if stmt has $d's, otherwise -1
+  nmbrString **hyps; // Shared math strings of the stmt's hypotheses
+  nmbrString *result; // Shared math string of the step
+  unsigned long hash;
+};
+static struct shareStep_struct *shareStep = NULL;
+static long shareStepSize = 0; // Number of slots (a power of 2)
+static long shareStepCount = 0; // Number of slots in use
+
+// The tables are emptied by verifyProof() when the shared math strings
+// reach this many tokens in total
+#define SHARE_MAX_TOKENS 4000000
+
+// Set by assignVar() when it finds a $d violation, so that verifyProof()
+// won't remember the step
+static flag disjViolation = 0;
+
+// Set by verifyProof() if g_WrkProof.mathStringPtrs[] are shared, so
+// that cleanWrkProof() will leave them alone
+static flag stepsShared = 0;
+
+// Hash function (FNV-1a over the token numbers) for shareString[]
+static unsigned long shareStringHash(const nmbrString *mathString)
+{
+  unsigned long hash = 2166136261UL;
+  for (long i = 0; mathString[i] != -1; i++) {
+    hash = (hash ^ (unsigned long)mathString[i]) * 16777619UL;
+  }
+  return hash;
+} // shareStringHash
+
+// Hash function for shareStep[]; the hypotheses are hashed by address
+static unsigned long shareStepHash(long stmt, long owner,
+    nmbrString **hyps, long numHyps)
+{
+  unsigned long hash = 2166136261UL;
+  hash = (hash ^ (unsigned long)stmt) * 16777619UL;
+  hash = (hash ^ (unsigned long)owner) * 16777619UL;
+  for (long i = 0; i < numHyps; i++) {
+    hash = (hash ^ (unsigned long)(size_t)hyps[i]) * 16777619UL;
+  }
+  return hash;
+} // shareStepHash
+
+// Return the shared copy of mathString, adding it if it is new.  If
+// adoptFlag is set, mathString was allocated by the caller and is either
+// kept as the shared copy or deallocated.
+static nmbrString *getSharedString(nmbrString *mathString, flag adoptFlag)
+{
+  if (mathString[0] == -1) { // Empty (unknown) math strings aren't shared
+    if (adoptFlag) free_nmbrString(mathString);
+    return NULL_NMBRSTRING;
+  }
+
+  // Keep the table at most half full
+  if (2 * (shareStringCount + 1) > shareStringSize) {
+    long newSize = shareStringSize ? 2 * shareStringSize : 1024;
+    struct shareString_struct *newTable = malloc((size_t)newSize
+        * sizeof(struct shareString_struct));
+    if (!newTable) outOfMemory("#134 (shareString)");
+    for (long i = 0; i < newSize; i++) newTable[i].mathString = NULL;
+    for (long i = 0; i < shareStringSize; i++) {
+      if (shareString[i].mathString == NULL) continue;
+      long slot = (long)(shareString[i].hash & (unsigned long)(newSize - 1));
+      while (newTable[slot].mathString != NULL) {
+        slot = (slot + 1) & (newSize - 1); // Linear probing
+      }
+      newTable[slot] = shareString[i];
+    }
+    free(shareString);
+    shareString = newTable;
+    shareStringSize = newSize;
+  }
+
+  unsigned long hash = shareStringHash(mathString);
+  long mask = shareStringSize - 1;
+  long slot = (long)(hash & (unsigned long)mask);
+  while (shareString[slot].mathString != NULL) {
+    if (shareString[slot].hash == hash
+        && nmbrEq(shareString[slot].mathString, mathString)) {
+      if (adoptFlag) free_nmbrString(mathString);
+      return shareString[slot].mathString;
+    }
+    slot = (slot + 1) & mask; // Linear probing
+  }
+  if (!adoptFlag) {
+    nmbrString *copy = NULL_NMBRSTRING;
+    nmbrLet(&copy, mathString);
+    mathString = copy;
+  }
+  shareString[slot].mathString = mathString;
+  shareString[slot].hash = hash;
+  shareStringCount++;
+  shareStringTokens += nmbrLen(mathString);
+  return mathString;
+} // getSharedString
+
+// Return the slot of shareStep[] for the step, or the empty slot where it
+// would be added.  shareStepSize must be > 0.
+static long getShareStepSlot(long stmt, long owner, nmbrString **hyps,
+    long numHyps, unsigned long hash)
+{
+  long mask = shareStepSize - 1;
+  long slot = (long)(hash & (unsigned long)mask);
+  while (shareStep[slot].stmt != -1) {
+    if (shareStep[slot].hash == hash && shareStep[slot].stmt == stmt
+        && shareStep[slot].owner == owner) {
+      long i = 0;
+      while (i < numHyps && shareStep[slot].hyps[i] == hyps[i]) i++;
+      if (i == numHyps) return slot;
+    }
+    slot = (slot + 1) & mask; // Linear probing
+  }
+  return slot;
+} // getShareStepSlot
+
+// Return the shared result of a step using stmt whose hypotheses have the
+// shared math strings hyps[], or NULL if it hasn't been seen before
+static nmbrString *lookupSharedStep(long stmt, long owner, nmbrString **hyps,
+    long numHyps)
+{
+  if (shareStepSize == 0) return NULL;
+  long slot = getShareStepSlot(stmt, owner, hyps, numHyps,
+      shareStepHash(stmt, owner, hyps, numHyps));
+  if (shareStep[slot].stmt == -1) return NULL;
+  return shareStep[slot].result;
+} // lookupSharedStep
+
+// Remember the shared result of a step for lookupSharedStep()
+static void addSharedStep(long stmt, long owner, nmbrString **hyps,
+    long numHyps, nmbrString *result)
+{
+  // Keep the table at most half full
+  if (2 * (shareStepCount + 1) > shareStepSize) {
+    long newSize = shareStepSize ? 2 * shareStepSize : 1024;
+    struct shareStep_struct *newTable = malloc((size_t)newSize
+        * sizeof(struct shareStep_struct));
+    if (!newTable) outOfMemory("#135 (shareStep)");
+    for (long i = 0; i < newSize; i++) newTable[i].stmt = -1;
+    for (long i = 0; i < shareStepSize; i++) {
+      if (shareStep[i].stmt == -1) continue;
+      long slot = (long)(shareStep[i].hash & (unsigned long)(newSize - 1));
+      while (newTable[slot].stmt != -1) {
+        slot = (slot + 1) & (newSize - 1); // Linear probing
+      }
+      newTable[slot] = shareStep[i];
+    }
+    free(shareStep);
+    shareStep = newTable;
+    shareStepSize = newSize;
+  }
+
+  unsigned long hash = shareStepHash(stmt, owner, hyps, numHyps);
+  long slot = getShareStepSlot(stmt, owner, hyps, numHyps, hash);
+  if (shareStep[slot].stmt != -1) bug(2111); // Already there
+  shareStep[slot].hyps = malloc((size_t)(numHyps ? numHyps : 1)
+      * sizeof(nmbrString *));
+  if (!shareStep[slot].hyps) outOfMemory("#136 (shareStep hyps)");
+  for (long i = 0; i < numHyps; i++) shareStep[slot].hyps[i] = hyps[i];
+  shareStep[slot].stmt = stmt;
+  shareStep[slot].owner = owner;
+  shareStep[slot].result = result;
+  shareStep[slot].hash = hash;
+  shareStepCount++;
+} // addSharedStep
+
+// Deallocate the shared math strings and remembered steps
+void eraseStepSharing(void) {
+  for (long i = 0; i < shareStringSize; i++) {
+    if (shareString[i].mathString != NULL) {
+      free_nmbrString(shareString[i].mathString);
+    }
+  }
+  for (long i = 0; i < shareStepSize; i++) {
+    if (shareStep[i].stmt != -1) free(shareStep[i].hyps);
+  }
+  free(shareString);
+  free(shareStep);
+  shareString = NULL;
+  shareStep = NULL;
+  shareStringSize = 0;
+  shareStringCount = 0;
+  shareStringTokens = 0;
+  shareStepSize = 0;
+  shareStepCount = 0;
+} // eraseStepSharing
+
+// Return the number of distinct math strings currently shared
+long stepSharingStrings(void) {
+  return shareStringCount;
+} // stepSharingStrings
+
+// Packed copy of the statement fields used during verification
+struct verifyView_struct g_VerifyView = {0, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+
+// Build g_VerifyView from g_Statement[]
+void buildVerifyView(void) {
+  eraseVerifyView();
+  long n = g_statements + 1; // Statement 0 is unused but keeps the indexing
+  long hypTotal = 0;
+  long tokenTotal = 0;
+  long disjTotal = 0;
+  for (long stmt = 0; stmt < n; stmt++) {
+    hypTotal += g_Statement[stmt].numReqHyp;
+    tokenTotal += nmbrLen(g_Statement[stmt].mathString) + 1;
+    disjTotal += nmbrLen(g_Statement[stmt].reqDisjVarsA);
+  }
+
+  struct verifyView_struct *v = &g_VerifyView;
+  v->type = malloc((size_t)n * sizeof(char));
+  v->numReqHyp = malloc((size_t)n * sizeof(long));
+  v->hypStart = malloc((size_t)n * sizeof(long));
+  v->hypPool = malloc((size_t)(hypTotal + 1) * sizeof(nmbrString));
+  v->mathStart = malloc((size_t)n * sizeof(long));
+  v->mathLen = malloc((size_t)n * sizeof(long));
+  v->tokenPool = malloc((size_t)tokenTotal * sizeof(nmbrString));
+  v->numReqVar = malloc((size_t)n * sizeof(long));
+  v->reqDisjStart = malloc((size_t)n * sizeof(long));
+  v->reqDisjLen = malloc((size_t)n * sizeof(long));
+  v->disjPoolA = malloc((size_t)(disjTotal + 1) * sizeof(nmbrString));
+  v->disjPoolB = malloc((size_t)(disjTotal + 1) * sizeof(nmbrString));
+  if (!v->type || !v->numReqHyp || !v->hypStart || !v->hypPool
+      || !v->mathStart || !v->mathLen || !v->tokenPool || !v->numReqVar
+      || !v->reqDisjStart || !v->reqDisjLen || !v->disjPoolA
+      || !v->disjPoolB) {
+    outOfMemory("#138 (g_VerifyView)");
+  }
+
+  long hypPos = 0;
+  long tokenPos = 0;
+  long disjPos = 0;
+  for (long stmt = 0; stmt < n; stmt++) {
+    struct statement_struct *s = &g_Statement[stmt];
+    v->type[stmt] = s->type;
+    v->numReqHyp[stmt] = s->numReqHyp;
+    v->hypStart[stmt] = hypPos;
+    for (long i = 0; i < s->numReqHyp; i++) {
+      v->hypPool[hypPos++] = s->reqHypList[i];
+    }
+    long len = nmbrLen(s->mathString);
+    v->mathStart[stmt] = tokenPos;
+    v->mathLen[stmt] = len;
+    memcpy(v->tokenPool + tokenPos, s->mathString,
+        (size_t)len * sizeof(nmbrString));
+    tokenPos += len;
+    v->tokenPool[tokenPos++] = -1;
+    v->numReqVar[stmt] = nmbrLen(s->reqVarList);
+    len = nmbrLen(s->reqDisjVarsA);
+    v->reqDisjStart[stmt] = disjPos;
+    v->reqDisjLen[stmt] = len;
+    memcpy(v->disjPoolA + disjPos, s->reqDisjVarsA,
+        (size_t)len * sizeof(nmbrString));
+    memcpy(v->disjPoolB + disjPos, s->reqDisjVarsB,
+        (size_t)len * sizeof(nmbrString));
+    disjPos += len;
+  }
+  if (hypPos != hypTotal || tokenPos != tokenTotal || disjPos != disjTotal) {
+    bug(2112);
+  }
+  v->statements = g_statements;
+} // buildVerifyView
+
+// Deallocate g_VerifyView
+void eraseVerifyView(void) {
+  struct verifyView_struct *v = &g_VerifyView;
+  free(v->type);
+  free(v->numReqHyp);
+  free(v->hypStart);
+  free(v->hypPool);
+  free(v->mathStart);
+  free(v->mathLen);
+  free(v->tokenPool);
+  free(v->numReqVar);
+  free(v->reqDisjStart);
+  free(v->reqDisjLen);
+  free(v->disjPoolA);
+  free(v->disjPoolB);
+  struct verifyView_struct empty = {0, NULL, NULL, NULL, NULL, NULL,
+      NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+  *v = empty;
+} // eraseVerifyView
+
+// Make buf a nmbrString of length len, reusing its space if possible.  Its
+// contents are not preserved.
+static void setVerifyBufLen(nmbrString **buf, long len) {
+  if (nmbrAllocLen(*buf) < len) {
+    nmbrLet(buf, nmbrSpace(len));
+  } else {
+    nmbrZapLen(*buf, len);
+    (*buf)[len] = -1;
+  }
+} // setVerifyBufLen
+
 // Verify proof of one statement in source file.  Uses wrkProof structure.
 // Assumes that parseProof() has just been called for this statement.
 // Returns 0 if proof is OK; 1 if proof is incomplete (has '?' tokens);
@@ -25,6 +341,11 @@ struct getStep_struct getStep = {0, 0, 0, 0, 0,
 char verifyProof(long statemNum) {
   if (g_Statement[statemNum].type != p_) return 4; // Do nothing if not $p
 
+  stepsShared = g_stepSharing;
+  if (stepsShared && shareStringTokens > SHARE_MAX_TOKENS) {
+    eraseStepSharing(); // Keep memory use bounded
+  }
+
   // Initialize pointers to math strings in RPN stack and vs. statement.
   // (Must be initialized, even if severe error, to prevent crashes later.)
   for (long i = 0; i < g_WrkProof.numSteps; i++) {
@@ -32,6 +353,9 @@ char verifyProof(long statemNum) {
   }
   // Error too severe to check here
   if (g_WrkProof.errorSeverity > 2) return g_WrkProof.errorSeverity;
+
+  if (g_VerifyView.statements != g_statements) buildVerifyView();
+  const struct verifyView_struct *v = &g_VerifyView;
                                     
   g_WrkProof.RPNStackPtr = 0;
   // Empty proof caused by error found in parseProof
@@ -39,6 +363,8 @@ char verifyProof(long statemNum) {
 
   nmbrString_def(bigSubstSchemeHyp);
   nmbrString_def(bigSubstInstHyp);
+  nmbrString **hyps = NULL; // Shared hypotheses of a step
+  long hypsAlloc = 0;
   char returnFlag = 0;
   for (long step = 0; step < g_WrkProof.numSteps; step++) {
     long stmt = g_WrkProof.proofString[step]; // Contents of proof string location
@@ -73,7 +399,7 @@ char verifyProof(long statemNum) {
       continue;
     }
 
-    char type = g_Statement[stmt].type;
+    char type = v->type[stmt];
 
     // See if the proof token is a hypothesis
     if (type == e_ || type == f_) {
@@ -85,8 +411,9 @@ char verifyProof(long statemNum) {
 
       // Assign a math string to the step (must not be deallocated by
       // cleanWrkProof()!)
-      g_WrkProof.mathStringPtrs[step] =
-          g_Statement[stmt].mathString;
+      g_WrkProof.mathStringPtrs[step] = stepsShared
+          ? getSharedString(g_Statement[stmt].mathString, 0)
+          : g_Statement[stmt].mathString;
 
       continue;
     }
@@ -95,8 +422,41 @@ char verifyProof(long statemNum) {
     if (type != a_ && type != p_) bug(2102);
 
     // It's an valid assertion.
-    long numReqHyp = g_Statement[stmt].numReqHyp;
-    nmbrString *nmbrHypPtr = g_Statement[stmt].reqHypList;
+    long numReqHyp = v->numReqHyp[stmt];
+    const nmbrString *nmbrHypPtr = v->hypPool + v->hypStart[stmt];
+
+    // See if the same step was seen before.  Steps using an assertion with
+    // $d's are only reused within the same statement being proved, since
+    // their $d check depends on it.  (Not when getting step info, since
+    // assignVar() collects it.)
+    long owner = -1;
+    long errorCount = g_WrkProof.errorCount;
+    disjViolation = 0;
+    if (stepsShared) {
+      if (v->reqDisjLen[stmt]) owner = statemNum;
+      // Gather the hypotheses' shared math strings into hyps[]
+      if (numReqHyp > hypsAlloc) {
+        hypsAlloc = numReqHyp;
+        free(hyps);
+        hyps = malloc((size_t)hypsAlloc * sizeof(nmbrString *));
+        if (!hyps) outOfMemory("#137 (verifyProof hyps)");
+      }
+      for (long i = 0; i < numReqHyp; i++) {
+        hyps[i] = g_WrkProof.mathStringPtrs[g_WrkProof.RPNStack[
+            g_WrkProof.RPNStackPtr - numReqHyp + i]];
+      }
+      nmbrString *result = getStep.stepNum ? NULL
+          : lookupSharedStep(stmt, owner, hyps, numReqHyp);
+      if (result) {
+        g_stepShareHits++;
+        g_WrkProof.mathStringPtrs[step] = result;
+        // Pop the stack
+        g_WrkProof.RPNStackPtr = g_WrkProof.RPNStackPtr - numReqHyp;
+        g_WrkProof.RPNStack[g_WrkProof.RPNStackPtr] = step;
+        g_WrkProof.RPNStackPtr++;
+        continue;
+      }
+    }
 
     // Assemble the hypotheses into two big math strings for unification.
     // Use a "dummy" token, the top of g_mathTokens array, to separate them.
@@ -104,28 +464,42 @@ char verifyProof(long statemNum) {
     //    g_MathToken[g_mathTokens].tokenType = (char)con_;
     //    g_MathToken[g_mathTokens].tokenName = "$|$"; // Don't deallocate!
 
-    nmbrLet(&bigSubstSchemeHyp, nmbrAddElement(NULL_NMBRSTRING, g_mathTokens));
-    nmbrLet(&bigSubstInstHyp, nmbrAddElement(NULL_NMBRSTRING, g_mathTokens));
+    // The lengths are found first so that each is built in place.
+    long schemeLen = 1;
+    long instLen = 1;
+    for (long j = 0; j < numReqHyp; j++) {
+      long len = nmbrLen(g_WrkProof.mathStringPtrs[g_WrkProof.RPNStack[
+          g_WrkProof.RPNStackPtr - numReqHyp + j]]);
+      // (An unknown hyp has an empty scheme; see below)
+      schemeLen += (len ? v->mathLen[nmbrHypPtr[j]] : 0) + 1;
+      instLen += len + 1;
+    }
+    setVerifyBufLen(&bigSubstSchemeHyp, schemeLen);
+    setVerifyBufLen(&bigSubstInstHyp, instLen);
+    bigSubstSchemeHyp[0] = g_mathTokens;
+    bigSubstInstHyp[0] = g_mathTokens;
+    long schemePos = 1;
+    long instPos = 1;
     flag unkHypFlag = 0; // Flag that there are unknown hypotheses
     long j = 0;
     for (long i = g_WrkProof.RPNStackPtr - numReqHyp; i < g_WrkProof.RPNStackPtr; i++) {
       nmbrString *nmbrTmpPtr = g_WrkProof.mathStringPtrs[
           g_WrkProof.RPNStack[i]];
-      if (nmbrTmpPtr[0] == -1) { // If length is zero, hyp is unknown
+      long len = nmbrLen(nmbrTmpPtr);
+      if (len == 0) { // If length is zero, hyp is unknown
         unkHypFlag = 1;
-        // Assign scheme to empty nmbrString so it will always match instance
-        nmbrLet(&bigSubstSchemeHyp,
-            nmbrCat(bigSubstSchemeHyp,
-            nmbrAddElement(nmbrTmpPtr, g_mathTokens), NULL));
+        // Leave the scheme empty so it will always match instance
       } else {
-        nmbrLet(&bigSubstSchemeHyp,
-            nmbrCat(bigSubstSchemeHyp,
-            nmbrAddElement(g_Statement[nmbrHypPtr[j]].mathString,
-            g_mathTokens), NULL));
+        long hyp = nmbrHypPtr[j];
+        memcpy(bigSubstSchemeHyp + schemePos, v->tokenPool + v->mathStart[hyp],
+            (size_t)(v->mathLen[hyp]) * sizeof(nmbrString));
+        schemePos += v->mathLen[hyp];
       }
-      nmbrLet(&bigSubstInstHyp,
-          nmbrCat(bigSubstInstHyp,
-          nmbrAddElement(nmbrTmpPtr, g_mathTokens), NULL));
+      bigSubstSchemeHyp[schemePos++] = g_mathTokens;
+      memcpy(bigSubstInstHyp + instPos, nmbrTmpPtr,
+          (size_t)len * sizeof(nmbrString));
+      instPos += len;
+      bigSubstInstHyp[instPos++] = g_mathTokens;
       j++;
 
       // Get information about the step if requested
@@ -137,8 +511,7 @@ char verifyProof(long statemNum) {
         }
         if (step == getStep.stepNum - 1) {
           // Add to source hypothesis list
-          nmbrLet(&getStep.sourceHyps, nmbrAddElement(getStep.sourceHyps,
-              g_WrkProof.RPNStack[i]));
+          nmbrPush(&getStep.sourceHyps, g_WrkProof.RPNStack[i]);
         }
       } // End of if (getStep.stepNum)
     }
@@ -159,7 +532,17 @@ char verifyProof(long statemNum) {
     // Deallocate stack built up if there are many $d violations
     nmbrTempAlloc(0);
 
-    // Assign the substituted assertion (must be deallocated by cleanWrkProof()!)
+    if (stepsShared) {
+      nmbrTmpPtr = getSharedString(nmbrTmpPtr, 1);
+      // Remember it unless it is incomplete or gave an error message
+      if (!unkHypFlag && !getStep.stepNum && nmbrTmpPtr[0] != -1
+          && g_WrkProof.errorCount == errorCount && !disjViolation) {
+        addSharedStep(stmt, owner, hyps, numReqHyp, nmbrTmpPtr);
+      }
+    }
+
+    // Assign the substituted assertion (must be deallocated by cleanWrkProof()
+    // unless shared!)
     g_WrkProof.mathStringPtrs[step] = nmbrTmpPtr;
     if (nmbrTmpPtr[0] == -1) {
       if (!unkHypFlag) {
@@ -178,8 +561,11 @@ char verifyProof(long statemNum) {
 
   // See if the result matches the statement to be proved.
   if (returnFlag == 0) {
-    if (!nmbrEq(g_Statement[statemNum].mathString,
-        g_WrkProof.mathStringPtrs[g_WrkProof.numSteps - 1])) {
+    if (stepsShared
+        ? getSharedString(g_Statement[statemNum].mathString, 0)
+            != g_WrkProof.mathStringPtrs[g_WrkProof.numSteps - 1]
+        : !nmbrEq(g_Statement[statemNum].mathString,
+            g_WrkProof.mathStringPtrs[g_WrkProof.numSteps - 1])) {
       if (!g_WrkProof.errorCount) {
         char *fbPtr = g_WrkProof.stepSrcPtrPntr[g_WrkProof.numSteps - 1];
         long tokenLength = g_WrkProof.stepSrcPtrNmbr[g_WrkProof.numSteps - 1];
@@ -200,6 +586,7 @@ char verifyProof(long statemNum) {
 
   free_nmbrString(bigSubstSchemeHyp);
   free_nmbrString(bigSubstInstHyp);
+  free(hyps);
 
   return returnFlag;
 } // verifyProof
@@ -243,7 +630,7 @@ nmbrString *assignVar(nmbrString *bigSubstSchemeAss,
   nmbrLet(&varAssLen,substSchemeFrstVarOcc);
   nmbrLet(&substInstFrstVarOcc,substSchemeFrstVarOcc);
 
-  if (bigSubstSchemeVarLen != nmbrLen(g_Statement[substScheme].reqVarList)) {
+  if (bigSubstSchemeVarLen != g_VerifyView.numReqVar[substScheme]) {
     if (unkHypFlag) {
       // If there are unknown hypotheses and all variables aren't present,
       // give up here.
@@ -312,6 +699,7 @@ ambiguityCheck: // Re-entry point to see if unification is unique
             break; // Error - possibilities exhausted
           }
           varAssLen[v]++;
+          g_assignVarBacktracks++;
           p = substSchemeFrstVarOcc[v] + 1;
           q = substInstFrstVarOcc[v] + varAssLen[v];
           contFlag = 0;
@@ -374,6 +762,7 @@ ambiguityCheck: // Re-entry point to see if unification is unique
               break; // Error - possibilities exhausted
             }
             varAssLen[v]++;
+            g_assignVarBacktracks++;
             p = substSchemeFrstVarOcc[v] + 1;
             q = substInstFrstVarOcc[v] + varAssLen[v];
             contFlag = 0;
@@ -523,17 +912,17 @@ ambiguityCheck: // Re-entry point to see if unification is unique
 
   /***** Check for $d violations *****/
   if (!ambiguityCheckFlag) { // This is the real (first) unification
-    nmbrString *nmbrTmpPtrAS = g_Statement[substScheme].reqDisjVarsA;
-    nmbrString *nmbrTmpPtrBS = g_Statement[substScheme].reqDisjVarsB;
-    long dLen = nmbrLen(nmbrTmpPtrAS); // Number of disjoint variable pairs
+    const struct verifyView_struct *view = &g_VerifyView;
+    long d = view->reqDisjStart[substScheme];
+    const nmbrString *nmbrTmpPtrAS = view->disjPoolA + d;
+    const nmbrString *nmbrTmpPtrBS = view->disjPoolB + d;
+    long dLen = view->reqDisjLen[substScheme]; // Number of disj var pairs
     if (dLen) { // There is a disjoint variable requirement
       // (Speedup) Save pointers and lengths for statement being proved
-      nmbrString *nmbrTmpPtrAIR = g_Statement[statementNum].reqDisjVarsA;
-      nmbrString *nmbrTmpPtrBIR = g_Statement[statementNum].reqDisjVarsB;
-      long dILenR = nmbrLen(nmbrTmpPtrAIR); // Number of disj hypotheses
-      nmbrString *nmbrTmpPtrAIO = g_Statement[statementNum].optDisjVarsA;
-      nmbrString *nmbrTmpPtrBIO = g_Statement[statementNum].optDisjVarsB;
-      long dILenO = nmbrLen(nmbrTmpPtrAIO); // Number of disj hypotheses
+      d = view->reqDisjStart[statementNum];
+      const nmbrString *nmbrTmpPtrAIR = view->disjPoolA + d;
+      const nmbrString *nmbrTmpPtrBIR = view->disjPoolB + d;
+      long dILenR = view->reqDisjLen[statementNum]; // Number of disj hyps
       for (long pos = 0; pos < dLen; pos++) { // Scan the disj var pairs
         long substAPos = g_MathToken[nmbrTmpPtrAS[pos]].tmp;
         long substALen = varAssLen[substAPos];
@@ -547,42 +936,23 @@ ambiguityCheck: // Re-entry point to see if unification is unique
 
           // Speed up:  find the 1st occurrence of aToken in the disjoint variable
           // list of the statement being proved.
-          long optStart, reqStart = 0;
+          long reqStart = dILenR; // Force skipping required scan if not found
           // To bypass speedup, we would do this:
           //    reqStart = 0;
-          //    optStart = 0;
-          // First, see if the variable is in the required list.
-          flag foundFlag = 0;
           for (long i = 0; i < dILenR; i++) {
             if (nmbrTmpPtrAIR[i] == aToken
                 || nmbrTmpPtrBIR[i] == aToken) {
-              foundFlag = 1;
               reqStart = i;
               break;
             }
           }
-          // If not, see if it is in the optional list.
-          if (!foundFlag) {
-            reqStart = dILenR; // Force skipping required scan
-            foundFlag = 0;
-            for (long i = 0; i < dILenO; i++) {
-              if (nmbrTmpPtrAIO[i] == aToken
-                  || nmbrTmpPtrBIO[i] == aToken) {
-                foundFlag = 1;
-                optStart = i;
-                break;
-              }
-            }
-            if (!foundFlag) optStart = dILenO; // Force skipping optional scan
-          } else {
-            optStart = 0;
-          } // (End if (!foundFlag))
           // (End of speedup section)
 
           for (long b = 0; b < substBLen; b++) { // Scan subst of 2nd var in pair
             long bToken = bigSubstInstAss[instBPos + b];
             if (g_MathToken[bToken].tokenType == (char)con_) continue; // Ignore
             if (aToken == bToken) {
+              disjViolation = 1;
               if (!g_WrkProof.errorCount) { // No previous errors in this proof
                 sourceError(g_WrkProof.stepSrcPtrPntr[step], // source ptr
                     g_WrkProof.stepSrcPtrNmbr[step], // size of token
@@ -639,20 +1009,14 @@ ambiguityCheck: // Re-entry point to see if unification is unique
                   }
                 }
               }
-              // If not, see if they are in the optional list.
+              // If not, see if they are in the optional list, which is kept
+              // as the scope frame of the statement (see activeDisjPair()).
               if (!foundFlag) {
-                foundFlag = 0;
-                for (long i = optStart; i < dILenO; i++) {
-                  if (nmbrTmpPtrAIO[i] == aToken2) {
-                    if (nmbrTmpPtrBIO[i] == bToken2) {
-                      foundFlag = 1;
-                      break;
-                    }
-                  }
-                }
+                foundFlag = activeDisjPair(statementNum, aToken2, bToken2);
               } // (End if (!foundFlag))
               // If they were in neither place, we have a violation.
               if (!foundFlag) {
+                disjViolation = 1;
                 if (!g_WrkProof.errorCount) { // No previous errors in this proof
                   sourceError(g_WrkProof.stepSrcPtrPntr[step], // source
                       g_WrkProof.stepSrcPtrNmbr[step], // size of token
@@ -707,11 +1071,13 @@ ambiguityCheck: // Re-entry point to see if unification is unique
   /***** (End of $d violation check) *****/
 
   // Assemble the final result
-  long substSchemeLen = nmbrLen(g_Statement[substScheme].mathString);
+  long substSchemeLen = g_VerifyView.mathLen[substScheme];
+  const nmbrString *substSchemeStr = g_VerifyView.tokenPool
+      + g_VerifyView.mathStart[substScheme];
   // Calculate the length of the final result
   q = 0;
   for (long p = 0; p < substSchemeLen; p++) {
-    long tokenNum = g_Statement[substScheme].mathString[p];
+    long tokenNum = substSchemeStr[p];
     if (g_MathToken[tokenNum].tokenType == (char)con_) {
       q++;
     } else {
@@ -724,7 +1090,7 @@ ambiguityCheck: // Re-entry point to see if unification is unique
   // Assign the final result
   q = 0;
   for (long p = 0; p < substSchemeLen; p++) {
-    long tokenNum = g_Statement[substScheme].mathString[p];
+    long tokenNum = substSchemeStr[p];
     if (g_MathToken[tokenNum].tokenType == (char)con_) {
       result[q] = tokenNum;
       q++;
@@ -764,6 +1130,7 @@ ambiguityCheck: // Re-entry point to see if unification is unique
         goto returnPoint; // It's unique
       }
       varAssLen[v]++;
+      g_assignVarBacktracks++;
       p = substSchemeFrstVarOcc[v] + 1;
       q = substInstFrstVarOcc[v] + varAssLen[v];
       if (bigSubstInstAss[q - 1] != g_mathTokens) break;
@@ -799,6 +1166,7 @@ ambiguityCheck: // Re-entry point to see if unification is unique
 // Note that this does NOT free the other allocations in g_WrkProof.  The
 // ERASE command will do this.
 void cleanWrkProof(void) {
+  if (stepsShared) return; // The math strings belong to the shared tables
   for (long step = 0; step < g_WrkProof.numSteps; step++) {
     if (g_WrkProof.proofString[step] > 0) {
       char type = g_Statement[g_WrkProof.proofString[step]].type;
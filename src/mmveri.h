@@ -11,8 +11,52 @@
 
 #include "mmdata.h"
 
+/*! \brief Packed, read-only copy of the statement fields used by verifyProof()
+  and assignVar()
+
+  The arrays are indexed by statement number.  The lists of a statement are
+  stored contiguously in shared pools, so verifying a proof doesn't have to
+  touch the much larger g_Statement[] records.  Each math string in
+  tokenPool is followed by -1, but the pools are not nmbrStrings:  don't pass
+  pointers into them to nmbrLen() or other nmbrString functions. */
+struct verifyView_struct {
+  long statements; /*!< Number of statements in the view; 0 = not built */
+  char *type; /*!< Statement type (a_, p_, e_, f_,...) */
+  long *numReqHyp; /*!< Number of required hypotheses */
+  long *hypStart; /*!< Start of the required hypotheses in hypPool */
+  nmbrString *hypPool;
+  long *mathStart; /*!< Start of the math string in tokenPool */
+  long *mathLen; /*!< Length of the math string */
+  nmbrString *tokenPool;
+  long *numReqVar; /*!< Number of required variables */
+  long *reqDisjStart; /*!< Start of the required $d pairs in disjPoolA/B */
+  long *reqDisjLen; /*!< Number of required $d pairs */
+  nmbrString *disjPoolA; /*!< 1st variables of the $d pairs */
+  nmbrString *disjPoolB; /*!< 2nd variables of the $d pairs */
+};
+extern struct verifyView_struct g_VerifyView;
+
+/*! Build g_VerifyView from g_Statement[].  Called by readInput() after
+   parseStatements(); verifyProof() also rebuilds it if it is missing. */
+void buildVerifyView(void);
+
+/*! Deallocate g_VerifyView.  Called by eraseSource(). */
+void eraseVerifyView(void);
+
 char verifyProof(long statemNum);
 
+extern flag g_stepSharing; /*!< Share equal step results in verifyProof()
+                                (SET STEP_SHARING) */
+extern long g_stepShareHits; /*!< Steps whose result verifyProof() reused */
+extern long g_assignVarBacktracks; /*!< Variable assignments assignVar() retried */
+
+/*! Deallocate the math strings and steps shared by verifyProof().  Called
+   by eraseSource() and when step sharing is turned off. */
+void eraseStepSharing(void);
+
+/*! Returns the number of distinct math strings shared by verifyProof() */
+long stepSharingStrings(void);
+
 /*! assignVar() finds an assignment to substScheme variables that match
    the assumptions specified in the reason string */
 nmbrString *assignVar(nmbrString *bigSubstSchemeAss,
@@ -29,6 +29,7 @@ This is an emulation of the string functions available in VMS BASIC.
 //   http://us.metamath.org/downloads/quantum-logic.tar.gz
 
 /*E*/long db1=0;
+long g_letCount = 0;
 
 /*!
  * \def INCDB1
@@ -43,6 +44,27 @@ This is an emulation of the string functions available in VMS BASIC.
 # define INCDB1(x) db1 += (x)
 #endif
 
+#ifdef VSTRING_HEADER
+/*!
+ * \brief hidden header in front of the text of every non-empty vstring
+ *   allocated by this library, compiled in with -DVSTRING_HEADER.
+ *
+ * \a room is the number of characters the allocation holds besides the
+ * terminating NUL, so that let() can reuse a target without scanning its old
+ * text.  \a length caches the length of the text.  It is only trusted for
+ * temporaries still on \ref tempAllocStack:  callers may shorten the vstrings
+ * they own in place, and the string arguments of this library may be literals
+ * or string tails without any header.
+ */
+struct vstringHeader {
+  size_t length; // VSTRING_UNKNOWN_LENGTH if not computed yet
+  size_t room;
+};
+#define VSTRING_UNKNOWN_LENGTH ((size_t)-1)
+#define VSTRING_HDR(s) ((struct vstringHeader *)(void *)(s) - 1)
+#define VSTRING_ROOM(s) ((s)[0] ? VSTRING_HDR(s)->room : 0)
+#endif
+
 /*!
  * \def MAX_ALLOC_STACK
  *
@@ -85,13 +107,51 @@ void freeTempAlloc(void) {
   // g_startTempAllocStack.
   long i;
   for (i = g_startTempAllocStack; i < g_tempAllocStackTop; i++) {
+#ifdef VSTRING_HEADER
+/*E*/INCDB1(-1 - (long)VSTRING_HDR(tempAllocStack[i])->room);
+    free(VSTRING_HDR(tempAllocStack[i]));
+#else
 /*E*/INCDB1(-1 - (long)strlen(tempAllocStack[i]));
 /*E*/  // printf("%ld removing [%s]\n", db1, tempAllocStack[i]);
     free(tempAllocStack[i]);
+#endif
   }
   g_tempAllocStackTop = g_startTempAllocStack;
 } // freeTempAlloc
 
+// Allocate uninitialized room for a vstring of up to room characters, or
+// return NULL
+static vstring newVstring(size_t room) {
+#ifdef VSTRING_HEADER
+  struct vstringHeader *header = malloc(sizeof(struct vstringHeader)
+      + room + 1);
+  if (!header) return NULL;
+  header->length = VSTRING_UNKNOWN_LENGTH;
+  header->room = room;
+  return (vstring)(header + 1);
+#else
+  return malloc(room + 1);
+#endif
+} // newVstring
+
+// Length of a string argument.  With VSTRING_HEADER, temporaries still on
+// the stack remember it, so it is found without scanning the text.
+static size_t argLength(const char *s) {
+#ifdef VSTRING_HEADER
+  long i;
+  if (!s[0]) return 0;
+  for (i = g_tempAllocStackTop - 1; i >= 0; i--) {
+    if (tempAllocStack[i] == s) {
+      if (VSTRING_HDR(s)->length == VSTRING_UNKNOWN_LENGTH) {
+        VSTRING_HDR(s)->length = strlen(s);
+      }
+      return VSTRING_HDR(s)->length;
+    }
+  }
+#endif
+  return strlen(s);
+} // argLength
+
 /*!
  * \fn pushTempAlloc(void *mem)
  * \brief pushes a pointer onto the \ref tempAllocStack.
@@ -123,6 +183,7 @@ static void pushTempAlloc(void *mem)
     bug(2201);
   }
   tempAllocStack[g_tempAllocStackTop++] = mem;
+  g_tempAllocCount++;
 } // pushTempAlloc
 
 /*!
@@ -149,8 +210,8 @@ static void pushTempAlloc(void *mem)
  */
 static void* tempAlloc(long size) // String memory allocation/deallocation
 {
-  void* memptr = malloc((size_t)size);
-  if (!memptr || size == 0) {
+  void* memptr = size ? newVstring((size_t)size - 1) : NULL;
+  if (!memptr) {
     printf("*** FATAL ERROR ***  Temporary string allocation failed\n");
 #if __STDC__
     fflush(stdout);
@@ -167,8 +228,15 @@ static void* tempAlloc(long size) // String memory allocation/deallocation
 temp_vstring makeTempAlloc(vstring s) {
   if (s[0]) { // Don't do it if vstring is empty
     pushTempAlloc(s);
+#ifdef VSTRING_HEADER
+    // The owner may have shortened s in place
+    VSTRING_HDR(s)->length = VSTRING_UNKNOWN_LENGTH;
+/*E*/INCDB1((long)VSTRING_HDR(s)->room + 1);
+/*E*/db-=(long)VSTRING_HDR(s)->room + 1;
+#else
 /*E*/INCDB1((long)strlen(s) + 1);
 /*E*/db-=(long)strlen(s) + 1;
+#endif
 /*E*/  // printf("%ld temping[%s]\n", db1, s);
   }
   return s;
@@ -177,7 +245,43 @@ temp_vstring makeTempAlloc(vstring s) {
 // String assignment
 void let(vstring *target, const char *source) {
 
-  size_t sourceLength = strlen(source); // Save its length
+  size_t sourceLength = argLength(source); // Save its length
+#ifdef VSTRING_HEADER
+  size_t targetRoom = VSTRING_ROOM(*target);
+  vstring newTarget;
+  if (targetRoom < sourceLength) { // Old string has not enough room
+    // Grow geometrically, so that a vstring built up piece by piece is
+    // reallocated only a logarithmic number of times
+    size_t room = 2 * targetRoom;
+    if (room < sourceLength) room = sourceLength;
+    newTarget = newVstring(room);
+    if (!newTarget) {
+      printf("*** FATAL ERROR ***  String memory couldn't be allocated\n");
+#if __STDC__
+      fflush(stdout);
+#endif
+      bug(2207);
+    }
+/*E*/db += (long)room + 1;
+    if (targetRoom) {
+/*E*/db -= (long)targetRoom + 1;
+      free(VSTRING_HDR(*target));
+    }
+    *target = newTarget;
+    targetRoom = room;
+  }
+  if (sourceLength) {
+    memcpy(*target, source, sourceLength + 1);
+    VSTRING_HDR(*target)->length = sourceLength;
+  } else {
+    // Empty strings could still be temporaries, so always assign a constant
+    if (targetRoom) {
+/*E*/db -= (long)targetRoom + 1;
+      free(VSTRING_HDR(*target));
+    }
+    *target = "";
+  }
+#else
   size_t targetLength = strlen(*target); // Save its length
 /*E*/if (targetLength) {
 /*E*/  db -= (long)targetLength+1;
@@ -191,7 +295,7 @@ void let(vstring *target, const char *source) {
     // Free old string space and allocate new space
     if (targetLength)
       free(*target); // Free old space
-    *target = malloc(sourceLength + 1); // Allocate new space
+    *target = newVstring(sourceLength); // Allocate new space
     if (!*target) {
       printf("*** FATAL ERROR ***  String memory couldn't be allocated\n");
 #if __STDC__
@@ -209,10 +313,47 @@ void let(vstring *target, const char *source) {
     }
     *target = "";
   }
+#endif
 
+  g_letCount++;
   freeTempAlloc(); // Free up temporary strings used in expression computation
 } // let
 
+vstring allocVstring(size_t room) {
+  vstring s = newVstring(room);
+#ifdef VSTRING_HEADER
+/*E*/if (s) db += (long)room + 1;
+#endif
+  return s;
+} // allocVstring
+
+vstring reallocVstring(vstring s, size_t room) {
+#ifdef VSTRING_HEADER
+  struct vstringHeader *header;
+  size_t oldRoom;
+  if (!s[0]) return allocVstring(room);
+  oldRoom = VSTRING_HDR(s)->room;
+  header = realloc(VSTRING_HDR(s), sizeof(struct vstringHeader) + room + 1);
+  if (!header) return NULL;
+/*E*/db += (long)room - (long)oldRoom;
+  header->length = VSTRING_UNKNOWN_LENGTH;
+  header->room = room;
+  return (vstring)(header + 1);
+#else
+  if (!s[0]) return malloc(room + 1);
+  return realloc(s, room + 1);
+#endif
+} // reallocVstring
+
+void deallocVstring(vstring s) {
+#ifdef VSTRING_HEADER
+/*E*/db -= (long)VSTRING_HDR(s)->room + 1;
+  free(VSTRING_HDR(s));
+#else
+  free(s);
+#endif
+} // deallocVstring
+
 // String concatenation
 temp_vstring cat(const char *string1, ...) {
 #define MAX_CAT_ARGS 50
@@ -237,7 +378,7 @@ temp_vstring cat(const char *string1, ...) {
     }
     arg[numArgs] = curArg;
     argPos[numArgs] = pos;
-    pos += strlen(curArg);
+    pos += argLength(curArg);
   } while (++numArgs, (curArg = va_arg(ap,char *)) != 0);
   va_end(ap); // End varargs session
 
@@ -245,7 +386,12 @@ temp_vstring cat(const char *string1, ...) {
   temp_vstring result = tempAlloc((long)pos+1);
   // Move the strings into the newly allocated area
   for (i = 0; i < numArgs; ++i)
-    strcpy(result + argPos[i], arg[i]);
+    memcpy(result + argPos[i], arg[i],
+        (i + 1 < numArgs ? argPos[i + 1] : pos) - argPos[i]);
+  result[pos] = 0;
+#ifdef VSTRING_HEADER
+  VSTRING_HDR(result)->length = pos;
+#endif
   return result;
 } // cat
 
@@ -299,7 +445,7 @@ int linput(FILE *stream, const char* ask, vstring *target) {
 
 // Find out the length of a string
 long len(const char *s) {
-  return (long)strlen(s);
+  return (long)argLength(s);
 } // len
 
 // Extract sin from character position start to stop into sout
@@ -313,9 +459,15 @@ temp_vstring mid(const char *sin, long start, long length) {
   if (start < 1) start = 1;
   if (length < 0) length = 0;
   temp_vstring sout = tempAlloc(length + 1);
-  strncpy(sout, sin + start - 1, (size_t)length);
+  // Copy up to the end of sin, which memchr() stops reading at
+  const char *end = memchr(sin + start - 1, 0, (size_t)length);
+  if (end) length = end - (sin + start - 1);
+  memcpy(sout, sin + start - 1, (size_t)length);
 /*E*/ // ??? Should db be subtracted from if length > end of string?
   sout[length] = 0;
+#ifdef VSTRING_HEADER
+  VSTRING_HDR(sout)->length = (size_t)length;
+#endif
   return sout;
 } // mid
 
@@ -326,7 +478,7 @@ temp_vstring left(const char *sin, long n) {
 
 // Extract after character n
 temp_vstring right(const char *sin, long n) {
-  return seg(sin, n, (long)(strlen(sin)));
+  return seg(sin, n, (long)(argLength(sin)));
 } // right
 
 // Emulate VMS BASIC edit$ command
@@ -386,7 +538,7 @@ temp_vstring edit(const char *sin, long control) {
   discardcr_flag = control & 8192; // Discard CR's
 
   // Copy string
-  i = (long)strlen(sin) + 1;
+  i = (long)argLength(sin) + 1;
   if (untab_flag) i = i * 7; // Allow for max possible length
   temp_vstring sout = tempAlloc(i);
   strcpy(sout, sin);
@@ -618,11 +770,13 @@ temp_vstring edit(const char *sin, long control) {
 
 // Return a string of the same character
 temp_vstring string(long n, char c) {
-  long j = 0;
   if (n < 0) n = 0;
   temp_vstring sout = tempAlloc(n + 1);
-  while (j < n) sout[j++] = c;
-  sout[j] = 0;
+  memset(sout, c, (size_t)n);
+  sout[n] = 0;
+#ifdef VSTRING_HEADER
+  VSTRING_HDR(sout)->length = (size_t)n;
+#endif
   return sout;
 } // string
 
@@ -641,13 +795,13 @@ temp_vstring chr(long n) {
 
 long instr(long start, const char *string, const char *match) {
   const char *sp1, *sp2;
-  long ls1, ls2;
+  long ls2;
   long found = 0;
   if (start < 1) start = 1;
-  ls1 = (long)strlen(string);
   ls2 = (long)strlen(match);
-  if (start > ls1) start = ls1 + 1;
-  sp1 = string + start - 1;
+  // Clamp start to the terminating NUL without scanning the whole string
+  sp1 = memchr(string, 0, (size_t)start);
+  if (!sp1) sp1 = string + start - 1;
   while ((sp2 = strchr(sp1, match[0])) != 0) {
     if (strncmp(sp2, match, (size_t)ls2) == 0) {
       found = sp2 - string + 1;
@@ -693,6 +847,9 @@ temp_vstring xlate(const char *sin, const char *table)
         sout[j++] = m;
   }
   sout[j]='\0';
+#ifdef VSTRING_HEADER
+  VSTRING_HDR(sout)->length = (size_t)j;
+#endif
   return (sout);
 } // xlate
 
@@ -624,6 +624,33 @@ extern long g_tempAllocStackTop; // Top of stack for tempAlloc function
 // (normally 0, except for nested vstring functions).
 extern long g_startTempAllocStack; 
 
+/*!
+ * \brief allocates a \ref vstring buffer for code filling in large text
+ *   directly, such as a file read, instead of through let().
+ *
+ * The contents are uninitialized; the caller stores at most \p room
+ * characters and a terminating NUL.  Once filled, the buffer is an ordinary
+ * \ref vstring that let() may assign to or free.  When built with
+ * -DVSTRING_HEADER, vstrings carry a hidden header in front of their text, so
+ * such buffers must come from here rather than from malloc().
+ * \return the buffer, or NULL if out of memory.
+ */
+vstring allocVstring(size_t room);
+
+/*!
+ * \brief resizes a \ref vstring obtained from allocVstring() or let(), like
+ *   realloc().  An empty \p s is allocated anew.
+ * \return the resized buffer, or NULL if out of memory (then \p s is left
+ *   untouched).
+ */
+vstring reallocVstring(vstring s, size_t room);
+
+/*!
+ * \brief frees a non-empty \ref vstring obtained from allocVstring() or
+ *   let(), without freeing temporaries as let() does.
+ */
+void deallocVstring(vstring s);
+
 /*! \brief Make string have temporary allocation to be released by next let().
 
   This function effectively changes the type of `s`
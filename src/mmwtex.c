@@ -77,6 +77,41 @@ struct texDef_struct *g_TexDefs;
 
 // Variables local to this module (except some $t variables)
 long numSymbs;
+
+// Typesetting definition of each math token, indexed by math token number
+// (pointers into g_TexDefs[]; NULL if the token has no definition).  Built by
+// readTexDefs() so that getTexLongMath() doesn't have to look up each token.
+static char **tokenTexTable = NULL;
+static long tokenTexTableSize = 0;
+
+// Optional cache of getTexLongMath() results, keyed by the contents of the
+// math string.  It holds up to g_mathCacheMax entries and discards the least
+// recently used one when full.  Entries are linked in a hash chain by
+// hashNext and in order of use by older/newer.
+struct mathCache_struct {
+  nmbrString *mathString; // Key
+  vstring texLine; // getTexLongMath() result
+  unsigned long hash;
+  long hashNext; // Next entry in the same hash bucket; -1 = none
+  long older; // Next less recently used entry; -1 = none
+  long newer; // Next more recently used entry; -1 = none
+};
+long g_mathCacheMax = 0; // SET MATH_CACHE; 0 = no cache
+long g_mathCacheHits = 0;
+long g_mathCacheMisses = 0;
+static struct mathCache_struct *mathCache = NULL;
+static long *mathCacheBucket = NULL; // Hash bucket heads; -1 = empty
+static long mathCacheEntries = 0;
+static long mathCacheNewest = -1;
+static long mathCacheOldest = -1;
+// Output mode the cached entries were made for (see mathCacheMode())
+static int mathCacheEntryMode = 0;
+static int mathCacheMode(void);
+static unsigned long mathCacheHash(nmbrString *mathString, long len);
+static long lookupMathCache(nmbrString *mathString, long len,
+    unsigned long hash);
+static void addMathCache(nmbrString *mathString, long len,
+    unsigned long hash, vstring texLine);
 // Substitute character for $ in converting to obsolete $l,$m,$n
 // comments - Use '$' instead of non-printable ASCII 2 for debugging.
 #define DOLLAR_SUBST 2
@@ -128,6 +163,10 @@ void eraseTexDefs(void) {
     }
     free(g_TexDefs); // Deallocate the structure
   }
+  free(tokenTexTable);
+  tokenTexTable = NULL;
+  tokenTexTableSize = 0;
+  eraseMathCache(); // Cached results depend on the definitions
   free_vstring(htmlTitle);
   free_vstring(g_htmlHome);
   free_vstring(g_htmlCSS);
@@ -678,10 +717,17 @@ flag readTexDefs(
     }
   }
 
-  // Check to make sure all math tokens have typesetting definitions
+  // Check to make sure all math tokens have typesetting definitions,
+  // and save them by token number for getTexLongMath()
+  free(tokenTexTable);
+  tokenTexTable = malloc((size_t)(g_mathTokens + 1) * sizeof(char *));
+  if (!tokenTexTable) outOfMemory("#117 (tokenTexTable)");
+  tokenTexTableSize = g_mathTokens;
   for (i = 0; i < g_mathTokens; i++) {
     texDefsPtr = (void *)bsearch(g_MathToken[i].tokenName, g_TexDefs,
         (size_t)numSymbs, sizeof(struct texDef_struct), texSrchCmp);
+    tokenTexTable[i] = texDefsPtr
+        ? ((struct texDef_struct *)texDefsPtr)->texEquiv : NULL;
     if (!texDefsPtr) {
       printLongLine(cat("?Warning: The token \"", g_MathToken[i].tokenName,
        "\", which was defined in a $v or $c statement, was not declared in ",
@@ -2750,7 +2796,7 @@ flag printTexComment(vstring commentPtr, flag htmlCenterFlag,
           // equal input when no processing qualifiers are used.
           if (i > 1) {
             if (g_printString[i - 2] == '\n') {
-              let(&g_printString, left(g_printString, i - 1));
+              setPrintString(left(g_printString, i - 1));
             }
           }
         }
@@ -4361,6 +4407,157 @@ void writeTheoremList(long theoremsPerPage, flag showLemmas, flag noVersioning)
 // have a bunch of headers for sections planned for the future, but we
 // ignore them if those sections are empty (no $a or $p in them).
 
+// Section outline index.  Rather than copying and re-scanning the header
+// area of a statement each time getSectionHeadings() is called, the label
+// sections of all statements are scanned once for "$(" + newline +
+// decoration, and the location of each header found is recorded here.
+// Entries are in source order; sectionHdrFirst[stmt] is the index of the
+// first entry in the label section of stmt, and sectionHdrFirst[stmt + 1]
+// is one past its last entry.
+struct sectionHdr_struct {
+  long stmt; // Statement whose label section contains the header
+  int level; // 0 = huge, 1 = big, 2 = small, 3 = tiny
+  long pos; // Offset of the "$(" in the label section
+  long eol; // Offset of the newline ending the opening decoration line
+};
+static struct sectionHdr_struct *sectionHdr = NULL;
+static long sectionHdrs = 0; // Number of entries in sectionHdr[]
+static long *sectionHdrFirst = NULL;
+static flag sectionOutlineBuilt = 0;
+
+static const char *sectionDecoration[4] = {HUGE_DECORATION, BIG_DECORATION,
+    SMALL_DECORATION, TINY_DECORATION};
+
+// Build the section outline index if it hasn't been built yet.  It is
+// called by READ, and again by getSectionHeadings() after
+// eraseSectionOutline() has discarded it because a label section changed.
+void buildSectionOutline(void) {
+  long stmt, pos, dPos, eol, len, allocSize;
+  int level;
+  char *ptr;
+
+  if (sectionOutlineBuilt) return;
+  eraseSectionOutline();
+  sectionHdrFirst = malloc((size_t)(g_statements + 2) * sizeof(long));
+  if (!sectionHdrFirst) outOfMemory("#115 (sectionHdrFirst)");
+  allocSize = 0;
+  sectionHdrFirst[0] = 0;
+  for (stmt = 1; stmt <= g_statements; stmt++) {
+    sectionHdrFirst[stmt] = sectionHdrs;
+    ptr = g_Statement[stmt].labelSectionPtr;
+    len = g_Statement[stmt].labelSectionLen;
+    for (pos = 0; pos + 3 < len; pos++) {
+      if (ptr[pos] != '$' || ptr[pos + 1] != '(') continue;
+      // Tolerate one space after "$(" (see getSectionHeadings())
+      dPos = pos + 2;
+      if (ptr[dPos] == ' ') dPos++;
+      if (ptr[dPos] != '\n') continue;
+      dPos++;
+      if (dPos + 4 > len) continue;
+      for (level = 0; level < 4; level++) {
+        if (!strncmp(ptr + dPos, sectionDecoration[level], 4)) break;
+      }
+      if (level == 4) continue;
+      for (eol = pos + 4; eol < len; eol++) {
+        if (ptr[eol] == '\n') break;
+      }
+      if (sectionHdrs >= allocSize) {
+        allocSize = allocSize + 1000;
+        sectionHdr = realloc(sectionHdr,
+            (size_t)allocSize * sizeof(struct sectionHdr_struct));
+        if (!sectionHdr) outOfMemory("#116 (sectionHdr)");
+      }
+      sectionHdr[sectionHdrs].stmt = stmt;
+      sectionHdr[sectionHdrs].level = level;
+      sectionHdr[sectionHdrs].pos = pos;
+      sectionHdr[sectionHdrs].eol = eol;
+      sectionHdrs++;
+    } // next pos
+  } // next stmt
+  sectionHdrFirst[g_statements + 1] = sectionHdrs;
+  sectionOutlineBuilt = 1;
+} // buildSectionOutline
+
+// Discard the section outline index.  Called by ERASE, and whenever a
+// label section is modified so that the index will be rebuilt on next use.
+void eraseSectionOutline(void) {
+  free(sectionHdr);
+  sectionHdr = NULL;
+  free(sectionHdrFirst);
+  sectionHdrFirst = NULL;
+  sectionHdrs = 0;
+  sectionOutlineBuilt = 0;
+} // eraseSectionOutline
+
+// Extract the title and comment of outline entry hdr for
+// getSectionHeadings().  Only the header comment itself (plus any
+// whitespace preceding it, for fullComment) is copied from the label section.
+// Return 1 if error found, 0 otherwise
+static flag getSectionHeading(long stmt, long hdr,
+    vstring *hdrTitle, vstring *hdrComment, flag fullComment) {
+  vstring_def(labelStr);
+  long pos, pos2, pos3, pos4;
+  long wsLen, cmtLen, sectionLen;
+  const char *decoration, *sectionPtr;
+  flag errorFound = 0;
+
+  decoration = sectionDecoration[sectionHdr[hdr].level];
+  sectionPtr = g_Statement[sectionHdr[hdr].stmt].labelSectionPtr;
+  sectionLen = g_Statement[sectionHdr[hdr].stmt].labelSectionLen;
+  pos = sectionHdr[hdr].pos;
+  // Whitespace preceding "$("
+  wsLen = 0;
+  while (pos - wsLen > 0) {
+    if (sectionPtr[pos - wsLen - 1] != ' '
+        && sectionPtr[pos - wsLen - 1] != '\n') break;
+    wsLen++;
+  }
+  // The header comment, up to and including its "$)"
+  for (cmtLen = 2; pos + cmtLen < sectionLen; cmtLen++) {
+    if (sectionPtr[pos + cmtLen - 1] == '$'
+        && sectionPtr[pos + cmtLen] == ')') {
+      cmtLen++;
+      break;
+    }
+  }
+  let(&labelStr, space(wsLen + cmtLen));
+  memcpy(labelStr, sectionPtr + pos - wsLen, (size_t)(wsLen + cmtLen));
+
+  pos2 = wsLen + 1; // "$(" position
+  pos = instr(pos2 + 4, labelStr, "\n"); // Get to end of decoration line
+  pos2 = instr(pos + 1, labelStr, "\n"); // Find end of title line
+
+  // Error check - can't have more than 1 title line
+  if (strcmp(mid(labelStr, pos2 + 1, 4), decoration)) {
+    print2(
+     "?Warning: missing closing \"%s\" decoration above statement \"%s\".\n",
+        decoration, g_Statement[stmt].labelName);
+    errorFound = 1;
+  }
+
+  pos3 = instr(pos2 + 1, labelStr, "\n"); // Get to end of 2nd decoration line
+  while (labelStr[(pos3 - 1) + 1] == '\n') pos3++; // Skip 1st blank lines
+  pos4 = instr(pos3, labelStr, "$)"); // Get to end of title comment
+  if (fullComment == 0) {
+    let(&(*hdrTitle), seg(labelStr, pos + 1, pos2 - 1));
+    // Trim leading, trailing sp
+    let(&(*hdrTitle), edit((*hdrTitle), 8 + 128));
+    let(&(*hdrComment), seg(labelStr, pos3 + 1, pos4 - 2));
+    // Trim leading sp, trailing sp & lf
+    let(&(*hdrComment), edit((*hdrComment), 8 + 16384));
+  } else {
+    // Put entire comment in hdrTitle and hdrComment for /EXTRACT
+    // The whitespace preceding "$(" starts at position 1
+    // pos4 is the "$" in "$)"
+    // pos3 is the \n after the 2nd decoration line
+    let(&(*hdrTitle), seg(labelStr, 1, pos3));
+    let(&(*hdrComment), seg(labelStr, pos3 + 1, pos4 + 1));
+  }
+
+  free_vstring(labelStr); // Deallocate string memory
+  return errorFound;
+} // getSectionHeading
+
 // Return 1 if error found, 0 otherwise
 flag getSectionHeadings(long stmt,
     vstring *hugeHdrTitle,
@@ -4374,9 +4571,9 @@ flag getSectionHeadings(long stmt,
     flag fineResolution,
     flag fullComment) {
 
-  // for table of contents
-  vstring_def(labelStr);
-  long pos, pos1, pos2, pos3, pos4;
+  vstring *hdrTitle[4], *hdrComment[4];
+  long firstStmt, firstHdr, lastHdr, hdr, prevHdr;
+  int level;
   flag errorFound = 0;
   flag saveOutputToString;
 
@@ -4384,16 +4581,21 @@ flag getSectionHeadings(long stmt,
   saveOutputToString = g_outputToString; // To restore when returning
   g_outputToString = 0;
 
+  hdrTitle[0] = hugeHdrTitle;
+  hdrTitle[1] = bigHdrTitle;
+  hdrTitle[2] = smallHdrTitle;
+  hdrTitle[3] = tinyHdrTitle;
+  hdrComment[0] = hugeHdrComment;
+  hdrComment[1] = bigHdrComment;
+  hdrComment[2] = smallHdrComment;
+  hdrComment[3] = tinyHdrComment;
+
   // (This initialization seems to be done redundantly by caller elsewhere,
   // but for  WRITE SOURCE ... / EXTRACT we need to do it explicitly.)
-  free_vstring(*hugeHdrTitle);
-  free_vstring(*bigHdrTitle);
-  free_vstring(*smallHdrTitle);
-  free_vstring(*tinyHdrTitle);
-  free_vstring(*hugeHdrComment);
-  free_vstring(*bigHdrComment);
-  free_vstring(*smallHdrComment);
-  free_vstring(*tinyHdrComment);
+  for (level = 0; level < 4; level++) {
+    free_vstring(*hdrTitle[level]);
+    free_vstring(*hdrComment[level]);
+  }
 
   // We now process only $a or $p statements
   if (fineResolution == 0) {
@@ -4402,241 +4604,45 @@ flag getSectionHeadings(long stmt,
 
   // Get header area between this statement and the statement after the
   // previous $a or $p statement.
-  // pos3 and pos4 are used temporarily here; not related to later use
   if (fineResolution == 0) {
     // Statement immediately after the previous $a or $p statement
     // (will be this statement if previous statement is $a or $p).
-    pos3 = g_Statement[stmt].headerStartStmt;
+    firstStmt = g_Statement[stmt].headerStartStmt;
   } else {
     // For WRITE SOURCE ... / EXTRACT, we want every statement treated equally
-    pos3 = stmt;
+    firstStmt = stmt;
   }
-  if (pos3 == 0 || pos3 > stmt) bug(2241);
-  pos4 = (g_Statement[stmt].labelSectionPtr
-        - g_Statement[pos3].labelSectionPtr)
-        + g_Statement[stmt].labelSectionLen; // Length of the header area
-  let(&labelStr, space(pos4));
-  memcpy(labelStr, g_Statement[pos3].labelSectionPtr,
-      (size_t)(pos4));
-
-  pos = 0;
-  pos2 = 0;
-  while (1) { // Find last "huge" header, if any
-    // 4-Nov-2007 nm:  Obviously, the match below will not work if the
-    // $( line has a trailing space, which some editors might insert.
-    // The symptom is a missing table of contents entry.  But to detect
-    // this (and for the #*#* and =-=- matches below) would take a little work
-    // and perhaps slow things down, and I don't think it is worth it.  I
-    // put a note in HELP WRITE THEOREM_LIST.
-    pos1 = pos;
-    pos = instr(pos + 1, labelStr, "$(\n" HUGE_DECORATION);
-
-    // 23-May-2008 nm Tolerate one space after "$(", to handle case of
-    // one space added to the end of each line with TOOLS to make global
-    // label changes are easier (still a kludge; this should be made
-    // whitespace insensitive some day).
-    pos1 = instr(pos1 + 1, labelStr, "$( \n" HUGE_DECORATION);
-    if (pos1 > pos) pos = pos1;
-
-    if (!pos) break;
-    if (pos) pos2 = pos;
-  }
-  if (pos2) { // Extract "huge" header
-    pos1 = pos2; // Save "$(" position
-    pos = instr(pos2 + 4, labelStr, "\n"); // Get to end of #### line
-    pos2 = instr(pos + 1, labelStr, "\n"); // Find end of title line
-
-    // Error check - can't have more than 1 title line
-    if (strcmp(mid(labelStr, pos2 + 1, 4), HUGE_DECORATION)) {
-      print2(
-       "?Warning: missing closing \"%s\" decoration above statement \"%s\".\n",
-          HUGE_DECORATION, g_Statement[stmt].labelName);
-      errorFound = 1;
+  if (firstStmt == 0 || firstStmt > stmt) bug(2241);
+
+  buildSectionOutline(); // In case a label section was changed
+  firstHdr = sectionHdrFirst[firstStmt];
+  lastHdr = sectionHdrFirst[stmt + 1] - 1;
+
+  // For each kind of header, take the last one in the header area, but only
+  // if it follows the header kept for the previous (larger) kind.  If no
+  // header of a kind was kept, the next kind may be anywhere in the area.
+  prevHdr = -1;
+  for (level = 0; level < 4; level++) {
+    for (hdr = lastHdr; hdr >= firstHdr; hdr--) {
+      if (sectionHdr[hdr].level == level) break;
     }
-
-    pos3 = instr(pos2 + 1, labelStr, "\n"); // Get to end of 2nd #### line
-    while (labelStr[(pos3 - 1) + 1] == '\n') pos3++; // Skip 1st blank lines
-    pos4 = instr(pos3, labelStr, "$)"); // Get to end of title comment
-    if (fullComment == 0) {
-      let(&(*hugeHdrTitle), seg(labelStr, pos + 1, pos2 - 1));
-      // Trim leading, trailing sp
-      let(&(*hugeHdrTitle), edit((*hugeHdrTitle), 8 + 128));
-      let(&(*hugeHdrComment), seg(labelStr, pos3 + 1, pos4 - 2));
-      // Trim leading sp, trailing sp & lf
-      let(&(*hugeHdrComment), edit((*hugeHdrComment), 8 + 16384));
-    } else {
-      // Put entire comment in hugeHdrTitle and hugeHdrComment for /EXTRACT
-      // Search backwards for non-space or beginning of string:
-      pos = pos1; // pos1 is the "$" in "$("
-      pos--;
-      while (pos > 0) {
-        if (labelStr[pos - 1] != ' '
-              && labelStr[pos - 1] != '\n') break;
-        pos--;
-      }
-      // pos + 1 is the start of whitespace preceding "$("
-      // pos4 is the "$" in "$)"
-      // pos3 is the \n after the 2nd decoration line
-      let(&(*hugeHdrTitle), seg(labelStr, pos + 1, pos3));
-      let(&(*hugeHdrComment), seg(labelStr, pos3 + 1, pos4 + 1));
+    if (hdr < firstHdr) {
+      prevHdr = -1;
+      continue;
     }
-  }
-  // pos = 0; // Leave pos alone so that we start with "huge" header pos,
-  // to ignore any earlier "tiny" or "small" or "big" header.
-  pos2 = 0;
-  while (1) { // Find last "big" header, if any
-    pos1 = pos;
-    pos = instr(pos + 1, labelStr, "$(\n" BIG_DECORATION);
-    pos1 = instr(pos1 + 1, labelStr, "$( \n" BIG_DECORATION);
-    if (pos1 > pos) pos = pos1;
-
-    if (!pos) break;
-    if (pos) pos2 = pos;
-  }
-  if (pos2) { // Extract "big" header
-    pos1 = pos2; // Save "$(" position
-    pos = instr(pos2 + 4, labelStr, "\n"); // Get to end of #*#* line
-    pos2 = instr(pos + 1, labelStr, "\n"); // Find end of title line
-
-    // Error check - can't have more than 1 title line
-    if (strcmp(mid(labelStr, pos2 + 1, 4), BIG_DECORATION)) {
-      print2(
-       "?Warning: missing closing \"%s\" decoration above statement \"%s\".\n",
-          BIG_DECORATION, g_Statement[stmt].labelName);
-      errorFound = 1;
-    }
-
-    pos3 = instr(pos2 + 1, labelStr, "\n"); // Get to end of 2nd #*#* line
-    while (labelStr[(pos3 - 1) + 1] == '\n') pos3++; // Skip 1st blank lines
-    pos4 = instr(pos3, labelStr, "$)"); // Get to end of title comment
-    if (fullComment == 0) {
-      let(&(*bigHdrTitle), seg(labelStr, pos + 1, pos2 - 1));
-      // Trim leading, trailing sp
-      let(&(*bigHdrTitle), edit((*bigHdrTitle), 8 + 128));
-      let(&(*bigHdrComment), seg(labelStr, pos3 + 1, pos4 - 2));
-      // Trim leading sp, trailing sp & lf
-      let(&(*bigHdrComment), edit((*bigHdrComment), 8 + 16384));
-    } else {
-      // Put entire comment in bigHdrTitle and bigHdrComment for /EXTRACT
-      // Search backwards for non-space or beginning of string:
-      pos = pos1; // pos1 is the "$" in "$("
-      pos--;
-      while (pos > 0) {
-        if (labelStr[pos - 1] != ' '
-              && labelStr[pos - 1] != '\n') break;
-        pos--;
-      }
-      // pos + 1 is the start of whitespace preceding "$("
-      // pos4 is the "$" in "$)"
-      // pos3 is the \n after the 2nd decoration line
-      let(&(*bigHdrTitle), seg(labelStr, pos + 1, pos3));
-      let(&(*bigHdrComment), seg(labelStr, pos3 + 1, pos4 + 1));
+    if (prevHdr != -1
+        && (sectionHdr[hdr].stmt < sectionHdr[prevHdr].stmt
+          || (sectionHdr[hdr].stmt == sectionHdr[prevHdr].stmt
+            && sectionHdr[hdr].pos <= sectionHdr[prevHdr].eol))) {
+      // Not after the previous kept header
+      prevHdr = -1;
+      continue;
     }
-  }
-  // pos = 0; // Leave pos alone so that we start with "big" header pos,
-  // to ignore any earlier "tiny" or "small" header
-  pos2 = 0;
-  while (1) { // Find last "small" header, if any
-    pos1 = pos;
-    pos = instr(pos + 1, labelStr, "$(\n" SMALL_DECORATION);
-    pos1 = instr(pos1 + 1, labelStr, "$( \n" SMALL_DECORATION);
-    if (pos1 > pos) pos = pos1;
-
-    if (!pos) break;
-    if (pos) pos2 = pos;
-  }
-  if (pos2) { // Extract "small" header
-    pos1 = pos2; // Save "$(" position
-    pos = instr(pos2 + 4, labelStr, "\n"); // Get to end of =-=- line
-    pos2 = instr(pos + 1, labelStr, "\n"); // Find end of title line
-
-    // Error check - can't have more than 1 title line
-    if (strcmp(mid(labelStr, pos2 + 1, 4), SMALL_DECORATION)) {
-      print2(
-       "?Warning: missing closing \"%s\" decoration above statement \"%s\".\n",
-          SMALL_DECORATION, g_Statement[stmt].labelName);
+    if (getSectionHeading(stmt, hdr, hdrTitle[level], hdrComment[level],
+        fullComment)) {
       errorFound = 1;
     }
-
-    pos3 = instr(pos2 + 1, labelStr, "\n"); // Get to end of 2nd =-=- line
-    while (labelStr[(pos3 - 1) + 1] == '\n') pos3++; // Skip 1st blank lines
-    pos4 = instr(pos3, labelStr, "$)"); // Get to end of title comment
-    if (fullComment == 0) {
-      let(&(*smallHdrTitle), seg(labelStr, pos + 1, pos2 - 1));
-      // Trim leading, trailing sp
-      let(&(*smallHdrTitle), edit((*smallHdrTitle), 8 + 128));
-      let(&(*smallHdrComment), seg(labelStr, pos3 + 1, pos4 - 2));
-      // Trim leading sp, trailing sp & lf
-      let(&(*smallHdrComment), edit((*smallHdrComment), 8 + 16384));
-    } else {
-      // Put entire comment in smallHdrTitle and smallHdrComment for /EXTRACT
-      // Search backwards for non-space or beginning of string:
-      pos = pos1; // pos1 is the "$" in "$("
-      pos--;
-      while (pos > 0) {
-        if (labelStr[pos - 1] != ' '
-              && labelStr[pos - 1] != '\n') break;
-        pos--;
-      }
-      // pos + 1 is the start of whitespace preceding "$("
-      // pos4 is the "$" in "$)"
-      // pos3 is the \n after the 2nd decoration line
-      let(&(*smallHdrTitle), seg(labelStr, pos + 1, pos3));
-      let(&(*smallHdrComment), seg(labelStr, pos3 + 1, pos4 + 1));
-    }
-  }
-
-  // pos = 0; // Leave pos alone so that we start with "small" header pos,
-  // to ignore any earlier "tiny" header.
-  pos2 = 0;
-  while (1) { // Find last "tiny" header, if any
-    pos1 = pos;
-    pos = instr(pos + 1, labelStr, "$(\n" TINY_DECORATION);
-    pos1 = instr(pos1 + 1, labelStr, "$( \n" TINY_DECORATION);
-    if (pos1 > pos) pos = pos1;
-
-    if (!pos) break;
-    if (pos) pos2 = pos;
-  }
-  if (pos2) { // Extract "tiny" header
-    pos1 = pos2; // Save "$(" position
-    pos = instr(pos2 + 4, labelStr, "\n"); // Get to end of -.-. line
-    pos2 = instr(pos + 1, labelStr, "\n"); // Find end of title line
-
-    // Error check - can't have more than 1 title line
-    if (strcmp(mid(labelStr, pos2 + 1, 4), TINY_DECORATION)) {
-      print2(
-       "?Warning: missing closing \"%s\" decoration above statement \"%s\".\n",
-          TINY_DECORATION, g_Statement[stmt].labelName);
-      errorFound = 1;
-    }
-
-    pos3 = instr(pos2 + 1, labelStr, "\n"); // Get to end of 2nd -.-. line
-    while (labelStr[(pos3 - 1) + 1] == '\n') pos3++; // Skip 1st blank lines
-    pos4 = instr(pos3, labelStr, "$)"); // Get to end of title comment
-    if (fullComment == 0) {
-      let(&(*tinyHdrTitle), seg(labelStr, pos + 1, pos2 - 1));
-      // Trim leading, trailing sp
-      let(&(*tinyHdrTitle), edit((*tinyHdrTitle), 8 + 128));
-      let(&(*tinyHdrComment), seg(labelStr, pos3 + 1, pos4 - 2));
-      // Trim leading sp, trailing sp & lf
-      let(&(*tinyHdrComment), edit((*tinyHdrComment), 8 + 16384));
-    } else {
-      // Put entire comment in tinyHdrTitle and tinyHdrComment for /EXTRACT
-      // Search backwards for non-space or beginning of string:
-      pos = pos1; // pos1 is the "$" in "$("
-      pos--;
-      while (pos > 0) {
-        if (labelStr[pos - 1] != ' '
-              && labelStr[pos - 1] != '\n') break;
-        pos--;
-      }
-      // pos + 1 is the start of whitespace preceding "$("
-      // pos4 is the "$" in "$)"
-      // pos3 is the \n after the 2nd decoration line
-      let(&(*tinyHdrTitle), seg(labelStr, pos + 1, pos3));
-      let(&(*tinyHdrComment), seg(labelStr, pos3 + 1, pos4 + 1));
-    }
+    prevHdr = hdr;
   }
 
   if (errorFound == 1) {
@@ -4645,7 +4651,6 @@ flag getSectionHeadings(long stmt,
   // Restore output stream
   g_outputToString = saveOutputToString;
 
-  free_vstring(labelStr); // Deallocate string memory
   return errorFound;
 } // getSectionHeadings
 
@@ -4836,20 +4841,45 @@ vstring spectrumToRGB(long color, long maxColor) {
 // Warning: The caller must deallocate the returned vstring.
 vstring getTexLongMath(nmbrString *mathString, long statemNum)
 {
-  long pos;
-  vstring_def(tex);
+  long pos, len;
+  unsigned long hash = 0;
+  char *tex;
+  vstring_def(texAlloc); // Result of tokenToTex() if not in tokenTexTable
   vstring_def(texLine);
-  vstring_def(lastTex);
+  char lastTex; // First character of previous token's tex
   flag alphnew, alphold, unknownnew, unknownold;
+  flag cacheable;
 
   if (!g_texDefsRead) bug(2322); // LaTeX defs were not read
+  len = nmbrLen(mathString);
+  if (g_mathCacheMax > 0) {
+    hash = mathCacheHash(mathString, len);
+    pos = lookupMathCache(mathString, len, hash);
+    if (pos != -1) {
+      g_mathCacheHits++;
+      let(&texLine, mathCache[pos].texLine);
+      return texLine;
+    }
+    g_mathCacheMisses++;
+  }
+  // Tokens without a definition give a warning (with the statement
+  // label), so results containing them are not cached.
+  cacheable = 1;
   let(&texLine, "");
 
-  let(&lastTex, "");
-  for (pos = 0; pos < nmbrLen(mathString); pos++) {
-    free_vstring(tex);
-    // tokenToTex allocates tex; we must deallocate it
-    tex = tokenToTex(g_MathToken[mathString[pos]].tokenName, statemNum);
+  lastTex = 0;
+  for (pos = 0; pos < len; pos++) {
+    if (mathString[pos] < tokenTexTableSize
+        && tokenTexTable[mathString[pos]] != NULL) {
+      tex = tokenTexTable[mathString[pos]];
+    } else {
+      free_vstring(texAlloc);
+      // tokenToTex allocates texAlloc; we must deallocate it
+      texAlloc = tokenToTex(g_MathToken[mathString[pos]].tokenName,
+          statemNum);
+      tex = texAlloc;
+      cacheable = 0;
+    }
     if (!g_htmlFlag) { // LaTeX
       // If this token and previous token begin with letter, add a thin
       // space between them.
@@ -4859,7 +4889,7 @@ vstring getTexLongMath(nmbrString *mathString, long statemNum)
       if (!strcmp(left(tex, 8), "\\mathrm{")) { // token not in table
         unknownnew = 1;
       }
-      alphold = !!isalpha((unsigned char)(lastTex[0]));
+      alphold = !!isalpha((unsigned char)lastTex);
       unknownold = 0;
       if (!strcmp(left(tex, 8), "\\mathrm{")) { // token not in table
         unknownold = 1;
@@ -4991,7 +5021,7 @@ vstring getTexLongMath(nmbrString *mathString, long statemNum)
 
       let(&texLine, cat(texLine, tex, NULL));
     } // if !g_htmlFlag
-    let(&lastTex, tex); // Save for next pass
+    lastTex = tex[0]; // Save for next pass
   } // Next pos
 
   // x Discard redundant white space to reduce HTML file size
@@ -5003,11 +5033,135 @@ vstring getTexLongMath(nmbrString *mathString, long statemNum)
       texLine,
       (g_altHtmlFlag ? "</SPAN>" : ""), NULL));
 
-  free_vstring(tex);
-  free_vstring(lastTex);
+  if (g_mathCacheMax > 0 && cacheable) {
+    addMathCache(mathString, len, hash, texLine);
+  }
+  free_vstring(texAlloc);
   return texLine;
 } // getTexLongMath
 
+// The output mode that getTexLongMath() results depend on
+static int mathCacheMode(void)
+{
+  return (g_htmlFlag ? 1 : 0) + (g_altHtmlFlag ? 2 : 0)
+      + (g_oldTexFlag ? 4 : 0);
+} // mathCacheMode
+
+// Hash function (FNV-1a over the token numbers) for the getTexLongMath() cache
+static unsigned long mathCacheHash(nmbrString *mathString, long len)
+{
+  unsigned long hash = 2166136261UL;
+  long i;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ (unsigned long)mathString[i]) * 16777619UL;
+  }
+  return hash;
+} // mathCacheHash
+
+// Move cache entry i to the most recently used end of the list
+static void touchMathCache(long i)
+{
+  if (mathCacheNewest == i) return;
+  // Unlink
+  if (mathCache[i].older != -1) {
+    mathCache[mathCache[i].older].newer = mathCache[i].newer;
+  } else if (mathCacheOldest == i) {
+    mathCacheOldest = mathCache[i].newer;
+  }
+  if (mathCache[i].newer != -1) {
+    mathCache[mathCache[i].newer].older = mathCache[i].older;
+  }
+  // Link as newest
+  mathCache[i].older = mathCacheNewest;
+  mathCache[i].newer = -1;
+  if (mathCacheNewest != -1) mathCache[mathCacheNewest].newer = i;
+  mathCacheNewest = i;
+  if (mathCacheOldest == -1) mathCacheOldest = i;
+} // touchMathCache
+
+// Return the cache entry for mathString, or -1 if there is none
+static long lookupMathCache(nmbrString *mathString, long len,
+    unsigned long hash)
+{
+  long i;
+  if (mathCache == NULL) return -1;
+  if (mathCacheEntryMode != mathCacheMode()) {
+    eraseMathCache(); // Entries were made for another output mode
+    return -1;
+  }
+  for (i = mathCacheBucket[hash % (unsigned long)g_mathCacheMax]; i != -1;
+      i = mathCache[i].hashNext) {
+    if (mathCache[i].hash == hash
+        && nmbrLen(mathCache[i].mathString) == len
+        && !memcmp(mathCache[i].mathString, mathString,
+            (size_t)len * sizeof(nmbrString))) {
+      touchMathCache(i);
+      return i;
+    }
+  }
+  return -1;
+} // lookupMathCache
+
+// Add a getTexLongMath() result to the cache, discarding the least
+// recently used entry if the cache is full
+static void addMathCache(nmbrString *mathString, long len,
+    unsigned long hash, vstring texLine)
+{
+  long i, bucket;
+  long *link;
+
+  if (mathCache == NULL) {
+    mathCache = malloc((size_t)g_mathCacheMax
+        * sizeof(struct mathCache_struct));
+    mathCacheBucket = malloc((size_t)g_mathCacheMax * sizeof(long));
+    if (!mathCache || !mathCacheBucket) outOfMemory("#118 (mathCache)");
+    for (i = 0; i < g_mathCacheMax; i++) mathCacheBucket[i] = -1;
+    mathCacheEntryMode = mathCacheMode();
+  }
+  if (mathCacheEntries < g_mathCacheMax) {
+    i = mathCacheEntries;
+    mathCacheEntries++;
+    mathCache[i].mathString = NULL_NMBRSTRING;
+    mathCache[i].texLine = "";
+    mathCache[i].older = -1;
+    mathCache[i].newer = -1;
+  } else {
+    // Reuse the least recently used entry; unlink it from its hash chain
+    i = mathCacheOldest;
+    link = &mathCacheBucket[mathCache[i].hash % (unsigned long)g_mathCacheMax];
+    while (*link != i) {
+      if (*link == -1) bug(2351); // Entry is missing from its chain
+      link = &mathCache[*link].hashNext;
+    }
+    *link = mathCache[i].hashNext;
+  }
+  nmbrLet(&mathCache[i].mathString, mathString);
+  let(&mathCache[i].texLine, texLine);
+  mathCache[i].hash = hash;
+  bucket = (long)(hash % (unsigned long)g_mathCacheMax);
+  mathCache[i].hashNext = mathCacheBucket[bucket];
+  mathCacheBucket[bucket] = i;
+  if (nmbrLen(mathCache[i].mathString) != len) bug(2352);
+  touchMathCache(i);
+} // addMathCache
+
+// Discard all entries of the getTexLongMath() cache
+void eraseMathCache(void)
+{
+  long i;
+  for (i = 0; i < mathCacheEntries; i++) {
+    free_nmbrString(mathCache[i].mathString);
+    free_vstring(mathCache[i].texLine);
+  }
+  free(mathCache);
+  mathCache = NULL;
+  free(mathCacheBucket);
+  mathCacheBucket = NULL;
+  mathCacheEntries = 0;
+  mathCacheNewest = -1;
+  mathCacheOldest = -1;
+} // eraseMathCache
+
 // Returns the LaTeX, or HTML code for GIFs (!g_altHtmlFlag) or Unicode
 // (g_altHtmlFlag), for a statement's hypotheses and assertion in the form
 // hyp & ... & hyp => assertion.
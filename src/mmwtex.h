@@ -138,6 +138,12 @@ flag getSectionHeadings(long stmt, vstring *hugeHdrTitle,
     flag fullComment /*!< 1 = put $( + header + comment + $) into xxxHdrTitle */
     );
 
+/*! Build the index of section headers used by getSectionHeadings(); this is
+  done by READ and does nothing if the index is already built */
+void buildSectionOutline(void);
+/*! Discard the section header index, e.g. after a label section changed */
+void eraseSectionOutline(void);
+
 // TeX normal output
 extern flag g_texFileOpenFlag;
 extern FILE *g_texFilePtr;
@@ -164,6 +170,15 @@ vstring spectrumToRGB(long color, long maxColor);
   \warning The caller must deallocate the returned vstring. */
 vstring getTexLongMath(nmbrString *mathString, long statemNum);
 
+extern long g_mathCacheMax; /*!< Max entries in the getTexLongMath() cache;
+                                  0 = no cache (SET MATH_CACHE) */
+extern long g_mathCacheHits; /*!< getTexLongMath() cache hits */
+extern long g_mathCacheMisses; /*!< getTexLongMath() cache misses */
+
+/*! Discard all entries of the getTexLongMath() cache.  Called by
+   eraseTexDefs() and when the cache size is changed. */
+void eraseMathCache(void);
+
 /*! Returns the TeX, or HTML code for GIFs (!g_altHtmlFlag) or Unicode
    (g_altHtmlFlag), for a statement's hypotheses and assertion in the form
    hyp & ... & hyp => assertion
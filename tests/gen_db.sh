@@ -0,0 +1,266 @@
+#!/bin/sh
+
+usage() {
+  cat >&2 <<"HELP"
+Usage: gen_db.sh [OPTIONS] NAME
+Write a large, valid synthetic database to NAME.mm for scaling measurements.
+
+The database has the propositional wff syntax, the axioms ax-mp and ax-1, and
+a variant ax-1d of ax-1 with a $d condition.  Each theorem is an instance
+|- ( X -> ( Y -> X ) ) of ax-1 or ax-1d with random formulas X and Y, which
+share subformulas with earlier theorems as in real databases.  The output only
+depends on the options, so the same options always give the same database.
+
+Options:
+  -n N   number of theorems (default 1000)
+  -l N   average number of tokens of the formula X (default 40); Y has half
+         as many, and the proof length grows with both
+  -p     write normal proofs instead of compressed ones
+  -d N   percentage of theorems proved with ax-1d, each with its own $d
+         statements (default 10)
+  -s N   nest the theorems in scopes ${ ... $} up to depth N (default 0)
+  -i N   split the theorems into N files NAME-1.mm ... NAME-N.mm, included
+         by NAME.mm (default 0, a single file)
+  -r N   seed of the pseudo-random numbers (default 1)
+
+The database has a $t comment, so SHOW STATEMENT / HTML works on it.
+HELP
+}
+
+theorems=1000
+tokens=40
+compressed=1
+density=10
+depth=0
+includes=0
+seed=1
+
+while getopts n:l:pd:s:i:r:h flag
+do
+  case "${flag}" in
+    n) theorems=${OPTARG};;
+    l) tokens=${OPTARG};;
+    p) compressed=0;;
+    d) density=${OPTARG};;
+    s) depth=${OPTARG};;
+    i) includes=${OPTARG};;
+    r) seed=${OPTARG};;
+    h) usage; exit;;
+    *) usage; exit 2;;
+  esac
+done
+shift $((OPTIND - 1))
+if [ $# -ne 1 ]; then usage; exit 2; fi
+
+awk -v name="$1" -v theorems="$theorems" -v tokens="$tokens" \
+    -v compressed="$compressed" -v density="$density" -v depth="$depth" \
+    -v includes="$includes" -v seed="$seed" '
+
+# Park-Miller pseudo-random number in 0..n-1; exact in double arithmetic, so
+# every awk gives the same sequence
+function random(n) {
+  state = state * 16807 % 2147483647
+  return int(state / 2147483647 * n)
+}
+
+# Formulas are kept as a DAG.  Nodes 1 to 8 are the variables.  cls[] is the
+# set of variables a formula was built from:  0 all, 1 the first four, 2 the
+# last four (formulas of classes 1 and 2 have no variable in common, as ax-1d
+# requires).
+function newNode(t, l, r, c) {
+  nodes++
+  type[nodes] = t; left[nodes] = l; right[nodes] = r; cls[nodes] = c
+  if (t == "v") size[nodes] = 1
+  else if (t == "n") size[nodes] = 1 + size[l]
+  else size[nodes] = 3 + size[l] + size[r]
+  return nodes
+}
+
+# A random formula of class c with at most n tokens
+function formula(n, c,    node, l) {
+  if (n >= 4 && nodes > 8 && random(3) == 0) {
+    # Reuse an earlier subformula of about the requested size
+    node = 9 + random(nodes - 8)
+    if (cls[node] == c && size[node] <= n && 2 * size[node] > n) return node
+  }
+  if (n < 2) {
+    if (c == 0) return 1 + random(8)
+    return 4 * (c - 1) + 1 + random(4)
+  }
+  if (n < 5 || random(5) == 0) return newNode("n", formula(n - 1, c), 0, c)
+  l = 1 + random(n - 4)
+  return newNode("i", formula(l, c), formula(n - 3 - l, c), c)
+}
+
+# Write a token, wrapping lines at 79 characters
+function emit(token) {
+  if (column + 1 + length(token) > 79) {
+    printf "\n   " > out
+    column = 3
+  }
+  printf " %s", token > out
+  column += 1 + length(token)
+}
+
+function emitMath(node) {
+  if (type[node] == "v") emit(var[left[node]])
+  else if (type[node] == "n") { emit("-."); emitMath(left[node]) }
+  else {
+    emit("("); emitMath(left[node]); emit("->"); emitMath(right[node])
+    emit(")")
+  }
+}
+
+# Record the variables occurring in node in used[]
+function scan(node) {
+  if (type[node] == "v") used[left[node]] = 1
+  else if (type[node] == "n") { usedWn = 1; scan(left[node]) }
+  else { usedWi = 1; scan(left[node]); scan(right[node]) }
+}
+
+# Write step number n of a compressed proof
+function emitNumber(n,    s) {
+  s = substr(letters, (n - 1) % 20 + 1, 1)
+  n = int((n - 1) / 20)
+  while (n > 0) {
+    s = substr("UVWXY", (n - 1) % 5 + 1, 1) s
+    n = int((n - 1) / 5)
+  }
+  if (column + length(s) > 79) {
+    printf "\n    " > out
+    column = 4
+  }
+  printf "%s", s > out
+  column += length(s)
+}
+
+function emitStep(label) {
+  if (compressed) emitNumber(number[label])
+  else emit(label)
+}
+
+function emitProof(node) {
+  if (type[node] == "v") emitStep("w" var[left[node]])
+  else if (type[node] == "n") { emitProof(left[node]); emitStep("wn") }
+  else {
+    emitProof(left[node]); emitProof(right[node]); emitStep("wi")
+  }
+}
+
+# Write theorem label:  |- ( x -> ( y -> x ) ) by axiom ax
+function theorem(label, x, y, ax,    i, j, n) {
+  for (i = 1; i <= 8; i++) used[i] = 0
+  usedWn = 0; usedWi = 0
+  scan(x); scan(y)
+  if (ax == "ax-1d") {
+    # Our own scope for the $d statements
+    printf "  ${\n   " > out
+    column = 3
+    emit("$d")
+    for (i = 1; i <= 4; i++) if (used[i]) emit(var[i])
+    for (i = 5; i <= 8; i++) if (used[i]) emit(var[i])
+    emit("$.")
+    printf "\n" > out
+  }
+  printf "  $( Instance of %s. $)\n  %s $p |-", ax, label > out
+  column = length(label) + 7
+  emit("("); emitMath(x); emit("->"); emit("("); emitMath(y); emit("->")
+  emitMath(x); emit(")"); emit(")"); emit("$=")
+  printf "\n   " > out
+  column = 3
+  if (compressed) {
+    # The mandatory hypotheses are the variables in declaration order,
+    # followed by the labels in the order listed
+    n = 0
+    for (i = 1; i <= 8; i++) if (used[i]) number["w" var[i]] = ++n
+    emit("(")
+    if (usedWn) { emit("wn"); number["wn"] = ++n }
+    if (usedWi) { emit("wi"); number["wi"] = ++n }
+    emit(ax); number[ax] = ++n
+    emit(")")
+    if (column + 1 > 79) {
+      printf "\n   " > out
+      column = 3
+    }
+    printf " " > out
+    column++
+  }
+  emitProof(x); emitProof(y); emitStep(ax)
+  printf " $.\n" > out
+  if (ax == "ax-1d") printf "  $}\n" > out
+}
+
+# Open and close scopes towards the given nesting depth
+function nest(target) {
+  while (level < target) {
+    level++
+    printf "%s${\n", substr("                    ", 1, level) > out
+    # A local $d statement, as real databases have
+    printf "%s  $d %s %s $.\n", substr("                    ", 1, level),
+        var[1 + random(4)], var[5 + random(4)] > out
+  }
+  while (level > target) {
+    printf "%s$}\n", substr("                    ", 1, level) > out
+    level--
+  }
+}
+
+BEGIN {
+  state = seed % 2147483646 + 1
+  letters = "ABCDEFGHIJKLMNOPQRST"
+  split("ph ps ch th ta et ze si", var, " ")
+  for (i = 1; i <= 8; i++) newNode("v", i, 0, i <= 4 ? 1 : 2)
+
+  out = name ".mm"
+  printf "$( Synthetic database written by gen_db.sh -n %d -l %d%s -d %d" \
+      " -s %d -i %d -r %d $)\n\n", theorems, tokens, \
+      compressed ? "" : " -p", density, depth, includes, seed > out
+  printf "  $c ( ) -> -. wff |- $.\n  $v ph ps ch th ta et ze si $.\n" > out
+  for (i = 1; i <= 8; i++) {
+    printf "  w%s $f wff %s $.\n", var[i], var[i] > out
+  }
+  printf "  wn $a wff -. ph $.\n  wi $a wff ( ph -> ps ) $.\n" > out
+  printf "  ${\n    min $e |- ph $.\n    maj $e |- ( ph -> ps ) $.\n" > out
+  printf "    ax-mp $a |- ps $.\n  $}\n" > out
+  printf "  ax-1 $a |- ( ph -> ( ps -> ph ) ) $.\n" > out
+  printf "  ${\n    $d ph ps $.\n" > out
+  printf "    ax-1d $a |- ( ph -> ( ps -> ph ) ) $.\n  $}\n\n" > out
+
+  files = includes > 0 ? includes : 1
+  perFile = int((theorems + files - 1) / files)
+  for (t = 1; t <= theorems; t++) {
+    if (includes > 0 && (t - 1) % perFile == 0) {
+      nest(0)
+      file = name "-" (int((t - 1) / perFile) + 1) ".mm"
+      printf "  $[ %s $]\n", file > out
+      if (out != name ".mm") close(out)
+      out = file
+      printf "$( Part of %s.mm $)\n\n", name > out
+    }
+    # Go up and down the scope depths
+    if (depth > 0) {
+      d = (t - 1) % (2 * depth)
+      nest(d <= depth ? d : 2 * depth - d)
+    }
+    n = int(tokens / 2) + random(tokens + 1)
+    if (random(100) < density) {
+      theorem("gen" t, formula(n, 1), formula(int(n / 2) + 1, 2), "ax-1d")
+    } else {
+      theorem("gen" t, formula(n, 0), formula(int(n / 2) + 1, 0), "ax-1")
+    }
+  }
+  nest(0)
+  if (out != name ".mm") {
+    close(out)
+    out = name ".mm"
+  }
+
+  printf "\n$( $t\n" > out
+  split("( ) -> -. wff |- ph ps ch th ta et ze si", token, " ")
+  for (i = 1; i <= 14; i++) {
+    printf "  htmldef \"%s\" as \"%s \";\n", token[i], token[i] > out
+    printf "  althtmldef \"%s\" as \"%s \";\n", token[i], token[i] > out
+    printf "  latexdef \"%s\" as \"%s\";\n", token[i], token[i] > out
+  }
+  printf "$)\n" > out
+}'
@@ -0,0 +1,23 @@
+$( Included by READ / INCREMENTAL tests:  the proof of th needs the $d on
+   its dummy variable ch $)
+  $c ( ) -> wff |- $.
+  $v ph ps ch $.
+  wph $f wff ph $.
+  wps $f wff ps $.
+  wch $f wff ch $.
+  wi $a wff ( ph -> ps ) $.
+  ${
+    $d ph ps $.
+    ax-k $a |- ( ph -> ps ) $.
+  $}
+  ax-c $a |- ( ( ph -> ps ) -> ph ) $.
+  ${
+    mp.1 $e |- ph $.
+    mp.2 $e |- ( ph -> ps ) $.
+    ax-mp $a |- ps $.
+  $}
+  ${
+    $d ph ch $.
+    th $p |- ph $=
+      wph wch wi wph wph wch ax-k wph wch ax-c ax-mp $.
+  $}
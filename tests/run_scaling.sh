@@ -0,0 +1,100 @@
+#!/bin/sh
+
+usage() {
+  cat >&2 <<"HELP"
+Usage: run_scaling.sh [-c CMD] [-d DIR] [-g GEN_OPTIONS] [SIZES...]
+Measure how metamath scales with the size of the database.
+
+For each SIZE (number of theorems, default 1000 4000 16000) a database is
+written with gen_db.sh into the directory DIR (default scaling.tmp, created if
+needed), and metamath runs these phases on it in a single session:
+
+  read      READ of the database
+  verify    VERIFY PROOF *
+  html      SHOW STATEMENT / HTML of the last theorem
+  minimize  MINIMIZE_WITH * on the last theorem in the Proof Assistant
+  write     WRITE SOURCE
+
+The results go to stdout, one tab-separated line per size and phase:  size,
+phase, CPU seconds (as SHOW ELAPSED_TIME reports them), and the peak resident
+memory of the phase in kB.  The peak memory is read from /proc and is "-"
+where that is not available; each phase resets it first where the system
+allows that, otherwise it is the peak up to the end of the phase.
+
+GEN_OPTIONS are passed to gen_db.sh, e.g. -g '-l 100 -p -i 4'.
+
+The 'metamath' command can be modified by setting the METAMATH environment
+variable, or via the '-c CMD' option (which takes priority).
+HELP
+}
+
+if [ "$1" = "--help" ]; then usage; exit; fi
+
+# Allow overriding the 'metamath' command using the METAMATH env variable
+cmd="${METAMATH:-metamath}"
+dir=scaling.tmp
+gen_options=""
+
+while getopts c:d:g:h flag
+do
+  case "${flag}" in
+    c) cmd=${OPTARG};;
+    d) dir=${OPTARG};;
+    g) gen_options=${OPTARG};;
+    h) usage; exit;;
+    *) usage; exit 2;;
+  esac
+done
+shift $((OPTIND - 1))
+if [ $# -eq 0 ]; then set -- 1000 4000 16000; fi
+
+# Check that the 'metamath' command actually exists
+if ! [ -x "$(command -v "$cmd")" ]; then
+  echo >&2 "'$cmd' not found on the PATH."
+  exit 2
+fi
+# Resolve the paths before changing to the work directory
+case "$cmd" in
+  */*) cmd="$(cd "$(dirname "$cmd")" && pwd)/$(basename "$cmd")";;
+esac
+gen="$(cd "$(dirname "$0")" && pwd)/gen_db.sh"
+
+mkdir -p "$dir" && cd "$dir" || exit 2
+
+# Operating system commands (lines starting with a quote) run by metamath
+# itself, so $PPID is the metamath process:  reset and record its peak memory
+reset_memory="'(echo 5 > /proc/\$PPID/clear_refs) 2>/dev/null'"
+record_memory="'grep VmHWM /proc/\$PPID/status >> memory.txt 2>/dev/null \
+|| echo VmHWM: - >> memory.txt'"
+
+phase() {
+  echo "$reset_memory"
+  shift
+  for command in "$@"; do echo "$command"; done
+  echo "show elapsed_time"
+  echo "$record_memory"
+}
+
+echo "# size	phase	seconds	peak_kB"
+for size in "$@"; do
+  # shellcheck disable=SC2086 # the options are to be split
+  "$gen" $gen_options -n "$size" "scale$size" || exit 2
+  rm -f memory.txt
+  {
+    echo "set scroll continuous"
+    echo "show elapsed_time"
+    phase read "read \"scale$size.mm\""
+    phase verify "verify proof *"
+    phase html "show statement gen$size /html"
+    phase minimize "prove gen$size" "minimize_with *" "exit /force"
+    phase write "write source \"scale$size-out.mm\""
+    echo "exit"
+  } | "$cmd" > "scale$size.log" 2>&1
+  # Pair the times (after the first SHOW ELAPSED_TIME) with the memory peaks
+  grep "Time since last SHOW ELAPSED_TIME" "scale$size.log" \
+    | sed -e 's/.*= *\([0-9.]*\) s;.*/\1/' | tail -n +2 \
+    | paste - memory.txt \
+    | awk -v size="$size" '
+        BEGIN { split("read verify html minimize write", name, " ") }
+        { printf "%s\t%s\t%s\t%s\n", size, name[NR], $1, $3 }'
+done
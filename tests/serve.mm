@@ -0,0 +1,16 @@
+$( Minimal database for the SERVE test $)
+  $c ( ) -> wff |- $.
+  $v ph ps $.
+  wph $f wff ph $.
+  wps $f wff ps $.
+  wi $a wff ( ph -> ps ) $.
+  ${
+    min $e |- ph $.
+    maj $e |- ( ph -> ps ) $.
+    mp $a |- ps $.
+  $}
+  ax-1 $a |- ( ph -> ( ps -> ph ) ) $.
+  ${
+    a1i.1 $e |- ph $.
+    a1i $p |- ( ps -> ph ) $= wph wps wph wi a1i.1 wph wps ax-1 mp $.
+  $}
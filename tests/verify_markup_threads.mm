@@ -0,0 +1,36 @@
+$( $t htmldef "wff" as "wff"; althtmldef "wff" as "wff";
+  latexdef "wff" as "wff"; $)
+$c wff |- $.
+$v ph $.
+wph $f wff ph $.
+
+$(
+####
+  Part one
+####
+
+  See ~ nolabel1 here.
+$)
+
+$( First axiom.  (Contributed by A, 2-Jan-2020.) $)
+ax-1 $a |- ph $.
+
+$( Second axiom.  (Contributed by A, 1-Jan-2020.)
+   (Revised by B, 1-Jan-2019.) $)
+ax-2 $a |- ph $.
+
+$(
+=-=-
+  Section two
+  with two title lines
+=-=-
+$)
+
+$( Third axiom, see ~ nolabel3 .  (Contributed by A, 3-Jan-2020.) $)
+ax-3 $a |- ph $.
+
+$( Theorem.  (Contributed by A, 4-Jan-2020.) $)
+th1 $p |- ph $= ( ax-1 ) A $.
+
+$( Last theorem.  (Contributed by A, 5-Jan-2020.) $)
+thOLD $p |- ph $= ( ax-2 ) A $.